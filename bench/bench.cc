@@ -0,0 +1,201 @@
+#include "bench.h"
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <vector>
+
+namespace bench {
+  State::State(uint64_t iterationsA)
+      : iterations(iterationsA), remaining(iterationsA + 1), elapsed() {}
+
+  bool State::keepRunning() {
+    if (this->remaining == this->iterations + 1) {
+      this->allocations.reset();
+      this->start = std::chrono::steady_clock::now();
+    }
+    if (--this->remaining > 0) {
+      return true;
+    }
+    this->elapsed = std::chrono::steady_clock::now() - this->start;
+    if (mqttutils::AllocationCounter::enabled() && this->iterations > 0) {
+      this->counters["allocs"] = double(this->allocations.allocations()) /
+                                 double(this->iterations);
+    }
+    return false;
+  }
+
+  void State::setCounter(const std::string& name, double value) {
+    this->counters[name] = value;
+  }
+
+  uint64_t State::getIterations() const {
+    return this->iterations;
+  }
+
+  double State::getNanosPerIteration() const {
+    double nanos = double(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(this->elapsed)
+            .count());
+    return this->iterations > 0 ? nanos / double(this->iterations) : 0.0;
+  }
+
+  const std::map<std::string, double>& State::getCounters() const {
+    return this->counters;
+  }
+
+  struct Entry {
+    std::string name;
+    Benchmark benchmark;
+    bool onRequest;
+  };
+
+  using registry_t = std::vector<Entry>;
+
+  static registry_t& registry() {
+    static registry_t& r = *new registry_t();
+    return r;
+  }
+
+  int registerBenchmark(const std::string& name, Benchmark benchmark,
+                        bool onRequest) {
+    registry().push_back(Entry{name, std::move(benchmark), onRequest});
+    return 0;
+  }
+
+  // runs the benchmark with an increasing number of iterations till the
+  // measured loop runs for at least minTime, the setup of the benchmark does
+  // not count
+  static State run(const Benchmark& benchmark) {
+    const double minTime = 200e6;
+    uint64_t iterations = 1;
+    for (;;) {
+      State state(iterations);
+      benchmark(state);
+      double elapsed = state.getNanosPerIteration() * double(iterations);
+      if (elapsed >= minTime || iterations >= (uint64_t(1) << 30)) {
+        return state;
+      }
+      iterations *= 10;
+    }
+  }
+
+  // Result is a benchmark run several times, the median is reported
+  struct Result {
+    std::string name;
+    std::vector<State> runs;
+
+    const State& median() const {
+      return this->runs[this->runs.size() / 2];
+    }
+  };
+
+  static std::string quote(const std::string& s) {
+    std::string out = "\"";
+    for (char c : s) {
+      if (c == '"' || c == '\\') {
+        out += '\\';
+      }
+      out += c;
+    }
+    return out + "\"";
+  }
+
+  static void printText(const Result& result) {
+    const State& state = result.median();
+    std::cout << std::left << std::setw(40) << result.name << std::right
+              << std::setw(14) << std::fixed << std::setprecision(1)
+              << state.getNanosPerIteration() << " ns/op" << std::setw(12)
+              << state.getIterations() << " iterations";
+    for (const auto& counter : state.getCounters()) {
+      std::cout << "  " << counter.first << "=" << std::setprecision(2)
+                << counter.second;
+    }
+    std::cout << std::endl;
+  }
+
+  // the JSON document lists the benchmarks with the median and the spread
+  // of the runs, one object per line so that results diff well
+  static void printJSON(const std::vector<Result>& results) {
+#ifdef NDEBUG
+    const char* build = "release";
+#else
+    const char* build = "debug";
+#endif
+    std::cout << "{\n  \"context\": {\"compiler\": " << quote(__VERSION__)
+              << ", \"build\": \"" << build << "\"},\n  \"benchmarks\": [";
+    for (size_t i = 0; i < results.size(); ++i) {
+      const Result& result = results[i];
+      const State& state = result.median();
+      std::cout << (i == 0 ? "\n" : ",\n") << std::setprecision(1)
+                << std::fixed << "    {\"name\": " << quote(result.name)
+                << ", \"iterations\": " << state.getIterations()
+                << ", \"repetitions\": " << result.runs.size()
+                << ", \"ns_per_op\": " << state.getNanosPerIteration()
+                << ", \"min_ns_per_op\": "
+                << result.runs.front().getNanosPerIteration()
+                << ", \"max_ns_per_op\": "
+                << result.runs.back().getNanosPerIteration()
+                << ", \"counters\": {";
+      const char* sep = "";
+      for (const auto& counter : state.getCounters()) {
+        std::cout << sep << quote(counter.first) << ": "
+                  << std::setprecision(4) << counter.second;
+        sep = ", ";
+      }
+      std::cout << "}}";
+    }
+    std::cout << "\n  ]\n}" << std::endl;
+  }
+} // namespace bench
+
+int main(int argc, char** argv) {
+  // usage: mqtt_benchmarks [--json] [--repetitions=N] [filter]
+  // runs the benchmarks containing the filter, all of them without one
+  bool json = false;
+  size_t repetitions = 1;
+  std::string filter;
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    if (arg == "--json") {
+      json = true;
+    } else if (arg.rfind("--repetitions=", 0) == 0) {
+      repetitions = std::max<size_t>(
+          1, std::strtoul(arg.c_str() + std::strlen("--repetitions="),
+                          nullptr, 10));
+    } else if (arg.rfind("--", 0) == 0) {
+      std::cerr << "unknown option " << arg << std::endl;
+      return 1;
+    } else {
+      filter = arg;
+    }
+  }
+
+  std::vector<bench::Result> results;
+  for (const auto& entry : bench::registry()) {
+    if (entry.onRequest ? entry.name != filter
+                        : entry.name.find(filter) == std::string::npos) {
+      continue;
+    }
+    bench::Result result{entry.name, {}};
+    for (size_t i = 0; i < repetitions; ++i) {
+      result.runs.push_back(bench::run(entry.benchmark));
+    }
+    std::sort(result.runs.begin(), result.runs.end(),
+              [](const bench::State& a, const bench::State& b) {
+                return a.getNanosPerIteration() < b.getNanosPerIteration();
+              });
+    if (json) {
+      // the names go to stderr as progress
+      std::cerr << entry.name << std::endl;
+    } else {
+      bench::printText(result);
+    }
+    results.emplace_back(std::move(result));
+  }
+  if (json) {
+    bench::printJSON(results);
+  }
+  return 0;
+}
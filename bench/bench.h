@@ -0,0 +1,53 @@
+#pragma once
+
+#include "lib/alloccount.h"
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <string>
+
+namespace bench {
+  // State is handed to every benchmark. The benchmark loops while
+  // keepRunning() returns true, the time spent in the loop is measured and
+  // divided by the number of iterations. So are the allocations of the
+  // benchmark thread in the loop, reported as the allocs counter.
+  class State {
+  public:
+    explicit State(uint64_t iterations);
+
+    bool keepRunning();
+
+    // counters are reported as is next to the timing
+    void setCounter(const std::string& name, double value);
+
+    uint64_t getIterations() const;
+    double getNanosPerIteration() const;
+    const std::map<std::string, double>& getCounters() const;
+
+  private:
+    uint64_t iterations;
+    uint64_t remaining;
+    std::chrono::steady_clock::time_point start;
+    std::chrono::steady_clock::duration elapsed;
+    mqttutils::AllocationCounter allocations;
+    std::map<std::string, double> counters;
+  };
+
+  using Benchmark = std::function<void(State&)>;
+
+  // onRequest benchmarks are only run when named in full on the command
+  // line, e.g. the ones that need gigabytes of memory
+  int registerBenchmark(const std::string& name, Benchmark benchmark,
+                        bool onRequest = false);
+
+  // prevents the compiler from optimizing away a computed value
+  template <typename T> inline void doNotOptimize(const T& value) {
+    asm volatile("" : : "g"(&value) : "memory");
+  }
+} // namespace bench
+
+#define MQTT_BENCHMARK(name)                                                   \
+  static void name(bench::State& state);                                       \
+  static const int name##Registered = bench::registerBenchmark(#name, name);   \
+  static void name(bench::State& state)
@@ -0,0 +1,118 @@
+#include "bench.h"
+#include "lib/packet/codec.h"
+#include "lib/packet/connack.h"
+#include "lib/packet/packet.h"
+#include "lib/packet/publish.h"
+
+#include <string>
+#include <vector>
+
+// route by topic, forward the payload: a QoS 1 PUBLISH with the usual
+// request/response properties, decoded from the receive buffer. Measured
+// per packet
+static std::vector<uint8_t> requestPublish() {
+  mqtt::Publish p;
+  p.topicName = "services/billing/requests";
+  p.qosLevel = 1;
+  p.payload.assign(128, 0x2A);
+  p.properties = std::make_shared<mqtt::Publish::Properties>();
+  p.properties->responseTopic = "services/billing/responses/client-42";
+  p.properties->correlationData.assign(16, 0x01);
+  p.properties->contentType = "application/json";
+  p.properties->subscriptionIdentifiers = {7};
+  return packet::PublishEncoder(packet::PublishPacket{1, p}).encode();
+}
+
+MQTT_BENCHMARK(DecodePublishEager) {
+  const std::vector<uint8_t> encoded = requestPublish();
+  size_t bytes = 0;
+  while (state.keepRunning()) {
+    packet::Decoder dec(encoded.data(), encoded.size());
+    packet::FixedHeader fhdr = packet::FixedHeaderReader::read(dec);
+    packet::PublishPacket pkt =
+        packet::PublishDecoder::decode(dec, fhdr.first, fhdr.second);
+    bytes += pkt.second.topicName.size() + pkt.second.payload.size();
+    bench::doNotOptimize(pkt);
+  }
+  bench::doNotOptimize(bytes);
+}
+
+MQTT_BENCHMARK(DecodePublishLazy) {
+  const std::vector<uint8_t> encoded = requestPublish();
+  size_t bytes = 0;
+  while (state.keepRunning()) {
+    packet::Decoder dec(encoded.data(), encoded.size());
+    packet::FixedHeader fhdr = packet::FixedHeaderReader::read(dec);
+    packet::LazyPublishPacket pkt =
+        packet::PublishDecoder::decodeLazy(dec, fhdr.first, fhdr.second);
+    bytes += pkt.publish.topicName.size() + pkt.publish.payload.size();
+    bench::doNotOptimize(pkt);
+  }
+  bench::doNotOptimize(bytes);
+}
+
+// garbage: the frame is one byte short of its remaining length, the decoder
+// finds out at the payload after the rest was parsed
+MQTT_BENCHMARK(DecodePublishMalformed) {
+  std::vector<uint8_t> encoded = requestPublish();
+  encoded.pop_back();
+  size_t errors = 0;
+  while (state.keepRunning()) {
+    packet::Decoder dec(encoded.data(), encoded.size());
+    packet::FixedHeader fhdr = packet::FixedHeaderReader::read(dec);
+    packet::PublishPacket pkt;
+    if (packet::PublishDecoder::decode(dec, fhdr.first, fhdr.second, pkt)) {
+      errors++;
+    }
+    bench::doNotOptimize(pkt);
+  }
+  bench::doNotOptimize(errors);
+}
+
+// the same garbage through the throwing decode
+MQTT_BENCHMARK(DecodePublishMalformedThrow) {
+  std::vector<uint8_t> encoded = requestPublish();
+  encoded.pop_back();
+  size_t errors = 0;
+  while (state.keepRunning()) {
+    packet::Decoder dec(encoded.data(), encoded.size());
+    packet::FixedHeader fhdr = packet::FixedHeaderReader::read(dec);
+    try {
+      packet::PublishPacket pkt =
+          packet::PublishDecoder::decode(dec, fhdr.first, fhdr.second);
+      bench::doNotOptimize(pkt);
+    } catch (const std::exception&) {
+      errors++;
+    }
+  }
+  bench::doNotOptimize(errors);
+}
+
+// a CONNACK with most of its properties, the decode dispatches per property
+MQTT_BENCHMARK(DecodeConnAckProperties) {
+  mqtt::ConnAck ca;
+  ca.properties = std::make_shared<mqtt::ConnAck::Properties>();
+  mqtt::ConnAck::Properties& props = *ca.properties;
+  props.sessionExpiryInterval = 3600;
+  props.receiveMaximum = 20;
+  props.maximumQoS = 1;
+  props.retainAvailable = false;
+  props.maximumPacketSize = 1 << 20;
+  props.assignedClientIdentifier = "auto-1";
+  props.topicAliasMaximum = 10;
+  props.wildcardSubscriptionAvailable = true;
+  props.subscriptionIdentifierAvailable = true;
+  props.sharedSubscriptionAvailable = false;
+  const std::vector<uint8_t> encoded = packet::ConnAckEncoder(ca).encode();
+  size_t decoded = 0;
+  while (state.keepRunning()) {
+    packet::Decoder dec(encoded.data(), encoded.size());
+    packet::FixedHeaderReader::read(dec);
+    mqtt::ConnAck out;
+    if (!packet::ConnAckDecoder::decode(dec, out)) {
+      decoded++;
+    }
+    bench::doNotOptimize(out);
+  }
+  bench::doNotOptimize(decoded);
+}
@@ -0,0 +1,71 @@
+#include "bench.h"
+#include "lib/bufferpool.h"
+#include "lib/packet/publish.h"
+
+#include <string>
+#include <vector>
+
+// steady state publishing: a 256 byte QoS 1 PUBLISH encoded and written,
+// measured per packet
+static mqtt::Publish telemetryPublish() {
+  mqtt::Publish p;
+  p.topicName = "telemetry/site-3/meter-17/power";
+  p.qosLevel = 1;
+  p.payload.assign(256, 0x2A);
+  return p;
+}
+
+MQTT_BENCHMARK(EncodeDiscardBuffer) {
+  const mqtt::Publish p = telemetryPublish();
+  uint16_t packetID = 0;
+  size_t bytes = 0;
+  while (state.keepRunning()) {
+    ++packetID;
+    std::vector<uint8_t> encoded =
+        packet::PublishEncoder(packet::PublishPacket{packetID, p}).encode();
+    bytes += encoded.size();
+    bench::doNotOptimize(encoded);
+  }
+  bench::doNotOptimize(bytes);
+}
+
+MQTT_BENCHMARK(EncodeRecycleBuffer) {
+  const mqtt::Publish p = telemetryPublish();
+  mqttutils::BufferPool& pool = mqttutils::BufferPool::local();
+  const mqttutils::BufferPool::Stats before = pool.stats();
+  uint16_t packetID = 0;
+  size_t bytes = 0;
+  while (state.keepRunning()) {
+    ++packetID;
+    std::vector<uint8_t> encoded =
+        packet::PublishEncoder(packet::PublishPacket{packetID, p}).encode();
+    bytes += encoded.size();
+    bench::doNotOptimize(encoded);
+    // the buffer goes back once written
+    pool.release(std::move(encoded));
+  }
+  const mqttutils::BufferPool::Stats after = pool.stats();
+  const double acquired =
+      double(after.hits - before.hits + after.misses - before.misses);
+  state.setCounter("hit_ratio",
+                   acquired > 0 ? double(after.hits - before.hits) / acquired
+                                : 0.0);
+  bench::doNotOptimize(bytes);
+}
+
+// the packet is borrowed and appended to a connection buffer that is
+// flushed after each write, the payload is copied once
+MQTT_BENCHMARK(EncodeIntoSink) {
+  const mqtt::Publish p = telemetryPublish();
+  packet::Sink sink;
+  uint16_t packetID = 0;
+  size_t bytes = 0;
+  while (state.keepRunning()) {
+    ++packetID;
+    packet::PublishEncoder::encode(packetID, p, sink);
+    bytes += sink.size();
+    bench::doNotOptimize(sink);
+    sink.clear();
+  }
+  bench::doNotOptimize(bytes);
+}
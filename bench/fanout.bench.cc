@@ -0,0 +1,53 @@
+#include "bench.h"
+#include "lib/packet/publish.h"
+
+#include <string>
+#include <vector>
+
+// dashboard fan-out: one 1 KB PUBLISH with properties sent to every
+// subscriber, each with its own packet identifier and subscription
+// identifier. Measured per recipient
+static mqtt::Publish dashboardPublish() {
+  mqtt::Publish p;
+  p.topicName = "dashboards/plant-4/line-2/overview/widgets/throughput";
+  p.qosLevel = 1;
+  p.payload.assign(1024, 0x2A);
+  p.properties = std::make_shared<mqtt::Publish::Properties>();
+  p.properties->contentType = "application/json";
+  p.properties->messageExpiryInterval = 30;
+  return p;
+}
+
+MQTT_BENCHMARK(FanoutEncodePerRecipient) {
+  const mqtt::Publish p = dashboardPublish();
+  uint16_t packetID = 0;
+  size_t bytes = 0;
+  while (state.keepRunning()) {
+    // the naive path copies the message and encodes it for every recipient
+    mqtt::Publish q = p;
+    q.properties = std::make_shared<mqtt::Publish::Properties>(*p.properties);
+    ++packetID;
+    q.properties->subscriptionIdentifiers.push_back(packetID % 100);
+    std::vector<uint8_t> encoded =
+        packet::PublishEncoder(packet::PublishPacket{packetID, q}).encode();
+    bytes += encoded.size();
+    bench::doNotOptimize(encoded);
+  }
+  bench::doNotOptimize(bytes);
+}
+
+MQTT_BENCHMARK(FanoutSharedEncode) {
+  const mqtt::Publish p = dashboardPublish();
+  // encoded once per message, amortized over the subscribers
+  const packet::SharedPublish shared(p);
+  uint16_t packetID = 0;
+  size_t bytes = 0;
+  while (state.keepRunning()) {
+    ++packetID;
+    packet::PublishHeader header =
+        shared.header(1, false, packetID, 30, uint32_t(packetID % 100));
+    bytes += shared.size(header);
+    bench::doNotOptimize(header);
+  }
+  bench::doNotOptimize(bytes);
+}
@@ -0,0 +1,47 @@
+#include "bench.h"
+#include "lib/histogram.h"
+
+#include <chrono>
+#include <vector>
+
+// the cost of recording one latency, the stages of the broker record
+// several per PUBLISH
+MQTT_BENCHMARK(HistogramRecord) {
+  mqttutils::Histogram h;
+  // spread over the buckets like real latencies
+  std::vector<uint64_t> values;
+  for (uint64_t i = 0; i < 1024; ++i) {
+    values.push_back(200 + (i * i * 37) % 50000);
+  }
+  size_t i = 0;
+  while (state.keepRunning()) {
+    h.record(values[i++ & 1023]);
+  }
+  bench::doNotOptimize(h);
+  state.setCounter("p99", double(h.snapshot().valueAt(0.99)));
+}
+
+// recording with the two clock reads around a stage
+MQTT_BENCHMARK(HistogramRecordTimed) {
+  mqttutils::Histogram h;
+  while (state.keepRunning()) {
+    auto start = std::chrono::steady_clock::now();
+    auto end = std::chrono::steady_clock::now();
+    h.record(static_cast<uint64_t>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(end - start)
+            .count()));
+  }
+  bench::doNotOptimize(h);
+}
+
+MQTT_BENCHMARK(HistogramSnapshot) {
+  mqttutils::Histogram h;
+  for (uint64_t v = 0; v < 100000; ++v) {
+    h.record(v);
+  }
+  uint64_t sum = 0;
+  while (state.keepRunning()) {
+    sum += h.snapshot().percentiles().p99;
+  }
+  bench::doNotOptimize(sum);
+}
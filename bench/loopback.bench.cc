@@ -0,0 +1,106 @@
+#include "bench.h"
+#include "lib/loopbackstream.h"
+#include "lib/packet/codec.h"
+#include "lib/packet/packet.h"
+#include "lib/packet/publish.h"
+#include "lib/topic.h"
+
+#include <string>
+#include <thread>
+#include <vector>
+
+// end to end over the in-process LoopbackStream pair, without the kernel:
+// the stream alone, a PUBLISH through the codec and the matcher, and a
+// round trip between two threads
+
+static mqttutils::LoopbackStream::Pair openPair() {
+  auto ends = mqttutils::LoopbackStream::pair();
+  ends.first->open();
+  ends.second->open();
+  return ends;
+}
+
+static void writeRead(bench::State& state, size_t size) {
+  auto ends = openPair();
+  const std::vector<uint8_t> data(size, 0x2A);
+  size_t bytes = 0;
+  while (state.keepRunning()) {
+    ends.first->writeBytes(data);
+    bytes += ends.second->readBytes(size).first.size();
+  }
+  bench::doNotOptimize(bytes);
+}
+
+static int registerWriteRead() {
+  for (size_t size : {64, 1024, 16384}) {
+    bench::registerBenchmark("LoopbackWriteRead/" + std::to_string(size) + "B",
+                             [size](bench::State& state) {
+                               writeRead(state, size);
+                             });
+  }
+  return 0;
+}
+
+static const int writeReadRegistered = registerWriteRead();
+
+class NullSubscriber : public mqtt::Subscriber {
+public:
+  void onData() override {}
+};
+
+// the client encodes a PUBLISH and writes it, the server reads the fixed
+// header and the rest, decodes it and matches the topic
+MQTT_BENCHMARK(LoopbackPublishPipeline) {
+  auto ends = openPair();
+  mqttutils::TopicMatcher matcher;
+  auto s = std::make_shared<NullSubscriber>();
+  matcher.subscribe("telemetry/+/meter-17/power", s);
+  matcher.subscribe("telemetry/#", s);
+  matcher.subscribe("alerts/#", s);
+
+  mqtt::Publish p;
+  p.topicName = "telemetry/site-3/meter-17/power";
+  p.qosLevel = 1;
+  p.payload.assign(64, 0x2A);
+  const packet::PublishPacket pkt{1, p};
+  packet::Sink sink;
+  size_t matched = 0;
+  while (state.keepRunning()) {
+    sink.clear();
+    packet::PublishEncoder::encode(pkt, sink);
+    ends.first->writeBytes(sink);
+
+    // the remaining length takes one byte below 128
+    std::vector<uint8_t> header = ends.second->readBytes(2).first;
+    std::vector<uint8_t> body = ends.second->readBytes(header[1]).first;
+    packet::Decoder dec(body.data(), body.size());
+    packet::PublishPacket decoded;
+    if (!packet::PublishDecoder::decode(dec, header[0], header[1], decoded)) {
+      matched += matcher.match(decoded.second.topicName).size();
+    }
+  }
+  state.setCounter("matched",
+                   double(matched) / double(state.getIterations()));
+}
+
+// a 64 byte message and its echo, the two ends on two threads
+MQTT_BENCHMARK(LoopbackPingPong) {
+  auto ends = openPair();
+  std::thread echo([&ends] {
+    for (;;) {
+      auto read = ends.second->readBytes(64);
+      if (read.second != 0 || ends.second->writeBytes(read.first).second) {
+        return;
+      }
+    }
+  });
+  const std::vector<uint8_t> data(64, 0x2A);
+  size_t bytes = 0;
+  while (state.keepRunning()) {
+    ends.first->writeBytes(data);
+    bytes += ends.first->readBytes(64).first.size();
+  }
+  ends.first->close();
+  echo.join();
+  bench::doNotOptimize(bytes);
+}
@@ -0,0 +1,39 @@
+#include "bench.h"
+#include "lib/offlinebuffer.h"
+#include "lib/packet/publish.h"
+
+#include <filesystem>
+#include <string>
+#include <vector>
+
+// gateway outage: 10,000 QoS 1 frames of 512 bytes buffered with a 1 MB
+// memory budget, most of them on disk, then drained. Measured per frame
+MQTT_BENCHMARK(OfflineBufferSpillDrain) {
+  const std::string dir =
+      (std::filesystem::temp_directory_path() / "mqtt-bench-offline").string();
+  std::filesystem::create_directories(dir);
+
+  mqtt::Publish p;
+  p.topicName = "gateway/7/telemetry";
+  p.qosLevel = 1;
+  p.payload.assign(512, 0x2A);
+  const std::vector<uint8_t> frame = packet::PublishEncoder({1, p}).encode();
+
+  mqttutils::OfflineBuffer::Options options;
+  options.memoryBudget = 1 << 20;
+  options.spillDirectory = dir;
+  size_t bytes = 0;
+  while (state.keepRunning()) {
+    mqttutils::OfflineBuffer buffer(options);
+    for (int i = 0; i < 10000; ++i) {
+      buffer.push(frame);
+    }
+    buffer.drain([&bytes](const std::vector<uint8_t>& f) {
+      bytes += f.size();
+      return true;
+    });
+  }
+  state.setCounter("framesPerIteration", 10000);
+  bench::doNotOptimize(bytes);
+  std::filesystem::remove_all(dir);
+}
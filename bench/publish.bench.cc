@@ -0,0 +1,99 @@
+#include "bench.h"
+#include "lib/packet/codec.h"
+#include "lib/packet/packet.h"
+#include "lib/packet/publish.h"
+
+#include <string>
+#include <vector>
+
+// PUBLISH encode and decode across payload sizes and property mixes, to see
+// where the time goes as messages grow. Registered as
+// EncodePublish/<payload>/<properties> and DecodePublish/<payload>/<properties>
+enum class PropertyMix { None, Request, All };
+
+static const char* mixName(PropertyMix mix) {
+  switch (mix) {
+  case PropertyMix::None:
+    return "none";
+  case PropertyMix::Request:
+    return "request";
+  case PropertyMix::All:
+    return "all";
+  }
+  return "";
+}
+
+static mqtt::Publish sweepPublish(size_t payloadSize, PropertyMix mix) {
+  mqtt::Publish p;
+  p.topicName = "telemetry/site-3/meter-17/power";
+  p.qosLevel = 1;
+  p.payload.assign(payloadSize, 0x2A);
+  if (mix == PropertyMix::None) {
+    return p;
+  }
+
+  // request/response
+  p.properties = std::make_shared<mqtt::Publish::Properties>();
+  p.properties->responseTopic = "services/billing/responses/client-42";
+  p.properties->correlationData.assign(16, 0x01);
+  p.properties->contentType = "application/json";
+  if (mix == PropertyMix::All) {
+    p.properties->payloadFormatIndicator = true;
+    p.properties->messageExpiryInterval = 30;
+    p.properties->topicAlias = 5;
+    p.properties->subscriptionIdentifiers = {7, 300, 70000};
+  }
+  return p;
+}
+
+static void encodePublish(bench::State& state, size_t payloadSize,
+                          PropertyMix mix) {
+  const packet::PublishPacket pkt{1, sweepPublish(payloadSize, mix)};
+  packet::Sink sink;
+  size_t bytes = 0;
+  while (state.keepRunning()) {
+    packet::PublishEncoder::encode(pkt, sink);
+    bytes += sink.size();
+    bench::doNotOptimize(sink);
+    sink.clear();
+  }
+  state.setCounter("bytes", double(bytes) / double(state.getIterations()));
+}
+
+static void decodePublish(bench::State& state, size_t payloadSize,
+                          PropertyMix mix) {
+  const std::vector<uint8_t> encoded =
+      packet::PublishEncoder({1, sweepPublish(payloadSize, mix)}).encode();
+  size_t bytes = 0;
+  while (state.keepRunning()) {
+    packet::Decoder dec(encoded.data(), encoded.size());
+    packet::FixedHeader fhdr = packet::FixedHeaderReader::read(dec);
+    packet::PublishPacket pkt;
+    if (!packet::PublishDecoder::decode(dec, fhdr.first, fhdr.second, pkt)) {
+      bytes += pkt.second.payload.size();
+    }
+    bench::doNotOptimize(pkt);
+  }
+  bench::doNotOptimize(bytes);
+}
+
+static int registerPublishSweep() {
+  for (size_t payloadSize : {16, 256, 4096, 65536}) {
+    for (PropertyMix mix :
+         {PropertyMix::None, PropertyMix::Request, PropertyMix::All}) {
+      std::string suffix =
+          "/" + std::to_string(payloadSize) + "B/" + mixName(mix);
+      bench::registerBenchmark("EncodePublish" + suffix,
+                               [payloadSize, mix](bench::State& state) {
+                                 encodePublish(state, payloadSize, mix);
+                               });
+      bench::registerBenchmark("DecodePublish" + suffix,
+                               [payloadSize, mix](bench::State& state) {
+                                 decodePublish(state, payloadSize, mix);
+                               });
+    }
+  }
+  return 0;
+}
+
+static const int publishSweepRegistered = registerPublishSweep();
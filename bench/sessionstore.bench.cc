@@ -0,0 +1,51 @@
+#include "bench.h"
+#include "lib/packet/publish.h"
+#include "lib/sessionstore.h"
+
+#include <cstdio>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+// QoS 1 outbound flow: the encoded PUBLISH is stored before it is sent and
+// removed when the PUBACK arrives, 16 messages in flight
+static void sessionStoreFlow(bench::State& state, size_t syncEvery) {
+  const std::string path =
+      (std::filesystem::temp_directory_path() / "mqtt-bench-session").string();
+  std::remove(path.c_str());
+
+  mqtt::Publish p;
+  p.topicName = "factory/line-1/station-4/events";
+  p.qosLevel = 1;
+  p.payload.assign(256, 0x2A);
+
+  // the store takes the wire bytes, encoding is not part of the measurement
+  const std::vector<uint8_t> encoded =
+      packet::PublishEncoder({1, p}).encode();
+
+  mqttutils::SessionStore store(path);
+  if (store.open()) {
+    return;
+  }
+  uint16_t packetID = 0;
+  size_t count = 0;
+  while (state.keepRunning()) {
+    packetID = uint16_t(packetID % 1024 + 1);
+    store.put(packetID, encoded);
+    store.remove(uint16_t((packetID + 1024 - 16 - 1) % 1024 + 1));
+    if (syncEvery > 0 && ++count % syncEvery == 0) {
+      store.sync();
+    }
+  }
+  store.close();
+  std::remove(path.c_str());
+}
+
+MQTT_BENCHMARK(SessionStorePutNoSync) {
+  sessionStoreFlow(state, 0);
+}
+
+MQTT_BENCHMARK(SessionStoreGroupCommit64) {
+  // one msync for 64 messages
+  sessionStoreFlow(state, 64);
+}
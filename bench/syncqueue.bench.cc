@@ -0,0 +1,62 @@
+#include "bench.h"
+#include "lib/syncqueue.h"
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+// the worker hand-off: a consumer pops what the producers push. Measured per
+// item on the consumer, the producers share the items between them
+static void syncQueueContention(bench::State& state, size_t producers) {
+  mqttutils::SyncQueue<uint64_t> queue;
+  std::atomic<bool> go{false};
+  const uint64_t items = state.getIterations();
+
+  std::vector<std::thread> threads;
+  for (size_t p = 0; p < producers; ++p) {
+    threads.emplace_back([&queue, &go, items, producers, p] {
+      while (!go.load(std::memory_order_acquire)) {
+        std::this_thread::yield();
+      }
+      for (uint64_t i = p; i < items; i += producers) {
+        queue.push(i);
+      }
+    });
+  }
+
+  go.store(true, std::memory_order_release);
+  uint64_t sum = 0;
+  uint64_t item = 0;
+  while (state.keepRunning()) {
+    queue.pop(item);
+    sum += item;
+  }
+  for (auto& t : threads) {
+    t.join();
+  }
+  bench::doNotOptimize(sum);
+}
+
+MQTT_BENCHMARK(SyncQueueUncontended) {
+  mqttutils::SyncQueue<uint64_t> queue;
+  uint64_t sum = 0;
+  uint64_t item = 0;
+  while (state.keepRunning()) {
+    queue.push(sum);
+    queue.pop(item);
+    sum += item + 1;
+  }
+  bench::doNotOptimize(sum);
+}
+
+MQTT_BENCHMARK(SyncQueueContention1Producer) {
+  syncQueueContention(state, 1);
+}
+
+MQTT_BENCHMARK(SyncQueueContention4Producers) {
+  syncQueueContention(state, 4);
+}
+
+MQTT_BENCHMARK(SyncQueueContention16Producers) {
+  syncQueueContention(state, 16);
+}
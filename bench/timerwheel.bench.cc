@@ -0,0 +1,31 @@
+#include "bench.h"
+#include "lib/timerwheel.h"
+
+#include <vector>
+
+MQTT_BENCHMARK(TimerWheelScheduleCancel) {
+  // in-flight messages are acknowledged well before they expire: the common
+  // case is schedule followed by cancel
+  mqttutils::TimerWheel wheel;
+  std::vector<mqttutils::TimerWheel::TimerID> ids(1024);
+  uint64_t i = 0;
+  while (state.keepRunning()) {
+    auto& id = ids[i % ids.size()];
+    wheel.cancel(id);
+    id = wheel.scheduleAfter(30000 + (i % 5000), [] {});
+    ++i;
+  }
+  state.setCounter("timers", double(wheel.size()));
+}
+
+MQTT_BENCHMARK(TimerWheelExpire) {
+  mqttutils::TimerWheel wheel;
+  uint64_t fired = 0;
+  uint64_t i = 0;
+  while (state.keepRunning()) {
+    wheel.scheduleAfter(1 + (i % 10000), [&fired] { ++fired; });
+    wheel.advance(wheel.now() + 1);
+    ++i;
+  }
+  bench::doNotOptimize(fired);
+}
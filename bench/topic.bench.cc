@@ -0,0 +1,105 @@
+#include "bench.h"
+#include "lib/topic.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+MQTT_BENCHMARK(TopicSplitShort) {
+  const std::string topic = "home/kitchen/temp";
+  size_t parts = 0;
+  while (state.keepRunning()) {
+    std::vector<std::string> out = mqttutils::TopicUtils::split(topic);
+    parts += out.size();
+    bench::doNotOptimize(out);
+  }
+  bench::doNotOptimize(parts);
+}
+
+MQTT_BENCHMARK(TopicSplitDeep) {
+  const std::string topic =
+      "factory/building-07/line-03/station-12/sensor/temperature/celsius/raw";
+  size_t parts = 0;
+  while (state.keepRunning()) {
+    std::vector<std::string> out = mqttutils::TopicUtils::split(topic);
+    parts += out.size();
+    bench::doNotOptimize(out);
+  }
+  bench::doNotOptimize(parts);
+}
+
+// fleet telemetry: every device subscribes to its own topic, the 100 region
+// wildcards and fleet/# see all of it. A match finds 3 subscribers whatever
+// the size of the trie
+class NullSubscriber : public mqtt::Subscriber {
+public:
+  void onData() override {}
+};
+
+static const size_t fleetRegions = 100;
+
+// the trie is kept between the runs of a benchmark, building the large ones
+// takes longer than matching
+static const mqttutils::Trie& fleetTrie(size_t subscriptions) {
+  static std::unique_ptr<mqttutils::Trie> trie;
+  static size_t size = 0;
+  if (!trie || size != subscriptions) {
+    trie.reset();
+    trie = std::make_unique<mqttutils::Trie>();
+    size = subscriptions;
+    auto subscriber = std::make_shared<NullSubscriber>();
+    for (size_t i = 0; i < subscriptions; ++i) {
+      trie->insert("fleet/r" + std::to_string(i % fleetRegions) + "/d" +
+                       std::to_string(i),
+                   subscriber);
+    }
+    for (size_t r = 0; r < fleetRegions; ++r) {
+      trie->insert("fleet/r" + std::to_string(r) + "/+", subscriber);
+    }
+    trie->insert("fleet/#", subscriber);
+  }
+  return *trie;
+}
+
+static void trieMatch(bench::State& state, size_t subscriptions) {
+  const mqttutils::Trie& trie = fleetTrie(subscriptions);
+  // the devices are visited in a scattered order, not along the trie
+  std::vector<std::string> topics;
+  for (size_t i = 0; i < 1024; ++i) {
+    size_t device = (i * 2654435761u) % subscriptions;
+    topics.emplace_back("fleet/r" + std::to_string(device % fleetRegions) +
+                        "/d" + std::to_string(device));
+  }
+
+  size_t matched = 0;
+  size_t i = 0;
+  while (state.keepRunning()) {
+    mqtt::Subscribers subscribers = trie.match(topics[i++ % topics.size()]);
+    matched += subscribers.size();
+    bench::doNotOptimize(subscribers);
+  }
+  state.setCounter("matched",
+                   double(matched) / double(state.getIterations()));
+}
+
+MQTT_BENCHMARK(TrieMatch1K) {
+  trieMatch(state, 1000);
+}
+
+MQTT_BENCHMARK(TrieMatch10K) {
+  trieMatch(state, 10000);
+}
+
+MQTT_BENCHMARK(TrieMatch100K) {
+  trieMatch(state, 100000);
+}
+
+// a million subscriptions take a few hundred MB, ten million some GB: run
+// them by name, e.g. ./mqtt_benchmarks TrieMatch10M
+static const int trieMatch1MRegistered = bench::registerBenchmark(
+    "TrieMatch1M",
+    [](bench::State& state) { trieMatch(state, 1000000); }, true);
+
+static const int trieMatch10MRegistered = bench::registerBenchmark(
+    "TrieMatch10M",
+    [](bench::State& state) { trieMatch(state, 10000000); }, true);
@@ -0,0 +1,69 @@
+#include "bench.h"
+#include "lib/packet/publish.h"
+#include "lib/topicalias.h"
+
+#include <string>
+#include <vector>
+
+// device telemetry: 80 byte topic names, a small payload and a working set of
+// topics that fits in the alias maximum advertised by the broker
+static std::vector<std::string> telemetryTopics(size_t count) {
+  std::vector<std::string> topics;
+  for (size_t i = 0; i < count; ++i) {
+    std::string topic = "factory/building-07/line-03/station-" +
+                        std::to_string(i) + "/sensor/temperature/celsius";
+    topic.resize(80, 'x');
+    topics.emplace_back(topic);
+  }
+  return topics;
+}
+
+static size_t encodedSize(const mqtt::Publish& p) {
+  return packet::PublishEncoder(packet::PublishPacket{0, p}).encode().size();
+}
+
+static void topicAliasSavings(bench::State& state, size_t topicCount,
+                              uint16_t aliasMaximum) {
+  const std::vector<std::string> topics = telemetryTopics(topicCount);
+  const std::vector<uint8_t> payload(16, 0x2A);
+
+  mqttutils::TopicAliasManager manager(aliasMaximum);
+  size_t plainBytes = 0;
+  size_t aliasedBytes = 0;
+  size_t i = 0;
+  while (state.keepRunning()) {
+    mqtt::Publish p;
+    p.topicName = topics[i++ % topics.size()];
+    p.payload = payload;
+    plainBytes += encodedSize(p);
+    manager.apply(p);
+    aliasedBytes += encodedSize(p);
+  }
+
+  state.setCounter("plainBytesPerMsg", double(plainBytes) / double(i));
+  state.setCounter("aliasedBytesPerMsg", double(aliasedBytes) / double(i));
+  state.setCounter("savedPercent",
+                   100.0 * (1.0 - double(aliasedBytes) / double(plainBytes)));
+}
+
+MQTT_BENCHMARK(TopicAliasSavingsHotSet) {
+  // 50 topics, alias maximum 64: every topic keeps its alias
+  topicAliasSavings(state, 50, 64);
+}
+
+MQTT_BENCHMARK(TopicAliasSavingsChurn) {
+  // 100 topics round robin, alias maximum 64: worst case for the LRU
+  topicAliasSavings(state, 100, 64);
+}
+
+MQTT_BENCHMARK(TopicAliasApply) {
+  const std::vector<std::string> topics = telemetryTopics(50);
+  mqttutils::TopicAliasManager manager(64);
+  size_t i = 0;
+  while (state.keepRunning()) {
+    mqtt::Publish p;
+    p.topicName = topics[i++ % topics.size()];
+    manager.apply(p);
+    bench::doNotOptimize(p);
+  }
+}
@@ -0,0 +1,36 @@
+#include "bench.h"
+#include "lib/tracering.h"
+
+// the cost of one trace event on the hot path, the timestamp is taken by
+// the caller
+MQTT_BENCHMARK(TraceRecord) {
+  mqttutils::TraceRing& ring = mqttutils::TraceRing::local();
+  uint64_t t = 0;
+  while (state.keepRunning()) {
+    ring.record(mqttutils::TraceEvent::Written, 3, uint16_t(t), 128, t);
+    ++t;
+  }
+  bench::doNotOptimize(ring);
+}
+
+// with the clock read
+MQTT_BENCHMARK(TraceRecordTimed) {
+  mqttutils::TraceRing& ring = mqttutils::TraceRing::local();
+  while (state.keepRunning()) {
+    ring.record(mqttutils::TraceEvent::Written, 3, 1, 128,
+                mqttutils::TraceRing::now());
+  }
+  bench::doNotOptimize(ring);
+}
+
+MQTT_BENCHMARK(TraceRingCopy) {
+  mqttutils::TraceRing ring(1);
+  for (uint64_t t = 0; t < mqttutils::TraceRing::capacity; ++t) {
+    ring.record(mqttutils::TraceEvent::Written, 3, 1, 128, t);
+  }
+  size_t n = 0;
+  while (state.keepRunning()) {
+    n += ring.records().size();
+  }
+  bench::doNotOptimize(n);
+}
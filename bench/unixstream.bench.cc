@@ -0,0 +1,115 @@
+#include "bench.h"
+#include "lib/tcpstream.h"
+#include "lib/unixstream.h"
+
+#include <arpa/inet.h>
+#include <memory>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <string>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+// the same host over loopback TCP and over an AF_UNIX socket: a round trip
+// of a small message, and the bytes per second of a one way stream. The
+// server end is a plain socket on another thread
+
+enum class Transport { Tcp, Unix };
+
+// Connection is a client Stream and the accepted socket of the server
+struct Connection {
+  std::unique_ptr<mqtt::Stream> stream;
+  int server;
+};
+
+static Connection connectTo(Transport transport) {
+  Connection c{nullptr, -1};
+  int listener = -1;
+  if (transport == Transport::Tcp) {
+    listener = socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t addrLen = sizeof(addr);
+    bind(listener, reinterpret_cast<const sockaddr*>(&addr), addrLen);
+    getsockname(listener, reinterpret_cast<sockaddr*>(&addr), &addrLen);
+    listen(listener, 1);
+    c.stream = std::make_unique<mqttutils::TCPStream>("127.0.0.1",
+                                                      ntohs(addr.sin_port));
+  } else {
+    std::string name = "@mqtt-bench-" + std::to_string(getpid());
+    sockaddr_un addr;
+    socklen_t addrLen = 0;
+    mqttutils::unixAddress(name, addr, addrLen);
+    listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    bind(listener, reinterpret_cast<const sockaddr*>(&addr), addrLen);
+    listen(listener, 1);
+    c.stream = std::make_unique<mqttutils::UnixStream>(name);
+  }
+
+  c.stream->open();
+  c.server = accept(listener, nullptr, nullptr);
+  close(listener);
+  // as the broker does for its TCP connections
+  if (transport == Transport::Tcp) {
+    int on = 1;
+    setsockopt(c.server, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+  }
+  return c;
+}
+
+static void pingPong(bench::State& state, Transport transport) {
+  Connection c = connectTo(transport);
+  std::thread echo([fd = c.server] {
+    uint8_t buffer[64];
+    for (;;) {
+      ssize_t n = recv(fd, buffer, sizeof(buffer), MSG_WAITALL);
+      if (n <= 0 || send(fd, buffer, static_cast<size_t>(n), 0) != n) {
+        return;
+      }
+    }
+  });
+  const std::vector<uint8_t> data(64, 0x2A);
+  size_t bytes = 0;
+  while (state.keepRunning()) {
+    c.stream->writeBytes(data);
+    bytes += c.stream->readBytes(64).first.size();
+  }
+  c.stream->close();
+  echo.join();
+  close(c.server);
+  bench::doNotOptimize(bytes);
+}
+
+static void stream(bench::State& state, Transport transport) {
+  Connection c = connectTo(transport);
+  std::thread drain([fd = c.server] {
+    std::vector<uint8_t> buffer(1 << 16);
+    while (recv(fd, buffer.data(), buffer.size(), 0) > 0) {
+    }
+  });
+  const std::vector<uint8_t> data(16384, 0x2A);
+  while (state.keepRunning()) {
+    c.stream->writeBytes(data);
+  }
+  c.stream->close();
+  drain.join();
+  close(c.server);
+  state.setCounter("bytes", double(data.size()));
+}
+
+static int registerTransports() {
+  for (Transport t : {Transport::Tcp, Transport::Unix}) {
+    std::string name = t == Transport::Tcp ? "Tcp" : "Unix";
+    bench::registerBenchmark("Transport/" + name + "PingPong/64B",
+                             [t](bench::State& state) { pingPong(state, t); });
+    bench::registerBenchmark("Transport/" + name + "Stream/16384B",
+                             [t](bench::State& state) { stream(state, t); });
+  }
+  return 0;
+}
+
+static const int transportsRegistered = registerTransports();
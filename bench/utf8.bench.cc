@@ -0,0 +1,56 @@
+#include "bench.h"
+#include "lib/utf8.h"
+
+#include <string>
+
+// topic validation: a 77 byte topic with a few non ascii levels, and a 1 KB
+// string property. Measured per string
+static const std::string topic =
+    "factory/m\xC3\xBCnchen/line-2/robot-9/axis-\xCE\xB1/telemetry/"
+    "temperature/celsius/average";
+static const std::string property = [] {
+  std::string s;
+  while (s.size() < 1024) {
+    s += "{\"sensor\":\"caf\xC3\xA9\",\"value\":21.5},";
+  }
+  return s;
+}();
+
+static void scan(bench::State& state, mqttutils::UTF8::Implementation impl,
+                 const std::string& str) {
+  if (!mqttutils::UTF8::supported(impl)) {
+    state.setCounter("unsupported", 1);
+    return;
+  }
+  size_t valid = 0;
+  while (state.keepRunning()) {
+    bench::doNotOptimize(str);
+    valid += mqttutils::UTF8::scan(impl, str.data(), str.size()).valid;
+  }
+  bench::doNotOptimize(valid);
+  state.setCounter("bytes", double(str.size()));
+}
+
+MQTT_BENCHMARK(UTF8TopicScalar) {
+  scan(state, mqttutils::UTF8::Implementation::Scalar, topic);
+}
+
+MQTT_BENCHMARK(UTF8TopicSSE4) {
+  scan(state, mqttutils::UTF8::Implementation::SSE4, topic);
+}
+
+MQTT_BENCHMARK(UTF8TopicAVX2) {
+  scan(state, mqttutils::UTF8::Implementation::AVX2, topic);
+}
+
+MQTT_BENCHMARK(UTF8PropertyScalar) {
+  scan(state, mqttutils::UTF8::Implementation::Scalar, property);
+}
+
+MQTT_BENCHMARK(UTF8PropertySSE4) {
+  scan(state, mqttutils::UTF8::Implementation::SSE4, property);
+}
+
+MQTT_BENCHMARK(UTF8PropertyAVX2) {
+  scan(state, mqttutils::UTF8::Implementation::AVX2, property);
+}
@@ -0,0 +1,105 @@
+#include "bench.h"
+#include "lib/packet/codec.h"
+
+#include <random>
+#include <vector>
+
+// variable byte integers as they appear on the wire: remaining lengths of
+// small packets and subscription identifiers (1 byte), property lengths (1-2
+// bytes), large payload lengths (4 bytes) and a mix of all lengths that
+// defeats the branch predictor. Measured per integer
+static std::vector<uint32_t> values(uint32_t minBytes, uint32_t maxBytes) {
+  std::mt19937 rng(42);
+  std::vector<uint32_t> v(4096);
+  for (auto& x : v) {
+    uint32_t bytes = minBytes + uint32_t(rng()) % (maxBytes - minBytes + 1);
+    uint32_t lo = bytes == 1 ? 0 : 1u << (7 * (bytes - 1));
+    uint32_t hi = (1u << (7 * bytes)) - 1;
+    x = lo + uint32_t(rng()) % (hi - lo + 1);
+  }
+  return v;
+}
+
+// the byte at a time codec the fast paths replaced
+static uint32_t encodeLoop(uint32_t value, uint8_t* out) {
+  uint32_t n = 0;
+  do {
+    uint8_t encodedByte = value % 0x80;
+    value = value / 0x80;
+    if (value > 0) {
+      encodedByte |= 0x80;
+    }
+    out[n++] = encodedByte;
+  } while (value != 0);
+  return n;
+}
+
+static uint32_t decodeLoop(const uint8_t* data, size_t size,
+                           uint32_t& value) {
+  uint32_t multiplier = 1;
+  value = 0;
+  for (size_t i = 0; i < size && i < 4; ++i) {
+    value += static_cast<uint32_t>(data[i] & 0x7f) * multiplier;
+    if ((data[i] & 0x80) == 0) {
+      return uint32_t(i + 1);
+    }
+    multiplier *= 128;
+  }
+  return 0;
+}
+
+template <bool fast>
+static void encodeDecode(bench::State& state, const std::vector<uint32_t>& v) {
+  std::vector<uint8_t> wire(v.size() * 4 + 4);
+  uint64_t sum = 0;
+  while (state.keepRunning()) {
+    size_t end = 0;
+    for (uint32_t x : v) {
+      end += fast ? packet::EncodedVarUint32::encode(x, &wire[end])
+                  : encodeLoop(x, &wire[end]);
+    }
+    bench::doNotOptimize(wire);
+    size_t pos = 0;
+    while (pos < end) {
+      uint32_t x = 0;
+      pos += fast ? packet::EncodedVarUint32::decode(&wire[pos], end - pos, x)
+                  : decodeLoop(&wire[pos], end - pos, x);
+      sum += x;
+    }
+  }
+  bench::doNotOptimize(sum);
+  state.setCounter("ns_per_int",
+                   state.getNanosPerIteration() / double(v.size()));
+}
+
+MQTT_BENCHMARK(VarintOneByteLoop) {
+  encodeDecode<false>(state, values(1, 1));
+}
+
+MQTT_BENCHMARK(VarintOneByteFast) {
+  encodeDecode<true>(state, values(1, 1));
+}
+
+MQTT_BENCHMARK(VarintTwoBytesLoop) {
+  encodeDecode<false>(state, values(1, 2));
+}
+
+MQTT_BENCHMARK(VarintTwoBytesFast) {
+  encodeDecode<true>(state, values(1, 2));
+}
+
+MQTT_BENCHMARK(VarintFourBytesLoop) {
+  encodeDecode<false>(state, values(4, 4));
+}
+
+MQTT_BENCHMARK(VarintFourBytesFast) {
+  encodeDecode<true>(state, values(4, 4));
+}
+
+MQTT_BENCHMARK(VarintMixedLoop) {
+  encodeDecode<false>(state, values(1, 4));
+}
+
+MQTT_BENCHMARK(VarintMixedFast) {
+  encodeDecode<true>(state, values(1, 4));
+}
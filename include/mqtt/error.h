@@ -10,6 +10,14 @@ namespace mqtt {
     InvalidTopic           = 2,
     EmptySubscriptionTopic = 3,
     InvalidProtocolName = 4,
+    TopicAliasInvalid = 5,
+    TopicAliasNotFound = 6,
+    SessionStoreCorrupt = 7,
+    MalformedUTF8String = 8,
+    MalformedPacket = 9,
+    InvalidPropertyID = 10,
+    DuplicateProperty = 11,
+    UnsupportedProtocolVersion = 12,
   };
 
   class ErrorCategory : public std::error_category {
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <memory>
 #include <mqtt/mqtt.h>
 #include <string>
 #include <vector>
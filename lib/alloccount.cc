@@ -0,0 +1,38 @@
+#include "alloccount.h"
+
+namespace mqttutils {
+  // totals of the thread, plain thread locals: operator new runs before
+  // main and while threads exit
+  static thread_local uint64_t totalAllocations = 0;
+  static thread_local uint64_t totalBytes = 0;
+  static bool installed = false;
+
+  AllocationCounter::AllocationCounter()
+      : startAllocations(totalAllocations), startBytes(totalBytes) {}
+
+  uint64_t AllocationCounter::allocations() const {
+    return totalAllocations - this->startAllocations;
+  }
+
+  uint64_t AllocationCounter::bytes() const {
+    return totalBytes - this->startBytes;
+  }
+
+  void AllocationCounter::reset() {
+    this->startAllocations = totalAllocations;
+    this->startBytes = totalBytes;
+  }
+
+  bool AllocationCounter::enabled() {
+    return installed;
+  }
+
+  void AllocationCounter::install() {
+    installed = true;
+  }
+
+  void AllocationCounter::record(size_t size) {
+    totalAllocations++;
+    totalBytes += size;
+  }
+} // namespace mqttutils
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace mqttutils {
+  // AllocationCounter counts the heap allocations of the calling thread in
+  // a scope, the allocations and the bytes allocated since it was created:
+  //
+  //   AllocationCounter counter;
+  //   PublishDecoder::decode(dec, byte0, remainingLen, pkt);
+  //   CHECK(counter.allocations() == 0);
+  //
+  // The counts come from a replaceable global operator new, allochook.cc,
+  // which the unit tests and the benchmarks link. The library does not
+  // replace operator new, without the hook the counts stay 0 and enabled()
+  // is false.
+  class AllocationCounter {
+  public:
+    AllocationCounter();
+
+    uint64_t allocations() const;
+    uint64_t bytes() const;
+    // starts counting again from 0
+    void reset();
+
+    static bool enabled();
+
+    // called by the hook
+    static void install();
+    static void record(size_t size);
+
+  private:
+    uint64_t startAllocations;
+    uint64_t startBytes;
+  };
+} // namespace mqttutils
@@ -0,0 +1,79 @@
+#include "alloccount.h"
+#include "arena.h"
+#include "doctest/doctest.h"
+#include "packet/codec.h"
+#include "packet/packet.h"
+#include "packet/publish.h"
+#include <thread>
+
+TEST_CASE("testing allocation counter") {
+  REQUIRE(mqttutils::AllocationCounter::enabled());
+
+  mqttutils::AllocationCounter counter;
+  CHECK(counter.allocations() == 0);
+  auto a = std::make_unique<uint64_t>(1);
+  std::vector<uint8_t> b(100);
+  CHECK(counter.allocations() == 2);
+  CHECK(counter.bytes() == sizeof(uint64_t) + 100);
+
+  // scopes nest, other threads are not counted: only the state of the
+  // thread is allocated here
+  mqttutils::AllocationCounter inner;
+  std::thread t([] { std::vector<uint8_t> c(100); });
+  t.join();
+  CHECK(inner.allocations() <= 1);
+  counter.reset();
+  CHECK(counter.allocations() == 0);
+  CHECK(counter.bytes() == 0);
+}
+
+TEST_CASE("testing allocations of the PUBLISH decode path") {
+  mqtt::Publish p;
+  // longer than the small string buffer, like the topics of a deployment
+  p.topicName = "telemetry/site-3/meter-17/power";
+  p.qosLevel = 1;
+  p.payload.assign(64, 'x');
+  p.properties = std::make_shared<mqtt::Publish::Properties>();
+  p.properties->contentType = "application/json;charset=utf-8";
+  p.properties->messageExpiryInterval = 30;
+  const std::vector<uint8_t> encoded = packet::PublishEncoder({9, p}).encode();
+
+  // framing
+  mqttutils::AllocationCounter counter;
+  packet::FixedHeader fhdr;
+  size_t headerLen = 0;
+  REQUIRE(packet::FixedHeaderReader::parse(encoded.data(), encoded.size(),
+                                           fhdr, headerLen) ==
+          packet::FixedHeaderReader::Result::Complete);
+  CHECK(counter.allocations() == 0);
+
+  // warm up the arena, then the properties come from it: the allocations
+  // left are the topic, the content type and the payload, the mqtt:: types
+  // hold std::string and std::vector
+  mqttutils::Arena arena;
+  for (int i = 0; i < 2; ++i) {
+    counter.reset();
+    packet::Decoder dec(encoded.data() + headerLen, encoded.size() - headerLen,
+                        &arena);
+    packet::PublishPacket pkt;
+    REQUIRE(!packet::PublishDecoder::decode(dec, fhdr.first, fhdr.second,
+                                            pkt));
+    CHECK(pkt.second.properties->contentType ==
+          p.properties->contentType);
+    if (i > 0) {
+      CHECK(counter.allocations() == 3);
+      CHECK(counter.bytes() == p.topicName.size() + 1 +
+                                   p.properties->contentType.size() + 1 +
+                                   p.payload.size());
+    }
+    pkt = {};
+    arena.reset();
+  }
+
+  // forwarding a frame as it is
+  std::vector<uint8_t> frame = encoded;
+  counter.reset();
+  packet::RawPublish raw(std::move(frame));
+  raw.setPacketID(10);
+  CHECK(counter.allocations() == 0);
+}
@@ -0,0 +1,46 @@
+// Replaces the global operator new to count the allocations for
+// mqttutils::AllocationCounter. Linked into the unit tests and the
+// benchmarks, not into the library: an application keeps its own operator
+// new.
+#include "alloccount.h"
+#include <cstdlib>
+#include <new>
+
+static const bool hookInstalled =
+    (mqttutils::AllocationCounter::install(), true);
+
+void* operator new(size_t size) {
+  mqttutils::AllocationCounter::record(size);
+  if (void* ptr = std::malloc(size == 0 ? 1 : size)) {
+    return ptr;
+  }
+  throw std::bad_alloc();
+}
+
+void* operator new(size_t size, std::align_val_t alignment) {
+  mqttutils::AllocationCounter::record(size);
+  size_t align = static_cast<size_t>(alignment);
+  // aligned_alloc wants a multiple of the alignment
+  size_t rounded = (size + align - 1) / align * align;
+  if (void* ptr = std::aligned_alloc(align, rounded == 0 ? align : rounded)) {
+    return ptr;
+  }
+  throw std::bad_alloc();
+}
+
+void operator delete(void* ptr) noexcept {
+  std::free(ptr);
+}
+
+void operator delete(void* ptr, size_t /*size*/) noexcept {
+  std::free(ptr);
+}
+
+void operator delete(void* ptr, std::align_val_t /*alignment*/) noexcept {
+  std::free(ptr);
+}
+
+void operator delete(void* ptr, size_t /*size*/,
+                     std::align_val_t /*alignment*/) noexcept {
+  std::free(ptr);
+}
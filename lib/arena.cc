@@ -0,0 +1,61 @@
+#include "arena.h"
+#include <algorithm>
+
+namespace mqttutils {
+  Arena::Arena(size_t blockSizeA)
+      : blockSize(blockSizeA), current(0), offset(0), usedBytes(0) {}
+
+  void Arena::reset() {
+    // oversized blocks are not reused
+    this->blocks.erase(std::remove_if(this->blocks.begin(), this->blocks.end(),
+                                      [this](const Block& b) {
+                                        return b.size > this->blockSize;
+                                      }),
+                       this->blocks.end());
+    this->current = 0;
+    this->offset = 0;
+    this->usedBytes = 0;
+  }
+
+  size_t Arena::used() const {
+    return this->usedBytes;
+  }
+
+  size_t Arena::blockCount() const {
+    return this->blocks.size();
+  }
+
+  void* Arena::do_allocate(size_t bytes, size_t alignment) {
+    for (;;) {
+      if (this->current < this->blocks.size()) {
+        Block& b = this->blocks[this->current];
+        uintptr_t base = reinterpret_cast<uintptr_t>(b.data.get());
+        uintptr_t p = (base + this->offset + alignment - 1) &
+                      ~static_cast<uintptr_t>(alignment - 1);
+        if (p + bytes <= base + b.size) {
+          this->offset = p + bytes - base;
+          this->usedBytes += bytes;
+          return reinterpret_cast<void*>(p);
+        }
+        if (this->current + 1 < this->blocks.size()) {
+          this->current++;
+          this->offset = 0;
+          continue;
+        }
+      }
+
+      size_t size = std::max(this->blockSize, bytes + alignment);
+      this->blocks.push_back(Block{std::unique_ptr<uint8_t[]>(new uint8_t[size]), size});
+      this->current = this->blocks.size() - 1;
+      this->offset = 0;
+    }
+  }
+
+  void Arena::do_deallocate(void* /*p*/, size_t /*bytes*/,
+                            size_t /*alignment*/) {}
+
+  bool Arena::do_is_equal(const std::pmr::memory_resource& other) const
+      noexcept {
+    return this == &other;
+  }
+} // namespace mqttutils
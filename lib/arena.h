@@ -0,0 +1,52 @@
+#pragma once
+
+#include "mqtt/noncopyable.h"
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <memory_resource>
+#include <vector>
+
+namespace mqttutils {
+  // Arena is a bump allocator for the objects decoded from one inbound
+  // packet. Allocation moves a pointer forward, deallocation does nothing
+  // and reset releases everything in one shot once the packet is
+  // dispatched. The blocks are kept across resets, in steady state the
+  // arena does not touch the heap. Requests larger than a block get a
+  // block of their own which reset frees.
+  //
+  // The arena is a std::pmr::memory_resource, pass it to packet::Decoder.
+  // The decoders take the properties objects from it; the strings and
+  // vectors of the mqtt:: types use the heap, they are std::string and
+  // std::vector in the public API.
+  // Not thread safe, use one arena per connection or event loop.
+  class Arena : public std::pmr::memory_resource, private mqtt::noncopyable {
+  public:
+    explicit Arena(size_t blockSize = 4096);
+
+    void reset();
+
+    // bytes handed out since the last reset
+    size_t used() const;
+    size_t blockCount() const;
+
+  private:
+    void* do_allocate(size_t bytes, size_t alignment) override;
+    void do_deallocate(void* p, size_t bytes, size_t alignment) override;
+    bool do_is_equal(const std::pmr::memory_resource& other) const
+        noexcept override;
+
+  private:
+    struct Block {
+      std::unique_ptr<uint8_t[]> data;
+      size_t size;
+    };
+
+    const size_t blockSize;
+    std::vector<Block> blocks;
+    // block allocated from and offset of the next free byte in it
+    size_t current;
+    size_t offset;
+    size_t usedBytes;
+  };
+} // namespace mqttutils
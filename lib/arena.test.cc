@@ -0,0 +1,64 @@
+#include "arena.h"
+#include "doctest/doctest.h"
+#include "packet/codec.h"
+#include "packet/packet.h"
+#include "packet/publish.h"
+
+TEST_CASE("testing arena allocation and reset") {
+  mqttutils::Arena arena(256);
+  void* a = arena.allocate(10, 1);
+  void* b = arena.allocate(8, 8);
+  CHECK(reinterpret_cast<uintptr_t>(b) % 8 == 0);
+  CHECK(static_cast<uint8_t*>(b) >= static_cast<uint8_t*>(a) + 10);
+  CHECK(arena.used() == 18);
+  CHECK(arena.blockCount() == 1);
+
+  // a new block when the current one is full
+  for (int i = 0; i < 40; ++i) {
+    CHECK(arena.allocate(16, 16) != nullptr);
+  }
+  const size_t blocks = arena.blockCount();
+  CHECK(blocks > 1);
+
+  // an oversized request gets a block of its own, dropped by reset
+  void* big = arena.allocate(1000, 64);
+  CHECK(reinterpret_cast<uintptr_t>(big) % 64 == 0);
+  CHECK(arena.blockCount() == blocks + 1);
+
+  // the blocks are reused after reset
+  arena.reset();
+  CHECK(arena.used() == 0);
+  CHECK(arena.blockCount() == blocks);
+  CHECK(arena.allocate(10, 1) == a);
+  for (int i = 0; i < 40; ++i) {
+    CHECK(arena.allocate(16, 16) != nullptr);
+  }
+  CHECK(arena.blockCount() == blocks);
+}
+
+TEST_CASE("testing decode with arena") {
+  mqtt::Publish p;
+  p.topicName = "a/b";
+  p.qosLevel = 1;
+  p.payload = {'h', 'i'};
+  p.properties = std::make_shared<mqtt::Publish::Properties>();
+  p.properties->contentType = "text/plain";
+  const std::vector<uint8_t> encoded = packet::PublishEncoder({9, p}).encode();
+
+  mqttutils::Arena arena;
+  for (int i = 0; i < 3; ++i) {
+    // the decoder reads the packet in place
+    packet::Decoder dec(encoded.data(), encoded.size(), &arena);
+    packet::FixedHeader fhdr = packet::FixedHeaderReader::read(dec);
+    auto pkt = packet::PublishDecoder::decode(dec, fhdr.first, fhdr.second);
+    CHECK(pkt.first == 9);
+    CHECK(pkt.second.topicName == "a/b");
+    REQUIRE(pkt.second.properties);
+    CHECK(pkt.second.properties->contentType == "text/plain");
+    CHECK(arena.used() >= sizeof(mqtt::Publish::Properties));
+    CHECK(arena.blockCount() == 1);
+    // the packet must be gone before the reset
+    pkt = {};
+    arena.reset();
+  }
+}
@@ -0,0 +1,263 @@
+#include "broker.h"
+#include "../metrics.h"
+#include "../unixstream.h"
+#include "worker.h"
+#include <arpa/inet.h>
+#include <cerrno>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace broker {
+  static const char* stageName(Stage stage) {
+    static const char* names[stageCount] = {"framing", "decode", "match",
+                                            "queue",   "encode", "write"};
+    return names[static_cast<size_t>(stage)];
+  }
+
+  // listenUnix binds a listening AF_UNIX socket to path, returns 0 or the
+  // errno of the failing call
+  static int listenUnix(const std::string& path, int& fd) {
+    sockaddr_un addr;
+    socklen_t addrLen = 0;
+    int err = mqttutils::unixAddress(path, addr, addrLen);
+    if (err != 0) {
+      return err;
+    }
+
+    // the socket file of a broker that did not stop is in the way: nobody
+    // accepts on it. A socket in use and other files are left alone, bind
+    // fails with EADDRINUSE
+    struct stat st;
+    if (path[0] != '@' && lstat(path.c_str(), &st) == 0 &&
+        S_ISSOCK(st.st_mode)) {
+      int probe = socket(AF_UNIX, SOCK_STREAM, 0);
+      if (probe != -1 &&
+          ::connect(probe, reinterpret_cast<const sockaddr*>(&addr),
+                    addrLen) != 0 &&
+          errno == ECONNREFUSED) {
+        unlink(path.c_str());
+      }
+      if (probe != -1) {
+        ::close(probe);
+      }
+    }
+
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd == -1) {
+      return errno;
+    }
+    if (bind(fd, reinterpret_cast<const sockaddr*>(&addr), addrLen) != 0 ||
+        listen(fd, SOMAXCONN) != 0) {
+      err = errno;
+      ::close(fd);
+      fd = -1;
+      return err;
+    }
+    return 0;
+  }
+
+  Broker::Broker() : Broker(Options()) {}
+
+  Broker::Broker(Options optionsA)
+      : options(optionsA), listenFd(-1), unixFd(-1), wakeFds{-1, -1}, port(0),
+        nextConnectionID(1), started(std::chrono::steady_clock::now()) {
+    if (this->options.workers == 0) {
+      this->options.workers = 1;
+    }
+  }
+
+  Broker::~Broker() {
+    this->stop();
+  }
+
+  int Broker::start() {
+    if (this->listenFd != -1) {
+      return 0;
+    }
+
+    sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(static_cast<uint16_t>(this->options.port));
+    if (inet_pton(AF_INET, this->options.address.c_str(), &addr.sin_addr) !=
+        1) {
+      return EINVAL;
+    }
+
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd == -1) {
+      return errno;
+    }
+
+    int on = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    if (bind(fd, reinterpret_cast<const sockaddr*>(&addr), sizeof(addr)) != 0 ||
+        listen(fd, SOMAXCONN) != 0 || pipe(this->wakeFds) != 0) {
+      int err = errno;
+      ::close(fd);
+      return err;
+    }
+
+    socklen_t addrLen = sizeof(addr);
+    getsockname(fd, reinterpret_cast<sockaddr*>(&addr), &addrLen);
+    this->port = ntohs(addr.sin_port);
+    this->listenFd = fd;
+
+    if (!this->options.unixPath.empty()) {
+      int err = listenUnix(this->options.unixPath, this->unixFd);
+      if (err != 0) {
+        this->stop();
+        return err;
+      }
+    }
+
+    for (size_t i = 0; i < this->options.workers; ++i) {
+      this->workers.emplace_back(std::make_unique<Worker>(*this, i));
+      int err = this->workers.back()->start();
+      if (err != 0) {
+        this->stop();
+        return err;
+      }
+    }
+
+    for (size_t i = 0; i < stageCount; ++i) {
+      Stage stage = static_cast<Stage>(i);
+      this->summaryIDs.push_back(
+          mqttutils::MetricsRegistry::global().attachSummary(
+              "mqtt_broker_stage_latency_seconds",
+              "Latency of the stages of a PUBLISH in the broker",
+              {{"stage", stageName(stage)}},
+              [this, stage] { return this->latency(stage); }));
+    }
+
+    this->acceptor = std::thread(&Broker::acceptLoop, this);
+    return 0;
+  }
+
+  void Broker::stop() {
+    if (this->listenFd == -1) {
+      return;
+    }
+
+    // wake up the acceptor
+    uint8_t b = 0;
+    if (write(this->wakeFds[1], &b, 1) == 1 && this->acceptor.joinable()) {
+      this->acceptor.join();
+    }
+
+    // the registry does not read the workers once detached
+    for (uint64_t id : this->summaryIDs) {
+      mqttutils::MetricsRegistry::global().detachSummary(id);
+    }
+    this->summaryIDs.clear();
+    for (auto& worker : this->workers) {
+      worker->stop();
+    }
+    this->workers.clear();
+
+    ::close(this->listenFd);
+    if (this->unixFd != -1) {
+      ::close(this->unixFd);
+      if (this->options.unixPath[0] != '@') {
+        unlink(this->options.unixPath.c_str());
+      }
+      this->unixFd = -1;
+    }
+    ::close(this->wakeFds[0]);
+    ::close(this->wakeFds[1]);
+    this->listenFd = -1;
+    this->wakeFds[0] = -1;
+    this->wakeFds[1] = -1;
+
+    std::lock_guard<std::mutex> guard(this->clientsMux);
+    this->clients.clear();
+  }
+
+  int Broker::getPort() const {
+    return this->port;
+  }
+
+  const Broker::Options& Broker::getOptions() const {
+    return this->options;
+  }
+
+  mqttutils::Histogram::Snapshot Broker::latency(Stage stage) const {
+    mqttutils::Histogram::Snapshot s;
+    for (const auto& worker : this->workers) {
+      s.add(worker->latency(stage));
+    }
+    return s;
+  }
+
+  void Broker::acceptLoop() {
+    size_t next = 0;
+    for (;;) {
+      // poll skips the AF_UNIX listener when there is none, at -1
+      pollfd fds[3] = {{this->listenFd, POLLIN, 0},
+                       {this->wakeFds[0], POLLIN, 0},
+                       {this->unixFd, POLLIN, 0}};
+      if (poll(fds, 3, -1) < 0) {
+        if (errno == EINTR) {
+          continue;
+        }
+        return;
+      }
+
+      if (fds[1].revents != 0) {
+        // stop requested
+        return;
+      }
+
+      for (int i : {0, 2}) {
+        if (fds[i].revents == 0) {
+          continue;
+        }
+        int fd = ::accept(fds[i].fd, nullptr, nullptr);
+        if (fd == -1) {
+          continue;
+        }
+
+        // connections are sharded round robin over the workers, fds[0] is
+        // the TCP listener
+        uint64_t connectionID = this->nextConnectionID++;
+        this->workers[next]->addConnection(fd, connectionID, i == 0);
+        next = (next + 1) % this->workers.size();
+      }
+    }
+  }
+
+  uint64_t Broker::now() const {
+    return static_cast<uint64_t>(
+        std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now() - this->started)
+            .count());
+  }
+
+  void Broker::registerClient(const std::string& clientID, size_t worker,
+                              uint64_t connectionID) {
+    std::pair<size_t, uint64_t> previous{0, 0};
+    {
+      std::lock_guard<std::mutex> guard(this->clientsMux);
+      auto& entry = this->clients[clientID];
+      previous = entry;
+      entry = {worker, connectionID};
+    }
+
+    // a new connection with the same client ID takes over the session
+    if (previous.second != 0) {
+      this->workers[previous.first]->closeConnection(previous.second);
+    }
+  }
+
+  void Broker::unregisterClient(const std::string& clientID,
+                                uint64_t connectionID) {
+    std::lock_guard<std::mutex> guard(this->clientsMux);
+    auto it = this->clients.find(clientID);
+    if (it != this->clients.end() && it->second.second == connectionID) {
+      this->clients.erase(it);
+    }
+  }
+} // namespace broker
@@ -0,0 +1,108 @@
+#pragma once
+
+#include "../histogram.h"
+#include "../topic.h"
+#include "mqtt/noncopyable.h"
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace broker {
+  class Worker;
+
+  // Stage is a step of a PUBLISH from the socket of the publisher to the
+  // socket of a subscriber, the workers keep a latency histogram per stage:
+  // Framing finds the packet in the receive buffer, Decode decodes the
+  // PUBLISH, Match looks up the subscriptions, Queue is the hand-off to the
+  // worker of a subscriber on another worker, Encode builds the header of a
+  // delivery and Write is a sendmsg call
+  enum class Stage { Framing, Decode, Match, Queue, Encode, Write };
+  static constexpr size_t stageCount = 6;
+
+  // Broker is an in-process MQTT v5 broker for integration tests and edge
+  // gateways. A listener thread accepts the connections and hands them to N
+  // worker threads, round robin. Every worker runs an event loop over its
+  // connections, subscriptions are routed through the TopicMatcher and the
+  // messages are fanned out to the workers owning the subscribers.
+  //
+  // Supported: QoS 0 and 1 (QoS 2 subscriptions are granted QoS 1), topic
+  // aliases from the client, subscription identifiers, no local, message
+  // expiry and keep alive. Not supported: retained messages, will messages,
+  // shared subscriptions and persistent sessions.
+  class Broker : private mqtt::noncopyable {
+  public:
+    struct Options {
+      // the broker listens on the loopback interface by default
+      std::string address{"127.0.0.1"};
+      // 0 binds an ephemeral port, see getPort()
+      int port{0};
+      // when set, the broker listens on this AF_UNIX socket as well, for the
+      // clients on the same host. '@' starts a name in the abstract
+      // namespace, a stale socket file at the path is replaced
+      std::string unixPath;
+      size_t workers{2};
+      uint16_t topicAliasMaximum{64};
+      uint32_t maximumPacketSize{1 << 20};
+      // QoS 0 messages are dropped when more bytes are queued for a slow
+      // subscriber
+      size_t maxOutboundBytes{8 << 20};
+      // seconds a new connection has to send CONNECT
+      uint16_t connectTimeout{10};
+    };
+
+    Broker();
+    explicit Broker(Options options);
+    ~Broker();
+
+    // start binds the listener and starts the threads. Returns 0 or the
+    // errno of the failing call
+    int start();
+    void stop();
+
+    int getPort() const;
+    const Options& getOptions() const;
+
+    // latency of a stage in nanoseconds, merged over the workers. While the
+    // broker runs, the histograms start over on start(). The latencies are
+    // in the global metrics registry as mqtt_broker_stage_latency_seconds
+    // as well, with the counters of the workers
+    mqttutils::Histogram::Snapshot latency(Stage stage) const;
+
+  private:
+    friend class Worker;
+
+    void acceptLoop();
+
+    // milliseconds since the broker started, the time base of the workers
+    uint64_t now() const;
+
+    // registerClient records the connection of a client ID and closes the
+    // previous connection of the same client ID
+    void registerClient(const std::string& clientID, size_t worker,
+                        uint64_t connectionID);
+    void unregisterClient(const std::string& clientID, uint64_t connectionID);
+
+  private:
+    Options options;
+    mqttutils::TopicMatcher matcher;
+    std::vector<std::unique_ptr<Worker>> workers;
+    std::thread acceptor;
+    int listenFd;
+    int unixFd;
+    int wakeFds[2];
+    int port;
+    std::atomic<uint64_t> nextConnectionID;
+    // the summaries in the metrics registry, one per stage
+    std::vector<uint64_t> summaryIDs;
+    std::chrono::steady_clock::time_point started;
+
+    std::mutex clientsMux;
+    // client ID -> worker, connection ID
+    std::unordered_map<std::string, std::pair<size_t, uint64_t>> clients;
+  };
+} // namespace broker
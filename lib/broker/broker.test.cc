@@ -0,0 +1,336 @@
+#include "doctest/doctest.h"
+
+#include "broker.h"
+#include "lib/packet/codec.h"
+#include "lib/packet/connack.h"
+#include "lib/packet/connect.h"
+#include "lib/packet/packet.h"
+#include "lib/packet/ping.h"
+#include "lib/packet/publish.h"
+#include "lib/packet/publishresponse.h"
+#include "lib/packet/suback.h"
+#include "lib/packet/subscribe.h"
+#include "lib/packet/unsuback.h"
+#include "lib/packet/unsubscribe.h"
+#include "lib/tcpstream.h"
+#include "lib/tracering.h"
+#include "lib/temppath.h"
+#include "lib/unixstream.h"
+
+#include <cstdio>
+#include <filesystem>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace test {
+  // Client is a minimal blocking MQTT client on top of the packet codec
+  class Client {
+  public:
+    explicit Client(int port)
+        : stream(std::make_unique<mqttutils::TCPStream>("127.0.0.1", port)) {}
+    explicit Client(std::unique_ptr<mqtt::Stream> streamA)
+        : stream(std::move(streamA)) {}
+
+    mqtt::ConnAck connect(const std::string& clientID) {
+      mqtt::Connect c;
+      c.clientID = clientID;
+      c.protocolName = "MQTT";
+      REQUIRE(this->stream->open() == 0);
+      this->write(packet::ConnectEncoder(c).encode());
+      auto pkt = this->read();
+      REQUIRE(packet::ControlPacket::Type(pkt.first >> 4) ==
+              packet::ControlPacket::Type::CONNACK);
+      return packet::ConnAckDecoder::decode(pkt.second);
+    }
+
+    void write(const std::vector<uint8_t>& data) {
+      REQUIRE(this->stream->writeBytes(data).second == 0);
+    }
+
+    // returns byte0 and the packet body
+    std::pair<uint8_t, std::vector<uint8_t>> read() {
+      std::vector<uint8_t> header;
+      packet::FixedHeader fhdr;
+      size_t headerLen = 0;
+      for (;;) {
+        auto result = this->stream->readBytes(1);
+        REQUIRE(result.second == 0);
+        header.push_back(result.first[0]);
+        auto r = packet::FixedHeaderReader::parse(header.data(), header.size(),
+                                                  fhdr, headerLen);
+        REQUIRE(r != packet::FixedHeaderReader::Result::Malformed);
+        if (r == packet::FixedHeaderReader::Result::Complete) {
+          break;
+        }
+      }
+      if (fhdr.second == 0) {
+        return {fhdr.first, {}};
+      }
+      auto result = this->stream->readBytes(fhdr.second);
+      REQUIRE(result.second == 0);
+      return {fhdr.first, result.first};
+    }
+
+    mqtt::SubAck subscribe(uint16_t packetID, const std::string& topicFilter,
+                           uint8_t qosLevel, bool noLocal = false,
+                           std::optional<uint32_t> subscriptionID = {}) {
+      mqtt::Subscribe s;
+      s.subscriptions.push_back(
+          mqtt::Subscription{topicFilter, qosLevel, noLocal, false, 0});
+      if (subscriptionID) {
+        s.properties = std::make_shared<mqtt::Subscribe::Properties>();
+        s.properties->subscriptionIdentifier = subscriptionID;
+      }
+      this->write(packet::SubscribeEncoder({packetID, s}).encode());
+      auto pkt = this->read();
+      REQUIRE(packet::ControlPacket::Type(pkt.first >> 4) ==
+              packet::ControlPacket::Type::SUBACK);
+      auto suback = packet::SubAckDecoder::decode(pkt.second);
+      REQUIRE(suback.first == packetID);
+      return suback.second;
+    }
+
+    void publish(uint16_t packetID, const std::string& topic, uint8_t qosLevel,
+                 const std::string& payload) {
+      mqtt::Publish p;
+      p.topicName = topic;
+      p.qosLevel = qosLevel;
+      p.payload.assign(payload.begin(), payload.end());
+      this->write(packet::PublishEncoder({packetID, p}).encode());
+    }
+
+    packet::PublishPacket readPublish() {
+      auto pkt = this->read();
+      REQUIRE(packet::ControlPacket::Type(pkt.first >> 4) ==
+              packet::ControlPacket::Type::PUBLISH);
+      packet::Decoder dec(pkt.second);
+      return packet::PublishDecoder::decode(dec, pkt.first,
+                                            uint32_t(pkt.second.size()));
+    }
+
+    packet::PublishResponsePacket readPubAck() {
+      auto pkt = this->read();
+      REQUIRE(packet::ControlPacket::Type(pkt.first >> 4) ==
+              packet::ControlPacket::Type::PUBACK);
+      return packet::PublishResponseDecoder::decode(
+          pkt.second, packet::ControlPacket::Type::PUBACK);
+    }
+
+    void ping() {
+      this->write(
+          packet::PingEncoder::encode(packet::ControlPacket::Type::PINGREQ));
+      auto pkt = this->read();
+      REQUIRE(packet::ControlPacket::Type(pkt.first >> 4) ==
+              packet::ControlPacket::Type::PINGRESP);
+    }
+
+  private:
+    // the stream functions are private in TCPStream
+    std::unique_ptr<mqtt::Stream> stream;
+  };
+} // namespace test
+
+TEST_CASE("testing broker connect and ping") {
+  broker::Broker b;
+  REQUIRE(b.start() == 0);
+  REQUIRE(b.getPort() > 0);
+
+  test::Client client(b.getPort());
+  mqtt::ConnAck ca = client.connect("");
+  CHECK(ca.reasonCode == mqtt::ConnAck::ReasonCode::Success);
+  REQUIRE(ca.properties);
+  CHECK(ca.properties->maximumQoS == 1);
+  CHECK(ca.properties->retainAvailable == false);
+  CHECK(ca.properties->topicAliasMaximum == b.getOptions().topicAliasMaximum);
+  CHECK(!ca.properties->assignedClientIdentifier.empty());
+
+  client.ping();
+  b.stop();
+}
+
+TEST_CASE("testing broker unix socket listener") {
+  // the abstract namespace and a socket file, the TCP listener is there
+  // as well
+  test::TempPath tmp("mqtt-broker.sock");
+  const std::string& file = tmp.path;
+  // a socket file left behind, nobody accepts on it
+  {
+    sockaddr_un addr;
+    socklen_t addrLen = 0;
+    REQUIRE(mqttutils::unixAddress(file, addr, addrLen) == 0);
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    REQUIRE(bind(fd, reinterpret_cast<const sockaddr*>(&addr), addrLen) == 0);
+    close(fd);
+  }
+  for (const std::string& path :
+       {"@mqtt-broker-" + std::to_string(getpid()), file}) {
+    broker::Broker::Options options;
+    options.unixPath = path;
+    broker::Broker b(options);
+    REQUIRE(b.start() == 0);
+
+    test::Client subscriber(std::make_unique<mqttutils::UnixStream>(path));
+    subscriber.connect("sub");
+    subscriber.subscribe(1, "local/#", 0);
+    test::Client publisher(b.getPort());
+    publisher.connect("pub");
+    publisher.publish(0, "local/a", 0, "over tcp");
+    auto pkt = subscriber.readPublish();
+    CHECK(pkt.second.topicName == "local/a");
+    b.stop();
+  }
+  // the socket file is removed on stop
+  CHECK(!std::filesystem::exists(file));
+}
+
+TEST_CASE("testing broker fan out across workers") {
+  broker::Broker::Options options;
+  options.workers = 3;
+  broker::Broker b(options);
+  REQUIRE(b.start() == 0);
+
+  // the connections are spread over the workers round robin
+  std::vector<std::unique_ptr<test::Client>> subscribers;
+  for (int i = 0; i < 4; ++i) {
+    subscribers.emplace_back(std::make_unique<test::Client>(b.getPort()));
+    subscribers.back()->connect("sub-" + std::to_string(i));
+    mqtt::SubAck suback = subscribers.back()->subscribe(
+        1, "sensors/+/temp", uint8_t(i % 2));
+    REQUIRE(suback.reasonCodes.size() == 1);
+    CHECK(suback.reasonCodes[0] == (i % 2 == 0
+                                        ? mqtt::SubAck::ReasonCode::GrantedQoS0
+                                        : mqtt::SubAck::ReasonCode::GrantedQoS1));
+  }
+
+  test::Client publisher(b.getPort());
+  publisher.connect("pub");
+  publisher.publish(7, "sensors/1/temp", 1, "21.5");
+  auto puback = publisher.readPubAck();
+  CHECK(puback.packetID == 7);
+  CHECK(puback.response.reasonCode == mqtt::PublishResponse::ReasonCode::Success);
+
+  for (size_t i = 0; i < subscribers.size(); ++i) {
+    auto pkt = subscribers[i]->readPublish();
+    CHECK(pkt.second.topicName == "sensors/1/temp");
+    CHECK(pkt.second.payload == std::vector<uint8_t>{'2', '1', '.', '5'});
+    CHECK(pkt.second.qosLevel == i % 2);
+    if (pkt.second.qosLevel == 1) {
+      CHECK(pkt.first != 0);
+      subscribers[i]->write(packet::PublishResponseEncoder(
+                                {packet::ControlPacket::Type::PUBACK,
+                                 pkt.first,
+                                 {}})
+                                .encode());
+    }
+  }
+
+  // nobody subscribed
+  publisher.publish(8, "sensors/1/humidity", 1, "40");
+  puback = publisher.readPubAck();
+  CHECK(puback.packetID == 8);
+  CHECK(puback.response.reasonCode ==
+        mqtt::PublishResponse::ReasonCode::NoMatchingSubscribers);
+
+  // every stage saw the PUBLISH, the subscribers on other workers than the
+  // publisher got it through the queue
+  CHECK(b.latency(broker::Stage::Decode).count() == 2);
+  CHECK(b.latency(broker::Stage::Match).count() == 2);
+  CHECK(b.latency(broker::Stage::Encode).count() == 4);
+  CHECK(b.latency(broker::Stage::Queue).count() >= 2);
+  CHECK(b.latency(broker::Stage::Framing).count() >= 2);
+  CHECK(b.latency(broker::Stage::Write).count() >= 4);
+  mqttutils::Histogram::Percentiles p =
+      b.latency(broker::Stage::Decode).percentiles();
+  CHECK(p.p50 > 0);
+  CHECK(p.p50 <= p.max);
+
+  // the workers traced the PUBLISH
+  test::TempPath tmp("mqtt-broker-trace");
+  REQUIRE(mqttutils::TraceRing::dump(tmp.path) == 0);
+  mqttutils::TraceDump dump;
+  REQUIRE(dump.read(tmp.path) == 0);
+  bool decoded = false;
+  bool matched = false;
+  size_t encoded = 0;
+  for (const auto& t : dump.threads) {
+    for (const auto& r : t.records) {
+      decoded |= r.event == mqttutils::TraceEvent::Decoded && r.packetID == 7;
+      matched |= r.event == mqttutils::TraceEvent::Matched && r.size == 4;
+      encoded += r.event == mqttutils::TraceEvent::Encoded &&
+                 r.packetType == uint8_t(packet::ControlPacket::Type::PUBLISH);
+    }
+  }
+  CHECK(decoded);
+  CHECK(matched);
+  CHECK(encoded >= 4);
+  b.stop();
+}
+
+TEST_CASE("testing broker subscription options and unsubscribe") {
+  broker::Broker b;
+  REQUIRE(b.start() == 0);
+
+  test::Client client(b.getPort());
+  client.connect("client");
+  client.subscribe(1, "a/#", 2, true);
+  client.subscribe(2, "a/b", 0, false, 42);
+
+  // no local skips a/#, the subscription identifier is forwarded
+  client.publish(3, "a/b", 1, "x");
+  auto pkt = client.readPublish();
+  CHECK(pkt.second.qosLevel == 0);
+  REQUIRE(pkt.second.properties);
+  CHECK(pkt.second.properties->subscriptionIdentifiers ==
+        std::vector<uint32_t>{42});
+  CHECK(client.readPubAck().packetID == 3);
+
+  mqtt::Unsubscribe u;
+  u.topicFilters = {"a/b", "c"};
+  client.write(packet::UnsubscribeEncoder({4, u}).encode());
+  auto unsuback = client.read();
+  REQUIRE(packet::ControlPacket::Type(unsuback.first >> 4) ==
+          packet::ControlPacket::Type::UNSUBACK);
+  auto ack = packet::UnsubAckDecoder::decode(unsuback.second);
+  CHECK(ack.first == 4);
+  REQUIRE(ack.second.reasonCodes.size() == 2);
+  CHECK(ack.second.reasonCodes[0] == mqtt::UnsubAck::ReasonCode::Success);
+  CHECK(ack.second.reasonCodes[1] ==
+        mqtt::UnsubAck::ReasonCode::NoSubscriptionExisted);
+
+  client.publish(5, "a/b", 1, "y");
+  auto puback = client.readPubAck();
+  CHECK(puback.packetID == 5);
+  CHECK(puback.response.reasonCode ==
+        mqtt::PublishResponse::ReasonCode::NoMatchingSubscribers);
+  b.stop();
+}
+
+TEST_CASE("testing broker topic alias from the client") {
+  broker::Broker b;
+  REQUIRE(b.start() == 0);
+
+  test::Client subscriber(b.getPort());
+  subscriber.connect("sub");
+  subscriber.subscribe(1, "alias/topic", 0);
+
+  test::Client publisher(b.getPort());
+  publisher.connect("pub");
+  mqtt::Publish p;
+  p.topicName = "alias/topic";
+  p.properties = std::make_shared<mqtt::Publish::Properties>();
+  p.properties->topicAlias = 1;
+  p.payload = {'1'};
+  publisher.write(packet::PublishEncoder({0, p}).encode());
+  p.topicName.clear();
+  p.payload = {'2'};
+  publisher.write(packet::PublishEncoder({0, p}).encode());
+
+  for (uint8_t expected : {'1', '2'}) {
+    auto pkt = subscriber.readPublish();
+    CHECK(pkt.second.topicName == "alias/topic");
+    CHECK(pkt.second.payload == std::vector<uint8_t>{expected});
+    // the alias is not forwarded
+    CHECK((!pkt.second.properties || !pkt.second.properties->topicAlias));
+  }
+  b.stop();
+}
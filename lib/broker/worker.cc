@@ -0,0 +1,816 @@
+#include "worker.h"
+#include "../bufferpool.h"
+#include "../messageexpiry.h"
+#include "../metrics.h"
+#include "../packet/codec.h"
+#include "../packet/connack.h"
+#include "../packet/connect.h"
+#include "../packet/packet.h"
+#include "../packet/ping.h"
+#include "../packet/publish.h"
+#include "../packet/publishresponse.h"
+#include "../packet/suback.h"
+#include "../packet/subscribe.h"
+#include "../packet/unsuback.h"
+#include "../packet/unsubscribe.h"
+#include "../probes.h"
+#include "../tracering.h"
+#include "broker.h"
+#include <algorithm>
+#include <cerrno>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+namespace broker {
+  Message::Message(const mqtt::Publish& publish, uint64_t receivedAt)
+      : qosLevel(publish.qosLevel),
+        expiresAt(mqttutils::MessageExpiry::deadline(publish, receivedAt)),
+        encoded(publish) {}
+
+  Route::Route(size_t workerA, uint64_t connectionIDA,
+               const mqtt::Subscription& subscription,
+               std::optional<uint32_t> subscriptionIDA)
+      : worker(workerA), connectionID(connectionIDA),
+        // QoS 2 is granted as QoS 1
+        qosLevel(std::min(subscription.qosLevel, uint8_t(1))),
+        noLocal(subscription.noLocal), subscriptionID(subscriptionIDA) {}
+
+  void Route::onData() {}
+
+  // SIGPIPE must not kill the process when a client goes away
+  static int sendFlags() {
+#ifdef MSG_NOSIGNAL
+    return MSG_NOSIGNAL;
+#else
+    return 0;
+#endif
+  }
+
+  // the metrics of all the brokers of the process, in the global registry
+  struct WorkerMetrics {
+    // by packet type
+    std::array<mqttutils::Counter*, 16> received;
+    std::array<mqttutils::Counter*, 16> sent;
+    mqttutils::Counter& bytesReceived;
+    mqttutils::Counter& bytesSent;
+    mqttutils::Gauge& connections;
+    mqttutils::Gauge& inflight;
+  };
+
+  static WorkerMetrics makeMetrics() {
+    mqttutils::MetricsRegistry& r = mqttutils::MetricsRegistry::global();
+    WorkerMetrics m{
+        {},
+        {},
+        r.counter("mqtt_broker_bytes_received_total",
+                  "Bytes received by the broker"),
+        r.counter("mqtt_broker_bytes_sent_total", "Bytes sent by the broker"),
+        r.gauge("mqtt_broker_connections", "Open connections of the broker"),
+        r.gauge("mqtt_broker_inflight",
+                "QoS 1 PUBLISH sent by the broker and not acknowledged")};
+    for (size_t i = 0; i < m.received.size(); ++i) {
+      const char* type =
+          packet::ControlPacket::name(packet::ControlPacket::Type(i));
+      m.received[i] = &r.counter("mqtt_broker_packets_received_total",
+                                 "Packets received by the broker",
+                                 {{"type", type}});
+      m.sent[i] = &r.counter("mqtt_broker_packets_sent_total",
+                             "Packets sent by the broker", {{"type", type}});
+    }
+    return m;
+  }
+
+  static WorkerMetrics& metrics() {
+    static WorkerMetrics m = makeMetrics();
+    return m;
+  }
+
+  // the clock of the latency histograms and of the trace
+  static uint64_t nanos() {
+    return mqttutils::TraceRing::now();
+  }
+
+  static void setNonBlocking(int fd) {
+    int flags = fcntl(fd, F_GETFL, 0);
+    fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+  }
+
+  Worker::Worker(Broker& brokerA, size_t indexA)
+      : broker(brokerA), index(indexA), wakeFds{-1, -1}, stopping(false),
+        wheel(brokerA.now()),
+        keepAlive(this->wheel,
+                  mqttutils::KeepAliveMonitor::Handler{
+                      // the broker does not ping
+                      [](uint64_t) {},
+                      [this](uint64_t connectionID) {
+                        auto it = this->connections.find(connectionID);
+                        if (it != this->connections.end()) {
+                          this->close(*it->second);
+                        }
+                      }}) {}
+
+  Worker::~Worker() {
+    this->stop();
+  }
+
+  int Worker::start() {
+    if (pipe(this->wakeFds) != 0) {
+      return errno;
+    }
+    setNonBlocking(this->wakeFds[0]);
+    this->thread = std::thread(&Worker::run, this);
+    return 0;
+  }
+
+  void Worker::stop() {
+    if (!this->thread.joinable()) {
+      return;
+    }
+    this->post([this] { this->stopping = true; });
+    this->thread.join();
+    ::close(this->wakeFds[0]);
+    ::close(this->wakeFds[1]);
+    this->wakeFds[0] = -1;
+    this->wakeFds[1] = -1;
+  }
+
+  void Worker::addConnection(int fd, uint64_t connectionID, bool tcp) {
+    this->post([this, fd, connectionID, tcp] {
+      this->accept(fd, connectionID, tcp);
+    });
+  }
+
+  void Worker::deliver(std::vector<Delivery> deliveries) {
+    this->post([this, deliveries = std::move(deliveries)] {
+      uint64_t now = nanos();
+      for (const auto& delivery : deliveries) {
+        this->record(Stage::Queue, delivery.queuedAt, now);
+        this->deliverLocal(delivery);
+      }
+    });
+  }
+
+  void Worker::closeConnection(uint64_t connectionID) {
+    this->post([this, connectionID] {
+      auto it = this->connections.find(connectionID);
+      if (it != this->connections.end()) {
+        this->close(*it->second);
+      }
+    });
+  }
+
+  const mqttutils::Histogram& Worker::latency(Stage stage) const {
+    return this->stages[static_cast<size_t>(stage)];
+  }
+
+  void Worker::record(Stage stage, uint64_t start, uint64_t end) {
+    this->stages[static_cast<size_t>(stage)].record(end - start);
+  }
+
+  void Worker::post(std::function<void()> task) {
+    bool wasEmpty = false;
+    {
+      std::lock_guard<std::mutex> guard(this->mux);
+      wasEmpty = this->tasks.empty();
+      this->tasks.emplace_back(std::move(task));
+      MQTT_PROBE2(queue__push, this, this->tasks.size());
+    }
+
+    // wake up the event loop when the task list was empty
+    if (wasEmpty) {
+      uint8_t b = 0;
+      while (write(this->wakeFds[1], &b, 1) == -1 && errno == EINTR) {
+      }
+    }
+  }
+
+  void Worker::runTasks() {
+    // drain the wake up pipe before taking the tasks, a task posted after
+    // the tasks are taken writes to the pipe again
+    uint8_t buffer[64];
+    while (read(this->wakeFds[0], buffer, sizeof(buffer)) > 0) {
+    }
+
+    std::vector<std::function<void()>> pending;
+    {
+      std::lock_guard<std::mutex> guard(this->mux);
+      pending.swap(this->tasks);
+    }
+    // the tasks are taken at once
+    MQTT_PROBE2(queue__pop, this, pending.size());
+    for (auto& task : pending) {
+      task();
+    }
+  }
+
+  void Worker::run() {
+    std::vector<pollfd> fds;
+    std::vector<Connection*> polled;
+    while (!this->stopping) {
+      fds.clear();
+      polled.clear();
+      fds.push_back(pollfd{this->wakeFds[0], POLLIN, 0});
+      for (auto& entry : this->connections) {
+        Connection& c = *entry.second;
+        short events = POLLIN;
+        if (!c.out.empty()) {
+          events |= POLLOUT;
+        }
+        fds.push_back(pollfd{c.fd, events, 0});
+        polled.push_back(&c);
+      }
+
+      int timeout = -1;
+      auto next = this->wheel.ticksUntilNext();
+      if (next) {
+        timeout = static_cast<int>(std::min(*next, uint64_t(1000)));
+      }
+      if (poll(fds.data(), fds.size(), timeout) < 0 && errno != EINTR) {
+        break;
+      }
+
+      this->wheel.advance(this->broker.now());
+      for (size_t i = 0; i < polled.size(); ++i) {
+        Connection& c = *polled[i];
+        short revents = fds[i + 1].revents;
+        if (!c.closing && (revents & POLLOUT)) {
+          this->writable(c);
+        }
+        if (!c.closing && (revents & (POLLIN | POLLHUP | POLLERR))) {
+          this->readable(c);
+        }
+      }
+
+      if (fds[0].revents & POLLIN) {
+        this->runTasks();
+      }
+
+      for (auto it = this->connections.begin();
+           it != this->connections.end();) {
+        if (it->second->closing) {
+          it = this->connections.erase(it);
+        } else {
+          ++it;
+        }
+      }
+    }
+
+    for (auto& entry : this->connections) {
+      this->close(*entry.second);
+    }
+    this->connections.clear();
+  }
+
+  void Worker::accept(int fd, uint64_t connectionID, bool tcp) {
+    setNonBlocking(fd);
+    int on = 1;
+    if (tcp) {
+      setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+    }
+#ifdef SO_NOSIGPIPE
+    setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &on, sizeof(on));
+#endif
+
+    auto c = std::make_unique<Connection>();
+    c->id = connectionID;
+    c->fd = fd;
+    c->connected = false;
+    c->closing = false;
+    c->outOffset = 0;
+    c->outBytes = 0;
+    c->nextPacketID = 0;
+    c->receiveMaximum = UINT16_MAX;
+    c->maximumPacketSize = UINT32_MAX;
+    c->connectTimer = this->wheel.scheduleAfter(
+        uint64_t(this->broker.options.connectTimeout) * 1000,
+        [this, connectionID] {
+          auto it = this->connections.find(connectionID);
+          if (it != this->connections.end() && !it->second->connected) {
+            this->close(*it->second);
+          }
+        });
+    this->connections[connectionID] = std::move(c);
+    metrics().connections.add(1);
+  }
+
+  void Worker::readable(Connection& c) {
+    uint8_t buffer[16384];
+    for (;;) {
+      ssize_t n = recv(c.fd, buffer, sizeof(buffer), 0);
+      if (n > 0) {
+        metrics().bytesReceived.add(static_cast<size_t>(n));
+        c.in.insert(c.in.end(), buffer, buffer + n);
+        if (static_cast<size_t>(n) < sizeof(buffer)) {
+          break;
+        }
+      } else if (n == 0) {
+        this->close(c);
+        return;
+      } else if (errno == EINTR) {
+        continue;
+      } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+        break;
+      } else {
+        this->close(c);
+        return;
+      }
+    }
+
+    size_t offset = 0;
+    while (!c.closing) {
+      uint64_t start = nanos();
+      packet::FixedHeader fhdr;
+      size_t headerLen = 0;
+      auto result = packet::FixedHeaderReader::parse(
+          c.in.data() + offset, c.in.size() - offset, fhdr, headerLen);
+      if (result == packet::FixedHeaderReader::Result::Incomplete) {
+        break;
+      }
+      if (result == packet::FixedHeaderReader::Result::Malformed ||
+          fhdr.second > this->broker.options.maximumPacketSize) {
+        this->close(c);
+        return;
+      }
+      if (c.in.size() - offset - headerLen < fhdr.second) {
+        // wait for the rest of the packet
+        break;
+      }
+
+      // the packet is decoded in place, its properties come from the arena
+      packet::Decoder dec(c.in.data() + offset + headerLen, fhdr.second,
+                          &this->arena);
+      offset += headerLen + fhdr.second;
+      uint64_t framed = nanos();
+      this->record(Stage::Framing, start, framed);
+      mqttutils::TraceRing::local().record(
+          mqttutils::TraceEvent::FrameReceived, fhdr.first >> 4, 0,
+          static_cast<uint32_t>(headerLen + fhdr.second), framed);
+
+      this->keepAlive.packetReceived(c.id, this->wheel.now());
+      // malformed packets are rejected by the decoders without throwing
+      bool ok = this->dispatch(c, fhdr.first, dec, fhdr.second);
+      this->arena.reset();
+      if (!ok) {
+        this->close(c);
+        return;
+      }
+    }
+    c.in.erase(c.in.begin(), c.in.begin() + static_cast<std::ptrdiff_t>(offset));
+  }
+
+  // slices fills iov with the parts of out that are left after offset
+  // bytes, a PUBLISH has the fixed header, the shared topic, the variable
+  // header and the shared properties and payload. Returns the count
+  static size_t slices(const uint8_t* data, size_t size, size_t& offset,
+                       iovec* iov, size_t count) {
+    if (offset >= size) {
+      offset -= size;
+      return count;
+    }
+    iov[count].iov_base = const_cast<uint8_t*>(data + offset);
+    iov[count].iov_len = size - offset;
+    offset = 0;
+    return count + 1;
+  }
+
+  void Worker::writable(Connection& c) {
+    // up to maxSlices parts of the queued packets are written in one call
+    constexpr size_t maxSlices = 64;
+    iovec iov[maxSlices];
+    while (!c.out.empty()) {
+      size_t count = 0;
+      size_t offset = c.outOffset;
+      for (auto it = c.out.begin();
+           it != c.out.end() && count + 4 <= maxSlices; ++it) {
+        if (!it->message) {
+          count = slices(it->data.data(), it->data.size(), offset, iov, count);
+          continue;
+        }
+        const packet::SharedPublish& encoded = it->message->encoded;
+        const uint8_t* header = it->header.bytes.data();
+        count = slices(header, it->header.fixedLen, offset, iov, count);
+        count = slices(encoded.topic().data(), encoded.topic().size(), offset,
+                       iov, count);
+        count = slices(header + it->header.fixedLen, it->header.variableLen,
+                       offset, iov, count);
+        count = slices(encoded.rest().data(), encoded.rest().size(), offset,
+                       iov, count);
+      }
+
+      msghdr msg = {};
+      msg.msg_iov = iov;
+      msg.msg_iovlen = static_cast<decltype(msg.msg_iovlen)>(count);
+      uint64_t start = nanos();
+      ssize_t n = sendmsg(c.fd, &msg, sendFlags());
+      uint64_t end = nanos();
+      this->record(Stage::Write, start, end);
+      if (n > 0) {
+        const Outbound& front = c.out.front();
+        uint8_t type = front.message
+                           ? uint8_t(packet::ControlPacket::Type::PUBLISH)
+                           : uint8_t(front.data[0] >> 4);
+        mqttutils::TraceRing::local().record(mqttutils::TraceEvent::Written,
+                                             type, 0,
+                                             static_cast<uint32_t>(n), end);
+      }
+      if (n < 0) {
+        if (errno == EINTR) {
+          continue;
+        }
+        if (errno != EAGAIN && errno != EWOULDBLOCK) {
+          this->close(c);
+        }
+        return;
+      }
+
+      size_t written = static_cast<size_t>(n);
+      metrics().bytesSent.add(written);
+      c.outBytes -= written;
+      written += c.outOffset;
+      while (!c.out.empty() && written >= c.out.front().size) {
+        written -= c.out.front().size;
+        if (c.out.front().data.capacity() > 0) {
+          // the encoders draw their buffers from the pool of this thread
+          mqttutils::BufferPool::local().release(
+              std::move(c.out.front().data));
+        }
+        c.out.pop_front();
+      }
+      c.outOffset = written;
+    }
+  }
+
+  void Worker::send(Connection& c, std::vector<uint8_t> data) {
+    mqttutils::TraceRing::local().record(
+        mqttutils::TraceEvent::Encoded, data[0] >> 4, 0,
+        static_cast<uint32_t>(data.size()), nanos());
+    Outbound out;
+    out.size = data.size();
+    out.data = std::move(data);
+    this->send(c, std::move(out));
+  }
+
+  void Worker::send(Connection& c, Outbound out) {
+    if (c.closing) {
+      return;
+    }
+    uint8_t type = out.message ? uint8_t(packet::ControlPacket::Type::PUBLISH)
+                               : uint8_t(out.data[0] >> 4);
+    metrics().sent[type]->add();
+    c.outBytes += out.size;
+    c.out.emplace_back(std::move(out));
+    if (c.out.size() == 1) {
+      // nothing queued before, try to write right away
+      this->writable(c);
+    }
+  }
+
+  void Worker::close(Connection& c) {
+    if (c.closing) {
+      return;
+    }
+    c.closing = true;
+    metrics().connections.add(-1);
+    metrics().inflight.add(-static_cast<int64_t>(c.inflight.size()));
+
+    for (const auto& entry : c.routes) {
+      this->broker.matcher.unsubscribe(entry.first, entry.second);
+    }
+    c.routes.clear();
+    if (c.connected) {
+      this->broker.unregisterClient(c.clientID, c.id);
+    }
+    this->keepAlive.remove(c.id);
+    this->wheel.cancel(c.connectTimer);
+    ::close(c.fd);
+    c.fd = -1;
+  }
+
+  bool Worker::dispatch(Connection& c, uint8_t byte0, packet::Decoder& dec,
+                        uint32_t remainingLen) {
+    auto type = static_cast<packet::ControlPacket::Type>(byte0 >> 4);
+    metrics().received[byte0 >> 4]->add();
+    if (!c.connected && type != packet::ControlPacket::Type::CONNECT) {
+      // the first packet must be CONNECT
+      return false;
+    }
+
+    switch (type) {
+    case packet::ControlPacket::Type::CONNECT:
+      return !c.connected && this->onConnect(c, dec);
+    case packet::ControlPacket::Type::PUBLISH:
+      return this->onPublish(c, byte0, dec, remainingLen);
+    case packet::ControlPacket::Type::PUBACK:
+      return this->onPubAck(c, dec, remainingLen);
+    case packet::ControlPacket::Type::SUBSCRIBE:
+      return this->onSubscribe(c, dec, remainingLen);
+    case packet::ControlPacket::Type::UNSUBSCRIBE:
+      return this->onUnsubscribe(c, dec, remainingLen);
+    case packet::ControlPacket::Type::PINGREQ:
+      if (packet::PingDecoder::decode(byte0, remainingLen, type)) {
+        return false;
+      }
+      this->send(c, packet::PingEncoder::encode(
+                        packet::ControlPacket::Type::PINGRESP));
+      return true;
+    default:
+      // DISCONNECT closes the connection, QoS 2 and AUTH are not supported
+      return false;
+    }
+  }
+
+  bool Worker::onConnect(Connection& c, packet::Decoder& dec) {
+    mqtt::Connect connect;
+    if (packet::ConnectDecoder::decode(dec, connect)) {
+      return false;
+    }
+
+    mqtt::ConnAck ca;
+    ca.properties = std::make_shared<mqtt::ConnAck::Properties>();
+    c.clientID = connect.clientID;
+    if (c.clientID.empty()) {
+      c.clientID = "auto-" + std::to_string(c.id);
+      ca.properties->assignedClientIdentifier = c.clientID;
+    }
+    if (connect.properties) {
+      if (connect.properties->receiveMaximum) {
+        if (*connect.properties->receiveMaximum == 0) {
+          return false;
+        }
+        c.receiveMaximum = *connect.properties->receiveMaximum;
+      }
+      if (connect.properties->maximumPacketSize) {
+        c.maximumPacketSize = *connect.properties->maximumPacketSize;
+      }
+    }
+
+    const Broker::Options& options = this->broker.options;
+    ca.properties->maximumQoS = 1;
+    ca.properties->retainAvailable = false;
+    ca.properties->maximumPacketSize = options.maximumPacketSize;
+    if (options.topicAliasMaximum > 0) {
+      ca.properties->topicAliasMaximum = options.topicAliasMaximum;
+    }
+    c.aliases.setAliasMaximum(options.topicAliasMaximum);
+
+    c.connected = true;
+    this->wheel.cancel(c.connectTimer);
+    this->broker.registerClient(c.clientID, this->index, c.id);
+    this->keepAlive.add(c.id, connect.keepAlive, false, this->wheel.now());
+    this->send(c, packet::ConnAckEncoder(ca).encode());
+    return true;
+  }
+
+  bool Worker::onPublish(Connection& c, uint8_t byte0, packet::Decoder& dec,
+                         uint32_t remainingLen) {
+    uint64_t start = nanos();
+    packet::PublishPacket pkt;
+    if (packet::PublishDecoder::decode(dec, byte0, remainingLen, pkt)) {
+      return false;
+    }
+    uint64_t decoded = nanos();
+    this->record(Stage::Decode, start, decoded);
+    mqttutils::TraceRing::local().record(
+        mqttutils::TraceEvent::Decoded,
+        uint8_t(packet::ControlPacket::Type::PUBLISH), pkt.first, remainingLen,
+        decoded);
+    mqtt::Publish& p = pkt.second;
+
+    // QoS 2 is above the Maximum QoS sent in CONNACK
+    if (p.qosLevel > 1 || c.aliases.resolve(p) || p.topicName.empty() ||
+        mqttutils::TopicUtils::validatePublishTopic(p.topicName)) {
+      return false;
+    }
+
+    // the topic alias is scoped to the connection, retain is not supported
+    if (p.properties) {
+      p.properties->topicAlias.reset();
+    }
+    p.hasRetain = false;
+    p.isDup = false;
+
+    auto message = std::make_shared<const Message>(p, this->wheel.now());
+    size_t deliveries = this->route(c, p.topicName, message);
+
+    if (p.qosLevel == 1) {
+      packet::PublishResponsePacket ack{
+          packet::ControlPacket::Type::PUBACK, pkt.first, {}};
+      if (deliveries == 0) {
+        ack.response.reasonCode =
+            mqtt::PublishResponse::ReasonCode::NoMatchingSubscribers;
+      }
+      this->send(c, packet::PublishResponseEncoder(ack).encode());
+    }
+    return true;
+  }
+
+  bool Worker::onPubAck(Connection& c, packet::Decoder& dec,
+                        uint32_t remainingLen) {
+    packet::PublishResponsePacket ack;
+    if (packet::PublishResponseDecoder::decode(
+            dec, packet::ControlPacket::Type::PUBACK, remainingLen, ack)) {
+      return false;
+    }
+    if (c.inflight.erase(ack.packetID) != 0) {
+      metrics().inflight.add(-1);
+    }
+
+    // the receive maximum allows more messages
+    while (!c.pending.empty() && c.inflight.size() < c.receiveMaximum) {
+      Delivery delivery = std::move(c.pending.front());
+      c.pending.pop_front();
+      this->sendPublish(c, delivery);
+    }
+    return true;
+  }
+
+  bool Worker::onSubscribe(Connection& c, packet::Decoder& dec,
+                           uint32_t remainingLen) {
+    packet::SubscribePacket pkt;
+    if (packet::SubscribeDecoder::decode(dec, remainingLen, pkt)) {
+      return false;
+    }
+
+    std::optional<uint32_t> subscriptionID;
+    if (pkt.second.properties) {
+      subscriptionID = pkt.second.properties->subscriptionIdentifier;
+    }
+
+    // built in place, the encoder borrows it
+    packet::SubAckPacket ack{pkt.first, {}};
+    mqtt::SubAck& suback = ack.second;
+    for (const auto& s : pkt.second.subscriptions) {
+      if (mqttutils::TopicUtils::validateSubscribeTopic(s.topicFilter)) {
+        suback.reasonCodes.push_back(
+            mqtt::SubAck::ReasonCode::TopicFilterInvalid);
+        continue;
+      }
+
+      // a subscription with the same topic filter replaces the existing one
+      auto route =
+          std::make_shared<Route>(this->index, c.id, s, subscriptionID);
+      auto it = c.routes.find(s.topicFilter);
+      if (it != c.routes.end()) {
+        this->broker.matcher.unsubscribe(s.topicFilter, it->second);
+      }
+      this->broker.matcher.subscribe(s.topicFilter, route);
+      c.routes[s.topicFilter] = route;
+      suback.reasonCodes.push_back(route->qosLevel == 0
+                                       ? mqtt::SubAck::ReasonCode::GrantedQoS0
+                                       : mqtt::SubAck::ReasonCode::GrantedQoS1);
+    }
+
+    this->send(c, packet::SubAckEncoder(ack).encode());
+    return true;
+  }
+
+  bool Worker::onUnsubscribe(Connection& c, packet::Decoder& dec,
+                             uint32_t remainingLen) {
+    packet::UnsubscribePacket pkt;
+    if (packet::UnsubscribeDecoder::decode(dec, remainingLen, pkt)) {
+      return false;
+    }
+
+    packet::UnsubAckPacket ack{pkt.first, {}};
+    mqtt::UnsubAck& unsuback = ack.second;
+    for (const auto& topicFilter : pkt.second.topicFilters) {
+      auto it = c.routes.find(topicFilter);
+      if (it == c.routes.end()) {
+        unsuback.reasonCodes.push_back(
+            mqtt::UnsubAck::ReasonCode::NoSubscriptionExisted);
+        continue;
+      }
+      this->broker.matcher.unsubscribe(topicFilter, it->second);
+      c.routes.erase(it);
+      unsuback.reasonCodes.push_back(mqtt::UnsubAck::ReasonCode::Success);
+    }
+
+    this->send(c, packet::UnsubAckEncoder(ack).encode());
+    return true;
+  }
+
+  // route matches the message against the subscriptions and hands the
+  // deliveries to the workers owning the subscribers, one task per worker.
+  // Returns the number of deliveries
+  size_t Worker::route(const Connection& publisher, const std::string& topic,
+                       std::shared_ptr<const Message> message) {
+    uint64_t start = nanos();
+    mqtt::Subscribers subscribers = this->broker.matcher.match(topic);
+    uint64_t matched = nanos();
+    this->record(Stage::Match, start, matched);
+    mqttutils::TraceRing::local().record(
+        mqttutils::TraceEvent::Matched,
+        uint8_t(packet::ControlPacket::Type::PUBLISH), 0,
+        static_cast<uint32_t>(subscribers.size()), matched);
+
+    std::vector<std::vector<Delivery>> perWorker(this->broker.workers.size());
+    size_t count = 0;
+    for (const auto& subscriber : subscribers) {
+      const Route& r = static_cast<const Route&>(*subscriber);
+      if (r.noLocal && r.connectionID == publisher.id) {
+        continue;
+      }
+      perWorker[r.worker].push_back(
+          Delivery{r.connectionID,
+                   std::min(r.qosLevel, message->qosLevel),
+                   r.subscriptionID,
+                   message,
+                   matched});
+      ++count;
+    }
+
+    for (size_t i = 0; i < perWorker.size(); ++i) {
+      if (perWorker[i].empty()) {
+        continue;
+      }
+      if (i == this->index) {
+        for (const auto& delivery : perWorker[i]) {
+          this->deliverLocal(delivery);
+        }
+      } else {
+        mqttutils::TraceRing::local().record(
+            mqttutils::TraceEvent::Enqueued,
+            uint8_t(packet::ControlPacket::Type::PUBLISH), 0,
+            static_cast<uint32_t>(perWorker[i].size()), nanos());
+        this->broker.workers[i]->deliver(std::move(perWorker[i]));
+      }
+    }
+    return count;
+  }
+
+  void Worker::deliverLocal(const Delivery& delivery) {
+    auto it = this->connections.find(delivery.connectionID);
+    if (it == this->connections.end() || it->second->closing) {
+      return;
+    }
+
+    Connection& c = *it->second;
+    if (delivery.qosLevel > 0 && c.inflight.size() >= c.receiveMaximum) {
+      c.pending.push_back(delivery);
+      return;
+    }
+    this->sendPublish(c, delivery);
+  }
+
+  void Worker::sendPublish(Connection& c, const Delivery& delivery) {
+    if (delivery.qosLevel == 0 &&
+        c.outBytes > this->broker.options.maxOutboundBytes) {
+      // slow subscriber
+      return;
+    }
+
+    const Message& message = *delivery.message;
+    std::optional<uint32_t> expiryInterval;
+    if (message.expiresAt) {
+      uint64_t now = this->wheel.now();
+      if (now >= *message.expiresAt) {
+        // expired while queued
+        return;
+      }
+      // the interval is set to the lifetime that is left, rounded up
+      expiryInterval =
+          static_cast<uint32_t>((*message.expiresAt - now + 999) / 1000);
+    }
+
+    uint16_t packetID = 0;
+    if (delivery.qosLevel > 0) {
+      packetID = this->allocPacketID(c);
+    }
+
+    uint64_t start = nanos();
+    Outbound out;
+    out.header = message.encoded.header(delivery.qosLevel, false, packetID,
+                                        expiryInterval,
+                                        delivery.subscriptionID);
+    out.size = message.encoded.size(out.header);
+    uint64_t encoded = nanos();
+    this->record(Stage::Encode, start, encoded);
+    mqttutils::TraceRing::local().record(
+        mqttutils::TraceEvent::Encoded,
+        uint8_t(packet::ControlPacket::Type::PUBLISH), packetID,
+        static_cast<uint32_t>(out.size), encoded);
+    if (out.size > c.maximumPacketSize) {
+      // the client does not accept packets of this size, the message is
+      // discarded
+      return;
+    }
+    if (packetID != 0) {
+      c.inflight.insert(packetID);
+      metrics().inflight.add(1);
+    }
+    out.message = delivery.message;
+    this->send(c, std::move(out));
+  }
+
+  uint16_t Worker::allocPacketID(Connection& c) {
+    do {
+      ++c.nextPacketID;
+    } while (c.nextPacketID == 0 || c.inflight.count(c.nextPacketID) != 0);
+    return c.nextPacketID;
+  }
+} // namespace broker
@@ -0,0 +1,162 @@
+#pragma once
+
+#include "../arena.h"
+#include "../histogram.h"
+#include "../keepalive.h"
+#include "../packet/publish.h"
+#include "../timerwheel.h"
+#include "../topicalias.h"
+#include "broker.h"
+#include "mqtt/mqtt.h"
+#include "mqtt/noncopyable.h"
+#include "mqtt/publish.h"
+#include "mqtt/subscribe.h"
+#include <array>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace broker {
+
+  // Message is a PUBLISH received by the broker, shared by all deliveries.
+  // The PUBLISH is encoded once, deliveries only encode a PublishHeader
+  struct Message {
+    Message(const mqtt::Publish& publish, uint64_t receivedAt);
+
+    const uint8_t qosLevel;
+    const std::optional<uint64_t> expiresAt;
+    const packet::SharedPublish encoded;
+  };
+
+  struct Delivery {
+    uint64_t connectionID;
+    uint8_t qosLevel;
+    std::optional<uint32_t> subscriptionID;
+    std::shared_ptr<const Message> message;
+    // nanoseconds, when the delivery was handed to the worker
+    uint64_t queuedAt;
+  };
+
+  // Route is the subscriber stored in the TopicMatcher for a subscription of
+  // a connection. The broker does the routing, onData is not used.
+  class Route : public mqtt::Subscriber {
+  public:
+    Route(size_t worker, uint64_t connectionID,
+          const mqtt::Subscription& subscription,
+          std::optional<uint32_t> subscriptionID);
+    void onData() override final;
+
+    const size_t worker;
+    const uint64_t connectionID;
+    const uint8_t qosLevel;
+    const bool noLocal;
+    const std::optional<uint32_t> subscriptionID;
+  };
+
+  // Worker runs the event loop of a share of the connections. The public
+  // functions are thread safe, they post a task to the worker thread.
+  class Worker : private mqtt::noncopyable {
+  public:
+    Worker(Broker& broker, size_t index);
+    ~Worker();
+
+    int start();
+    void stop();
+
+    // tcp is false for the connections of the AF_UNIX listener
+    void addConnection(int fd, uint64_t connectionID, bool tcp);
+    void deliver(std::vector<Delivery> deliveries);
+    void closeConnection(uint64_t connectionID);
+
+    // written by the worker thread only, readable from any thread
+    const mqttutils::Histogram& latency(Stage stage) const;
+
+  private:
+    // Outbound is a queued packet, either encoded in data or a PUBLISH made
+    // of the per recipient header and the shared encoding of the message
+    struct Outbound {
+      std::vector<uint8_t> data;
+      packet::PublishHeader header{};
+      std::shared_ptr<const Message> message;
+      size_t size;
+    };
+
+    struct Connection {
+      uint64_t id;
+      int fd;
+      bool connected;
+      bool closing;
+      std::string clientID;
+      std::vector<uint8_t> in;
+      std::deque<Outbound> out;
+      // bytes of out.front() already written
+      size_t outOffset;
+      size_t outBytes;
+      // topic filter -> route
+      std::map<std::string, std::shared_ptr<Route>> routes;
+      mqttutils::TopicAliasResolver aliases;
+      uint16_t nextPacketID;
+      uint16_t receiveMaximum;
+      uint32_t maximumPacketSize;
+      std::unordered_set<uint16_t> inflight;
+      // QoS 1 deliveries waiting for the receive maximum
+      std::deque<Delivery> pending;
+      mqttutils::TimerWheel::TimerID connectTimer;
+    };
+
+    void post(std::function<void()> task);
+    void run();
+    void runTasks();
+
+    void accept(int fd, uint64_t connectionID, bool tcp);
+    void readable(Connection& c);
+    void writable(Connection& c);
+    void close(Connection& c);
+    void send(Connection& c, std::vector<uint8_t> data);
+    void send(Connection& c, Outbound out);
+
+    // returns false when the connection must be closed
+    bool dispatch(Connection& c, uint8_t byte0, packet::Decoder& dec,
+                  uint32_t remainingLen);
+    bool onConnect(Connection& c, packet::Decoder& dec);
+    bool onPublish(Connection& c, uint8_t byte0, packet::Decoder& dec,
+                   uint32_t remainingLen);
+    bool onPubAck(Connection& c, packet::Decoder& dec, uint32_t remainingLen);
+    bool onSubscribe(Connection& c, packet::Decoder& dec,
+                     uint32_t remainingLen);
+    bool onUnsubscribe(Connection& c, packet::Decoder& dec,
+                       uint32_t remainingLen);
+
+    size_t route(const Connection& publisher, const std::string& topic,
+                 std::shared_ptr<const Message> message);
+    void deliverLocal(const Delivery& delivery);
+    void sendPublish(Connection& c, const Delivery& delivery);
+    uint16_t allocPacketID(Connection& c);
+    void record(Stage stage, uint64_t start, uint64_t end);
+
+  private:
+    Broker& broker;
+    const size_t index;
+    std::thread thread;
+    int wakeFds[2];
+    bool stopping;
+
+    std::mutex mux;
+    std::vector<std::function<void()>> tasks;
+
+    // state below is only touched by the worker thread
+    std::unordered_map<uint64_t, std::unique_ptr<Connection>> connections;
+    mqttutils::TimerWheel wheel;
+    mqttutils::KeepAliveMonitor keepAlive;
+    // objects decoded from an inbound packet, reset after the dispatch
+    mqttutils::Arena arena;
+    std::array<mqttutils::Histogram, stageCount> stages;
+  };
+} // namespace broker
@@ -0,0 +1,68 @@
+#include "bufferpool.h"
+
+namespace mqttutils {
+  BufferPool::BufferPool(size_t maxPerClassA)
+      : maxPerClass(maxPerClassA), counters{0, 0, 0, 0} {}
+
+  BufferPool& BufferPool::local() {
+    static thread_local BufferPool pool;
+    return pool;
+  }
+
+  std::vector<uint8_t> BufferPool::acquire(size_t size) {
+    std::vector<uint8_t> buffer;
+    for (size_t i = 0; i < classCount; ++i) {
+      if (size > classSizes[i]) {
+        continue;
+      }
+      if (!this->free[i].empty()) {
+        buffer = std::move(this->free[i].back());
+        this->free[i].pop_back();
+        this->counters.hits++;
+        return buffer;
+      }
+      size = classSizes[i];
+      break;
+    }
+    this->counters.misses++;
+    buffer.reserve(size);
+    return buffer;
+  }
+
+  void BufferPool::release(std::vector<uint8_t>&& buffer) {
+    // the largest class the capacity covers, a buffer grown past the
+    // largest class would pin its memory in the pool
+    size_t capacity = buffer.capacity();
+    if (capacity > classSizes.back()) {
+      this->counters.dropped++;
+      buffer = std::vector<uint8_t>();
+      return;
+    }
+    for (size_t i = classCount; i-- > 0;) {
+      if (capacity < classSizes[i]) {
+        continue;
+      }
+      if (this->free[i].size() < this->maxPerClass) {
+        buffer.clear();
+        this->free[i].emplace_back(std::move(buffer));
+        this->counters.recycled++;
+        return;
+      }
+      break;
+    }
+    this->counters.dropped++;
+    buffer = std::vector<uint8_t>();
+  }
+
+  BufferPool::Stats BufferPool::stats() const {
+    return this->counters;
+  }
+
+  size_t BufferPool::size() const {
+    size_t n = 0;
+    for (const auto& f : this->free) {
+      n += f.size();
+    }
+    return n;
+  }
+} // namespace mqttutils
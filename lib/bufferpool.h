@@ -0,0 +1,50 @@
+#pragma once
+
+#include "mqtt/noncopyable.h"
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace mqttutils {
+  // BufferPool recycles the buffers of encoded packets. The buffers are kept
+  // in size classes, acquire hands out an empty buffer of the smallest class
+  // that fits, release takes a buffer back once it is written. Buffers
+  // larger than the largest class are not pooled.
+  //
+  // The packet encoders draw from the pool of the calling thread, local().
+  // Not thread safe, a buffer should be released on the thread that
+  // acquired it.
+  class BufferPool : private mqtt::noncopyable {
+  public:
+    struct Stats {
+      // acquire served from the pool
+      uint64_t hits;
+      // acquire that allocated
+      uint64_t misses;
+      // buffers taken back and dropped by release
+      uint64_t recycled;
+      uint64_t dropped;
+    };
+
+    static constexpr size_t classCount = 6;
+    static constexpr std::array<size_t, classCount> classSizes{
+        64, 256, 1024, 4096, 16384, 65536};
+
+    explicit BufferPool(size_t maxPerClass = 64);
+
+    static BufferPool& local();
+
+    std::vector<uint8_t> acquire(size_t size);
+    void release(std::vector<uint8_t>&& buffer);
+
+    Stats stats() const;
+    // buffers waiting in the pool
+    size_t size() const;
+
+  private:
+    const size_t maxPerClass;
+    std::array<std::vector<std::vector<uint8_t>>, classCount> free;
+    Stats counters;
+  };
+} // namespace mqttutils
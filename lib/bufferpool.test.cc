@@ -0,0 +1,63 @@
+#include "bufferpool.h"
+#include "doctest/doctest.h"
+#include "packet/publish.h"
+
+TEST_CASE("testing buffer pool size classes") {
+  mqttutils::BufferPool pool(2);
+  std::vector<uint8_t> b = pool.acquire(100);
+  CHECK(b.empty());
+  CHECK(b.capacity() >= 256);
+  const uint8_t* data = b.data();
+  b.assign(100, 1);
+  pool.release(std::move(b));
+  CHECK(pool.size() == 1);
+
+  // a smaller request of the same class gets the buffer back, cleared
+  std::vector<uint8_t> c = pool.acquire(200);
+  CHECK(c.empty());
+  CHECK(c.data() == data);
+  // another class misses
+  std::vector<uint8_t> d = pool.acquire(2000);
+  CHECK(d.capacity() >= 4096);
+
+  mqttutils::BufferPool::Stats s = pool.stats();
+  CHECK(s.hits == 1);
+  CHECK(s.misses == 2);
+  CHECK(s.recycled == 1);
+
+  // too small to be pooled, then the class is full
+  pool.release(std::vector<uint8_t>(10));
+  pool.release(std::move(c));
+  pool.release(std::vector<uint8_t>(300));
+  pool.release(std::vector<uint8_t>(300));
+  s = pool.stats();
+  CHECK(s.dropped == 2);
+  CHECK(pool.size() == 2);
+
+  // larger than the largest class
+  std::vector<uint8_t> e = pool.acquire(100000);
+  CHECK(e.capacity() >= 100000);
+  CHECK(pool.stats().misses == 3);
+  // and not taken back
+  pool.release(std::vector<uint8_t>(100000));
+  CHECK(pool.stats().dropped == 3);
+  CHECK(pool.size() == 2);
+}
+
+TEST_CASE("testing encoders draw from the thread buffer pool") {
+  mqtt::Publish p;
+  p.topicName = "a/b";
+  p.payload.assign(500, 'x');
+  mqttutils::BufferPool& pool = mqttutils::BufferPool::local();
+
+  std::vector<uint8_t> first = packet::PublishEncoder({0, p}).encode();
+  const uint8_t* data = first.data();
+  pool.release(std::move(first));
+
+  const mqttutils::BufferPool::Stats before = pool.stats();
+  std::vector<uint8_t> second = packet::PublishEncoder({0, p}).encode();
+  CHECK(pool.stats().hits == before.hits + 1);
+  CHECK(second.data() == data);
+  CHECK(second.size() == 500 + 2 + 3 + 1 + 2 + 1);
+  pool.release(std::move(second));
+}
@@ -0,0 +1,189 @@
+#include "capture.h"
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+
+namespace mqttutils {
+  static const char magic[8] = {'M', 'Q', 'T', 'T', 'C', 'A', 'P', 'T'};
+  static constexpr uint8_t version = 1;
+
+  static uint64_t nanos() {
+    return static_cast<uint64_t>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch())
+            .count());
+  }
+
+  // 7 bits per byte, low bits first, up to 10 bytes
+  static size_t putVarUint64(uint64_t value, uint8_t* out) {
+    size_t n = 0;
+    while (value >= 0x80) {
+      out[n++] = static_cast<uint8_t>(value | 0x80);
+      value >>= 7;
+    }
+    out[n++] = static_cast<uint8_t>(value);
+    return n;
+  }
+
+  // returns the bytes read, 0 when the value runs past size
+  static size_t getVarUint64(const uint8_t* data, size_t size,
+                             uint64_t& value) {
+    value = 0;
+    for (size_t i = 0; i < size && i < 10; ++i) {
+      value |= uint64_t(data[i] & 0x7F) << (7 * i);
+      if ((data[i] & 0x80) == 0) {
+        return i + 1;
+      }
+    }
+    return 0;
+  }
+
+  int Capture::read(const std::string& path) {
+    FILE* f = fopen(path.c_str(), "rb");
+    if (f == nullptr) {
+      return errno;
+    }
+    std::vector<uint8_t> in;
+    uint8_t buffer[65536];
+    size_t n = 0;
+    while ((n = fread(buffer, 1, sizeof(buffer), f)) > 0) {
+      in.insert(in.end(), buffer, buffer + n);
+    }
+    fclose(f);
+
+    this->frames.clear();
+    if (in.size() < sizeof(magic) + 1 ||
+        !std::equal(magic, magic + sizeof(magic), in.begin()) ||
+        in[sizeof(magic)] != version) {
+      return EINVAL;
+    }
+
+    size_t offset = sizeof(magic) + 1;
+    uint64_t time = 0;
+    while (offset < in.size()) {
+      uint8_t direction = in[offset++];
+      uint64_t delta = 0;
+      uint64_t length = 0;
+      size_t n1 = getVarUint64(in.data() + offset, in.size() - offset, delta);
+      size_t n2 = n1 == 0 ? 0
+                          : getVarUint64(in.data() + offset + n1,
+                                         in.size() - offset - n1, length);
+      if (direction > 1 || n1 == 0 || n2 == 0 ||
+          in.size() - offset - n1 - n2 < length) {
+        break;
+      }
+      offset += n1 + n2;
+      time += delta;
+      const uint8_t* bytes = in.data() + offset;
+      this->frames.push_back(Frame{time, static_cast<Direction>(direction),
+                                   std::vector<uint8_t>(bytes, bytes + length)});
+      offset += static_cast<size_t>(length);
+    }
+    return 0;
+  }
+
+  CaptureWriter::CaptureWriter() : file(nullptr), start(0), last(0), err(0) {}
+
+  CaptureWriter::~CaptureWriter() {
+    this->close();
+  }
+
+  int CaptureWriter::open(const std::string& path) {
+    std::lock_guard<std::mutex> guard(this->mux);
+    if (this->file != nullptr) {
+      return 0;
+    }
+    this->file = fopen(path.c_str(), "wb");
+    if (this->file == nullptr) {
+      return errno;
+    }
+    this->err = 0;
+    this->start = nanos();
+    this->last = 0;
+    if (fwrite(magic, 1, sizeof(magic), this->file) != sizeof(magic) ||
+        fputc(version, this->file) == EOF) {
+      this->err = errno;
+    }
+    return this->err;
+  }
+
+  int CaptureWriter::close() {
+    std::lock_guard<std::mutex> guard(this->mux);
+    if (this->file == nullptr) {
+      return this->err;
+    }
+    if (fclose(this->file) != 0 && this->err == 0) {
+      this->err = errno;
+    }
+    this->file = nullptr;
+    return this->err;
+  }
+
+  void CaptureWriter::record(Capture::Direction direction,
+                             const uint8_t* data, size_t size) {
+    std::lock_guard<std::mutex> guard(this->mux);
+    if (this->file == nullptr || this->err != 0) {
+      return;
+    }
+
+    // the clock is read under the lock so that the times go up
+    uint64_t time = nanos() - this->start;
+    uint8_t header[21];
+    header[0] = static_cast<uint8_t>(direction);
+    size_t n = 1 + putVarUint64(time - this->last, header + 1);
+    n += putVarUint64(size, header + n);
+    this->last = time;
+    if (fwrite(header, 1, n, this->file) != n ||
+        fwrite(data, 1, size, this->file) != size) {
+      this->err = errno != 0 ? errno : EIO;
+    }
+  }
+
+  RecordingStream::RecordingStream(std::unique_ptr<mqtt::Stream> streamA,
+                                   std::string pathA)
+      : stream(std::move(streamA)), path(std::move(pathA)), err(0) {}
+
+  int RecordingStream::captureError() const {
+    return this->err;
+  }
+
+  int RecordingStream::open() {
+    int result = this->stream->open();
+    if (result == 0) {
+      this->err = this->capture.open(this->path);
+    }
+    return result;
+  }
+
+  void RecordingStream::close() {
+    this->stream->close();
+    int result = this->capture.close();
+    if (this->err == 0) {
+      this->err = result;
+    }
+  }
+
+  std::pair<std::vector<uint8_t>, int>
+  RecordingStream::readBytes(size_t len) {
+    auto result = this->stream->readBytes(len);
+    if (!result.first.empty()) {
+      this->capture.record(Capture::Direction::Read, result.first.data(),
+                           result.first.size());
+    }
+    return result;
+  }
+
+  std::pair<size_t, int>
+  RecordingStream::writeBytes(const std::vector<uint8_t>& data) {
+    auto result = this->stream->writeBytes(data);
+    if (result.first > 0) {
+      this->capture.record(Capture::Direction::Written, data.data(),
+                           result.first);
+    }
+    return result;
+  }
+
+  bool RecordingStream::isValid() const {
+    return this->stream->isValid();
+  }
+} // namespace mqttutils
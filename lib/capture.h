@@ -0,0 +1,81 @@
+#pragma once
+
+#include "mqtt/noncopyable.h"
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <mqtt/stream.h>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace mqttutils {
+  // Capture is the traffic of a stream, the bytes of every read and write
+  // in the order they happened. On file it is a header and one record per
+  // frame: the direction, the nanoseconds since the previous frame and the
+  // length as variable length integers, then the bytes
+  struct Capture {
+    enum class Direction : uint8_t { Read = 0, Written = 1 };
+
+    struct Frame {
+      // nanoseconds since the capture started
+      uint64_t time;
+      Direction direction;
+      std::vector<uint8_t> bytes;
+    };
+
+    std::vector<Frame> frames;
+
+    // returns 0, the errno of the failing call or EINVAL when the file is
+    // not a capture. A frame cut short at the end of the file is dropped
+    int read(const std::string& path);
+  };
+
+  // CaptureWriter appends frames to a capture file, thread safe
+  class CaptureWriter : private mqtt::noncopyable {
+  public:
+    CaptureWriter();
+    ~CaptureWriter();
+
+    // returns 0 or the errno of the failing call
+    int open(const std::string& path);
+    // flushes the file. Returns the first error of the writes
+    int close();
+
+    void record(Capture::Direction direction, const uint8_t* data,
+                size_t size);
+
+  private:
+    std::mutex mux;
+    FILE* file;
+    uint64_t start;
+    uint64_t last;
+    int err;
+  };
+
+  // RecordingStream is a Stream that writes the bytes read from and
+  // written to another stream to a capture file. The capture is opened
+  // with the stream, a capture that fails to open does not fail the stream
+  class RecordingStream : public mqtt::Stream {
+  public:
+    RecordingStream(std::unique_ptr<mqtt::Stream> stream, std::string path);
+
+    // the error of opening or writing the capture
+    int captureError() const;
+
+  private:
+    int open() override final;
+    void close() override final;
+    std::pair<std::vector<uint8_t>, int> readBytes(size_t len) override final;
+    std::pair<size_t, int>
+    writeBytes(const std::vector<uint8_t>& data) override final;
+    bool isValid() const override final;
+
+  private:
+    std::unique_ptr<mqtt::Stream> stream;
+    const std::string path;
+    CaptureWriter capture;
+    int err;
+  };
+} // namespace mqttutils
@@ -0,0 +1,175 @@
+#include "doctest/doctest.h"
+#include "capture.h"
+#include "packet/ping.h"
+#include "packet/publish.h"
+#include "packet/subscribe.h"
+#include "packet/unsubscribe.h"
+#include "replay.h"
+#include "temppath.h"
+
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <unistd.h>
+
+namespace test {
+  // MemoryStream reads from a buffer and keeps what is written
+  class MemoryStream : public mqtt::Stream {
+  public:
+    explicit MemoryStream(std::vector<uint8_t> inA) : in(std::move(inA)) {}
+
+    int open() override {
+      this->valid = true;
+      return 0;
+    }
+    void close() override {
+      this->valid = false;
+    }
+    std::pair<std::vector<uint8_t>, int> readBytes(size_t len) override {
+      size_t n = std::min(len, this->in.size() - this->offset);
+      std::vector<uint8_t> bytes(this->in.begin() + long(this->offset),
+                                 this->in.begin() + long(this->offset + n));
+      this->offset += n;
+      return {bytes, n < len ? ECONNRESET : 0};
+    }
+    std::pair<size_t, int>
+    writeBytes(const std::vector<uint8_t>& data) override {
+      this->out.insert(this->out.end(), data.begin(), data.end());
+      return {data.size(), 0};
+    }
+    bool isValid() const override {
+      return this->valid;
+    }
+
+    std::vector<uint8_t> in;
+    size_t offset = 0;
+    std::vector<uint8_t> out;
+    bool valid = false;
+  };
+
+  static std::vector<uint8_t> publish(const std::string& topic) {
+    mqtt::Publish p;
+    p.topicName = topic;
+    p.qosLevel = 0;
+    p.payload = {'4', '2'};
+    return packet::PublishEncoder({0, p}).encode();
+  }
+
+  static std::vector<uint8_t> subscribe(const std::string& filter) {
+    mqtt::Subscribe s;
+    s.subscriptions.push_back(mqtt::Subscription{filter, 0, false, false, 0});
+    return packet::SubscribeEncoder({1, s}).encode();
+  }
+
+  static std::vector<uint8_t> unsubscribe(const std::string& filter) {
+    mqtt::Unsubscribe u;
+    u.topicFilters.push_back(filter);
+    return packet::UnsubscribeEncoder({2, u}).encode();
+  }
+} // namespace test
+
+TEST_CASE("testing capture of a stream") {
+  test::TempPath tmp("mqtt-capture");
+
+  std::vector<uint8_t> in = test::publish("a/b");
+  auto inner = std::make_unique<test::MemoryStream>(in);
+  test::MemoryStream& memory = *inner;
+  {
+    std::unique_ptr<mqtt::Stream> stream =
+        std::make_unique<mqttutils::RecordingStream>(std::move(inner),
+                                                     tmp.path);
+    REQUIRE(stream->open() == 0);
+    CHECK(stream->isValid());
+    std::vector<uint8_t> sub = test::subscribe("a/+");
+    CHECK(stream->writeBytes(sub).first == sub.size());
+    // the fixed header, then the rest of the packet
+    CHECK(stream->readBytes(2).first.size() == 2);
+    CHECK(stream->readBytes(in.size() - 2).first.size() == in.size() - 2);
+    // nothing left, nothing recorded
+    CHECK(stream->readBytes(1).second == ECONNRESET);
+    stream->close();
+    CHECK(static_cast<mqttutils::RecordingStream&>(*stream).captureError() ==
+          0);
+    CHECK(memory.out == sub);
+  }
+
+  mqttutils::Capture capture;
+  REQUIRE(capture.read(tmp.path) == 0);
+  REQUIRE(capture.frames.size() == 3);
+  CHECK(capture.frames[0].direction == mqttutils::Capture::Direction::Written);
+  CHECK(capture.frames[0].bytes == test::subscribe("a/+"));
+  CHECK(capture.frames[1].direction == mqttutils::Capture::Direction::Read);
+  CHECK(capture.frames[1].bytes ==
+        std::vector<uint8_t>(in.begin(), in.begin() + 2));
+  CHECK(capture.frames[2].bytes ==
+        std::vector<uint8_t>(in.begin() + 2, in.end()));
+  CHECK(capture.frames[0].time <= capture.frames[1].time);
+  CHECK(capture.frames[1].time <= capture.frames[2].time);
+
+  // a frame cut short is dropped, a file that is not a capture is rejected
+  std::filesystem::resize_file(tmp.path,
+                               std::filesystem::file_size(tmp.path) - 1);
+  REQUIRE(capture.read(tmp.path) == 0);
+  CHECK(capture.frames.size() == 2);
+  FILE* f = fopen(tmp.path.c_str(), "wb");
+  REQUIRE(f != nullptr);
+  fputs("not a capture", f);
+  fclose(f);
+  CHECK(capture.read(tmp.path) == EINVAL);
+}
+
+TEST_CASE("testing capture replay") {
+  using Direction = mqttutils::Capture::Direction;
+  using Type = packet::ControlPacket::Type;
+  mqttutils::Capture capture;
+  std::vector<uint8_t> pub = test::publish("sensors/1/temp");
+  capture.frames.push_back(
+      {0, Direction::Written, test::subscribe("sensors/+/temp")});
+  capture.frames.push_back(
+      {1000, Direction::Written, test::subscribe("sensors/#")});
+  // a packet split over two reads, two packets in one read
+  capture.frames.push_back({2000, Direction::Read,
+                            std::vector<uint8_t>(pub.begin(), pub.begin() + 3)});
+  std::vector<uint8_t> rest(pub.begin() + 3, pub.end());
+  rest.insert(rest.end(), pub.begin(), pub.end());
+  capture.frames.push_back({3000, Direction::Read, rest});
+  capture.frames.push_back(
+      {4000, Direction::Written, test::unsubscribe("sensors/#")});
+  capture.frames.push_back({5000, Direction::Read, pub});
+  capture.frames.push_back(
+      {6000, Direction::Written,
+       packet::PingEncoder::encode(Type::PINGREQ)});
+
+  mqttutils::CaptureReplay replay(capture);
+  mqttutils::CaptureReplay::Stats stats =
+      replay.run(mqttutils::CaptureReplay::Pace::Fast);
+  CHECK(stats.packets == 7);
+  CHECK(stats.types[size_t(Type::PUBLISH)].packets == 3);
+  CHECK(stats.types[size_t(Type::PUBLISH)].bytes == 3 * pub.size());
+  CHECK(stats.types[size_t(Type::SUBSCRIBE)].packets == 2);
+  CHECK(stats.types[size_t(Type::UNSUBSCRIBE)].packets == 1);
+  CHECK(stats.types[size_t(Type::PINGREQ)].packets == 1);
+  CHECK(stats.types[size_t(Type::PUBLISH)].nanos > 0);
+  // two subscriptions for the first two, one for the last
+  CHECK(stats.matched == 5);
+  CHECK(stats.malformed == 0);
+
+  // the subscriptions start over
+  CHECK(replay.run(mqttutils::CaptureReplay::Pace::Fast).matched == 5);
+
+  // a malformed fixed header ends the direction
+  capture.frames.push_back(
+      {7000, Direction::Read, {0x30, 0xFF, 0xFF, 0xFF, 0xFF}});
+  capture.frames.push_back({8000, Direction::Read, pub});
+  capture.frames.push_back({9000, Direction::Written, test::subscribe("x")});
+  stats = replay.run(mqttutils::CaptureReplay::Pace::Fast);
+  CHECK(stats.malformed == 1);
+  CHECK(stats.types[size_t(Type::PUBLISH)].packets == 3);
+  CHECK(stats.types[size_t(Type::SUBSCRIBE)].packets == 3);
+
+  // paced, the replay takes as long as the capture
+  capture.frames.push_back(
+      {20000000, Direction::Written, test::subscribe("y")});
+  stats = replay.run(mqttutils::CaptureReplay::Pace::Recorded);
+  CHECK(stats.nanos >= 20000000);
+}
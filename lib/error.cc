@@ -17,7 +17,24 @@ namespace mqtt {
       return "Empty subscription topics are not allowed";
     case Error::InvalidProtocolName:
       return "Protocol name is invalid";
+    case Error::TopicAliasInvalid:
+      return "Topic alias is 0 or greater than the topic alias maximum";
+    case Error::TopicAliasNotFound:
+      return "Topic alias is not mapped to a topic name";
+    case Error::SessionStoreCorrupt:
+      return "Session store file is not a valid session log";
+    case Error::MalformedUTF8String:
+      return "String is not well formed UTF-8 or contains U+0000";
+    case Error::MalformedPacket:
+      return "Packet is truncated or a length runs past its end";
+    case Error::InvalidPropertyID:
+      return "Property is not allowed in this packet";
+    case Error::DuplicateProperty:
+      return "Property must not be included more than once";
+    case Error::UnsupportedProtocolVersion:
+      return "Protocol version is not supported, must be 5";
     }
+    return "Unknown error";
   }
 
 } // namespace mqtt
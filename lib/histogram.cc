@@ -0,0 +1,97 @@
+#include "histogram.h"
+#include <algorithm>
+#include <cmath>
+
+namespace mqttutils {
+  Histogram::Histogram() : minValue(UINT64_MAX), maxValue(0), sum(0) {
+    for (auto& c : this->counts) {
+      c.store(0, std::memory_order_relaxed);
+    }
+  }
+
+  uint64_t Histogram::highestValue(size_t bucket) {
+    if (bucket < 2 * subBucketCount) {
+      return bucket;
+    }
+    unsigned shift = static_cast<unsigned>(bucket / subBucketCount) - 1;
+    uint64_t sub = bucket - shift * subBucketCount;
+    // wraps to UINT64_MAX for the last bucket
+    return ((sub + 1) << shift) - 1;
+  }
+
+  Histogram::Snapshot Histogram::snapshot() const {
+    Snapshot s;
+    s.add(*this);
+    return s;
+  }
+
+  Histogram::Snapshot::Snapshot()
+      : counts{}, total(0), minValue(UINT64_MAX), maxValue(0), sumValue(0) {}
+
+  void Histogram::Snapshot::add(const Histogram& h) {
+    for (size_t i = 0; i < bucketCount; ++i) {
+      uint64_t n = h.counts[i].load(std::memory_order_relaxed);
+      this->counts[i] += n;
+      this->total += n;
+    }
+    this->minValue =
+        std::min(this->minValue, h.minValue.load(std::memory_order_relaxed));
+    this->maxValue =
+        std::max(this->maxValue, h.maxValue.load(std::memory_order_relaxed));
+    this->sumValue += h.sum.load(std::memory_order_relaxed);
+  }
+
+  void Histogram::Snapshot::merge(const Snapshot& other) {
+    for (size_t i = 0; i < bucketCount; ++i) {
+      this->counts[i] += other.counts[i];
+    }
+    this->total += other.total;
+    this->minValue = std::min(this->minValue, other.minValue);
+    this->maxValue = std::max(this->maxValue, other.maxValue);
+    this->sumValue += other.sumValue;
+  }
+
+  uint64_t Histogram::Snapshot::count() const {
+    return this->total;
+  }
+
+  uint64_t Histogram::Snapshot::min() const {
+    return this->total == 0 ? 0 : this->minValue;
+  }
+
+  uint64_t Histogram::Snapshot::max() const {
+    return this->maxValue;
+  }
+
+  uint64_t Histogram::Snapshot::sum() const {
+    return this->sumValue;
+  }
+
+  double Histogram::Snapshot::mean() const {
+    return this->total == 0 ? 0.0
+                            : double(this->sumValue) / double(this->total);
+  }
+
+  uint64_t Histogram::Snapshot::valueAt(double q) const {
+    if (this->total == 0) {
+      return 0;
+    }
+    // rank of the value, 1 based
+    uint64_t rank = static_cast<uint64_t>(
+        std::ceil(std::clamp(q, 0.0, 1.0) * double(this->total)));
+    rank = std::max<uint64_t>(rank, 1);
+    uint64_t seen = 0;
+    for (size_t i = 0; i < bucketCount; ++i) {
+      seen += this->counts[i];
+      if (seen >= rank) {
+        return std::min(Histogram::highestValue(i), this->maxValue);
+      }
+    }
+    return this->maxValue;
+  }
+
+  Histogram::Percentiles Histogram::Snapshot::percentiles() const {
+    return Percentiles{this->total, this->valueAt(0.5), this->valueAt(0.99),
+                       this->valueAt(0.999), this->max()};
+  }
+} // namespace mqttutils
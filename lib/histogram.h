@@ -0,0 +1,95 @@
+#pragma once
+
+#include "mqtt/noncopyable.h"
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+namespace mqttutils {
+  // Histogram records latencies in nanoseconds, HDR style: the values are
+  // counted in buckets that are linear within each power of two, 32 per
+  // power of two, so a value is known to about 3% over the whole uint64
+  // range with a fixed array and no allocation.
+  //
+  // A histogram has one writer, record is a few instructions and does not
+  // lock: keep one per thread. The counts are relaxed atomics so that any
+  // thread can take a Snapshot while the writer records, the snapshots of
+  // the threads are merged for the totals.
+  class Histogram : private mqtt::noncopyable {
+  public:
+    static constexpr unsigned subBucketBits = 5;
+    static constexpr size_t subBucketCount = size_t(1) << subBucketBits;
+    static constexpr size_t bucketCount = (65 - subBucketBits) * subBucketCount;
+
+    struct Percentiles {
+      uint64_t count;
+      uint64_t p50;
+      uint64_t p99;
+      uint64_t p999;
+      uint64_t max;
+    };
+
+    // Snapshot is a copy of the counts of one or more histograms
+    class Snapshot {
+    public:
+      Snapshot();
+
+      void add(const Histogram& h);
+      void merge(const Snapshot& other);
+
+      uint64_t count() const;
+      uint64_t min() const;
+      uint64_t max() const;
+      uint64_t sum() const;
+      double mean() const;
+      // the value below which fraction q (0..1) of the values are, the
+      // upper bound of its bucket capped at the maximum. 0 when empty
+      uint64_t valueAt(double q) const;
+      Percentiles percentiles() const;
+
+    private:
+      std::array<uint64_t, bucketCount> counts;
+      uint64_t total;
+      uint64_t minValue;
+      uint64_t maxValue;
+      uint64_t sumValue;
+    };
+
+    Histogram();
+
+    // called by the writer only
+    inline void record(uint64_t value) {
+      std::atomic<uint64_t>& bucket = this->counts[Histogram::bucket(value)];
+      bucket.store(bucket.load(std::memory_order_relaxed) + 1,
+                   std::memory_order_relaxed);
+      this->sum.store(this->sum.load(std::memory_order_relaxed) + value,
+                      std::memory_order_relaxed);
+      if (value > this->maxValue.load(std::memory_order_relaxed)) {
+        this->maxValue.store(value, std::memory_order_relaxed);
+      }
+      if (value < this->minValue.load(std::memory_order_relaxed)) {
+        this->minValue.store(value, std::memory_order_relaxed);
+      }
+    }
+
+    Snapshot snapshot() const;
+
+    // the bucket of a value and the largest value counted in a bucket
+    static inline size_t bucket(uint64_t value) {
+      if (value < 2 * subBucketCount) {
+        return static_cast<size_t>(value);
+      }
+      unsigned shift =
+          static_cast<unsigned>(63 - __builtin_clzll(value)) - subBucketBits;
+      return shift * subBucketCount + static_cast<size_t>(value >> shift);
+    }
+    static uint64_t highestValue(size_t bucket);
+
+  private:
+    std::array<std::atomic<uint64_t>, bucketCount> counts;
+    std::atomic<uint64_t> minValue;
+    std::atomic<uint64_t> maxValue;
+    std::atomic<uint64_t> sum;
+  };
+} // namespace mqttutils
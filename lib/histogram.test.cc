@@ -0,0 +1,77 @@
+#include "doctest/doctest.h"
+#include "histogram.h"
+#include <thread>
+
+TEST_CASE("testing histogram buckets") {
+  using mqttutils::Histogram;
+  // exact below 64, then 32 buckets per power of two
+  CHECK(Histogram::bucket(0) == 0);
+  CHECK(Histogram::bucket(63) == 63);
+  CHECK(Histogram::bucket(64) == 64);
+  CHECK(Histogram::bucket(65) == 64);
+  CHECK(Histogram::bucket(66) == 65);
+  CHECK(Histogram::highestValue(64) == 65);
+  CHECK(Histogram::bucket(UINT64_MAX) == Histogram::bucketCount - 1);
+  CHECK(Histogram::highestValue(Histogram::bucketCount - 1) == UINT64_MAX);
+
+  // every value is in a bucket whose upper bound is at most 1/32 above it
+  for (uint64_t v : {uint64_t(100), uint64_t(1000), uint64_t(123456),
+                     uint64_t(1) << 40, (uint64_t(1) << 40) + 12345}) {
+    size_t b = Histogram::bucket(v);
+    CHECK(Histogram::highestValue(b) >= v);
+    CHECK((b == 0 || Histogram::highestValue(b - 1) < v));
+    CHECK(double(Histogram::highestValue(b) - v) <= double(v) / 32);
+  }
+}
+
+TEST_CASE("testing histogram percentiles") {
+  mqttutils::Histogram h;
+  CHECK(h.snapshot().count() == 0);
+  CHECK(h.snapshot().valueAt(0.5) == 0);
+
+  // 1..10000 ns
+  for (uint64_t v = 1; v <= 10000; ++v) {
+    h.record(v);
+  }
+  mqttutils::Histogram::Percentiles p = h.snapshot().percentiles();
+  CHECK(p.count == 10000);
+  CHECK(p.p50 >= 5000);
+  CHECK(p.p50 <= 5000 + 5000 / 32);
+  CHECK(p.p99 >= 9900);
+  CHECK(p.p999 >= 9990);
+  CHECK(p.p999 <= 10000);
+  CHECK(p.max == 10000);
+  CHECK(h.snapshot().min() == 1);
+  CHECK(h.snapshot().mean() == doctest::Approx(5000.5));
+}
+
+TEST_CASE("testing histogram merge across threads") {
+  // one histogram per thread, merged into one snapshot
+  mqttutils::Histogram a;
+  mqttutils::Histogram b;
+  std::thread ta([&a] {
+    for (int i = 0; i < 1000; ++i) {
+      a.record(50);
+    }
+  });
+  std::thread tb([&b] {
+    for (int i = 0; i < 10; ++i) {
+      b.record(1000000);
+    }
+  });
+  ta.join();
+  tb.join();
+
+  mqttutils::Histogram::Snapshot s;
+  s.add(a);
+  s.add(b);
+  CHECK(s.count() == 1010);
+  CHECK(s.valueAt(0.5) == 50);
+  CHECK(s.max() == 1000000);
+  CHECK(s.valueAt(1.0) == 1000000);
+
+  mqttutils::Histogram::Snapshot other = b.snapshot();
+  other.merge(a.snapshot());
+  CHECK(other.count() == s.count());
+  CHECK(other.percentiles().p99 == s.percentiles().p99);
+}
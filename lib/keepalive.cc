@@ -0,0 +1,124 @@
+#include "keepalive.h"
+#include <algorithm>
+
+namespace mqttutils {
+  KeepAliveMonitor::KeepAliveMonitor(TimerWheel& wheelA, Handler handlerA)
+      : wheel(wheelA), handler(handlerA) {}
+
+  KeepAliveMonitor::~KeepAliveMonitor() {
+    for (const auto& entry : this->connections) {
+      this->wheel.cancel(entry.second.pingTimer);
+      this->wheel.cancel(entry.second.deadTimer);
+    }
+  }
+
+  void KeepAliveMonitor::add(ConnectionID id, uint16_t keepAlive,
+                             bool sendPings, uint64_t now) {
+    this->remove(id);
+    if (keepAlive == 0) {
+      return;
+    }
+
+    Connection c{uint64_t(keepAlive) * 1000,
+                 now,
+                 now,
+                 sendPings,
+                 TimerWheel::invalidTimerID,
+                 TimerWheel::invalidTimerID};
+    if (sendPings) {
+      c.pingTimer = this->wheel.schedule(this->pingDeadline(c),
+                                         [this, id] { this->onPingTimer(id); });
+    }
+    c.deadTimer = this->wheel.schedule(now + c.interval * 3 / 2,
+                                       [this, id] { this->onDeadTimer(id); });
+    this->connections[id] = c;
+  }
+
+  void KeepAliveMonitor::remove(ConnectionID id) {
+    auto it = this->connections.find(id);
+    if (it == this->connections.end()) {
+      return;
+    }
+    this->wheel.cancel(it->second.pingTimer);
+    this->wheel.cancel(it->second.deadTimer);
+    this->connections.erase(it);
+  }
+
+  void KeepAliveMonitor::packetSent(ConnectionID id, uint64_t now) {
+    auto it = this->connections.find(id);
+    if (it != this->connections.end()) {
+      it->second.lastSent = now;
+    }
+  }
+
+  void KeepAliveMonitor::packetReceived(ConnectionID id, uint64_t now) {
+    auto it = this->connections.find(id);
+    if (it != this->connections.end()) {
+      it->second.lastReceived = now;
+    }
+  }
+
+  size_t KeepAliveMonitor::size() const {
+    return this->connections.size();
+  }
+
+  uint16_t KeepAliveMonitor::effective(const mqtt::Connect& c,
+                                       const mqtt::ConnAck& ca) {
+    if (ca.properties && ca.properties->serverKeepAlive) {
+      return *ca.properties->serverKeepAlive;
+    }
+    return c.keepAlive;
+  }
+
+  // a PINGREQ is due when nothing was sent for the keep alive interval. It is
+  // also sent when nothing was received for the interval, otherwise a client
+  // that only publishes QoS 0 could not tell a dead broker from a quiet one
+  uint64_t KeepAliveMonitor::pingDeadline(const Connection& c) const {
+    return std::min(c.lastSent, c.lastReceived) + c.interval;
+  }
+
+  void KeepAliveMonitor::onPingTimer(ConnectionID id) {
+    auto it = this->connections.find(id);
+    if (it == this->connections.end()) {
+      return;
+    }
+
+    const uint64_t now = this->wheel.now();
+    if (now >= this->pingDeadline(it->second)) {
+      it->second.lastSent = now;
+      // the handler may remove the connection
+      this->handler.sendPing(id);
+      it = this->connections.find(id);
+      if (it == this->connections.end()) {
+        return;
+      }
+      // wait for the response before pinging again
+      it->second.pingTimer = this->wheel.schedule(
+          now + it->second.interval, [this, id] { this->onPingTimer(id); });
+      return;
+    }
+
+    it->second.pingTimer =
+        this->wheel.schedule(this->pingDeadline(it->second),
+                             [this, id] { this->onPingTimer(id); });
+  }
+
+  void KeepAliveMonitor::onDeadTimer(ConnectionID id) {
+    auto it = this->connections.find(id);
+    if (it == this->connections.end()) {
+      return;
+    }
+
+    const Connection& c = it->second;
+    const uint64_t deadline = c.lastReceived + c.interval * 3 / 2;
+    if (this->wheel.now() >= deadline) {
+      this->wheel.cancel(c.pingTimer);
+      this->connections.erase(it);
+      this->handler.peerDead(id);
+      return;
+    }
+
+    it->second.deadTimer =
+        this->wheel.schedule(deadline, [this, id] { this->onDeadTimer(id); });
+  }
+} // namespace mqttutils
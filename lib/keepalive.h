@@ -0,0 +1,66 @@
+#pragma once
+
+#include "mqtt/connack.h"
+#include "mqtt/connect.h"
+#include "mqtt/noncopyable.h"
+#include "timerwheel.h"
+#include <functional>
+#include <unordered_map>
+
+namespace mqttutils {
+  // KeepAliveMonitor tracks the keep alive of many connections on the
+  // TimerWheel of an event loop, there is no thread or timer per packet.
+  // Sending or receiving a packet only records the time, the timers check
+  // the recorded time when they fire and reschedule themselves if the
+  // connection was not idle. Times are milliseconds, the time base of the
+  // wheel.
+  class KeepAliveMonitor : private mqtt::noncopyable {
+  public:
+    using ConnectionID = uint64_t;
+
+    struct Handler {
+      // the connection must send a PINGREQ
+      std::function<void(ConnectionID)> sendPing;
+      // nothing was received from the peer within 1.5 times the keep alive,
+      // the connection is removed from the monitor before the call
+      std::function<void(ConnectionID)> peerDead;
+    };
+
+    KeepAliveMonitor(TimerWheel& wheel, Handler handler);
+    ~KeepAliveMonitor();
+
+    // keepAlive in seconds, 0 disables the keep alive. The client side sends
+    // pings, the broker side only watches the packets from the client
+    void add(ConnectionID id, uint16_t keepAlive, bool sendPings,
+             uint64_t now);
+    void remove(ConnectionID id);
+
+    void packetSent(ConnectionID id, uint64_t now);
+    void packetReceived(ConnectionID id, uint64_t now);
+
+    size_t size() const;
+
+    // the keep alive the client uses: the Server Keep Alive of CONNACK
+    // replaces the value sent in CONNECT
+    static uint16_t effective(const mqtt::Connect& c, const mqtt::ConnAck& ca);
+
+  private:
+    struct Connection {
+      uint64_t interval;
+      uint64_t lastSent;
+      uint64_t lastReceived;
+      bool sendPings;
+      TimerWheel::TimerID pingTimer;
+      TimerWheel::TimerID deadTimer;
+    };
+
+    uint64_t pingDeadline(const Connection& c) const;
+    void onPingTimer(ConnectionID id);
+    void onDeadTimer(ConnectionID id);
+
+  private:
+    TimerWheel& wheel;
+    Handler handler;
+    std::unordered_map<ConnectionID, Connection> connections;
+  };
+} // namespace mqttutils
@@ -0,0 +1,118 @@
+#include "doctest/doctest.h"
+#include "keepalive.h"
+
+#include <vector>
+
+namespace test {
+  struct KeepAliveEvents {
+    std::vector<std::pair<uint64_t, uint64_t>> pings;
+    std::vector<std::pair<uint64_t, uint64_t>> dead;
+  };
+
+  static mqttutils::KeepAliveMonitor::Handler
+  handler(mqttutils::TimerWheel& wheel, KeepAliveEvents& events) {
+    return mqttutils::KeepAliveMonitor::Handler{
+        [&wheel, &events](uint64_t id) {
+          events.pings.emplace_back(id, wheel.now());
+        },
+        [&wheel, &events](uint64_t id) {
+          events.dead.emplace_back(id, wheel.now());
+        }};
+  }
+} // namespace test
+
+TEST_CASE("testing keep alive pings only after idle time") {
+  mqttutils::TimerWheel wheel;
+  test::KeepAliveEvents events;
+  mqttutils::KeepAliveMonitor monitor(wheel, test::handler(wheel, events));
+  monitor.add(1, 10, true, 0);
+
+  // traffic in both directions keeps the connection from pinging
+  for (uint64_t now = 1000; now <= 30000; now += 1000) {
+    wheel.advance(now);
+    monitor.packetSent(1, now);
+    monitor.packetReceived(1, now);
+  }
+  CHECK(events.pings.empty());
+
+  // idle, the ping goes out 10 seconds after the last packet
+  wheel.advance(40000);
+  REQUIRE(events.pings.size() == 1);
+  CHECK(events.pings[0] == std::make_pair(uint64_t(1), uint64_t(40000)));
+  monitor.packetReceived(1, 40010); // PINGRESP
+
+  wheel.advance(50010);
+  CHECK(events.pings.size() == 2);
+  CHECK(events.dead.empty());
+}
+
+TEST_CASE("testing keep alive detects a dead peer") {
+  mqttutils::TimerWheel wheel;
+  test::KeepAliveEvents events;
+  mqttutils::KeepAliveMonitor monitor(wheel, test::handler(wheel, events));
+  monitor.add(1, 10, true, 0);
+  // broker side, only watches the client
+  monitor.add(2, 4, false, 0);
+
+  // the client keeps publishing but the broker never answers
+  for (uint64_t now = 500; now <= 20000; now += 500) {
+    wheel.advance(now);
+    monitor.packetSent(1, now);
+  }
+
+  // the ping goes out when nothing was received for the keep alive interval
+  REQUIRE(events.pings.size() >= 1);
+  CHECK(events.pings[0] == std::make_pair(uint64_t(1), uint64_t(10000)));
+
+  REQUIRE(events.dead.size() == 2);
+  CHECK(events.dead[0] == std::make_pair(uint64_t(2), uint64_t(6000)));
+  CHECK(events.dead[1] == std::make_pair(uint64_t(1), uint64_t(15000)));
+  CHECK(monitor.size() == 0);
+  CHECK(wheel.size() == 0);
+}
+
+TEST_CASE("testing keep alive with a publisher that receives nothing") {
+  mqttutils::TimerWheel wheel;
+  test::KeepAliveEvents events;
+  mqttutils::KeepAliveMonitor monitor(wheel, test::handler(wheel, events));
+  monitor.add(1, 10, true, 0);
+
+  // QoS 0 publishes only, the broker is alive and answers the pings: the
+  // outbound traffic alone does not hold the ping back, otherwise nothing
+  // would be received and the broker taken for dead after 15 seconds
+  for (uint64_t now = 500; now <= 60000; now += 500) {
+    wheel.advance(now);
+    monitor.packetSent(1, now);
+    if (!events.pings.empty() && events.pings.back().second == now) {
+      monitor.packetReceived(1, now); // PINGRESP
+    }
+  }
+  CHECK(events.pings.size() == 6);
+  CHECK(events.dead.empty());
+  CHECK(monitor.size() == 1);
+}
+
+TEST_CASE("testing keep alive remove and disabled keep alive") {
+  mqttutils::TimerWheel wheel;
+  test::KeepAliveEvents events;
+  mqttutils::KeepAliveMonitor monitor(wheel, test::handler(wheel, events));
+  monitor.add(1, 0, true, 0);
+  CHECK(monitor.size() == 0);
+
+  monitor.add(2, 1, true, 0);
+  monitor.remove(2);
+  wheel.advance(100000);
+  CHECK(events.pings.empty());
+  CHECK(events.dead.empty());
+  CHECK(wheel.size() == 0);
+}
+
+TEST_CASE("testing effective keep alive") {
+  mqtt::Connect c;
+  c.keepAlive = 60;
+  mqtt::ConnAck ca;
+  CHECK(mqttutils::KeepAliveMonitor::effective(c, ca) == 60);
+  ca.properties = std::make_shared<mqtt::ConnAck::Properties>();
+  ca.properties->serverKeepAlive = 20;
+  CHECK(mqttutils::KeepAliveMonitor::effective(c, ca) == 20);
+}
@@ -0,0 +1,206 @@
+#include "loopbackstream.h"
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+namespace mqttutils {
+  // the writes are queued in chunks: when the chunk is delivered in
+  // nanoseconds and its length, then the bytes
+  static constexpr size_t chunkHeaderSize = 12;
+
+  static uint64_t nanos() {
+    return static_cast<uint64_t>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch())
+            .count());
+  }
+
+  // pause backs off a waiting loop: spins first, then gives the CPU away
+  static void pause(unsigned& spins) {
+    if (spins++ < 64) {
+#if defined(__x86_64__) || defined(__i386__)
+      __builtin_ia32_pause();
+#endif
+      return;
+    }
+    std::this_thread::yield();
+  }
+
+  // Channel is one direction of a connection, a byte ring with one
+  // producer and one consumer. The producer publishes a chunk at once by
+  // moving the head past it, the consumer frees it by moving the tail
+  struct LoopbackStream::Channel {
+    explicit Channel(const Link& linkA)
+        : link(linkA), ring(linkA.capacity), mask(linkA.capacity - 1),
+          head(0), tail(0), closed(false) {}
+
+    void copyIn(uint64_t pos, const uint8_t* data, size_t size) {
+      size_t at = static_cast<size_t>(pos & this->mask);
+      size_t first = std::min(size, this->ring.size() - at);
+      memcpy(this->ring.data() + at, data, first);
+      memcpy(this->ring.data(), data + first, size - first);
+    }
+
+    void copyOut(uint64_t pos, uint8_t* data, size_t size) const {
+      size_t at = static_cast<size_t>(pos & this->mask);
+      size_t first = std::min(size, this->ring.size() - at);
+      memcpy(data, this->ring.data() + at, first);
+      memcpy(data + first, this->ring.data(), size - first);
+    }
+
+    const Link link;
+    std::vector<uint8_t> ring;
+    const uint64_t mask;
+    // written by the producer, bytes published
+    alignas(64) std::atomic<uint64_t> head;
+    // written by the consumer, bytes freed
+    alignas(64) std::atomic<uint64_t> tail;
+    std::atomic<bool> closed;
+  };
+
+  LoopbackStream::Pair LoopbackStream::pair() {
+    return LoopbackStream::pair(Link());
+  }
+
+  LoopbackStream::Pair LoopbackStream::pair(const Link& link) {
+    Link l = link;
+    // a power of two with room for a chunk header and some bytes
+    size_t capacity = 64;
+    while (capacity < l.capacity) {
+      capacity <<= 1;
+    }
+    l.capacity = capacity;
+
+    auto toServer = std::make_shared<Channel>(l);
+    auto toClient = std::make_shared<Channel>(l);
+    // the constructor is private, no make_unique
+    return {std::unique_ptr<mqtt::Stream>(
+                new LoopbackStream(toClient, toServer)),
+            std::unique_ptr<mqtt::Stream>(
+                new LoopbackStream(toServer, toClient))};
+  }
+
+  LoopbackStream::LoopbackStream(std::shared_ptr<Channel> inA,
+                                 std::shared_ptr<Channel> outA)
+      : in(std::move(inA)), out(std::move(outA)), opened(false), chunkLeft(0),
+        busyUntil(0) {}
+
+  LoopbackStream::~LoopbackStream() {
+    this->close();
+  }
+
+  int LoopbackStream::open() {
+    if (this->in->closed.load(std::memory_order_acquire)) {
+      return ECONNREFUSED;
+    }
+    this->opened = true;
+    return 0;
+  }
+
+  void LoopbackStream::close() {
+    this->opened = false;
+    this->in->closed.store(true, std::memory_order_release);
+    this->out->closed.store(true, std::memory_order_release);
+  }
+
+  std::pair<std::vector<uint8_t>, int>
+  LoopbackStream::readBytes(size_t len) {
+    Channel& c = *this->in;
+    std::vector<uint8_t> buffer(len);
+    size_t done = 0;
+    uint64_t tail = c.tail.load(std::memory_order_relaxed);
+    unsigned spins = 0;
+    while (done < len) {
+      uint64_t head = c.head.load(std::memory_order_acquire);
+      if (head == tail) {
+        // closed after the last chunk was published, so it is read first
+        if (c.closed.load(std::memory_order_acquire) &&
+            c.head.load(std::memory_order_acquire) == tail) {
+          buffer.resize(done);
+          return {std::move(buffer), ECONNRESET};
+        }
+        pause(spins);
+        continue;
+      }
+
+      if (this->chunkLeft == 0) {
+        uint8_t header[chunkHeaderSize];
+        c.copyOut(tail, header, sizeof(header));
+        uint64_t deliverAt = 0;
+        uint32_t size = 0;
+        memcpy(&deliverAt, header, 8);
+        memcpy(&size, header + 8, 4);
+        // the link latency, sleep while it is long
+        for (uint64_t now = nanos(); now < deliverAt; now = nanos()) {
+          if (deliverAt - now > 100000) {
+            std::this_thread::sleep_for(
+                std::chrono::nanoseconds(deliverAt - now - 50000));
+          }
+        }
+        tail += chunkHeaderSize;
+        this->chunkLeft = size;
+      }
+
+      size_t n = std::min(len - done, this->chunkLeft);
+      c.copyOut(tail, buffer.data() + done, n);
+      tail += n;
+      done += n;
+      this->chunkLeft -= n;
+      c.tail.store(tail, std::memory_order_release);
+      spins = 0;
+    }
+    return {std::move(buffer), 0};
+  }
+
+  std::pair<size_t, int>
+  LoopbackStream::writeBytes(const std::vector<uint8_t>& data) {
+    Channel& c = *this->out;
+    const Link& link = c.link;
+    // a chunk takes at most half the ring so that the reader frees room
+    // while the writer fills the rest
+    const size_t maxChunk = c.ring.size() / 2 - chunkHeaderSize;
+    size_t done = 0;
+    uint64_t head = c.head.load(std::memory_order_relaxed);
+    unsigned spins = 0;
+    while (done < data.size()) {
+      if (c.closed.load(std::memory_order_acquire)) {
+        return {done, EPIPE};
+      }
+      size_t n = std::min(data.size() - done, maxChunk);
+      uint64_t tail = c.tail.load(std::memory_order_acquire);
+      if (c.ring.size() - (head - tail) < chunkHeaderSize + n) {
+        pause(spins);
+        continue;
+      }
+
+      // the chunk is sent once the link is done with the chunks before it
+      uint64_t now = nanos();
+      uint64_t sent = std::max(now, this->busyUntil);
+      if (link.bandwidth > 0) {
+        sent += n * 1000000000 / link.bandwidth;
+      }
+      this->busyUntil = sent;
+      uint64_t deliverAt = sent + link.latency;
+      uint32_t size = static_cast<uint32_t>(n);
+
+      uint8_t header[chunkHeaderSize];
+      memcpy(header, &deliverAt, 8);
+      memcpy(header + 8, &size, 4);
+      c.copyIn(head, header, sizeof(header));
+      c.copyIn(head + chunkHeaderSize, data.data() + done, n);
+      head += chunkHeaderSize + n;
+      c.head.store(head, std::memory_order_release);
+      done += n;
+      spins = 0;
+    }
+    return {done, 0};
+  }
+
+  bool LoopbackStream::isValid() const {
+    return this->opened && !this->in->closed.load(std::memory_order_acquire);
+  }
+} // namespace mqttutils
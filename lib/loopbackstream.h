@@ -0,0 +1,63 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mqtt/stream.h>
+#include <utility>
+
+namespace mqttutils {
+  // LoopbackStream is one end of an in-process connection: what one end
+  // writes the other reads, through a lock-free single producer single
+  // consumer ring per direction. There is one reader and one writer per
+  // end, e.g. a client thread and a server thread. The reads and writes
+  // block by spinning then yielding, without the kernel.
+  //
+  // A Link models the network between the ends: every write is delivered
+  // latency nanoseconds after it is sent, and is sent at bandwidth bytes
+  // per second after the writes before it.
+  class LoopbackStream : public mqtt::Stream {
+  public:
+    struct Link {
+      // one way, nanoseconds
+      uint64_t latency = 0;
+      // bytes per second, 0 is not limited
+      uint64_t bandwidth = 0;
+      // bytes of the ring of each direction, a power of two
+      size_t capacity = 65536;
+    };
+
+    using Pair =
+        std::pair<std::unique_ptr<mqtt::Stream>, std::unique_ptr<mqtt::Stream>>;
+
+    // the client end and the server end of a connection, the link is the
+    // same both ways
+    static Pair pair();
+    static Pair pair(const Link& link);
+
+    ~LoopbackStream() override;
+
+  private:
+    struct Channel;
+
+    LoopbackStream(std::shared_ptr<Channel> in, std::shared_ptr<Channel> out);
+
+    int open() override final;
+    // closes both directions, the other end reads what was written before
+    // and then ECONNRESET
+    void close() override final;
+    std::pair<std::vector<uint8_t>, int> readBytes(size_t len) override final;
+    std::pair<size_t, int>
+    writeBytes(const std::vector<uint8_t>& data) override final;
+    bool isValid() const override final;
+
+  private:
+    std::shared_ptr<Channel> in;
+    std::shared_ptr<Channel> out;
+    bool opened;
+    // bytes left of the chunk being read
+    size_t chunkLeft;
+    // when the link is done sending the last write
+    uint64_t busyUntil;
+  };
+} // namespace mqttutils
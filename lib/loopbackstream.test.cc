@@ -0,0 +1,105 @@
+#include "doctest/doctest.h"
+#include "loopbackstream.h"
+
+#include <chrono>
+#include <thread>
+
+namespace test {
+  static uint64_t elapsed(std::chrono::steady_clock::time_point start) {
+    return static_cast<uint64_t>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - start)
+            .count());
+  }
+} // namespace test
+
+TEST_CASE("testing loopback stream both ways") {
+  auto ends = mqttutils::LoopbackStream::pair();
+  mqtt::Stream& client = *ends.first;
+  mqtt::Stream& server = *ends.second;
+  CHECK(!client.isValid());
+  REQUIRE(client.open() == 0);
+  REQUIRE(server.open() == 0);
+  CHECK(client.isValid());
+
+  CHECK(client.writeBytes({1, 2, 3}).first == 3);
+  CHECK(client.writeBytes({4, 5}).first == 2);
+  // the reads do not follow the writes
+  CHECK(server.readBytes(4) ==
+        std::make_pair(std::vector<uint8_t>{1, 2, 3, 4}, 0));
+  CHECK(server.readBytes(1) == std::make_pair(std::vector<uint8_t>{5}, 0));
+  CHECK(server.writeBytes({6}).first == 1);
+  CHECK(client.readBytes(1).first == std::vector<uint8_t>{6});
+
+  // the other end reads what was written before the close
+  CHECK(server.writeBytes({7, 8}).first == 2);
+  server.close();
+  CHECK(!server.isValid());
+  CHECK(!client.isValid());
+  auto read = client.readBytes(3);
+  CHECK(read.first == std::vector<uint8_t>{7, 8});
+  CHECK(read.second == ECONNRESET);
+  CHECK(client.writeBytes({9}) == std::make_pair(size_t(0), EPIPE));
+}
+
+TEST_CASE("testing loopback stream across threads") {
+  // much more than the ring holds
+  mqttutils::LoopbackStream::Link link;
+  link.capacity = 256;
+  auto ends = mqttutils::LoopbackStream::pair(link);
+  REQUIRE(ends.first->open() == 0);
+  REQUIRE(ends.second->open() == 0);
+
+  std::vector<uint8_t> data(100000);
+  for (size_t i = 0; i < data.size(); ++i) {
+    data[i] = uint8_t(i * 7);
+  }
+  std::thread writer([&ends, &data] {
+    for (size_t i = 0; i < data.size(); i += 1000) {
+      std::vector<uint8_t> part(data.begin() + long(i),
+                                data.begin() + long(i + 1000));
+      ends.first->writeBytes(part);
+    }
+  });
+  std::vector<uint8_t> received;
+  while (received.size() < data.size()) {
+    auto read = ends.second->readBytes(777);
+    REQUIRE(read.second == 0);
+    received.insert(received.end(), read.first.begin(), read.first.end());
+    if (data.size() - received.size() < 777) {
+      read = ends.second->readBytes(data.size() - received.size());
+      received.insert(received.end(), read.first.begin(), read.first.end());
+    }
+  }
+  writer.join();
+  CHECK(received == data);
+}
+
+TEST_CASE("testing loopback stream link latency and bandwidth") {
+  mqttutils::LoopbackStream::Link link;
+  link.latency = 20000000;
+  auto ends = mqttutils::LoopbackStream::pair(link);
+  REQUIRE(ends.first->open() == 0);
+  REQUIRE(ends.second->open() == 0);
+
+  auto start = std::chrono::steady_clock::now();
+  CHECK(ends.first->writeBytes({1}).first == 1);
+  // the write does not wait for the delivery
+  CHECK(test::elapsed(start) < link.latency);
+  CHECK(ends.second->readBytes(1).first == std::vector<uint8_t>{1});
+  CHECK(test::elapsed(start) >= link.latency);
+
+  // 100 KB at 10 MB/s take 10 ms to send
+  link.latency = 0;
+  link.bandwidth = 10000000;
+  ends = mqttutils::LoopbackStream::pair(link);
+  REQUIRE(ends.first->open() == 0);
+  REQUIRE(ends.second->open() == 0);
+  start = std::chrono::steady_clock::now();
+  std::thread writer([&ends] {
+    ends.first->writeBytes(std::vector<uint8_t>(100000, 1));
+  });
+  CHECK(ends.second->readBytes(100000).first.size() == 100000);
+  writer.join();
+  CHECK(test::elapsed(start) >= 10000000);
+}
@@ -0,0 +1,42 @@
+#include "messageexpiry.h"
+
+namespace mqttutils {
+  std::optional<uint64_t> MessageExpiry::deadline(const mqtt::Publish& p,
+                                                  uint64_t receivedAt) {
+    if (!p.properties || !p.properties->messageExpiryInterval) {
+      return std::nullopt;
+    }
+    return receivedAt + uint64_t(*p.properties->messageExpiryInterval) * 1000;
+  }
+
+  bool MessageExpiry::expired(const mqtt::Publish& p, uint64_t receivedAt,
+                              uint64_t now) {
+    auto expiresAt = MessageExpiry::deadline(p, receivedAt);
+    return expiresAt && now >= *expiresAt;
+  }
+
+  bool MessageExpiry::refresh(mqtt::Publish& p, uint64_t receivedAt,
+                              uint64_t now) {
+    auto expiresAt = MessageExpiry::deadline(p, receivedAt);
+    if (!expiresAt) {
+      return true;
+    }
+    if (now >= *expiresAt) {
+      return false;
+    }
+
+    // round up, a message with some lifetime left must not be sent with a
+    // zero interval
+    uint32_t remaining = static_cast<uint32_t>((*expiresAt - now + 999) / 1000);
+    if (remaining == *p.properties->messageExpiryInterval) {
+      return true;
+    }
+    // properties may be shared by the PUBLISH packets queued for several
+    // subscribers
+    if (p.properties.use_count() > 1) {
+      p.properties = std::make_shared<mqtt::Publish::Properties>(*p.properties);
+    }
+    p.properties->messageExpiryInterval = remaining;
+    return true;
+  }
+} // namespace mqttutils
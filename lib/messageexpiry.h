@@ -0,0 +1,31 @@
+#pragma once
+
+#include "mqtt/publish.h"
+#include <cstdint>
+#include <optional>
+
+namespace mqttutils {
+  // MessageExpiry applies the Message Expiry Interval of a PUBLISH packet.
+  // Times are in milliseconds of a monotonic clock, the same time base as
+  // the TimerWheel driving the expiry.
+  class MessageExpiry {
+  public:
+    // returns the time at which the message expires, nullopt if the message
+    // does not expire
+    static std::optional<uint64_t> deadline(const mqtt::Publish& p,
+                                            uint64_t receivedAt);
+
+    // returns true if the message received at receivedAt has expired
+    static bool expired(const mqtt::Publish& p, uint64_t receivedAt,
+                        uint64_t now);
+
+    // refresh must be called before the message is sent on. The Message
+    // Expiry Interval is set to the lifetime that is left, as required when
+    // the message is forwarded. Returns false if the message has expired and
+    // must be dropped
+    static bool refresh(mqtt::Publish& p, uint64_t receivedAt, uint64_t now);
+
+  private:
+    MessageExpiry() {}
+  };
+} // namespace mqttutils
@@ -0,0 +1,73 @@
+#include "doctest/doctest.h"
+#include "messageexpiry.h"
+#include "timerwheel.h"
+
+#include <list>
+#include <string>
+
+static mqtt::Publish makePublish(const std::string& topic,
+                                 std::optional<uint32_t> expiryInterval) {
+  mqtt::Publish p;
+  p.topicName = topic;
+  if (expiryInterval) {
+    p.properties = std::make_shared<mqtt::Publish::Properties>();
+    p.properties->messageExpiryInterval = expiryInterval;
+  }
+  return p;
+}
+
+TEST_CASE("testing message expiry deadline") {
+  CHECK_FALSE(mqttutils::MessageExpiry::deadline(makePublish("a", {}), 100));
+  CHECK(*mqttutils::MessageExpiry::deadline(makePublish("a", 2), 100) == 2100);
+
+  CHECK_FALSE(mqttutils::MessageExpiry::expired(makePublish("a", {}), 0,
+                                                UINT32_MAX));
+  CHECK_FALSE(mqttutils::MessageExpiry::expired(makePublish("a", 2), 0, 1999));
+  CHECK(mqttutils::MessageExpiry::expired(makePublish("a", 2), 0, 2000));
+}
+
+TEST_CASE("testing message expiry refresh") {
+  auto props = std::make_shared<mqtt::Publish::Properties>();
+  props->messageExpiryInterval = 10;
+  mqtt::Publish p = makePublish("a", {});
+  p.properties = props;
+
+  CHECK(mqttutils::MessageExpiry::refresh(p, 0, 2500));
+  CHECK(*p.properties->messageExpiryInterval == 8);
+  // the shared properties are untouched
+  CHECK(*props->messageExpiryInterval == 10);
+
+  mqtt::Publish q = makePublish("a", 10);
+  CHECK(mqttutils::MessageExpiry::refresh(q, 0, 9999));
+  CHECK(*q.properties->messageExpiryInterval == 1);
+  CHECK_FALSE(mqttutils::MessageExpiry::refresh(q, 0, 10000));
+}
+
+TEST_CASE("testing expired messages are dropped from a queue") {
+  mqttutils::TimerWheel wheel;
+  std::list<mqtt::Publish> queue;
+
+  for (auto p : {makePublish("a", 1), makePublish("b", {}),
+                 makePublish("c", 3)}) {
+    queue.push_back(p);
+    auto deadline = mqttutils::MessageExpiry::deadline(p, wheel.now());
+    if (deadline) {
+      auto it = std::prev(queue.end());
+      wheel.schedule(*deadline, [&queue, it] { queue.erase(it); });
+    }
+  }
+
+  wheel.advance(1500);
+  REQUIRE(queue.size() == 2);
+  CHECK(queue.front().topicName == "b");
+  CHECK(queue.back().topicName == "c");
+
+  // the consumer catches up, the message left is sent with the remaining
+  // lifetime
+  mqtt::Publish p = queue.back();
+  CHECK(mqttutils::MessageExpiry::refresh(p, 0, wheel.now()));
+  CHECK(*p.properties->messageExpiryInterval == 2);
+
+  wheel.advance(3000);
+  CHECK(queue.size() == 1);
+}
@@ -0,0 +1,199 @@
+#include "metrics.h"
+#include <cstdio>
+#include <stdexcept>
+
+namespace mqttutils {
+  Counter::Counter() {
+    for (auto& s : this->shards) {
+      s.value.store(0, std::memory_order_relaxed);
+    }
+  }
+
+  size_t Counter::shard() {
+    static std::atomic<size_t> next{0};
+    static thread_local size_t index =
+        next.fetch_add(1, std::memory_order_relaxed) % shardCount;
+    return index;
+  }
+
+  uint64_t Counter::value() const {
+    uint64_t sum = 0;
+    for (const auto& s : this->shards) {
+      sum += s.value.load(std::memory_order_relaxed);
+    }
+    return sum;
+  }
+
+  Gauge::Gauge() : current(0) {}
+
+  int64_t Gauge::value() const {
+    return this->current.load(std::memory_order_relaxed);
+  }
+
+  // renders the labels as name="value" pairs separated by commas, without
+  // the braces
+  static std::string renderLabels(const MetricLabels& labels) {
+    std::string out;
+    for (const auto& label : labels) {
+      if (!out.empty()) {
+        out += ',';
+      }
+      out += label.first;
+      out += "=\"";
+      for (char c : label.second) {
+        if (c == '\\' || c == '"') {
+          out += '\\';
+          out += c;
+        } else if (c == '\n') {
+          out += "\\n";
+        } else {
+          out += c;
+        }
+      }
+      out += '"';
+    }
+    return out;
+  }
+
+  static void appendSample(std::string& out, const std::string& name,
+                           const std::string& labels, const char* value) {
+    out += name;
+    if (!labels.empty()) {
+      out += '{';
+      out += labels;
+      out += '}';
+    }
+    out += ' ';
+    out += value;
+    out += '\n';
+  }
+
+  static void appendSample(std::string& out, const std::string& name,
+                           const std::string& labels, double value) {
+    char buffer[32];
+    snprintf(buffer, sizeof(buffer), "%.9g", value);
+    appendSample(out, name, labels, buffer);
+  }
+
+  static void appendSample(std::string& out, const std::string& name,
+                           const std::string& labels, int64_t value) {
+    appendSample(out, name, labels, std::to_string(value).c_str());
+  }
+
+  static void appendSample(std::string& out, const std::string& name,
+                           const std::string& labels, uint64_t value) {
+    appendSample(out, name, labels, std::to_string(value).c_str());
+  }
+
+  static void appendSummary(std::string& out, const std::string& name,
+                            const std::string& labels,
+                            const Histogram::Snapshot& s) {
+    static const std::pair<const char*, double> quantiles[] = {
+        {"0.5", 0.5}, {"0.99", 0.99}, {"0.999", 0.999}};
+    std::string sep = labels.empty() ? "" : ",";
+    for (const auto& q : quantiles) {
+      appendSample(out, name,
+                   labels + sep + "quantile=\"" + q.first + "\"",
+                   double(s.valueAt(q.second)) / 1e9);
+    }
+    appendSample(out, name + "_sum", labels, double(s.sum()) / 1e9);
+    appendSample(out, name + "_count", labels, s.count());
+  }
+
+  MetricsRegistry::MetricsRegistry() : nextSummaryID(1) {}
+
+  MetricsRegistry& MetricsRegistry::global() {
+    // never destroyed, the metrics are updated until the threads are gone
+    static MetricsRegistry& r = *new MetricsRegistry();
+    return r;
+  }
+
+  MetricsRegistry::Family& MetricsRegistry::family(const std::string& name,
+                                                   const std::string& help,
+                                                   Type type) {
+    auto it = this->families.find(name);
+    if (it == this->families.end()) {
+      it = this->families.emplace(name, Family{type, help, {}, {}, {}}).first;
+    }
+    if (it->second.type != type) {
+      throw std::logic_error("metric " + name +
+                             " is registered with another type");
+    }
+    return it->second;
+  }
+
+  Counter& MetricsRegistry::counter(const std::string& name,
+                                    const std::string& help,
+                                    const MetricLabels& labels) {
+    std::lock_guard<std::mutex> guard(this->mux);
+    auto& counters = this->family(name, help, Type::Counter).counters;
+    auto& c = counters[renderLabels(labels)];
+    if (!c) {
+      c = std::make_unique<Counter>();
+    }
+    return *c;
+  }
+
+  Gauge& MetricsRegistry::gauge(const std::string& name,
+                                const std::string& help,
+                                const MetricLabels& labels) {
+    std::lock_guard<std::mutex> guard(this->mux);
+    auto& gauges = this->family(name, help, Type::Gauge).gauges;
+    auto& g = gauges[renderLabels(labels)];
+    if (!g) {
+      g = std::make_unique<Gauge>();
+    }
+    return *g;
+  }
+
+  uint64_t MetricsRegistry::attachSummary(const std::string& name,
+                                          const std::string& help,
+                                          const MetricLabels& labels,
+                                          SnapshotSource source) {
+    std::lock_guard<std::mutex> guard(this->mux);
+    uint64_t id = this->nextSummaryID++;
+    this->family(name, help, Type::Summary)
+        .summaries.emplace(id,
+                           std::make_pair(renderLabels(labels), source));
+    return id;
+  }
+
+  void MetricsRegistry::detachSummary(uint64_t id) {
+    std::lock_guard<std::mutex> guard(this->mux);
+    for (auto& entry : this->families) {
+      entry.second.summaries.erase(id);
+    }
+  }
+
+  std::string MetricsRegistry::exposition() const {
+    std::lock_guard<std::mutex> guard(this->mux);
+    std::string out;
+    for (const auto& entry : this->families) {
+      const std::string& name = entry.first;
+      const Family& f = entry.second;
+      if (f.type == Type::Summary && f.summaries.empty()) {
+        continue;
+      }
+
+      static const char* types[] = {"counter", "gauge", "summary"};
+      out += "# HELP " + name + " " + f.help + "\n";
+      out += "# TYPE " + name + " " + types[static_cast<int>(f.type)] + "\n";
+      for (const auto& c : f.counters) {
+        appendSample(out, name, c.first, c.second->value());
+      }
+      for (const auto& g : f.gauges) {
+        appendSample(out, name, g.first, g.second->value());
+      }
+
+      // the sources with the same labels are merged
+      std::map<std::string, Histogram::Snapshot> merged;
+      for (const auto& s : f.summaries) {
+        merged[s.second.first].merge(s.second.second());
+      }
+      for (const auto& s : merged) {
+        appendSummary(out, name, s.first, s.second);
+      }
+    }
+    return out;
+  }
+} // namespace mqttutils
@@ -0,0 +1,119 @@
+#pragma once
+
+#include "histogram.h"
+#include "mqtt/noncopyable.h"
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace mqttutils {
+  using MetricLabels = std::vector<std::pair<std::string, std::string>>;
+
+  // Counter only goes up. It is sharded: a thread adds to its own cache
+  // line, the shards are summed when the counter is read
+  class Counter : private mqtt::noncopyable {
+  public:
+    static constexpr size_t shardCount = 16;
+
+    Counter();
+
+    inline void add(uint64_t n = 1) {
+      this->shards[Counter::shard()].value.fetch_add(
+          n, std::memory_order_relaxed);
+    }
+    uint64_t value() const;
+
+  private:
+    struct alignas(64) Shard {
+      std::atomic<uint64_t> value;
+    };
+
+    // the shard of the calling thread, assigned round robin
+    static size_t shard();
+
+    std::array<Shard, shardCount> shards;
+  };
+
+  // Gauge is a value that goes up and down, e.g. the connections
+  class Gauge : private mqtt::noncopyable {
+  public:
+    Gauge();
+
+    inline void add(int64_t n) {
+      this->current.fetch_add(n, std::memory_order_relaxed);
+    }
+    inline void set(int64_t v) {
+      this->current.store(v, std::memory_order_relaxed);
+    }
+    int64_t value() const;
+
+  private:
+    std::atomic<int64_t> current;
+  };
+
+  // MetricsRegistry holds the counters and gauges of the process, by name
+  // and labels, and renders them in the Prometheus text format. Getting a
+  // metric takes a lock, keep the reference: it stays valid as long as the
+  // registry. Updating a metric does not lock.
+  //
+  // Histograms have a single writer, see Histogram, so the registry does not
+  // own them: a summary is attached with a function returning a snapshot of
+  // the histograms, and is rendered with the p50/p99/p99.9 quantiles. The
+  // summaries attached with the same name and labels are merged.
+  //
+  // A name has one type, getting it as another type throws
+  // std::logic_error.
+  class MetricsRegistry : private mqtt::noncopyable {
+  public:
+    using SnapshotSource = std::function<Histogram::Snapshot()>;
+
+    MetricsRegistry();
+
+    // the registry the library instruments
+    static MetricsRegistry& global();
+
+    Counter& counter(const std::string& name, const std::string& help,
+                     const MetricLabels& labels = {});
+    Gauge& gauge(const std::string& name, const std::string& help,
+                 const MetricLabels& labels = {});
+
+    // the snapshot is in nanoseconds, it is rendered in seconds. Returns an
+    // ID for detachSummary, the source is called by exposition until then
+    uint64_t attachSummary(const std::string& name, const std::string& help,
+                           const MetricLabels& labels, SnapshotSource source);
+    void detachSummary(uint64_t id);
+
+    // exposition renders all the metrics in the Prometheus text format,
+    // version 0.0.4
+    std::string exposition() const;
+
+  private:
+    enum class Type { Counter, Gauge, Summary };
+
+    struct Family {
+      Type type;
+      std::string help;
+      // by rendered labels
+      std::map<std::string, std::unique_ptr<Counter>> counters;
+      std::map<std::string, std::unique_ptr<Gauge>> gauges;
+      // by ID: rendered labels, source
+      std::map<uint64_t, std::pair<std::string, SnapshotSource>> summaries;
+    };
+
+    Family& family(const std::string& name, const std::string& help,
+                   Type type);
+
+  private:
+    mutable std::mutex mux;
+    std::map<std::string, Family> families;
+    uint64_t nextSummaryID;
+  };
+} // namespace mqttutils
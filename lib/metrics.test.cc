@@ -0,0 +1,183 @@
+#include "doctest/doctest.h"
+#include "metrics.h"
+#include "metricsserver.h"
+#include "packet/codec.h"
+#include "packet/publish.h"
+#include "topic.h"
+#include <arpa/inet.h>
+#include <chrono>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+TEST_CASE("testing metrics counters and gauges") {
+  mqttutils::MetricsRegistry registry;
+  mqttutils::Counter& c = registry.counter("test_total", "help");
+  CHECK(&c == &registry.counter("test_total", "help"));
+
+  // every thread adds to its own shard
+  std::vector<std::thread> threads;
+  for (int i = 0; i < 8; ++i) {
+    threads.emplace_back([&c] {
+      for (int j = 0; j < 1000; ++j) {
+        c.add();
+      }
+    });
+  }
+  for (auto& t : threads) {
+    t.join();
+  }
+  CHECK(c.value() == 8000);
+
+  mqttutils::Gauge& g = registry.gauge("test_depth", "help");
+  g.add(5);
+  g.add(-2);
+  CHECK(g.value() == 3);
+  g.set(-1);
+  CHECK(g.value() == -1);
+
+  // a name has one type
+  CHECK_THROWS_AS(registry.gauge("test_total", "help"), std::logic_error);
+}
+
+TEST_CASE("testing metrics exposition") {
+  mqttutils::MetricsRegistry registry;
+  registry.counter("b_total", "Bees", {{"kind", "PUBLISH"}}).add(3);
+  registry.counter("b_total", "Bees", {{"kind", "a\"b\\c"}}).add();
+  registry.gauge("a_depth", "Depth").set(7);
+
+  mqttutils::Histogram h1;
+  mqttutils::Histogram h2;
+  h1.record(1000);
+  h2.record(3000);
+  uint64_t id1 = registry.attachSummary("c_seconds", "Latency",
+                                        {{"stage", "decode"}},
+                                        [&h1] { return h1.snapshot(); });
+  uint64_t id2 = registry.attachSummary("c_seconds", "Latency",
+                                        {{"stage", "decode"}},
+                                        [&h2] { return h2.snapshot(); });
+
+  // quantiles are bucket upper bounds, capped at the maximum
+  const std::string expected = "# HELP a_depth Depth\n"
+                               "# TYPE a_depth gauge\n"
+                               "a_depth 7\n"
+                               "# HELP b_total Bees\n"
+                               "# TYPE b_total counter\n"
+                               "b_total{kind=\"PUBLISH\"} 3\n"
+                               "b_total{kind=\"a\\\"b\\\\c\"} 1\n"
+                               "# HELP c_seconds Latency\n"
+                               "# TYPE c_seconds summary\n"
+                               "c_seconds{stage=\"decode\",quantile=\"0.5\"} 1.007e-06\n"
+                               "c_seconds{stage=\"decode\",quantile=\"0.99\"} 3e-06\n"
+                               "c_seconds{stage=\"decode\",quantile=\"0.999\"} 3e-06\n"
+                               "c_seconds_sum{stage=\"decode\"} 4e-06\n"
+                               "c_seconds_count{stage=\"decode\"} 2\n";
+  CHECK(registry.exposition() == expected);
+
+  // detached summaries are gone
+  registry.detachSummary(id1);
+  registry.detachSummary(id2);
+  CHECK(registry.exposition().find("c_seconds") == std::string::npos);
+}
+
+TEST_CASE("testing metrics of the library") {
+  mqttutils::MetricsRegistry& global = mqttutils::MetricsRegistry::global();
+
+  // decode errors
+  mqttutils::Counter& malformed = global.counter(
+      "mqtt_decode_errors_total", "", {{"error", "MalformedPacket"}});
+  uint64_t before = malformed.value();
+  packet::Decoder dec(std::vector<uint8_t>{0x00});
+  packet::PublishPacket pkt;
+  CHECK(packet::PublishDecoder::decode(dec, 0x30, 1, pkt));
+  CHECK(malformed.value() == before + 1);
+
+  // subscriptions and matches
+  mqttutils::Gauge& subscriptions =
+      global.gauge("mqtt_topic_subscriptions", "");
+  mqttutils::Counter& matches = global.counter("mqtt_topic_matches_total", "");
+  int64_t subscribed = subscriptions.value();
+  uint64_t matched = matches.value();
+  {
+    class NullSubscriber : public mqtt::Subscriber {
+    public:
+      void onData() override {}
+    };
+    auto s = std::make_shared<NullSubscriber>();
+    mqttutils::TopicMatcher matcher;
+    CHECK(!matcher.subscribe("a/+", s));
+    CHECK(!matcher.subscribe("a/b", s));
+    CHECK(subscriptions.value() == subscribed + 2);
+    CHECK(matcher.match("a/b").size() == 2);
+    CHECK(matches.value() == matched + 1);
+    CHECK(!matcher.unsubscribe("a/b", s));
+    CHECK(!matcher.unsubscribe("x/y", s));
+    CHECK(subscriptions.value() == subscribed + 1);
+  }
+  // the subscriptions left go with the matcher
+  CHECK(subscriptions.value() == subscribed);
+}
+
+TEST_CASE("testing metrics server") {
+  mqttutils::MetricsRegistry registry;
+  registry.counter("scraped_total", "Scrapes").add(42);
+  mqttutils::MetricsServer server(registry);
+  REQUIRE(server.start() == 0);
+  REQUIRE(server.getPort() > 0);
+
+  auto get = [&server](const std::string& request) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(static_cast<uint16_t>(server.getPort()));
+    inet_pton(AF_INET, "127.0.0.1", &addr.sin_addr);
+    REQUIRE(connect(fd, reinterpret_cast<const sockaddr*>(&addr),
+                    sizeof(addr)) == 0);
+    REQUIRE(send(fd, request.data(), request.size(), 0) ==
+            ssize_t(request.size()));
+    std::string response;
+    char buffer[1024];
+    ssize_t n = 0;
+    while ((n = recv(fd, buffer, sizeof(buffer), 0)) > 0) {
+      response.append(buffer, size_t(n));
+    }
+    close(fd);
+    return response;
+  };
+
+  std::string response =
+      get("GET /metrics HTTP/1.1\r\nHost: localhost\r\n\r\n");
+  CHECK(response.rfind("HTTP/1.1 200 OK\r\n", 0) == 0);
+  CHECK(response.find("text/plain; version=0.0.4") != std::string::npos);
+  CHECK(response.find("\r\n\r\n# HELP scraped_total Scrapes\n") !=
+        std::string::npos);
+  CHECK(response.find("scraped_total 42\n") != std::string::npos);
+
+  CHECK(get("GET / HTTP/1.1\r\n\r\n").rfind("HTTP/1.1 404", 0) == 0);
+
+  // a scraper that does not read a response larger than the socket buffers
+  // is dropped after the response timeout, stop does not hang
+  for (int i = 0; i < 8; ++i) {
+    registry.counter("large_" + std::to_string(i) + "_total",
+                     std::string(1 << 20, 'h'));
+  }
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  int small = 4096;
+  setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &small, sizeof(small));
+  sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(static_cast<uint16_t>(server.getPort()));
+  inet_pton(AF_INET, "127.0.0.1", &addr.sin_addr);
+  REQUIRE(connect(fd, reinterpret_cast<const sockaddr*>(&addr),
+                  sizeof(addr)) == 0);
+  const std::string request = "GET /metrics HTTP/1.1\r\n\r\n";
+  REQUIRE(send(fd, request.data(), request.size(), 0) ==
+          ssize_t(request.size()));
+  std::this_thread::sleep_for(std::chrono::milliseconds(100));
+  auto started = std::chrono::steady_clock::now();
+  server.stop();
+  CHECK(std::chrono::steady_clock::now() - started < std::chrono::seconds(5));
+  close(fd);
+}
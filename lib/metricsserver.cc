@@ -0,0 +1,169 @@
+#include "metricsserver.h"
+#include <arpa/inet.h>
+#include <cerrno>
+#include <chrono>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace mqttutils {
+  // a scraper that does not send its request in time is dropped
+  static constexpr int requestTimeout = 1000;
+  // and one that does not read the response in time as well, the server
+  // thread would block in send and stop() in join
+  static constexpr int responseTimeout = 1000;
+
+  MetricsServer::MetricsServer(MetricsRegistry& registryA)
+      : registry(registryA), listenFd(-1), wakeFds{-1, -1}, port(0) {}
+
+  MetricsServer::~MetricsServer() {
+    this->stop();
+  }
+
+  int MetricsServer::start(const std::string& address, int portA) {
+    if (this->listenFd != -1) {
+      return 0;
+    }
+
+    sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(static_cast<uint16_t>(portA));
+    if (inet_pton(AF_INET, address.c_str(), &addr.sin_addr) != 1) {
+      return EINVAL;
+    }
+
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd == -1) {
+      return errno;
+    }
+    int on = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    if (bind(fd, reinterpret_cast<const sockaddr*>(&addr), sizeof(addr)) != 0 ||
+        listen(fd, 16) != 0 || pipe(this->wakeFds) != 0) {
+      int err = errno;
+      ::close(fd);
+      return err;
+    }
+
+    socklen_t addrLen = sizeof(addr);
+    getsockname(fd, reinterpret_cast<sockaddr*>(&addr), &addrLen);
+    this->port = ntohs(addr.sin_port);
+    this->listenFd = fd;
+    this->thread = std::thread(&MetricsServer::serve, this);
+    return 0;
+  }
+
+  void MetricsServer::stop() {
+    if (this->listenFd == -1) {
+      return;
+    }
+
+    uint8_t b = 0;
+    if (write(this->wakeFds[1], &b, 1) == 1 && this->thread.joinable()) {
+      this->thread.join();
+    }
+    ::close(this->listenFd);
+    ::close(this->wakeFds[0]);
+    ::close(this->wakeFds[1]);
+    this->listenFd = -1;
+    this->wakeFds[0] = -1;
+    this->wakeFds[1] = -1;
+  }
+
+  int MetricsServer::getPort() const {
+    return this->port;
+  }
+
+  void MetricsServer::serve() {
+    for (;;) {
+      pollfd fds[2] = {{this->listenFd, POLLIN, 0},
+                       {this->wakeFds[0], POLLIN, 0}};
+      if (poll(fds, 2, -1) < 0) {
+        if (errno == EINTR) {
+          continue;
+        }
+        return;
+      }
+      if (fds[1].revents != 0) {
+        // stop requested
+        return;
+      }
+
+      int fd = ::accept(this->listenFd, nullptr, nullptr);
+      if (fd == -1) {
+        continue;
+      }
+      this->respond(fd);
+      ::close(fd);
+    }
+  }
+
+  // writeAll sends data without blocking, waiting for room in the socket
+  // buffer up to timeout milliseconds in total
+  static bool writeAll(int fd, const std::string& data, int timeout) {
+    auto deadline = std::chrono::steady_clock::now() +
+                    std::chrono::milliseconds(timeout);
+    size_t written = 0;
+    while (written < data.size()) {
+      ssize_t n = send(fd, data.data() + written, data.size() - written,
+#ifdef MSG_NOSIGNAL
+                       MSG_NOSIGNAL |
+#endif
+                           MSG_DONTWAIT);
+      if (n >= 0) {
+        written += static_cast<size_t>(n);
+        continue;
+      }
+      if (errno == EINTR) {
+        continue;
+      }
+      if (errno != EAGAIN && errno != EWOULDBLOCK) {
+        return false;
+      }
+      auto left = std::chrono::duration_cast<std::chrono::milliseconds>(
+                      deadline - std::chrono::steady_clock::now())
+                      .count();
+      pollfd pfd = {fd, POLLOUT, 0};
+      if (left <= 0 || poll(&pfd, 1, static_cast<int>(left)) <= 0) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  void MetricsServer::respond(int fd) {
+    // the request line and the headers, the body of a GET is ignored
+    std::string request;
+    char buffer[1024];
+    while (request.find("\r\n\r\n") == std::string::npos &&
+           request.size() < 8192) {
+      pollfd pfd = {fd, POLLIN, 0};
+      if (poll(&pfd, 1, requestTimeout) <= 0) {
+        return;
+      }
+      ssize_t n = recv(fd, buffer, sizeof(buffer), 0);
+      if (n <= 0) {
+        return;
+      }
+      request.append(buffer, static_cast<size_t>(n));
+    }
+
+    std::string status = "200 OK";
+    std::string body;
+    if (request.rfind("GET /metrics ", 0) == 0 ||
+        request.rfind("GET /metrics?", 0) == 0) {
+      body = this->registry.exposition();
+    } else if (request.rfind("GET ", 0) == 0) {
+      status = "404 Not Found";
+    } else {
+      status = "405 Method Not Allowed";
+    }
+    writeAll(fd, "HTTP/1.1 " + status +
+                     "\r\nContent-Type: text/plain; version=0.0.4\r\n"
+                     "Content-Length: " +
+                     std::to_string(body.size()) +
+                     "\r\nConnection: close\r\n\r\n" + body,
+             responseTimeout);
+  }
+} // namespace mqttutils
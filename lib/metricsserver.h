@@ -0,0 +1,36 @@
+#pragma once
+
+#include "metrics.h"
+#include "mqtt/noncopyable.h"
+#include <string>
+#include <thread>
+
+namespace mqttutils {
+  // MetricsServer serves the exposition of a registry over HTTP for a
+  // Prometheus scraper: GET /metrics, one request per connection. It is
+  // meant for a local endpoint, it listens on loopback by default and
+  // answers the requests one after the other on its own thread.
+  class MetricsServer : private mqtt::noncopyable {
+  public:
+    explicit MetricsServer(MetricsRegistry& registry);
+    ~MetricsServer();
+
+    // start binds the listener, port 0 binds an ephemeral port. Returns 0
+    // or the errno of the failing call
+    int start(const std::string& address = "127.0.0.1", int port = 0);
+    void stop();
+
+    int getPort() const;
+
+  private:
+    void serve();
+    void respond(int fd);
+
+  private:
+    MetricsRegistry& registry;
+    std::thread thread;
+    int listenFd;
+    int wakeFds[2];
+    int port;
+  };
+} // namespace mqttutils
@@ -0,0 +1,302 @@
+#include "offlinebuffer.h"
+#include "packet/packet.h"
+#include "packet/publishresponse.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <optional>
+#include <unistd.h>
+
+namespace mqttutils {
+  // segments hold the frames back to back, each prefixed by its length as a
+  // uint32 in host byte order
+  static constexpr size_t frameHeaderSize = 4;
+  // bytes read from a segment at once when draining
+  static constexpr size_t readChunkSize = 1 << 20;
+
+  static std::error_code lastError() {
+    return std::error_code(errno, std::generic_category());
+  }
+
+  static bool isPubRel(const std::vector<uint8_t>& frame) {
+    return static_cast<packet::ControlPacket::Type>(frame[0] >> 4) ==
+           packet::ControlPacket::Type::PUBREL;
+  }
+
+  // returns the packet identifier of a QoS 1 or 2 PUBLISH frame or of a
+  // PUBREL, nullopt for QoS 0. Returns false when the frame is neither
+  static bool packetIdentifier(const std::vector<uint8_t>& frame,
+                               std::optional<uint16_t>& packetID) {
+    packet::FixedHeader fhdr;
+    size_t headerLen = 0;
+    if (packet::FixedHeaderReader::parse(frame.data(), frame.size(), fhdr,
+                                         headerLen) !=
+            packet::FixedHeaderReader::Result::Complete ||
+        headerLen + fhdr.second != frame.size() || fhdr.second < 2) {
+      return false;
+    }
+
+    packetID.reset();
+    if (isPubRel(frame)) {
+      packetID = static_cast<uint16_t>(frame[headerLen] << 8 |
+                                       frame[headerLen + 1]);
+      return true;
+    }
+    if (static_cast<packet::ControlPacket::Type>(fhdr.first >> 4) !=
+        packet::ControlPacket::Type::PUBLISH) {
+      return false;
+    }
+    if (((fhdr.first >> 1) & 0x03) == 0) {
+      return true;
+    }
+    size_t topicLen = size_t(frame[headerLen]) << 8 | frame[headerLen + 1];
+    size_t pos = headerLen + 2 + topicLen;
+    if (pos + 2 > frame.size()) {
+      return false;
+    }
+    packetID = static_cast<uint16_t>(frame[pos] << 8 | frame[pos + 1]);
+    return true;
+  }
+
+  static bool writeAll(int fd, const uint8_t* data, size_t size) {
+    while (size > 0) {
+      ssize_t n = write(fd, data, size);
+      if (n < 0) {
+        if (errno == EINTR) {
+          continue;
+        }
+        return false;
+      }
+      data += n;
+      size -= static_cast<size_t>(n);
+    }
+    return true;
+  }
+
+  static bool readAll(int fd, uint8_t* data, size_t size, size_t offset) {
+    while (size > 0) {
+      ssize_t n = pread(fd, data, size, static_cast<off_t>(offset));
+      if (n <= 0) {
+        if (n < 0 && errno == EINTR) {
+          continue;
+        }
+        if (n == 0) {
+          errno = EIO;
+        }
+        return false;
+      }
+      data += n;
+      size -= static_cast<size_t>(n);
+      offset += static_cast<size_t>(n);
+    }
+    return true;
+  }
+
+  OfflineBuffer::OfflineBuffer() : OfflineBuffer(Options()) {}
+
+  OfflineBuffer::OfflineBuffer(Options optionsA)
+      : options(std::move(optionsA)), memoryUsed(0), diskFrames(0),
+        diskUsed(0), nextSegment(0), receiveMaximum(UINT16_MAX) {}
+
+  OfflineBuffer::~OfflineBuffer() {
+    while (!this->segments.empty()) {
+      this->removeSegment();
+    }
+  }
+
+  std::error_code OfflineBuffer::push(std::vector<uint8_t> frame) {
+    std::optional<uint16_t> packetID;
+    if (!packetIdentifier(frame, packetID) || isPubRel(frame)) {
+      return std::make_error_code(std::errc::invalid_argument);
+    }
+
+    // once frames are on disk the new ones follow them, the order is kept
+    if (this->segments.empty() &&
+        this->memoryUsed + frame.size() <= this->options.memoryBudget) {
+      this->memoryUsed += frame.size();
+      this->memory.emplace_back(std::move(frame));
+      return {};
+    }
+    if (this->options.spillDirectory.empty()) {
+      return std::make_error_code(std::errc::no_buffer_space);
+    }
+    return this->spill(frame);
+  }
+
+  std::error_code OfflineBuffer::spill(const std::vector<uint8_t>& frame) {
+    if (this->segments.empty() ||
+        this->segments.back().size >= this->options.segmentSize) {
+      Segment s{"", -1, 0, 0};
+      while (s.fd == -1) {
+        s.path = this->options.spillDirectory + "/offline-" +
+                 std::to_string(getpid()) + "-" +
+                 std::to_string(this->nextSegment++) + ".seg";
+        s.fd = ::open(s.path.c_str(), O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC,
+                      0600);
+        if (s.fd == -1 && errno != EEXIST) {
+          return lastError();
+        }
+      }
+      this->segments.push_back(s);
+    }
+
+    Segment& s = this->segments.back();
+    uint32_t len = static_cast<uint32_t>(frame.size());
+    uint8_t header[frameHeaderSize];
+    std::memcpy(header, &len, sizeof(len));
+    if (!writeAll(s.fd, header, sizeof(header)) ||
+        !writeAll(s.fd, frame.data(), frame.size())) {
+      auto ec = lastError();
+      // drop the partial frame
+      if (ftruncate(s.fd, static_cast<off_t>(s.size)) == 0) {
+        lseek(s.fd, static_cast<off_t>(s.size), SEEK_SET);
+      }
+      return ec;
+    }
+    s.size += frameHeaderSize + frame.size();
+    this->diskFrames++;
+    this->diskUsed += frameHeaderSize + frame.size();
+    return {};
+  }
+
+  // refill moves frames from the oldest segment to memory, up to the budget
+  std::error_code OfflineBuffer::refill() {
+    std::vector<uint8_t> chunk;
+    while (!this->segments.empty() &&
+           this->memoryUsed < this->options.memoryBudget) {
+      Segment& s = this->segments.front();
+      if (s.readOffset == s.size) {
+        this->removeSegment();
+        continue;
+      }
+
+      chunk.resize(std::min(s.size - s.readOffset, readChunkSize));
+      if (!readAll(s.fd, chunk.data(), chunk.size(), s.readOffset)) {
+        return lastError();
+      }
+
+      size_t pos = 0;
+      while (pos + frameHeaderSize <= chunk.size() &&
+             this->memoryUsed < this->options.memoryBudget) {
+        uint32_t len = 0;
+        std::memcpy(&len, chunk.data() + pos, sizeof(len));
+        std::vector<uint8_t> frame;
+        if (pos + frameHeaderSize + len <= chunk.size()) {
+          auto begin = chunk.begin() + static_cast<std::ptrdiff_t>(pos + frameHeaderSize);
+          frame.assign(begin, begin + len);
+        } else if (pos == 0) {
+          // the frame is larger than a chunk
+          frame.resize(len);
+          if (!readAll(s.fd, frame.data(), len,
+                       s.readOffset + frameHeaderSize)) {
+            return lastError();
+          }
+        } else {
+          break;
+        }
+
+        pos += frameHeaderSize + len;
+        this->diskFrames--;
+        this->diskUsed -= frameHeaderSize + len;
+        this->memoryUsed += len;
+        this->memory.emplace_back(std::move(frame));
+      }
+      s.readOffset += pos;
+    }
+    return {};
+  }
+
+  void OfflineBuffer::removeSegment() {
+    Segment& s = this->segments.front();
+    ::close(s.fd);
+    unlink(s.path.c_str());
+    this->segments.pop_front();
+  }
+
+  std::error_code OfflineBuffer::drain(const Sender& send) {
+    for (;;) {
+      if (this->memory.empty()) {
+        auto ec = this->refill();
+        if (ec) {
+          return ec;
+        }
+        if (this->memory.empty()) {
+          return {};
+        }
+      }
+
+      const std::vector<uint8_t>& frame = this->memory.front();
+      std::optional<uint16_t> packetID;
+      packetIdentifier(frame, packetID);
+      // a PUBREL continues an exchange the quota already counts
+      if (packetID && !isPubRel(frame) &&
+          this->unacknowledged.size() >= this->receiveMaximum) {
+        return {};
+      }
+      if (!send(frame)) {
+        return {};
+      }
+      this->memoryUsed -= frame.size();
+      if (packetID) {
+        this->unacknowledged.emplace_back(*packetID,
+                                          std::move(this->memory.front()));
+      }
+      this->memory.pop_front();
+    }
+  }
+
+  void OfflineBuffer::reset(uint16_t receiveMaximumA) {
+    // 0 is not allowed, the property is absent then and the default applies
+    this->receiveMaximum = receiveMaximumA == 0 ? UINT16_MAX : receiveMaximumA;
+    // the oldest goes in front last, the order they were sent in is kept
+    while (!this->unacknowledged.empty()) {
+      std::vector<uint8_t>& frame = this->unacknowledged.back().second;
+      if (!isPubRel(frame)) {
+        frame[0] |= 0x08;
+      }
+      this->memoryUsed += frame.size();
+      this->memory.emplace_front(std::move(frame));
+      this->unacknowledged.pop_back();
+    }
+  }
+
+  void OfflineBuffer::acknowledge(uint16_t packetID) {
+    // the acknowledgements mostly come in the order of the frames
+    auto it = std::find_if(
+        this->unacknowledged.begin(), this->unacknowledged.end(),
+        [packetID](const auto& entry) { return entry.first == packetID; });
+    if (it != this->unacknowledged.end()) {
+      this->unacknowledged.erase(it);
+    }
+  }
+
+  void OfflineBuffer::acknowledgeReceived(uint16_t packetID) {
+    auto it = std::find_if(
+        this->unacknowledged.begin(), this->unacknowledged.end(),
+        [packetID](const auto& entry) { return entry.first == packetID; });
+    if (it == this->unacknowledged.end() || isPubRel(it->second)) {
+      return;
+    }
+    // the PUBLISH is not sent again, the PUBREL takes its place
+    packet::PublishResponsePacket pubrel{packet::ControlPacket::Type::PUBREL,
+                                         packetID, {}};
+    it->second = packet::PublishResponseEncoder(pubrel).encode();
+  }
+
+  size_t OfflineBuffer::size() const {
+    return this->memory.size() + this->diskFrames;
+  }
+
+  size_t OfflineBuffer::memoryBytes() const {
+    return this->memoryUsed;
+  }
+
+  size_t OfflineBuffer::diskBytes() const {
+    return this->diskUsed;
+  }
+
+  size_t OfflineBuffer::inflight() const {
+    return this->unacknowledged.size();
+  }
+} // namespace mqttutils
@@ -0,0 +1,98 @@
+#pragma once
+
+#include "mqtt/noncopyable.h"
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <string>
+#include <system_error>
+#include <utility>
+#include <vector>
+
+namespace mqttutils {
+  // OfflineBuffer queues outbound PUBLISH frames while the connection is
+  // down. Frames are the PublishEncoder output and are sent as they are, no
+  // re-encoding on replay. The frames are held in memory up to a budget,
+  // further frames spill to segment files in the spill directory. On
+  // reconnect drain hands the frames out in the order they were pushed,
+  // segments are read back in large chunks.
+  //
+  // QoS 1 and 2 frames count against the Receive Maximum of the broker
+  // until they are acknowledged, draining stops when the quota is used up.
+  // The sent frames are kept until they are acknowledged: a reset puts the
+  // ones without an acknowledgement back in front of the queue, in the order
+  // they were sent, with the DUP flag set. A QoS 2 frame the broker has
+  // received (PUBREC) is replaced by its PUBREL, which is sent again instead.
+  // The segment files are removed when they are drained and when the buffer
+  // is destroyed, the buffer does not survive a restart.
+  class OfflineBuffer : private mqtt::noncopyable {
+  public:
+    struct Options {
+      // bytes of frames kept in memory
+      size_t memoryBudget{4 << 20};
+      // directory of the segment files, frames beyond the memory budget are
+      // rejected when empty
+      std::string spillDirectory;
+      // a new segment file is started when the current one is this large
+      size_t segmentSize{16 << 20};
+    };
+
+    // send returns false when the frame could not be sent, the frame stays
+    // in the buffer
+    using Sender = std::function<bool(const std::vector<uint8_t>& frame)>;
+
+    OfflineBuffer();
+    explicit OfflineBuffer(Options options);
+    ~OfflineBuffer();
+
+    std::error_code push(std::vector<uint8_t> frame);
+
+    // drain sends frames until the buffer is empty, the Receive Maximum is
+    // reached or send fails
+    std::error_code drain(const Sender& send);
+
+    // reset starts a new connection with the Receive Maximum from CONNACK,
+    // the frames sent on the previous one and not acknowledged are sent again
+    void reset(uint16_t receiveMaximum);
+    // acknowledge is called on PUBACK, PUBCOMP or a PUBREC with an error
+    // reason code, the exchange is over
+    void acknowledge(uint16_t packetID);
+    // acknowledgeReceived is called on a successful PUBREC, the caller sends
+    // the PUBREL
+    void acknowledgeReceived(uint16_t packetID);
+
+    size_t size() const;
+    // bytes of the frames waiting in memory, the sent frames waiting for an
+    // acknowledgement are not included
+    size_t memoryBytes() const;
+    size_t diskBytes() const;
+    size_t inflight() const;
+
+  private:
+    struct Segment {
+      std::string path;
+      int fd;
+      size_t size;
+      size_t readOffset;
+    };
+
+    std::error_code spill(const std::vector<uint8_t>& frame);
+    std::error_code refill();
+    void removeSegment();
+
+  private:
+    const Options options;
+    std::deque<std::vector<uint8_t>> memory;
+    size_t memoryUsed;
+    // oldest segment first, frames are appended to the last one
+    std::deque<Segment> segments;
+    size_t diskFrames;
+    size_t diskUsed;
+    uint64_t nextSegment;
+    uint16_t receiveMaximum;
+    // the sent QoS 1 and 2 frames by packet identifier, in the order they
+    // were sent. A QoS 2 frame is a PUBREL once the broker has received it
+    std::deque<std::pair<uint16_t, std::vector<uint8_t>>> unacknowledged;
+  };
+} // namespace mqttutils
@@ -0,0 +1,226 @@
+#include "doctest/doctest.h"
+#include "offlinebuffer.h"
+#include "packet/publish.h"
+
+#include <filesystem>
+#include <unistd.h>
+
+namespace test {
+  static std::vector<uint8_t> frame(uint16_t packetID, uint8_t qosLevel,
+                                    size_t payloadSize = 100) {
+    mqtt::Publish p;
+    p.topicName = "gateway/7/telemetry";
+    p.qosLevel = qosLevel;
+    p.payload.assign(payloadSize, uint8_t(packetID));
+    return packet::PublishEncoder({packetID, p}).encode();
+  }
+
+  // SpillDirectory removes the directory when the test is done
+  struct SpillDirectory {
+    explicit SpillDirectory(const std::string& name)
+        : path((std::filesystem::temp_directory_path() /
+                (name + "-" + std::to_string(getpid())))
+                   .string()) {
+      std::filesystem::remove_all(this->path);
+      std::filesystem::create_directories(this->path);
+    }
+    ~SpillDirectory() {
+      std::filesystem::remove_all(this->path);
+    }
+    size_t files() const {
+      auto it = std::filesystem::directory_iterator(this->path);
+      return size_t(std::distance(it, std::filesystem::directory_iterator()));
+    }
+    const std::string path;
+  };
+} // namespace test
+
+TEST_CASE("testing offline buffer in memory") {
+  mqttutils::OfflineBuffer buffer;
+  for (uint16_t id = 1; id <= 10; ++id) {
+    REQUIRE(!buffer.push(test::frame(id, id % 2 == 0 ? 0 : 1)));
+  }
+  CHECK(buffer.size() == 10);
+  CHECK(buffer.diskBytes() == 0);
+  CHECK(buffer.push({0x20, 0x02, 0x00, 0x00}) == std::errc::invalid_argument);
+
+  std::vector<std::vector<uint8_t>> sent;
+  auto send = [&sent](const std::vector<uint8_t>& f) {
+    sent.push_back(f);
+    return true;
+  };
+  REQUIRE(!buffer.drain(send));
+  REQUIRE(sent.size() == 10);
+  for (uint16_t id = 1; id <= 10; ++id) {
+    CHECK(sent[id - 1] == test::frame(id, id % 2 == 0 ? 0 : 1));
+  }
+  CHECK(buffer.size() == 0);
+  CHECK(buffer.memoryBytes() == 0);
+  CHECK(buffer.inflight() == 5);
+}
+
+TEST_CASE("testing offline buffer receive maximum") {
+  mqttutils::OfflineBuffer buffer;
+  buffer.reset(2);
+  REQUIRE(!buffer.push(test::frame(1, 1)));
+  REQUIRE(!buffer.push(test::frame(0, 0)));
+  REQUIRE(!buffer.push(test::frame(2, 1)));
+  REQUIRE(!buffer.push(test::frame(3, 1)));
+  REQUIRE(!buffer.push(test::frame(0, 0)));
+
+  size_t sent = 0;
+  auto send = [&sent](const std::vector<uint8_t>&) {
+    ++sent;
+    return true;
+  };
+  // QoS 0 frames behind the blocked frame wait, the order is kept
+  REQUIRE(!buffer.drain(send));
+  CHECK(sent == 3);
+  CHECK(buffer.inflight() == 2);
+  buffer.acknowledge(1);
+  REQUIRE(!buffer.drain(send));
+  CHECK(sent == 5);
+  CHECK(buffer.size() == 0);
+
+  // a failing send keeps the frame
+  REQUIRE(!buffer.push(test::frame(0, 0)));
+  REQUIRE(!buffer.drain([](const std::vector<uint8_t>&) { return false; }));
+  CHECK(buffer.size() == 1);
+}
+
+TEST_CASE("testing offline buffer spills to disk") {
+  test::SpillDirectory dir("mqtt-offline");
+  mqttutils::OfflineBuffer::Options options;
+  options.memoryBudget = 1024;
+  options.spillDirectory = dir.path;
+  options.segmentSize = 4096;
+  mqttutils::OfflineBuffer buffer(options);
+
+  for (uint16_t id = 1; id <= 500; ++id) {
+    REQUIRE(!buffer.push(test::frame(id, 1)));
+  }
+  CHECK(buffer.size() == 500);
+  CHECK(buffer.memoryBytes() <= 1024);
+  CHECK(buffer.diskBytes() > 0);
+  CHECK(dir.files() > 1);
+
+  // drain in the order of the pushes, part of the frames before reconnect
+  std::vector<uint16_t> sent;
+  auto send = [&sent](const std::vector<uint8_t>& f) {
+    sent.push_back(f.back());
+    return true;
+  };
+  buffer.reset(100);
+  REQUIRE(!buffer.drain(send));
+  CHECK(sent.size() == 100);
+  for (uint16_t id = 1; id <= 100; ++id) {
+    buffer.acknowledge(id);
+  }
+  // frames pushed while draining go behind the ones on disk
+  REQUIRE(!buffer.push(test::frame(501, 1)));
+  buffer.reset(UINT16_MAX);
+  REQUIRE(!buffer.drain(send));
+  REQUIRE(sent.size() == 501);
+  for (size_t i = 0; i < sent.size(); ++i) {
+    CHECK(sent[i] == uint8_t(i + 1));
+  }
+  CHECK(buffer.size() == 0);
+  CHECK(buffer.diskBytes() == 0);
+  CHECK(dir.files() == 0);
+
+  // a frame larger than the budget is spilled and read back as well
+  REQUIRE(!buffer.push(test::frame(7, 0, 2048)));
+  sent.clear();
+  REQUIRE(!buffer.drain(send));
+  CHECK(sent.size() == 1);
+}
+
+TEST_CASE("testing offline buffer without spill directory") {
+  mqttutils::OfflineBuffer::Options options;
+  options.memoryBudget = 300;
+  mqttutils::OfflineBuffer buffer(options);
+  REQUIRE(!buffer.push(test::frame(1, 1)));
+  REQUIRE(!buffer.push(test::frame(2, 1)));
+  CHECK(buffer.push(test::frame(3, 1)) == std::errc::no_buffer_space);
+  CHECK(buffer.size() == 2);
+}
+
+TEST_CASE("testing offline buffer resends the frames not acknowledged") {
+  mqttutils::OfflineBuffer buffer;
+  for (uint16_t id = 1; id <= 4; ++id) {
+    REQUIRE(!buffer.push(test::frame(id, id == 3 ? 0 : 1)));
+  }
+
+  std::vector<std::vector<uint8_t>> sent;
+  auto send = [&sent](const std::vector<uint8_t>& f) {
+    sent.push_back(f);
+    return true;
+  };
+  REQUIRE(!buffer.drain(send));
+  CHECK(sent.size() == 4);
+  CHECK(buffer.inflight() == 3);
+  buffer.acknowledge(2);
+
+  // disconnected before the PUBACK of 1 and 4: they are sent again first,
+  // in order and as duplicates, then the frames pushed meanwhile
+  REQUIRE(!buffer.push(test::frame(5, 1)));
+  buffer.reset(10);
+  CHECK(buffer.size() == 3);
+  CHECK(buffer.inflight() == 0);
+  sent.clear();
+  REQUIRE(!buffer.drain(send));
+  REQUIRE(sent.size() == 3);
+  const std::vector<uint16_t> resent = {1, 4, 5};
+  for (size_t i = 0; i < sent.size(); ++i) {
+    uint16_t id = resent[i];
+    std::vector<uint8_t> expected = test::frame(id, 1);
+    if (id != 5) {
+      expected[0] |= 0x08;
+    }
+    CHECK(sent[i] == expected);
+  }
+
+  // acknowledged on the new connection, nothing left to resend
+  for (uint16_t id : resent) {
+    buffer.acknowledge(id);
+  }
+  buffer.reset(10);
+  CHECK(buffer.size() == 0);
+}
+
+TEST_CASE("testing offline buffer resends the PUBREL of received QoS 2") {
+  mqttutils::OfflineBuffer buffer;
+  for (uint16_t id = 1; id <= 3; ++id) {
+    REQUIRE(!buffer.push(test::frame(id, 2)));
+  }
+  std::vector<std::vector<uint8_t>> sent;
+  auto send = [&sent](const std::vector<uint8_t>& f) {
+    sent.push_back(f);
+    return true;
+  };
+  REQUIRE(!buffer.drain(send));
+  CHECK(sent.size() == 3);
+
+  // 1 and 3 reached the broker, 2 did not: a PUBREL goes out for 1 and 3,
+  // the PUBLISH again for 2, in the order they were sent. The PUBREL of 3
+  // is not held back by the quota the three exchanges use up
+  buffer.acknowledgeReceived(1);
+  buffer.acknowledgeReceived(3);
+  CHECK(buffer.inflight() == 3);
+  buffer.reset(2);
+  sent.clear();
+  REQUIRE(!buffer.drain(send));
+  REQUIRE(sent.size() == 3);
+  CHECK(sent[0] == std::vector<uint8_t>{0x62, 0x02, 0x00, 0x01});
+  std::vector<uint8_t> dup = test::frame(2, 2);
+  dup[0] |= 0x08;
+  CHECK(sent[1] == dup);
+  CHECK(sent[2] == std::vector<uint8_t>{0x62, 0x02, 0x00, 0x03});
+
+  // PUBCOMP ends the exchange
+  buffer.acknowledge(1);
+  buffer.acknowledge(3);
+  CHECK(buffer.inflight() == 1);
+  // a PUBREL is not pushed by the caller
+  CHECK(buffer.push({0x62, 0x02, 0x00, 0x04}) == std::errc::invalid_argument);
+}
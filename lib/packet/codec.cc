@@ -1,33 +1,107 @@
 #include "codec.h"
+#include "../bufferpool.h"
+#include "../metrics.h"
+#include "../probes.h"
+#include "../utf8.h"
+#include <algorithm>
+#include <array>
 #include <iostream>
-#include <sstream>
+#include <limits>
 #include <string>
 
 namespace packet {
-  Encoder::Encoder(size_t capacity) {
+  // the label of a decode error, the errors of the other modules are not
+  // returned by the decoders
+  static const char* errorLabel(mqtt::Error err) {
+    switch (err) {
+    case mqtt::Error::InvalidProtocolName:
+      return "InvalidProtocolName";
+    case mqtt::Error::MalformedUTF8String:
+      return "MalformedUTF8String";
+    case mqtt::Error::MalformedPacket:
+      return "MalformedPacket";
+    case mqtt::Error::InvalidPropertyID:
+      return "InvalidPropertyID";
+    case mqtt::Error::DuplicateProperty:
+      return "DuplicateProperty";
+    case mqtt::Error::UnsupportedProtocolVersion:
+      return "UnsupportedProtocolVersion";
+    default:
+      return "Other";
+    }
+  }
+
+  void Decoder::countError(mqtt::Error err) {
+    constexpr size_t errorCount =
+        static_cast<size_t>(mqtt::Error::UnsupportedProtocolVersion) + 1;
+    static const auto counters = [] {
+      std::array<mqttutils::Counter*, errorCount> c{};
+      for (size_t i = 0; i < errorCount; ++i) {
+        c[i] = &mqttutils::MetricsRegistry::global().counter(
+            "mqtt_decode_errors_total", "Packets rejected by the decoders",
+            {{"error", errorLabel(static_cast<mqtt::Error>(i))}});
+      }
+      return c;
+    }();
+    size_t i = static_cast<size_t>(err);
+    counters[i < errorCount ? i : 0]->add();
+  }
+
+  std::error_code Decoder::done(ControlPacket::Type type) const {
+    MQTT_PROBE3(packet__decode, static_cast<int>(type), this->index,
+                static_cast<int>(this->status));
+    return this->status;
+  }
+
+  Encoder::Encoder() : out(&buffer) {}
+
+  Encoder::Encoder(size_t capacity)
+      : buffer(mqttutils::BufferPool::local().acquire(capacity)),
+        out(&buffer) {
+    // larger than the largest size class
     buffer.reserve(capacity);
   }
 
+  Encoder::Encoder(Sink& sink) : out(&sink) {}
+
+  Encoder::~Encoder() {
+    if (this->buffer.capacity() > 0) {
+      mqttutils::BufferPool::local().release(std::move(this->buffer));
+    }
+  }
+
+  void Encoder::reserve(size_t size) {
+    if (this->out == &this->buffer && this->buffer.capacity() == 0) {
+      this->buffer = mqttutils::BufferPool::local().acquire(size);
+    }
+    // a sink takes many packets: growing it by exactly one packet would copy
+    // it on every append, it doubles instead
+    std::vector<uint8_t>& b = *this->out;
+    if (b.capacity() - b.size() < size) {
+      b.reserve(std::max(2 * b.capacity(), b.size() + size));
+    }
+  }
+
   void Encoder::write(bool value) {
-    buffer.push_back(value ? 1 : 0);
+    this->out->push_back(value ? 1 : 0);
   }
 
   void Encoder::write(uint8_t value) {
-    buffer.push_back(value);
+    this->out->push_back(value);
   }
 
   // Write Big Endian 16-bit
   void Encoder::write(uint16_t value) {
-    buffer.push_back(uint8_t(value >> 8));
-    buffer.push_back(uint8_t(value));
+    this->out->push_back(uint8_t(value >> 8));
+    this->out->push_back(uint8_t(value));
   }
 
   // Write Big Endian 32-bit
   void Encoder::write(uint32_t value) {
-    buffer.push_back(uint8_t(value >> 24));
-    buffer.push_back(uint8_t(value >> 16));
-    buffer.push_back(uint8_t(value >> 8));
-    buffer.push_back(uint8_t(value));
+    this->out->push_back(uint8_t(value >> 24));
+    this->out->push_back(uint8_t(value >> 16));
+    this->out->push_back(uint8_t(value >> 8));
+    this->out->push_back(uint8_t(value));
   }
 
   void Encoder::write(const std::vector<uint8_t>& value) {
@@ -51,16 +125,25 @@ namespace packet {
           std::string(": Variable integer contains value of %d which is more "
                       "than the permissible"));
     }
-    do {
-      uint8_t encodedByte = value % 0x80;
-      value = value / 0x80;
-
-      if (value > 0) {
-        encodedByte |= 0x80;
-      }
-
-      this->write(encodedByte);
-    } while (value != 0);
+    // unrolled like EncodedVarUint32::encode, push_back is cheaper than
+    // an insert of the variable length
+    std::vector<uint8_t>& b = *this->out;
+    if (value < (1u << 7)) {
+      b.push_back(uint8_t(value));
+      return;
+    }
+    b.push_back(uint8_t(value | 0x80));
+    if (value < (1u << 14)) {
+      b.push_back(uint8_t(value >> 7));
+      return;
+    }
+    b.push_back(uint8_t((value >> 7) | 0x80));
+    if (value < (1u << 21)) {
+      b.push_back(uint8_t(value >> 14));
+      return;
+    }
+    b.push_back(uint8_t((value >> 14) | 0x80));
+    b.push_back(uint8_t(value >> 21));
   }
 
   void Encoder::writeBinaryData(const std::vector<uint8_t>& value) {
@@ -75,7 +158,11 @@ namespace packet {
   }
 
   void Encoder::writeBinaryDataNoLen(const std::vector<uint8_t>& value) {
-    this->buffer.insert(this->buffer.end(), value.begin(), value.end());
+    this->out->insert(this->out->end(), value.begin(), value.end());
+  }
+
+  void Encoder::writeBytes(const uint8_t* data, size_t size) {
+    this->out->insert(this->out->end(), data, data + size);
   }
 
   void Encoder::writeUTF8String(const std::string& value) {
@@ -85,68 +172,74 @@ namespace packet {
                                 std::string(": positive overflow"));
     }
     this->write(static_cast<uint16_t>(value.size()));
-    this->writeBinaryDataNoLen(
-        std::vector<uint8_t>(value.begin(), value.end()));
+    this->writeBytes(reinterpret_cast<const uint8_t*>(value.data()), size);
   }
 
   const std::vector<uint8_t>& Encoder::getBuffer() const {
-    return buffer;
+    return *this->out;
+  }
+
+  std::vector<uint8_t> Encoder::takeBuffer() {
+    return std::move(*this->out);
   }
 
   // --------------------------------------------------------------------------------------
 
-  Decoder::Decoder(std::vector<uint8_t> value) : buffer(value), index(0) {}
+  Decoder::Decoder(std::vector<uint8_t> value)
+      : buffer(std::move(value)), data(buffer.data()), length(buffer.size()),
+        index(0), resource(nullptr), status(mqtt::Error::Success) {}
+
+  Decoder::Decoder(const uint8_t* dataA, size_t size,
+                   std::pmr::memory_resource* resourceA)
+      : data(dataA), length(size), index(0), resource(resourceA),
+        status(mqtt::Error::Success) {}
 
   uint16_t Decoder::readBigEndianUint16() {
+    if (__builtin_expect(this->remaining() < 2, 0)) {
+      this->fail(mqtt::Error::MalformedPacket);
+      return 0;
+    }
     uint16_t result =
-        static_cast<uint16_t>((static_cast<uint16_t>(buffer[index++]) << 8));
-    result |= uint16_t(buffer[index++]);
+        static_cast<uint16_t>((static_cast<uint16_t>(data[index++]) << 8));
+    result |= uint16_t(data[index++]);
     return result;
   }
 
   uint32_t Decoder::readBigEndianUint32() {
-    uint16_t result =
-        static_cast<uint16_t>((static_cast<uint16_t>(buffer[index++]) << 24));
-    result |= uint16_t(buffer[index++]) << 16;
-    result |= uint16_t(buffer[index++]) << 8;
-    result |= uint16_t(buffer[index++]);
+    if (__builtin_expect(this->remaining() < 4, 0)) {
+      this->fail(mqtt::Error::MalformedPacket);
+      return 0;
+    }
+    uint32_t result = static_cast<uint32_t>(data[index++]) << 24;
+    result |= static_cast<uint32_t>(data[index++]) << 16;
+    result |= static_cast<uint32_t>(data[index++]) << 8;
+    result |= static_cast<uint32_t>(data[index++]);
 
     return result;
   }
 
   uint32_t Decoder::readVarUint32() {
     uint32_t value = 0;
-    uint32_t multiplier = 1;
-    uint8_t consumed = 0;
-
-    while (true) {
-      uint8_t encodedByte = this->read<uint8_t>();
-      consumed++;
-      if (consumed > 4) {
-        std::ostringstream stream;
-        stream << __PRETTY_FUNCTION__
-               << "  :variable integer contained more than maximum bytes  "
-               << consumed;
-        throw std::overflow_error(stream.str());
-      }
-      value += static_cast<uint32_t>(encodedByte & 0x7f) * multiplier;
-      if ((encodedByte & 0x80) == 0) {
-        break;
-      }
-
-      multiplier *= 128;
-      if (multiplier > 128 * 128 * 128) {
-        std::ostringstream stream;
-        stream << __PRETTY_FUNCTION__
-               << "  :variable integer contains value of " << multiplier
-               << " which is more than the permissible";
-        throw std::overflow_error(stream.str());
-      }
+    uint32_t n = EncodedVarUint32::decode(this->data + this->index,
+                                          this->remaining(), value);
+    if (__builtin_expect(n == 0, 0)) {
+      // runs past the end or is longer than 4 bytes
+      this->fail(mqtt::Error::MalformedPacket);
+      return 0;
     }
-
+    this->index += n;
     return value;
   }
 
+  uint32_t Decoder::readLength() {
+    uint32_t size = this->readVarUint32();
+    if (__builtin_expect(size > this->remaining(), 0)) {
+      this->fail(mqtt::Error::MalformedPacket);
+      return 0;
+    }
+    return size;
+  }
+
   std::vector<uint8_t> Decoder::readBinaryData() {
     size_t size = this->readBigEndianUint16();
     return this->readBinaryDataNoLen(size);
@@ -154,28 +247,40 @@ namespace packet {
 
   std::vector<uint8_t> Decoder::readBinaryDataNoLen(size_t size) {
     std::vector<uint8_t> result;
-    result.assign(this->buffer.data() + this->index,
-                  this->buffer.data() + (this->index + size));
+    if (__builtin_expect(size > this->remaining(), 0)) {
+      this->fail(mqtt::Error::MalformedPacket);
+      return result;
+    }
+    result.assign(this->data + this->index,
+                  this->data + (this->index + size));
     this->index += size;
     return result;
   }
 
+  const uint8_t* Decoder::readView(size_t size) {
+    if (__builtin_expect(size > this->remaining(), 0)) {
+      this->fail(mqtt::Error::MalformedPacket);
+      return nullptr;
+    }
+    const uint8_t* view = this->data + this->index;
+    this->index += size;
+    return view;
+  }
+
   std::string Decoder::readUTF8String() {
     size_t size = this->readBigEndianUint16();
-    std::string result(this->buffer.data() + this->index,
-                       this->buffer.data() + (this->index + size));
+    if (__builtin_expect(size > this->remaining(), 0)) {
+      this->fail(mqtt::Error::MalformedPacket);
+      return std::string();
+    }
+    const char* str = reinterpret_cast<const char*>(this->data + this->index);
+    if (!mqttutils::UTF8::validate(str, size)) {
+      this->fail(mqtt::Error::MalformedUTF8String);
+      return std::string();
+    }
+    std::string result(str, size);
     this->index += size;
     return result;
   }
 
-  uint32_t EncodedVarUint32::size(uint32_t value) {
-    uint32_t varSize = 0;
-    do {
-      // uint8_t encodedByte = value % 0x80;
-      value /= 0x80;
-      varSize++;
-    } while (value != 0);
-
-    return varSize;
-  }
 } // namespace packet
@@ -1,16 +1,34 @@
 #pragma once
 
+#include "mqtt/error.h"
+#include "packet.h"
 #include "mqtt/noncopyable.h"
 #include <cstdint>
 #include <iostream>
+#include <iterator>
+#include <memory>
+#include <memory_resource>
 #include <string>
+#include <system_error>
 #include <vector>
 
 namespace packet {
   const uint32_t maxVarUint32 = 268435455;
+
+  // Encoder writes into a buffer from the buffer pool of the thread, the
+  // buffer goes back to the pool with the encoder unless it is taken. An
+  // encoder made with a sink appends to it instead
   class Encoder : private mqtt::noncopyable {
   public:
+    // the buffer is acquired by reserve
+    Encoder();
     explicit Encoder(size_t capacity);
+    explicit Encoder(Sink& sink);
+    ~Encoder();
+
+    // reserve makes room for size more bytes
+    void reserve(size_t size);
+
     // todo: check later, change to operator <<
     void write(bool value);
     void write(uint8_t value);
@@ -22,8 +40,12 @@ namespace packet {
     void writeVarUint32(const std::vector<uint32_t>& value);
     void writeVarUint32(uint32_t value);
     void writeBinaryDataNoLen(const std::vector<uint8_t>& value);
+    void writeBytes(const uint8_t* data, size_t size);
 
     const std::vector<uint8_t>& getBuffer() const;
+    // takeBuffer moves the encoded buffer out of the encoder. Release it to
+    // mqttutils::BufferPool::local() once written. Not for a sink
+    std::vector<uint8_t> takeBuffer();
 
   private:
     void writeBinaryData(const std::vector<uint8_t>& value);
@@ -31,24 +53,93 @@ namespace packet {
 
   private:
     std::vector<uint8_t> buffer;
+    // buffer or the sink
+    std::vector<uint8_t>* out;
   };
 
   template <typename T> struct return_item { typedef T type; };
 
+  // Decoder reads the fields of a packet. The reads are bounds checked and
+  // do not throw: a read past the end, a malformed variable byte integer or
+  // UTF-8 string records an error and moves the decoder to the end, the
+  // reads after it return zero values. The packet decoders check error()
+  // once they are done
   class Decoder : private mqtt::noncopyable {
   public:
     Decoder(std::vector<uint8_t> value);
+    // the decoder reads from data without a copy, data must outlive the
+    // decoder. The properties of the decoded packet are allocated from
+    // resource when given, see makeProperties
+    Decoder(const uint8_t* data, size_t size,
+            std::pmr::memory_resource* resource = nullptr);
 
     template <typename T, bool varuint32 = false>
     inline typename return_item<T>::type read() {
       static_assert(!varuint32, "varuint32 cannot be read by this");
-      return T(buffer[index++]);
+      if (__builtin_expect(this->index >= this->length, 0)) {
+        this->fail(mqtt::Error::MalformedPacket);
+        return T(0);
+      }
+      return T(data[index++]);
+    }
+
+    // error is the first error of the reads, or of fail
+    std::error_code error() const {
+      return this->status;
+    }
+    bool ok() const {
+      return this->status == mqtt::Error::Success;
+    }
+    // fail records err unless there is an error already and stops the reads
+    void fail(mqtt::Error err) {
+      if (this->ok()) {
+        this->status = err;
+        Decoder::countError(err);
+      }
+      this->index = this->length;
+    }
+    size_t remaining() const {
+      return this->length - this->index;
+    }
+    // done ends the decoding of a packet: it fires the packet__decode probe
+    // with the bytes read and the error, and returns error()
+    std::error_code done(ControlPacket::Type type) const;
+    // take subtracts the n bytes of a field from the length left of the
+    // packet or of a property block, a field that runs past it fails the
+    // decoder
+    void take(uint32_t& left, size_t n) {
+      if (__builtin_expect(n > left, 0)) {
+        this->fail(mqtt::Error::MalformedPacket);
+        left = 0;
+        return;
+      }
+      left -= uint32_t(n);
+    }
+
+    // makeProperties creates the properties object of a decoded packet from
+    // the memory resource of the decoder, or the heap without one. Packets
+    // decoded with a resource must not outlive the memory it hands out
+    template <typename T> std::shared_ptr<T> makeProperties() const {
+      if (this->resource) {
+        return std::allocate_shared<T>(
+            std::pmr::polymorphic_allocator<T>(this->resource));
+      }
+      return std::make_shared<T>();
     }
 
     // todo: check later, change to operator >>
     std::vector<uint8_t> readBinaryDataNoLen(size_t size);
+    // readLength reads the variable byte integer length of a block, e.g. the
+    // properties, and fails when the block runs past the end
+    uint32_t readLength();
+    // readView skips size bytes and returns where they start, the bytes are
+    // not copied. nullptr when they run past the end
+    const uint8_t* readView(size_t size);
 
   private:
+    // counts the decode errors by error in the global metrics registry
+    static void countError(mqtt::Error err);
+
     uint16_t readBigEndianUint16();
     uint32_t readBigEndianUint32();
     uint32_t readVarUint32();
@@ -57,9 +148,21 @@ namespace packet {
 
   private:
     std::vector<uint8_t> buffer;
+    const uint8_t* data;
+    size_t length;
     size_t index;
+    std::pmr::memory_resource* resource;
+    mqtt::Error status;
   };
 
+  // throwIfError backs the throwing decode functions, they wrap the ones
+  // returning an error code
+  inline void throwIfError(std::error_code ec) {
+    if (ec) {
+      throw std::system_error(ec);
+    }
+  }
+
   template <> inline return_item<uint16_t>::type Decoder::read<uint16_t>() {
     return this->readBigEndianUint16();
   }
@@ -84,9 +187,81 @@ namespace packet {
     return this->readUTF8String();
   }
 
+  // EncodedVarUint32 is the variable byte integer codec. The size comes
+  // from the count of leading zeros, encode and decode are unrolled per
+  // length, the short lengths that most packets use take the first branches
   class EncodedVarUint32 {
   public:
-    static uint32_t size(uint32_t value);
+    // size of the encoded value, 1 to 4 bytes up to maxVarUint32
+    static inline uint32_t size(uint32_t value) {
+      // 7 bits per byte, a zero still takes a byte
+      uint32_t bits = 32 - uint32_t(__builtin_clz(value | 1));
+      return (bits + 6) / 7;
+    }
+
+    // encode writes value to out, which must have room for 4 bytes. Returns
+    // the bytes written. value must not be above maxVarUint32
+    static inline uint32_t encode(uint32_t value, uint8_t* out) {
+      if (value < (1u << 7)) {
+        out[0] = uint8_t(value);
+        return 1;
+      }
+      out[0] = uint8_t(value | 0x80);
+      if (value < (1u << 14)) {
+        out[1] = uint8_t(value >> 7);
+        return 2;
+      }
+      out[1] = uint8_t((value >> 7) | 0x80);
+      if (value < (1u << 21)) {
+        out[2] = uint8_t(value >> 14);
+        return 3;
+      }
+      out[2] = uint8_t((value >> 14) | 0x80);
+      out[3] = uint8_t(value >> 21);
+      return 4;
+    }
+
+    // decode reads a variable byte integer from data. Returns the bytes
+    // read, 0 when the integer does not end within size bytes or is longer
+    // than 4 bytes (malformed when size is at least 4)
+    static inline uint32_t decode(const uint8_t* data, size_t size,
+                                  uint32_t& value) {
+      if (size >= 4) {
+        // the bytes are known to be there, no bounds checks
+        uint32_t b = data[0];
+        value = b & 0x7F;
+        if (b < 0x80) {
+          return 1;
+        }
+        b = data[1];
+        value |= (b & 0x7F) << 7;
+        if (b < 0x80) {
+          return 2;
+        }
+        b = data[2];
+        value |= (b & 0x7F) << 14;
+        if (b < 0x80) {
+          return 3;
+        }
+        b = data[3];
+        value |= b << 21;
+        // a branch, not a select: the caller advances by the result and a
+        // select would make that wait for the load
+        if (__builtin_expect(b >= 0x80, 0)) {
+          return 0;
+        }
+        return 4;
+      }
+
+      value = 0;
+      for (size_t i = 0; i < size; ++i) {
+        value |= uint32_t(data[i] & 0x7F) << (7 * i);
+        if ((data[i] & 0x80) == 0) {
+          return uint32_t(i + 1);
+        }
+      }
+      return 0;
+    }
 
   private:
     EncodedVarUint32() {}
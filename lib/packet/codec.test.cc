@@ -1,6 +1,7 @@
 #include "codec.h"
 #include "doctest/doctest.h"
 
+#include <cstring>
 #include <iterator>
 #include <map>
 #include <string>
@@ -59,6 +60,33 @@ TEST_CASE("testing codec var uint32") {
   }
 }
 
+TEST_CASE("testing codec var uint32 fast paths") {
+  // every size on both the 4 byte load and the byte path, trailing bytes
+  // must not be read
+  for (uint32_t value : {0u, 1u, 127u, 128u, 300u, 16383u, 16384u, 2097151u,
+                         2097152u, 123456789u, 268435455u}) {
+    uint8_t buf[8];
+    std::memset(buf, 0xFF, sizeof(buf));
+    uint32_t n = EncodedVarUint32::encode(value, buf);
+    CHECK(n == EncodedVarUint32::size(value));
+    for (size_t avail : {size_t(n), size_t(8)}) {
+      uint32_t decoded = 0;
+      CHECK(EncodedVarUint32::decode(buf, avail, decoded) == n);
+      CHECK(decoded == value);
+    }
+  }
+
+  // runs past the end, too long
+  const uint8_t partial[] = {0x80, 0x80, 0x80};
+  uint32_t value = 0;
+  CHECK(EncodedVarUint32::decode(partial, sizeof(partial), value) == 0);
+  const uint8_t tooLong[] = {0x80, 0x80, 0x80, 0x80, 0x01};
+  CHECK(EncodedVarUint32::decode(tooLong, sizeof(tooLong), value) == 0);
+  Decoder dec(std::vector<uint8_t>(std::begin(tooLong), std::end(tooLong)));
+  CHECK(dec.read<uint32_t, true>() == 0);
+  CHECK(dec.error() == mqtt::Error::MalformedPacket);
+}
+
 TEST_CASE("testing codec UTF8 string") {
   std::map<std::string, std::vector<uint8_t>> elements = {
       {std::string("hello"),
@@ -2,54 +2,84 @@
 #include "codec.h"
 #include "packet.h"
 #include "properties.h"
+#include "../probes.h"
 
 namespace packet {
+  // the CONNACK properties in the order they are encoded
+  using ConnAckProperties = PropertyTable<
+      mqtt::ConnAck::Properties,
+      PropertyField<Property::ID::SessionExpiryIntervalID,
+                    &mqtt::ConnAck::Properties::sessionExpiryInterval>,
+      PropertyField<Property::ID::ReceiveMaximumID,
+                    &mqtt::ConnAck::Properties::receiveMaximum>,
+      PropertyField<Property::ID::MaximumQoSID,
+                    &mqtt::ConnAck::Properties::maximumQoS>,
+      PropertyField<Property::ID::RetainAvailableID,
+                    &mqtt::ConnAck::Properties::retainAvailable>,
+      PropertyField<Property::ID::MaximumPacketSizeID,
+                    &mqtt::ConnAck::Properties::maximumPacketSize>,
+      PropertyField<Property::ID::AssignedClientIdentifierID,
+                    &mqtt::ConnAck::Properties::assignedClientIdentifier>,
+      PropertyField<Property::ID::TopicAliasMaximumID,
+                    &mqtt::ConnAck::Properties::topicAliasMaximum>,
+      PropertyField<Property::ID::ReasonStringID,
+                    &mqtt::ConnAck::Properties::reasonString>,
+      PropertyField<Property::ID::WildcardSubscriptionAvailableID,
+                    &mqtt::ConnAck::Properties::wildcardSubscriptionAvailable>,
+      PropertyField<
+          Property::ID::SubscriptionIdentifierAvailableID,
+          &mqtt::ConnAck::Properties::subscriptionIdentifierAvailable>,
+      PropertyField<Property::ID::SharedSubscriptionAvailableID,
+                    &mqtt::ConnAck::Properties::sharedSubscriptionAvailable>,
+      PropertyField<Property::ID::ServerKeepAliveID,
+                    &mqtt::ConnAck::Properties::serverKeepAlive>,
+      PropertyField<Property::ID::ResponseInformationID,
+                    &mqtt::ConnAck::Properties::responseInformation>,
+      PropertyField<Property::ID::ServerReferenceID,
+                    &mqtt::ConnAck::Properties::serverReference>,
+      PropertyField<Property::ID::AuthenticationMethodID,
+                    &mqtt::ConnAck::Properties::authenticationMethod>,
+      PropertyField<Property::ID::AuthenticationDataID,
+                    &mqtt::ConnAck::Properties::authenticationData>>;
+
   ConnAckEncoder::ConnAckEncoder(const mqtt::ConnAck& ca) : connack(ca) {}
 
   std::vector<uint8_t> ConnAckEncoder::encode() const {
+    Encoder enc;
+    this->write(enc);
+    return enc.takeBuffer();
+  }
+
+  void ConnAckEncoder::encode(const mqtt::ConnAck& ca, Sink& sink) {
+    Encoder enc(sink);
+    ConnAckEncoder(ca).write(enc);
+  }
+
+  void ConnAckEncoder::write(Encoder& enc) const {
     uint32_t propertySize = this->propertySize();
     // calculate the remaining length
     // 2 = session present + reason code
     uint32_t remainingLength =
         2 + propertySize + EncodedVarUint32::size(propertySize);
-    Encoder enc(remainingLength + 1 + EncodedVarUint32::size(remainingLength));
+    enc.reserve(remainingLength + 1 + EncodedVarUint32::size(remainingLength));
     enc.write(static_cast<uint8_t>(
         static_cast<uint32_t>(ControlPacket::Type::CONNACK) << 4));
     enc.writeVarUint32(remainingLength);
+    MQTT_PROBE2(packet__encode,
+                static_cast<int>(ControlPacket::Type::CONNACK),
+                remainingLength);
 
     enc.write(this->connack.sessionPresent);
     enc.write(static_cast<uint8_t>(this->connack.reasonCode));
 
     this->encodeProperties(enc, propertySize);
-
-    return enc.getBuffer();
   }
 
   uint32_t ConnAckEncoder::propertySize() const {
     if (!this->connack.properties) {
       return 0;
     }
-
-    const mqtt::ConnAck::Properties& props = *this->connack.properties;
-    uint32_t propertySize = 0;
-
-    propertySize += Property::size(props.sessionExpiryInterval);
-    propertySize += Property::size(props.receiveMaximum);
-    propertySize += Property::size(props.maximumQoS);
-    propertySize += Property::size(props.retainAvailable);
-    propertySize += Property::size(props.maximumPacketSize);
-    propertySize += Property::size(props.assignedClientIdentifier);
-    propertySize += Property::size(props.topicAliasMaximum);
-    propertySize += Property::size(props.reasonString);
-    propertySize += Property::size(props.wildcardSubscriptionAvailable);
-    propertySize += Property::size(props.subscriptionIdentifierAvailable);
-    Property::size(props.sharedSubscriptionAvailable);
-    Property::size(props.responseInformation);
-    Property::size(props.serverReference);
-    Property::size(props.authenticationMethod);
-    Property::size(props.authenticationData);
-
-    return propertySize;
+    return ConnAckProperties::size(*this->connack.properties);
   }
 
   void ConnAckEncoder::encodeProperties(Encoder& enc,
@@ -57,36 +87,7 @@ namespace packet {
     enc.writeVarUint32(propertySize);
 
     if (this->connack.properties) {
-      const mqtt::ConnAck::Properties& props = *this->connack.properties;
-
-      Property::encode(enc, Property::ID::SessionExpiryIntervalID,
-                       props.sessionExpiryInterval);
-      Property::encode(enc, Property::ID::ReceiveMaximumID,
-                       props.receiveMaximum);
-      Property::encode(enc, Property::ID::MaximumQoSID, props.maximumQoS);
-      Property::encode(enc, Property::ID::RetainAvailableID,
-                       props.retainAvailable);
-      Property::encode(enc, Property::ID::MaximumPacketSizeID,
-                       props.maximumPacketSize);
-      Property::encode(enc, Property::ID::AssignedClientIdentifierID,
-                       props.assignedClientIdentifier);
-      Property::encode(enc, Property::ID::TopicAliasMaximumID,
-                       props.topicAliasMaximum);
-      Property::encode(enc, Property::ID::ReasonStringID, props.reasonString);
-      Property::encode(enc, Property::ID::WildcardSubscriptionAvailableID,
-                       props.wildcardSubscriptionAvailable);
-      Property::encode(enc, Property::ID::SubscriptionIdentifierAvailableID,
-                       props.subscriptionIdentifierAvailable);
-      Property::encode(enc, Property::ID::SharedSubscriptionAvailableID,
-                       props.sharedSubscriptionAvailable);
-      Property::encode(enc, Property::ID::ResponseInformationID,
-                       props.responseInformation);
-      Property::encode(enc, Property::ID::ServerReferenceID,
-                       props.serverReference);
-      Property::encode(enc, Property::ID::AuthenticationMethodID,
-                       props.authenticationMethod);
-      Property::encode(enc, Property::ID::AuthenticationDataID,
-                       props.authenticationData);
+      ConnAckProperties::encode(enc, *this->connack.properties);
     }
   }
 
@@ -97,81 +98,28 @@ namespace packet {
 
   mqtt::ConnAck ConnAckDecoder::decode(Decoder& dec) {
     mqtt::ConnAck ca;
+    throwIfError(ConnAckDecoder::decode(dec, ca));
+    return ca;
+  }
 
+  std::error_code ConnAckDecoder::decode(Decoder& dec, mqtt::ConnAck& ca) {
     ca.sessionPresent = dec.read<bool>();
     ca.reasonCode = static_cast<mqtt::ConnAck::ReasonCode>(dec.read<uint8_t>());
     ca.properties = ConnAckDecoder::decodeProperties(dec);
 
-    return ca;
+    return dec.done(ControlPacket::Type::CONNACK);
   }
 
   std::shared_ptr<mqtt::ConnAck::Properties>
   ConnAckDecoder::decodeProperties(Decoder& dec) {
-    uint32_t propertySize = dec.read<uint32_t, true>();
+    uint32_t propertySize = dec.readLength();
 
     std::shared_ptr<mqtt::ConnAck::Properties> props;
     if (propertySize > 0) {
-      props = std::make_shared<mqtt::ConnAck::Properties>();
+      props = dec.makeProperties<mqtt::ConnAck::Properties>();
+      ConnAckProperties::decode(dec, propertySize, *props);
     }
 
-    while (propertySize > 0) {
-      uint32_t val = dec.read<uint32_t, true>();
-      propertySize -= EncodedVarUint32::size(val);
-      Property::ID id = static_cast<Property::ID>(val);
-      switch (id) {
-      case Property::ID::SessionExpiryIntervalID:
-        propertySize -= Property::decode(dec, id, props->sessionExpiryInterval);
-        break;
-      case Property::ID::ReceiveMaximumID:
-        propertySize -= Property::decode(dec, id, props->receiveMaximum);
-        break;
-      case Property::ID::MaximumQoSID:
-        propertySize -= Property::decode(dec, id, props->maximumQoS);
-        break;
-      case Property::ID::RetainAvailableID:
-        propertySize -= Property::decode(dec, id, props->retainAvailable);
-        break;
-      case Property::ID::MaximumPacketSizeID:
-        propertySize -= Property::decode(dec, id, props->maximumPacketSize);
-        break;
-      case Property::ID::AssignedClientIdentifierID:
-        propertySize -=
-            Property::decode(dec, id, props->assignedClientIdentifier);
-        break;
-      case Property::ID::TopicAliasMaximumID:
-        propertySize -= Property::decode(dec, id, props->topicAliasMaximum);
-        break;
-      case Property::ID::ReasonStringID:
-        propertySize -= Property::decode(dec, id, props->reasonString);
-        break;
-      case Property::ID::WildcardSubscriptionAvailableID:
-        propertySize -=
-            Property::decode(dec, id, props->wildcardSubscriptionAvailable);
-        break;
-      case Property::ID::SubscriptionIdentifierAvailableID:
-        propertySize -=
-            Property::decode(dec, id, props->subscriptionIdentifierAvailable);
-        break;
-      case Property::ID::SharedSubscriptionAvailableID:
-        propertySize -=
-            Property::decode(dec, id, props->sharedSubscriptionAvailable);
-        break;
-      case Property::ID::ResponseInformationID:
-        propertySize -= Property::decode(dec, id, props->responseInformation);
-        break;
-      case Property::ID::ServerReferenceID:
-        propertySize -= Property::decode(dec, id, props->serverReference);
-        break;
-      case Property::ID::AuthenticationMethodID:
-        propertySize -= Property::decode(dec, id, props->authenticationMethod);
-        break;
-      case Property::ID::AuthenticationDataID:
-        propertySize -= Property::decode(dec, id, props->authenticationData);
-        break;
-      default:
-        throwInvalidPropertyID(id, "CONNACK");
-      }
-    }
     return props;
   }
 } // namespace packet
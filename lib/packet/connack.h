@@ -2,8 +2,10 @@
 
 #pragma once
 
+#include "packet.h"
 #include <mqtt/connack.h>
 #include <mqtt/noncopyable.h>
+#include <system_error>
 #include <vector>
 
 namespace packet {
@@ -14,8 +16,11 @@ namespace packet {
   public:
     explicit ConnAckEncoder(const mqtt::ConnAck& ca);
     std::vector<uint8_t> encode() const;
+    // encode appends the packet to sink
+    static void encode(const mqtt::ConnAck& ca, Sink& sink);
 
   private:
+    void write(Encoder& enc) const;
     uint32_t propertySize() const;
     void encodeProperties(Encoder& enc, uint32_t propertyLen) const;
 
@@ -27,6 +32,8 @@ namespace packet {
   public:
     static mqtt::ConnAck decode(std::vector<uint8_t> buffer);
     static mqtt::ConnAck decode(Decoder& dec);
+    // decode without exceptions, ca is complete when there is no error
+    static std::error_code decode(Decoder& dec, mqtt::ConnAck& ca);
 
   private:
     static std::shared_ptr<mqtt::ConnAck::Properties>
@@ -83,3 +83,41 @@ TEST_CASE("testing CONNACK codec - enc/dec with invalid properties") {
   REQUIRE(uint32_t(0x0D) == fhdr.second);
   CHECK_THROWS_AS(ConnAckDecoder::decode(dec), std::runtime_error);
 }
+
+TEST_CASE("testing CONNACK codec - enc/dec with all properties") {
+  mqtt::ConnAck ca;
+  ca.properties = std::make_shared<mqtt::ConnAck::Properties>();
+  mqtt::ConnAck::Properties& props = *ca.properties;
+  props.sessionExpiryInterval = 3600;
+  props.receiveMaximum = 20;
+  props.maximumQoS = 1;
+  props.retainAvailable = false;
+  props.maximumPacketSize = 1 << 20;
+  props.assignedClientIdentifier = "auto-1";
+  props.topicAliasMaximum = 10;
+  props.reasonString = "ok";
+  props.wildcardSubscriptionAvailable = true;
+  props.subscriptionIdentifierAvailable = true;
+  props.sharedSubscriptionAvailable = false;
+  props.serverKeepAlive = 30;
+  props.responseInformation = "responses/";
+  props.serverReference = "other";
+  props.authenticationMethod = "plain";
+  props.authenticationData = {0x01, 0x02};
+
+  // the remaining length covers every property
+  std::vector<uint8_t> encoded = ConnAckEncoder(ca).encode();
+  Decoder dec(encoded);
+  FixedHeader fhdr = FixedHeaderReader::read(dec);
+  REQUIRE(fhdr.second + 1 + EncodedVarUint32::size(fhdr.second) ==
+          encoded.size());
+  mqtt::ConnAck decoded = ConnAckDecoder::decode(dec);
+  REQUIRE(decoded.properties);
+  CHECK(decoded.properties->sharedSubscriptionAvailable == false);
+  CHECK(decoded.properties->serverKeepAlive == 30);
+  CHECK(decoded.properties->responseInformation == "responses/");
+  CHECK(decoded.properties->serverReference == "other");
+  CHECK(decoded.properties->authenticationMethod == "plain");
+  CHECK(decoded.properties->authenticationData == props.authenticationData);
+  CHECK(ConnAckEncoder(decoded).encode() == encoded);
+}
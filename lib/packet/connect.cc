@@ -2,11 +2,43 @@
 #include "codec.h"
 #include "packet.h"
 #include "properties.h"
+#include "../probes.h"
 
 namespace packet {
+  // the CONNECT properties in the order they are encoded
+  using ConnectProperties = PropertyTable<
+      mqtt::Connect::Properties,
+      PropertyField<Property::ID::SessionExpiryIntervalID,
+                    &mqtt::Connect::Properties::sessionExpiryInterval>,
+      PropertyField<Property::ID::ReceiveMaximumID,
+                    &mqtt::Connect::Properties::receiveMaximum>,
+      PropertyField<Property::ID::MaximumPacketSizeID,
+                    &mqtt::Connect::Properties::maximumPacketSize>,
+      PropertyField<Property::ID::TopicAliasMaximumID,
+                    &mqtt::Connect::Properties::topicAliasMaximum>,
+      PropertyField<Property::ID::RequestProblemInfoID,
+                    &mqtt::Connect::Properties::requestProblemInfo>,
+      PropertyField<Property::ID::RequestResponseInfoID,
+                    &mqtt::Connect::Properties::requestResponseInfo>,
+      PropertyField<Property::ID::AuthenticationMethodID,
+                    &mqtt::Connect::Properties::authenticationMethod>,
+      PropertyField<Property::ID::AuthenticationDataID,
+                    &mqtt::Connect::Properties::authenticationData>>;
+
   ConnectEncoder::ConnectEncoder(const mqtt::Connect& c) : connect(c) {}
 
   std::vector<uint8_t> ConnectEncoder::encode() const {
+    Encoder enc;
+    this->write(enc);
+    return enc.takeBuffer();
+  }
+
+  void ConnectEncoder::encode(const mqtt::Connect& c, Sink& sink) {
+    Encoder enc(sink);
+    ConnectEncoder(c).write(enc);
+  }
+
+  void ConnectEncoder::write(Encoder& enc) const {
     uint32_t propertySize = this->propertySize();
     // calculate the remaining length
     // 10 = protocolname + version + flags + keepalive
@@ -28,10 +60,13 @@ namespace packet {
       remainingLength += uint32_t(2 + this->connect.password.size());
     }
 
-    Encoder enc(remainingLength + 1 + EncodedVarUint32::size(remainingLength));
+    enc.reserve(remainingLength + 1 + EncodedVarUint32::size(remainingLength));
     enc.write(static_cast<uint8_t>(
         static_cast<uint32_t>(ControlPacket::Type::CONNECT) << 4));
     enc.writeVarUint32(remainingLength);
+    MQTT_PROBE2(packet__encode,
+                static_cast<int>(ControlPacket::Type::CONNECT),
+                remainingLength);
 
     enc.write(std::vector<uint8_t>{'M', 'Q', 'T', 'T'});
     enc.write(uint8_t(0x05)); // version
@@ -50,24 +85,13 @@ namespace packet {
     if (this->connect.password.size() > 0) {
       enc.write(this->connect.password);
     }
-
-    return enc.getBuffer();
   }
 
   uint32_t ConnectEncoder::propertySize() const {
-    uint32_t propertySize = 0;
-    if (this->connect.properties) {
-      const mqtt::Connect::Properties& props = *this->connect.properties;
-      propertySize += Property::size(props.sessionExpiryInterval);
-      propertySize += Property::size(props.receiveMaximum);
-      propertySize += Property::size(props.maximumPacketSize);
-      propertySize += Property::size(props.topicAliasMaximum);
-      propertySize += Property::size(props.requestProblemInfo);
-      propertySize += Property::size(props.requestResponseInfo);
-      propertySize += Property::size(props.authenticationMethod);
-      propertySize += Property::size(props.authenticationData);
+    if (!this->connect.properties) {
+      return 0;
     }
-    return propertySize;
+    return ConnectProperties::size(*this->connect.properties);
   }
 
   void ConnectEncoder::encodeProperties(Encoder& enc,
@@ -75,23 +99,7 @@ namespace packet {
     enc.writeVarUint32(propertySize);
 
     if (this->connect.properties) {
-      const mqtt::Connect::Properties& props = *this->connect.properties;
-      Property::encode(enc, Property::ID::SessionExpiryIntervalID,
-                       props.sessionExpiryInterval);
-      Property::encode(enc, Property::ID::ReceiveMaximumID,
-                       props.receiveMaximum);
-      Property::encode(enc, Property::ID::MaximumPacketSizeID,
-                       props.maximumPacketSize);
-      Property::encode(enc, Property::ID::TopicAliasMaximumID,
-                       props.topicAliasMaximum);
-      Property::encode(enc, Property::ID::RequestProblemInfoID,
-                       props.requestProblemInfo);
-      Property::encode(enc, Property::ID::RequestResponseInfoID,
-                       props.requestResponseInfo);
-      Property::encode(enc, Property::ID::AuthenticationMethodID,
-                       props.authenticationMethod);
-      Property::encode(enc, Property::ID::AuthenticationDataID,
-                       props.authenticationData);
+      ConnectProperties::encode(enc, *this->connect.properties);
     }
   }
 
@@ -103,20 +111,29 @@ namespace packet {
   }
 
   mqtt::Connect ConnectDecoder::decode(Decoder& dec) {
+    mqtt::Connect c;
+    throwIfError(ConnectDecoder::decode(dec, c));
+    return c;
+  }
+
+  std::error_code ConnectDecoder::decode(Decoder& dec, mqtt::Connect& c) {
     std::string protocolName = dec.read<std::string>();
+    if (!dec.ok()) {
+      return dec.done(ControlPacket::Type::CONNECT);
+    }
     if (protocolName != "MQTT") {
-      throw std::runtime_error(
-          "CONNECT: received protocol name is invalid, must be MQTT");
+      dec.fail(mqtt::Error::InvalidProtocolName);
+      return dec.done(ControlPacket::Type::CONNECT);
     }
 
     if (dec.read<uint8_t>() != 0x05) {
-      throw std::runtime_error(
-          "CONNECT: received MQTT protocol version is invalid, must be 0x05");
+      dec.fail(mqtt::Error::UnsupportedProtocolVersion);
+      return dec.done(ControlPacket::Type::CONNECT);
     }
-    mqtt::Connect c;
     c.protocolName = "MQTT";
 
     uint8_t connectFlag = dec.read<uint8_t>();
+    c.cleanStart = (connectFlag & 0x02);
 
     c.keepAlive = dec.read<uint16_t>();
     c.properties = ConnectDecoder::decodeProperties(dec);
@@ -127,52 +144,23 @@ namespace packet {
     }
 
     // password flag present?
-    if (connectFlag & 0x80) {
+    if (connectFlag & 0x40) {
       c.password = dec.read<std::vector<uint8_t>>();
     }
 
-    return c;
+    return dec.done(ControlPacket::Type::CONNECT);
   }
 
   std::shared_ptr<mqtt::Connect::Properties>
   ConnectDecoder::decodeProperties(Decoder& dec) {
-    uint32_t propertySize = dec.read<uint32_t, true>();
+    uint32_t propertySize = dec.readLength();
 
     std::shared_ptr<mqtt::Connect::Properties> props;
     if (propertySize > 0) {
-      props = std::make_shared<mqtt::Connect::Properties>();
+      props = dec.makeProperties<mqtt::Connect::Properties>();
+      ConnectProperties::decode(dec, propertySize, *props);
     }
 
-    while (propertySize > 0) {
-      uint32_t val = dec.read<uint32_t, true>();
-      propertySize -= EncodedVarUint32::size(val);
-      Property::ID id = static_cast<Property::ID>(val);
-      switch (id) {
-      case Property::ID::SessionExpiryIntervalID:
-        propertySize -= Property::decode(dec, id, props->sessionExpiryInterval);
-        break;
-      case Property::ID::ReceiveMaximumID:
-        propertySize -= Property::decode(dec, id, props->receiveMaximum);
-        break;
-      case Property::ID::MaximumPacketSizeID:
-        propertySize -= Property::decode(dec, id, props->maximumPacketSize);
-        break;
-      case Property::ID::TopicAliasMaximumID:
-        propertySize -= Property::decode(dec, id, props->topicAliasMaximum);
-        break;
-      case Property::ID::RequestProblemInfoID:
-        propertySize -= Property::decode(dec, id, props->requestProblemInfo);
-        break;
-      case Property::ID::AuthenticationMethodID:
-        propertySize -= Property::decode(dec, id, props->authenticationMethod);
-        break;
-      case Property::ID::AuthenticationDataID:
-        propertySize -= Property::decode(dec, id, props->authenticationData);
-        break;
-      default:
-        throwInvalidPropertyID(id, "CONNECT");
-      }
-    };
     return props;
   }
 
@@ -1,7 +1,9 @@
 #pragma once
 
+#include "packet.h"
 #include <mqtt/connect.h>
 #include <mqtt/noncopyable.h>
+#include <system_error>
 #include <vector>
 
 namespace packet {
@@ -12,8 +14,11 @@ namespace packet {
   public:
     explicit ConnectEncoder(const mqtt::Connect& c);
     std::vector<uint8_t> encode() const;
+    // encode appends the packet to sink
+    static void encode(const mqtt::Connect& c, Sink& sink);
 
   private:
+    void write(Encoder& enc) const;
     uint32_t propertySize() const;
     void encodeProperties(Encoder& enc, uint32_t propertyLen) const;
 
@@ -25,6 +30,8 @@ namespace packet {
   public:
     static mqtt::Connect decode(std::vector<uint8_t> buffer);
     static mqtt::Connect decode(Decoder& dec);
+    // decode without exceptions, c is complete when there is no error
+    static std::error_code decode(Decoder& dec, mqtt::Connect& c);
 
   private:
     static std::shared_ptr<mqtt::Connect::Properties>
@@ -13,6 +13,18 @@ TEST_CASE("testing CONNECT codec - invalid protocol name/version") {
   CHECK_THROWS_AS(
       ConnectDecoder::decode({0x00, 0x04, 'M', 'Q', 'T', 'T', 0x04}),
       std::runtime_error);
+
+  mqtt::Connect c;
+  const uint8_t name[] = {0x00, 0x04, 'T', 'T', 'Q', 'M', 0x05};
+  Decoder nameDec(name, sizeof(name));
+  CHECK(ConnectDecoder::decode(nameDec, c) == mqtt::Error::InvalidProtocolName);
+  const uint8_t version[] = {0x00, 0x04, 'M', 'Q', 'T', 'T', 0x04};
+  Decoder versionDec(version, sizeof(version));
+  CHECK(ConnectDecoder::decode(versionDec, c) ==
+        mqtt::Error::UnsupportedProtocolVersion);
+  // the protocol name is cut short
+  Decoder shortDec(name, 4);
+  CHECK(ConnectDecoder::decode(shortDec, c) == mqtt::Error::MalformedPacket);
 }
 
 TEST_CASE("testing CONNECT codec - enc/dec") {
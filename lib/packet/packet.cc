@@ -7,4 +7,31 @@ namespace packet {
     uint32_t remainingLen = dec.read<uint32_t, true>();
     return {byte0, remainingLen};
   }
+
+  FixedHeaderReader::Result FixedHeaderReader::parse(const uint8_t* data,
+                                                     size_t size,
+                                                     FixedHeader& fhdr,
+                                                     size_t& headerLen) {
+    if (size < 2) {
+      return Result::Incomplete;
+    }
+    // byte 0 followed by at most 4 bytes of remaining length
+    uint32_t value = 0;
+    uint32_t n = EncodedVarUint32::decode(data + 1, size - 1, value);
+    if (n == 0) {
+      return size - 1 >= 4 ? Result::Malformed : Result::Incomplete;
+    }
+    fhdr = {data[0], value};
+    headerLen = n + 1;
+    return Result::Complete;
+  }
+
+  const char* ControlPacket::name(Type type) {
+    static const char* names[] = {
+        "RESERVED",  "CONNECT",  "CONNACK",     "PUBLISH",
+        "PUBACK",    "PUBREC",   "PUBREL",      "PUBCOMP",
+        "SUBSCRIBE", "SUBACK",   "UNSUBSCRIBE", "UNSUBACK",
+        "PINGREQ",   "PINGRESP", "DISCONNECT",  "AUTH"};
+    return names[static_cast<size_t>(type) & 0x0F];
+  }
 } // namespace packet
@@ -1,17 +1,31 @@
 #pragma once
 
+#include <cstddef>
 #include <cstdint>
 #include <iostream>
+#include <vector>
 
 namespace packet {
   class Encoder;
   class Decoder;
+
+  // Sink is a buffer the static encode functions of the packet encoders
+  // append a packet to, e.g. the outbound buffer of a connection
+  using Sink = std::vector<uint8_t>;
 } // namespace packet
 
 namespace packet {
   using FixedHeader = std::pair<uint8_t, uint32_t>;
   struct FixedHeaderReader {
+    enum class Result { Complete, Incomplete, Malformed };
+
     static FixedHeader read(Decoder& dec);
+
+    // parse reads the fixed header from the start of a byte stream that may
+    // not hold the complete header yet. On Complete headerLen is the number
+    // of bytes the fixed header occupies
+    static Result parse(const uint8_t* data, size_t size, FixedHeader& fhdr,
+                        size_t& headerLen);
   };
   namespace ControlPacket {
     enum class Type {
@@ -32,6 +46,9 @@ namespace packet {
       DISCONNECT = 14,
       AUTH = 15
     };
+
+    // name of the packet type, e.g. "PUBLISH"
+    const char* name(Type type);
   } // namespace ControlPacket
 
 } // namespace packet
@@ -0,0 +1,53 @@
+#include "doctest/doctest.h"
+#include "packet.h"
+
+#include <vector>
+
+using namespace packet;
+
+TEST_CASE("testing fixed header parse") {
+  FixedHeader fhdr;
+  size_t headerLen = 0;
+
+  std::vector<uint8_t> data = {0x30, 0x0A};
+  REQUIRE(FixedHeaderReader::parse(data.data(), data.size(), fhdr,
+                                   headerLen) ==
+          FixedHeaderReader::Result::Complete);
+  CHECK(fhdr.first == 0x30);
+  CHECK(fhdr.second == 10);
+  CHECK(headerLen == 2);
+
+  // 321 = 0xC1 0x02
+  data = {0x30, 0xC1, 0x02, 'x'};
+  REQUIRE(FixedHeaderReader::parse(data.data(), data.size(), fhdr,
+                                   headerLen) ==
+          FixedHeaderReader::Result::Complete);
+  CHECK(fhdr.second == 321);
+  CHECK(headerLen == 3);
+
+  // maximum remaining length
+  data = {0x30, 0xFF, 0xFF, 0xFF, 0x7F};
+  REQUIRE(FixedHeaderReader::parse(data.data(), data.size(), fhdr,
+                                   headerLen) ==
+          FixedHeaderReader::Result::Complete);
+  CHECK(fhdr.second == 268435455);
+  CHECK(headerLen == 5);
+}
+
+TEST_CASE("testing fixed header parse incomplete and malformed") {
+  FixedHeader fhdr;
+  size_t headerLen = 0;
+
+  std::vector<uint8_t> data = {0x30, 0xC1};
+  CHECK(FixedHeaderReader::parse(data.data(), 0, fhdr, headerLen) ==
+        FixedHeaderReader::Result::Incomplete);
+  CHECK(FixedHeaderReader::parse(data.data(), 1, fhdr, headerLen) ==
+        FixedHeaderReader::Result::Incomplete);
+  CHECK(FixedHeaderReader::parse(data.data(), data.size(), fhdr, headerLen) ==
+        FixedHeaderReader::Result::Incomplete);
+
+  // the remaining length uses at most 4 bytes
+  data = {0x30, 0xFF, 0xFF, 0xFF, 0xFF, 0x01};
+  CHECK(FixedHeaderReader::parse(data.data(), data.size(), fhdr, headerLen) ==
+        FixedHeaderReader::Result::Malformed);
+}
@@ -0,0 +1,51 @@
+#include "ping.h"
+#include "codec.h"
+#include "../probes.h"
+#include <stdexcept>
+
+namespace packet {
+  const std::vector<uint8_t>& PingEncoder::encode(ControlPacket::Type t) {
+    static const std::vector<uint8_t>& pingReq = *new std::vector<uint8_t>{
+        static_cast<uint8_t>(
+            static_cast<uint32_t>(ControlPacket::Type::PINGREQ) << 4),
+        0x00};
+    static const std::vector<uint8_t>& pingResp = *new std::vector<uint8_t>{
+        static_cast<uint8_t>(
+            static_cast<uint32_t>(ControlPacket::Type::PINGRESP) << 4),
+        0x00};
+
+    MQTT_PROBE2(packet__encode, static_cast<int>(t), 0);
+    switch (t) {
+    case ControlPacket::Type::PINGREQ:
+      return pingReq;
+    case ControlPacket::Type::PINGRESP:
+      return pingResp;
+    default:
+      throw std::invalid_argument(__PRETTY_FUNCTION__ +
+                                  std::string(": not a ping packet type"));
+    }
+  }
+
+  ControlPacket::Type PingDecoder::decode(uint8_t byte0,
+                                          uint32_t remainingLen) {
+    ControlPacket::Type t;
+    throwIfError(PingDecoder::decode(byte0, remainingLen, t));
+    return t;
+  }
+
+  std::error_code PingDecoder::decode(uint8_t byte0, uint32_t remainingLen,
+                                      ControlPacket::Type& t) {
+    t = static_cast<ControlPacket::Type>(byte0 >> 4);
+    // not a PINGREQ or PINGRESP, the reserved flags must be 0 and there is
+    // no variable header
+    if ((t != ControlPacket::Type::PINGREQ &&
+         t != ControlPacket::Type::PINGRESP) ||
+        (byte0 & 0x0F) != 0 || remainingLen != 0) {
+      MQTT_PROBE3(packet__decode, static_cast<int>(t), remainingLen,
+                  static_cast<int>(mqtt::Error::MalformedPacket));
+      return mqtt::Error::MalformedPacket;
+    }
+    MQTT_PROBE3(packet__decode, static_cast<int>(t), 0, 0);
+    return {};
+  }
+} // namespace packet
@@ -0,0 +1,30 @@
+#pragma once
+
+#include "packet.h"
+#include <system_error>
+#include <vector>
+
+namespace packet {
+  // PINGREQ and PINGRESP have neither a variable header nor a payload, the
+  // packets are constant two byte frames that are built once
+  class PingEncoder {
+  public:
+    static const std::vector<uint8_t>& encode(ControlPacket::Type t);
+
+  private:
+    PingEncoder() {}
+  };
+
+  class PingDecoder {
+  public:
+    // validates the fixed header of a PINGREQ or PINGRESP packet and returns
+    // the packet type
+    static ControlPacket::Type decode(uint8_t byte0, uint32_t remainingLen);
+    // decode without exceptions
+    static std::error_code decode(uint8_t byte0, uint32_t remainingLen,
+                                  ControlPacket::Type& t);
+
+  private:
+    PingDecoder() {}
+  };
+} // namespace packet
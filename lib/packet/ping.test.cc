@@ -0,0 +1,32 @@
+#include "codec.h"
+#include "doctest/doctest.h"
+#include "packet.h"
+#include "ping.h"
+
+using namespace packet;
+
+TEST_CASE("testing PINGREQ/PINGRESP codec - enc/dec") {
+  const std::vector<uint8_t> pingReq = {0xC0, 0x00};
+  const std::vector<uint8_t> pingResp = {0xD0, 0x00};
+
+  REQUIRE(PingEncoder::encode(ControlPacket::Type::PINGREQ) == pingReq);
+  REQUIRE(PingEncoder::encode(ControlPacket::Type::PINGRESP) == pingResp);
+  // the frames are built once
+  REQUIRE(&PingEncoder::encode(ControlPacket::Type::PINGREQ) ==
+          &PingEncoder::encode(ControlPacket::Type::PINGREQ));
+
+  for (const auto& encoded : {pingReq, pingResp}) {
+    Decoder dec(encoded);
+    FixedHeader fhdr = FixedHeaderReader::read(dec);
+    REQUIRE(fhdr.second == 0);
+    REQUIRE(PingDecoder::decode(fhdr.first, fhdr.second) ==
+            ControlPacket::Type(encoded[0] >> 4));
+  }
+}
+
+TEST_CASE("testing PINGREQ/PINGRESP codec - malformed") {
+  REQUIRE_THROWS(PingEncoder::encode(ControlPacket::Type::PUBLISH));
+  REQUIRE_THROWS(PingDecoder::decode(0xC1, 0));
+  REQUIRE_THROWS(PingDecoder::decode(0xD0, 1));
+  REQUIRE_THROWS(PingDecoder::decode(0x30, 0));
+}
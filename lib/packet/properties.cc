@@ -1,48 +1,44 @@
 #include "properties.h"
-#include <map>
 
 namespace packet {
-  using propertymap_t = std::map<Property::ID, const char*>;
+  using propertytext_t = std::array<const char*, 256>;
 
-  const char* Property::Text(ID id) {
-    static propertymap_t& propertyMap = *new propertymap_t(
-        {{Property::ID::PayloadFormatIndicatorID, "Payload format indicator"},
-         {Property::ID::MessageExpiryIntervalID, "Message expiry interval"},
-         {Property::ID::ContentTypeID, "Content type"},
-         {Property::ID::ResponseTopicID, "response topic"},
-         {Property::ID::CorrelationDataID, "Correlation data"},
-         {Property::ID::SubscriptionIdentifierID, "Subscription Identifier"},
-         {Property::ID::SessionExpiryIntervalID, "Session Expiry Interval"},
-         {Property::ID::AssignedClientIdentifierID,
-          "Assigned Client Identifier"},
-         {Property::ID::ServerKeepAliveID, "Server Keep Alive"},
-         {Property::ID::AuthenticationMethodID, "Authentication Method"},
-         {Property::ID::AuthenticationDataID, "Authentication Data"},
-         {Property::ID::RequestProblemInfoID, "Request Problem Information"},
-         {Property::ID::RequestResponseInfoID, "Request Response Information"},
-         {Property::ID::WillDelayIntervalID, "Will Delay Interval"},
-         {Property::ID::ResponseInformationID, "Response Information"},
-         {Property::ID::ServerReferenceID, "Server Reference"},
-         {Property::ID::ReasonStringID, "Reason String"},
-         {Property::ID::ReceiveMaximumID, "Receive Maximum"},
-         {Property::ID::TopicAliasMaximumID, "Topic Alias Maximum"},
-         {Property::ID::TopicAliasID, "Topic Alias"},
-         {Property::ID::MaximumQoSID, "Maximum QoS"},
-         {Property::ID::RetainAvailableID, "Retain Available"},
-         {Property::ID::UserPropertyID, "User Property"},
-         {Property::ID::MaximumPacketSizeID, "Maximum Packet Size"},
-         {Property::ID::WildcardSubscriptionAvailableID,
-          "Wildcard Subscription Available"},
-         {Property::ID::SubscriptionIdentifierAvailableID,
-          "Subscription Identifier Available"},
-         {Property::ID::SharedSubscriptionAvailableID,
-          "Shared Subscription Available"}});
+  static constexpr propertytext_t makePropertyText() {
+    propertytext_t text{};
+    text[0x01] = "Payload format indicator";
+    text[0x02] = "Message expiry interval";
+    text[0x03] = "Content type";
+    text[0x08] = "response topic";
+    text[0x09] = "Correlation data";
+    text[0x0B] = "Subscription Identifier";
+    text[0x11] = "Session Expiry Interval";
+    text[0x12] = "Assigned Client Identifier";
+    text[0x13] = "Server Keep Alive";
+    text[0x15] = "Authentication Method";
+    text[0x16] = "Authentication Data";
+    text[0x17] = "Request Problem Information";
+    text[0x18] = "Will Delay Interval";
+    text[0x19] = "Request Response Information";
+    text[0x1A] = "Response Information";
+    text[0x1C] = "Server Reference";
+    text[0x1F] = "Reason String";
+    text[0x21] = "Receive Maximum";
+    text[0x22] = "Topic Alias Maximum";
+    text[0x23] = "Topic Alias";
+    text[0x24] = "Maximum QoS";
+    text[0x25] = "Retain Available";
+    text[0x26] = "User Property";
+    text[0x27] = "Maximum Packet Size";
+    text[0x28] = "Wildcard Subscription Available";
+    text[0x29] = "Subscription Identifier Available";
+    text[0x2A] = "Shared Subscription Available";
+    return text;
+  }
 
-    auto it = propertyMap.find(id);
-    if (it != propertyMap.end()) {
-      return it->second;
-    }
-    return "unknown property ID";
+  const char* Property::Text(ID id) {
+    static constexpr propertytext_t propertyText = makePropertyText();
+    const char* text = propertyText[toUnderlyingType(id)];
+    return text != nullptr ? text : "unknown property ID";
   }
 
 } // namespace packet
@@ -2,7 +2,7 @@
 
 #include "codec.h"
 #include "utils.h"
-#include <map>
+#include <array>
 #include <optional>
 #include <sstream>
 #include <type_traits>
@@ -106,6 +106,8 @@ namespace packet {
     template <typename T, bool varuint32 = false>
     static void encode(Encoder& enc, ID id, const T& value);
 
+    // decode reads the value after the identifier, returns the bytes read.
+    // An empty string or binary value is 2 bytes, its length
     template <typename T, bool varuint32 = false>
     static uint32_t decode(Decoder& dec, ID id, T& value);
   };
@@ -114,14 +116,6 @@ namespace packet {
     return 1;
   }
 
-  inline void throwErrorIfNotEmpty(Property::ID id, bool empty) {
-    if (!empty) {
-      std::ostringstream stream;
-      stream << Property::Text(id) << "  must not be included more than once";
-      throw std::runtime_error(stream.str());
-    }
-  }
-
   [[noreturn]] inline void throwInvalidPropertyID(Property::ID id,
                                                   const char* packetName) {
     std::ostringstream stream;
@@ -147,6 +141,13 @@ namespace packet {
     struct is_stl_container<std::vector<uint32_t>> : std::true_type {};
 
     template <> struct is_stl_container<std::string> : std::true_type {};
+
+    template <typename M> struct member_pointer;
+
+    template <typename C, typename T> struct member_pointer<T C::*> {
+      using owner = C;
+      using type = T;
+    };
   } // namespace detail
 
   template <typename T>
@@ -230,7 +231,7 @@ namespace packet {
   }
 
   template <typename T, bool varuint32>
-  inline uint32_t Property::decode(Decoder& dec, ID id, T& value) {
+  inline uint32_t Property::decode(Decoder& dec, ID /*id*/, T& value) {
     static_assert(is_optional<T> || is_stl_container<T>,
                   "Property type must be std::optional or std::vector<uint8_t> "
                   "or std::string ");
@@ -238,12 +239,132 @@ namespace packet {
     if constexpr (is_optional<T>) {
       static_assert(std::is_pod<typename T::value_type>::value,
                     "underlying type of std::optional must be POD");
-      throwErrorIfNotEmpty(id, !value);
       value = dec.read<typename T::value_type, varuint32>();
-    } else if constexpr (is_stl_container<T>) {
-      throwErrorIfNotEmpty(id, value.empty());
+      if constexpr (varuint32) {
+        return EncodedVarUint32::size(*value);
+      } else {
+        return sizeof(typename T::value_type);
+      }
+    } else {
       value = dec.read<T>();
+      return static_cast<uint32_t>(value.size()) + 2;
     }
-    return Property::valueSize<T, varuint32>(value);
   }
+
+  // PropertyField describes a property of a packet: the identifier and the
+  // member of the properties struct holding the value. A std::vector of
+  // uint32_t is a property that may be included more than once, each value
+  // with its own identifier
+  template <Property::ID Id, auto Member, bool varuint32 = false>
+  struct PropertyField {
+    using Properties = typename detail::member_pointer<decltype(Member)>::owner;
+    using T = typename detail::member_pointer<decltype(Member)>::type;
+    static constexpr Property::ID id = Id;
+    static constexpr bool repeated =
+        std::is_same<T, std::vector<uint32_t>>::value;
+
+    static uint32_t size(const Properties& props) {
+      if constexpr (repeated) {
+        return Property::sizeMoreThanOnce<T, varuint32>(props.*Member);
+      } else {
+        return Property::size<T, varuint32>(props.*Member);
+      }
+    }
+
+    static void encode(Encoder& enc, const Properties& props) {
+      if constexpr (repeated) {
+        for (uint32_t v : props.*Member) {
+          enc.writeVarUint32(toUnderlyingType(Id));
+          if constexpr (varuint32) {
+            enc.writeVarUint32(v);
+          } else {
+            enc.write(v);
+          }
+        }
+      } else {
+        Property::encode<T, varuint32>(enc, Id, props.*Member);
+      }
+    }
+
+    // decode reads the value after the identifier, returns its size
+    static uint32_t decode(Decoder& dec, Properties& props) {
+      if constexpr (repeated) {
+        uint32_t v = dec.read<uint32_t, varuint32>();
+        (props.*Member).push_back(v);
+        return varuint32 ? EncodedVarUint32::size(v) : 4;
+      } else {
+        return Property::decode<T, varuint32>(dec, Id, props.*Member);
+      }
+    }
+  };
+
+  // PropertyTable is the property codec of a packet type, generated from
+  // its fields. Size and encode go through the fields in order, decode
+  // dispatches on the identifier through a table built at compile time
+  template <typename Properties, typename... Fields> class PropertyTable {
+  public:
+    static uint32_t size(const Properties& props) {
+      return (0 + ... + Fields::size(props));
+    }
+
+    static void encode(Encoder& enc, const Properties& props) {
+      (Fields::encode(enc, props), ...);
+    }
+
+    // decode reads propertySize bytes of properties into props, an unknown
+    // identifier fails the decoder with InvalidPropertyID, a property that
+    // is not repeated and comes twice with DuplicateProperty
+    static void decode(Decoder& dec, uint32_t propertySize,
+                       Properties& props) {
+      // the value does not tell, an empty string may have been read
+      std::array<bool, 256> seen{};
+      while (propertySize > 0 && dec.ok()) {
+        uint32_t val = dec.read<uint32_t, true>();
+        dec.take(propertySize, EncodedVarUint32::size(val));
+        Decode fn = val < dispatch.size() ? dispatch[val] : nullptr;
+        if (fn == nullptr) {
+          dec.fail(mqtt::Error::InvalidPropertyID);
+          return;
+        }
+        if (seen[val] && !repeated[val]) {
+          dec.fail(mqtt::Error::DuplicateProperty);
+          return;
+        }
+        seen[val] = true;
+        dec.take(propertySize, fn(dec, props));
+      }
+    }
+
+  private:
+    using Decode = uint32_t (*)(Decoder&, Properties&);
+
+    static constexpr std::array<Decode, 256> makeDispatch() {
+      std::array<Decode, 256> table{};
+      ((table[toUnderlyingType(Fields::id)] = &Fields::decode), ...);
+      return table;
+    }
+
+    static constexpr std::array<bool, 256> makeRepeated() {
+      std::array<bool, 256> table{};
+      ((table[toUnderlyingType(Fields::id)] = Fields::repeated), ...);
+      return table;
+    }
+
+    static constexpr bool uniqueIDs() {
+      [[maybe_unused]] std::array<bool, 256> seen{};
+      bool unique = true;
+      ((unique = unique && !seen[toUnderlyingType(Fields::id)],
+        seen[toUnderlyingType(Fields::id)] = true),
+       ...);
+      return unique;
+    }
+
+    static_assert(uniqueIDs(), "a property is listed twice");
+    static_assert(
+        (std::is_same<typename Fields::Properties, Properties>::value && ...),
+        "the fields must be members of the properties struct");
+
+    static constexpr std::array<Decode, 256> dispatch = makeDispatch();
+    static constexpr std::array<bool, 256> repeated = makeRepeated();
+  };
 } // namespace packet
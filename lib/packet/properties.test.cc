@@ -34,10 +34,11 @@ void propertyTypeCodecTest(Property::ID id, const T& testValue) {
   Decoder dec(std::vector<uint8_t>(enc.getBuffer()));
   T varDecoded;
   CHECK(id == static_cast<Property::ID>(dec.read<uint32_t, true>()));
-  Property::decode<T, varuint32>(dec, id, varDecoded);
+  // the bytes read, the identifier aside
+  CHECK(Property::decode<T, varuint32>(dec, id, varDecoded) ==
+        size - propertyIDSize());
   CHECK(varDecoded == testValue);
-  Decoder dec2(std::vector<uint8_t>(enc.getBuffer()));
-  CHECK_THROWS_AS(Property::decode(dec2, id, varDecoded);, std::runtime_error);
+  CHECK(dec.ok());
 }
 
 TEST_CASE("testing property encode/decode") {
@@ -55,4 +56,80 @@ TEST_CASE("testing property encode/decode") {
                         std::vector<uint8_t>{'h', 'e', 'l', 'l', 'o'});
   propertyTypeCodecTest(Property::ID::AuthenticationMethodID,
                         std::string("base64"));
+
+  // an empty string is not encoded but may be received, its length is read
+  Decoder empty(std::vector<uint8_t>{0x00, 0x00});
+  std::string value;
+  CHECK(Property::decode(empty, Property::ID::ContentTypeID, value) == 2);
+  CHECK(value.empty());
+  CHECK(empty.ok());
+}
+
+namespace test {
+  struct Properties {
+    std::optional<uint16_t> receiveMaximum;
+    std::string reasonString;
+    std::vector<uint32_t> subscriptionIdentifiers;
+  };
+
+  using PropertiesTable = PropertyTable<
+      Properties,
+      PropertyField<Property::ID::ReceiveMaximumID,
+                    &Properties::receiveMaximum>,
+      PropertyField<Property::ID::ReasonStringID, &Properties::reasonString>,
+      PropertyField<Property::ID::SubscriptionIdentifierID,
+                    &Properties::subscriptionIdentifiers, true>>;
+} // namespace test
+
+TEST_CASE("testing property table") {
+  test::Properties props;
+  props.receiveMaximum = 10;
+  props.reasonString = "ok";
+  props.subscriptionIdentifiers = {1, 200};
+  uint32_t size = test::PropertiesTable::size(props);
+  // 1 + 2, 1 + 2 + 2, 1 + 1 and 1 + 2
+  CHECK(size == 13);
+
+  Encoder enc(size);
+  test::PropertiesTable::encode(enc, props);
+  REQUIRE(enc.getBuffer().size() == size);
+
+  Decoder dec(std::vector<uint8_t>(enc.getBuffer()));
+  test::Properties decoded;
+  test::PropertiesTable::decode(dec, size, decoded);
+  REQUIRE(dec.ok());
+  CHECK(decoded.receiveMaximum == props.receiveMaximum);
+  CHECK(decoded.reasonString == props.reasonString);
+  CHECK(decoded.subscriptionIdentifiers == props.subscriptionIdentifiers);
+
+  // the single valued properties must not repeat in a block, unknown ones
+  // fail
+  std::vector<uint8_t> twice = enc.getBuffer();
+  twice.insert(twice.end(), enc.getBuffer().begin(), enc.getBuffer().end());
+  Decoder again(twice);
+  test::Properties repeated;
+  test::PropertiesTable::decode(again, 2 * size, repeated);
+  CHECK(again.error() == mqtt::Error::DuplicateProperty);
+  // the repeated ones may
+  const std::vector<uint8_t> ids = {0x0B, 0x01, 0x0B, 0x02};
+  Decoder idDec(ids);
+  test::Properties idProps;
+  test::PropertiesTable::decode(idDec, 4, idProps);
+  CHECK(idDec.ok());
+  CHECK(idProps.subscriptionIdentifiers == std::vector<uint32_t>{1, 2});
+  // an empty Reason String is seen too
+  const std::vector<uint8_t> emptyTwice = {0x1F, 0x00, 0x00, 0x1F, 0x00, 0x00};
+  Decoder emptyDec(emptyTwice);
+  test::Properties emptyProps;
+  test::PropertiesTable::decode(emptyDec, 6, emptyProps);
+  CHECK(emptyDec.error() == mqtt::Error::DuplicateProperty);
+  Decoder unknown(std::vector<uint8_t>{0x24, 0x01});
+  test::Properties empty;
+  test::PropertiesTable::decode(unknown, 2, empty);
+  CHECK(unknown.error() == mqtt::Error::InvalidPropertyID);
+
+  CHECK(std::string(Property::Text(Property::ID::ReasonStringID)) ==
+        "Reason String");
+  CHECK(std::string(Property::Text(static_cast<Property::ID>(0x7F))) ==
+        "unknown property ID");
 }
@@ -1,14 +1,69 @@
 #include "publish.h"
 #include "packet.h"
 #include "properties.h"
+#include "../bufferpool.h"
+#include "../probes.h"
+#include "../utf8.h"
+#include <stdexcept>
 
 namespace packet {
-  PublishEncoder::PublishEncoder(PublishPacket sp) : publishPkt(sp) {}
+  // the PUBLISH properties, PublishPropertyTable lists them in the order
+  // they are encoded
+  using PayloadFormatIndicatorField =
+      PropertyField<Property::ID::PayloadFormatIndicatorID,
+                    &mqtt::Publish::Properties::payloadFormatIndicator>;
+  using MessageExpiryIntervalField =
+      PropertyField<Property::ID::MessageExpiryIntervalID,
+                    &mqtt::Publish::Properties::messageExpiryInterval>;
+  using TopicAliasField =
+      PropertyField<Property::ID::TopicAliasID,
+                    &mqtt::Publish::Properties::topicAlias>;
+  using ResponseTopicField =
+      PropertyField<Property::ID::ResponseTopicID,
+                    &mqtt::Publish::Properties::responseTopic>;
+  using CorrelationDataField =
+      PropertyField<Property::ID::CorrelationDataID,
+                    &mqtt::Publish::Properties::correlationData>;
+  using SubscriptionIdentifierField =
+      PropertyField<Property::ID::SubscriptionIdentifierID,
+                    &mqtt::Publish::Properties::subscriptionIdentifiers,
+                    true>;
+  using ContentTypeField =
+      PropertyField<Property::ID::ContentTypeID,
+                    &mqtt::Publish::Properties::contentType>;
+  using PublishPropertyTable =
+      PropertyTable<mqtt::Publish::Properties, PayloadFormatIndicatorField,
+                    MessageExpiryIntervalField, TopicAliasField,
+                    ResponseTopicField, CorrelationDataField,
+                    SubscriptionIdentifierField, ContentTypeField>;
+  // the properties SharedPublish encodes once for all recipients
+  using SharedPropertyTable =
+      PropertyTable<mqtt::Publish::Properties, PayloadFormatIndicatorField,
+                    ResponseTopicField, CorrelationDataField,
+                    ContentTypeField>;
+
+  PublishEncoder::PublishEncoder(const PublishPacket& sp)
+      : packetID(sp.first), publish(sp.second) {}
 
   std::vector<uint8_t> PublishEncoder::encode() const {
-    const mqtt::Publish& p = this->publishPkt.second;
+    Encoder enc;
+    PublishEncoder::write(enc, this->packetID, this->publish);
+    return enc.takeBuffer();
+  }
+
+  void PublishEncoder::encode(const PublishPacket& sp, Sink& sink) {
+    PublishEncoder::encode(sp.first, sp.second, sink);
+  }
+
+  void PublishEncoder::encode(uint16_t packetID, const mqtt::Publish& p,
+                              Sink& sink) {
+    Encoder enc(sink);
+    PublishEncoder::write(enc, packetID, p);
+  }
 
-    uint32_t propertySize = this->propertySize();
+  void PublishEncoder::write(Encoder& enc, uint16_t packetID,
+                             const mqtt::Publish& p) {
+    uint32_t propertySize = PublishEncoder::propertySize(p);
     uint32_t remainingLength =
         propertySize + EncodedVarUint32::size(propertySize);
     remainingLength += uint32_t(p.topicName.size() + 2 + p.payload.size());
@@ -16,7 +71,7 @@ namespace packet {
       remainingLength += 2;
     }
 
-    Encoder enc(remainingLength + 1 + EncodedVarUint32::size(remainingLength));
+    enc.reserve(remainingLength + 1 + EncodedVarUint32::size(remainingLength));
     uint8_t byte0 = static_cast<uint8_t>(
         static_cast<uint32_t>(ControlPacket::Type::PUBLISH) << 4);
     if (p.isDup) {
@@ -29,64 +84,137 @@ namespace packet {
 
     enc.write(byte0);
     enc.writeVarUint32(remainingLength);
+    MQTT_PROBE2(packet__encode,
+                static_cast<int>(ControlPacket::Type::PUBLISH),
+                remainingLength);
 
     // topic name
     enc.write(p.topicName);
     if (p.qosLevel > 0) {
-      enc.write(this->publishPkt.first);
+      enc.write(packetID);
     }
-    this->encodeProperties(enc, propertySize);
+    PublishEncoder::encodeProperties(enc, p, propertySize);
 
     enc.writeBinaryDataNoLen(p.payload);
-
-    return enc.getBuffer();
   }
 
-  uint32_t PublishEncoder::propertySize() const {
-    if (!this->publishPkt.second.properties) {
+  uint32_t PublishEncoder::propertySize(const mqtt::Publish& p) {
+    if (!p.properties) {
       return 0;
     }
-    const mqtt::Publish::Properties& props =
-        *this->publishPkt.second.properties;
+    return PublishPropertyTable::size(*p.properties);
+  }
 
-    uint32_t propertySize = 0;
-    propertySize += Property::size(props.payloadFormatIndicator);
-    propertySize += Property::size(props.messageExpiryInterval);
-    propertySize += Property::size(props.topicAlias);
-    propertySize += Property::size(props.responseTopic);
-    propertySize += Property::size(props.correlationData);
-    propertySize += Property::sizeMoreThanOnce<std::vector<uint32_t>, true>(
-        props.subscriptionIdentifiers);
-    propertySize += Property::size(props.contentType);
+  void PublishEncoder::encodeProperties(Encoder& enc, const mqtt::Publish& p,
+                                        uint32_t propertySize) {
+    enc.writeVarUint32(propertySize);
 
-    return propertySize;
+    if (p.properties) {
+      PublishPropertyTable::encode(enc, *p.properties);
+    }
   }
 
-  void PublishEncoder::encodeProperties(Encoder& enc,
-                                        uint32_t propertySize) const {
-    enc.writeVarUint32(propertySize);
+  SharedPublish::SharedPublish(const mqtt::Publish& p)
+      : sharedPropertySize(0), hasRetain(p.hasRetain) {
+    // encoded straight into the members, the payload is copied once
+    Encoder topicEnc(this->topicBytes);
+    topicEnc.reserve(p.topicName.size() + 2);
+    topicEnc.write(p.topicName);
 
-    if (this->publishPkt.second.properties) {
-      const mqtt::Publish::Properties& props =
-          *this->publishPkt.second.properties;
-      Property::encode(enc, Property::ID::PayloadFormatIndicatorID,
-                       props.payloadFormatIndicator);
-      Property::encode(enc, Property::ID::MessageExpiryIntervalID,
-                       props.messageExpiryInterval);
-      Property::encode(enc, Property::ID::TopicAliasID, props.topicAlias);
-      Property::encode(enc, Property::ID::ResponseTopicID, props.responseTopic);
-      Property::encode(enc, Property::ID::CorrelationDataID,
-                       props.correlationData);
-      for (auto v : props.subscriptionIdentifiers) {
-        enc.writeVarUint32(
-            static_cast<uint32_t>(Property::ID::SubscriptionIdentifierID));
-        enc.writeVarUint32(v);
-      }
-      Property::encode<std::vector<uint32_t>, true>(
-          enc, Property::ID::SubscriptionIdentifierID,
-          props.subscriptionIdentifiers);
-      Property::encode(enc, Property::ID::ContentTypeID, props.contentType);
+    if (p.properties) {
+      this->sharedPropertySize = SharedPropertyTable::size(*p.properties);
+    }
+
+    Encoder enc(this->restBytes);
+    enc.reserve(this->sharedPropertySize + p.payload.size());
+    if (p.properties) {
+      SharedPropertyTable::encode(enc, *p.properties);
     }
+    enc.writeBinaryDataNoLen(p.payload);
+  }
+
+  PublishHeader
+  SharedPublish::header(uint8_t qosLevel, bool isDup, uint16_t packetID,
+                        std::optional<uint32_t> messageExpiryInterval,
+                        std::optional<uint32_t> subscriptionID) const {
+    uint32_t propertySize = this->sharedPropertySize;
+    if (messageExpiryInterval) {
+      propertySize += propertyIDSize() + 4;
+    }
+    if (subscriptionID) {
+      propertySize += propertyIDSize() + EncodedVarUint32::size(*subscriptionID);
+    }
+    uint32_t remainingLength =
+        uint32_t(this->topicBytes.size() + this->restBytes.size()) -
+        this->sharedPropertySize + propertySize +
+        EncodedVarUint32::size(propertySize);
+    if (qosLevel > 0) {
+      remainingLength += 2;
+    }
+    MQTT_PROBE2(packet__encode,
+                static_cast<int>(ControlPacket::Type::PUBLISH),
+                remainingLength);
+
+    PublishHeader h{};
+    uint8_t* out = h.bytes.data();
+    out[0] = static_cast<uint8_t>(
+        static_cast<uint32_t>(ControlPacket::Type::PUBLISH) << 4);
+    if (isDup) {
+      out[0] |= (1 << 3);
+    }
+    out[0] |= static_cast<uint8_t>(qosLevel << 1);
+    if (this->hasRetain) {
+      out[0] |= 1;
+    }
+    h.fixedLen = static_cast<uint8_t>(1 + EncodedVarUint32::encode(remainingLength, out + 1));
+
+    uint8_t n = h.fixedLen;
+    if (qosLevel > 0) {
+      out[n++] = static_cast<uint8_t>(packetID >> 8);
+      out[n++] = static_cast<uint8_t>(packetID);
+    }
+    n = static_cast<uint8_t>(n + EncodedVarUint32::encode(propertySize, out + n));
+    if (messageExpiryInterval) {
+      out[n++] = static_cast<uint8_t>(Property::ID::MessageExpiryIntervalID);
+      out[n++] = static_cast<uint8_t>(*messageExpiryInterval >> 24);
+      out[n++] = static_cast<uint8_t>(*messageExpiryInterval >> 16);
+      out[n++] = static_cast<uint8_t>(*messageExpiryInterval >> 8);
+      out[n++] = static_cast<uint8_t>(*messageExpiryInterval);
+    }
+    if (subscriptionID) {
+      out[n++] = static_cast<uint8_t>(Property::ID::SubscriptionIdentifierID);
+      n = static_cast<uint8_t>(n + EncodedVarUint32::encode(*subscriptionID, out + n));
+    }
+    h.variableLen = static_cast<uint8_t>(n - h.fixedLen);
+    return h;
+  }
+
+  const std::vector<uint8_t>& SharedPublish::topic() const {
+    return this->topicBytes;
+  }
+
+  const std::vector<uint8_t>& SharedPublish::rest() const {
+    return this->restBytes;
+  }
+
+  size_t SharedPublish::size(const PublishHeader& header) const {
+    return header.fixedLen + header.variableLen + this->topicBytes.size() +
+           this->restBytes.size();
+  }
+
+  std::vector<uint8_t>
+  SharedPublish::encode(const PublishHeader& header) const {
+    std::vector<uint8_t> buffer =
+        mqttutils::BufferPool::local().acquire(this->size(header));
+    buffer.reserve(this->size(header));
+    const uint8_t* h = header.bytes.data();
+    buffer.insert(buffer.end(), h, h + header.fixedLen);
+    buffer.insert(buffer.end(), this->topicBytes.begin(),
+                  this->topicBytes.end());
+    buffer.insert(buffer.end(), h + header.fixedLen,
+                  h + header.fixedLen + header.variableLen);
+    buffer.insert(buffer.end(), this->restBytes.begin(), this->restBytes.end());
+    return buffer;
   }
 
   //   //
@@ -99,72 +227,395 @@ namespace packet {
     return PublishDecoder::decode(dec, byte0, remainingLen);
   }
 
+  // findProperty sets pos to the offset of the value of the property id in
+  // the block, the values of the other properties are skipped. pos is empty
+  // when the block does not have it
+  static std::error_code findProperty(const uint8_t* block, size_t size,
+                                      Property::ID wanted,
+                                      std::optional<size_t>& pos) {
+    pos.reset();
+    size_t i = 0;
+    while (i < size) {
+      // the PUBLISH property identifiers fit in one byte
+      Property::ID id = static_cast<Property::ID>(block[i++]);
+      if (id == wanted) {
+        pos = i;
+        return {};
+      }
+      switch (id) {
+      case Property::ID::PayloadFormatIndicatorID:
+        i += 1;
+        break;
+      case Property::ID::MessageExpiryIntervalID:
+        i += 4;
+        break;
+      case Property::ID::TopicAliasID:
+        i += 2;
+        break;
+      case Property::ID::ResponseTopicID:
+      case Property::ID::CorrelationDataID:
+      case Property::ID::ContentTypeID:
+        if (i + 2 > size) {
+          return mqtt::Error::MalformedPacket;
+        }
+        i += 2 + (size_t(block[i]) << 8 | block[i + 1]);
+        break;
+      case Property::ID::SubscriptionIdentifierID:
+        while (i < size && (block[i] & 0x80) != 0) {
+          i++;
+        }
+        i++;
+        break;
+      default:
+        return mqtt::Error::InvalidPropertyID;
+      }
+    }
+    return {};
+  }
+
+  PublishProperties::PublishProperties()
+      : block(nullptr), blockSize(0), decoded(false) {}
+
+  PublishProperties::PublishProperties(const uint8_t* dataA, uint32_t sizeA)
+      : block(dataA), blockSize(sizeA), decoded(false) {}
+
+  bool PublishProperties::empty() const {
+    return this->blockSize == 0;
+  }
+
+  const uint8_t* PublishProperties::data() const {
+    return this->block;
+  }
+
+  uint32_t PublishProperties::size() const {
+    return this->blockSize;
+  }
+
+  std::optional<uint16_t> PublishProperties::topicAlias() const {
+    std::optional<uint16_t> value;
+    throwIfError(this->topicAlias(value));
+    return value;
+  }
+
+  std::error_code
+  PublishProperties::topicAlias(std::optional<uint16_t>& value) const {
+    value.reset();
+    std::optional<size_t> pos;
+    std::error_code ec = findProperty(this->block, this->blockSize,
+                                      Property::ID::TopicAliasID, pos);
+    if (ec || !pos) {
+      return ec;
+    }
+    if (*pos + 2 > this->blockSize) {
+      return mqtt::Error::MalformedPacket;
+    }
+    value = static_cast<uint16_t>(this->block[*pos] << 8 |
+                                  this->block[*pos + 1]);
+    return {};
+  }
+
+  std::optional<uint32_t> PublishProperties::messageExpiryInterval() const {
+    std::optional<uint32_t> value;
+    throwIfError(this->messageExpiryInterval(value));
+    return value;
+  }
+
+  std::error_code PublishProperties::messageExpiryInterval(
+      std::optional<uint32_t>& value) const {
+    value.reset();
+    std::optional<size_t> pos;
+    std::error_code ec =
+        findProperty(this->block, this->blockSize,
+                     Property::ID::MessageExpiryIntervalID, pos);
+    if (ec || !pos) {
+      return ec;
+    }
+    if (*pos + 4 > this->blockSize) {
+      return mqtt::Error::MalformedPacket;
+    }
+    Decoder dec(this->block + *pos, 4);
+    value = dec.read<uint32_t>();
+    return {};
+  }
+
+  const std::shared_ptr<mqtt::Publish::Properties>&
+  PublishProperties::get() const {
+    throwIfError(this->decode());
+    return this->properties;
+  }
+
+  std::error_code PublishProperties::get(
+      std::shared_ptr<mqtt::Publish::Properties>& props) const {
+    std::error_code ec = this->decode();
+    props = ec ? nullptr : this->properties;
+    return ec;
+  }
+
+  std::error_code PublishProperties::decode() const {
+    if (this->decoded || this->blockSize == 0) {
+      this->decoded = true;
+      return {};
+    }
+    Decoder dec(this->block, this->blockSize);
+    auto props = std::make_shared<mqtt::Publish::Properties>();
+    PublishPropertyTable::decode(dec, this->blockSize, *props);
+    if (!dec.ok()) {
+      return dec.error();
+    }
+    this->properties = std::move(props);
+    this->decoded = true;
+    return {};
+  }
+
+  LazyPublishPacket PublishDecoder::decodeLazy(Decoder& dec, uint8_t byte0,
+                                               uint32_t remainingLen) {
+    LazyPublishPacket pkt{0, {}, {}};
+    throwIfError(PublishDecoder::decodeLazy(dec, byte0, remainingLen, pkt));
+    return pkt;
+  }
+
+  std::error_code PublishDecoder::decodeLazy(Decoder& dec, uint8_t byte0,
+                                             uint32_t remainingLen,
+                                             LazyPublishPacket& pkt) {
+    mqtt::Publish& p = pkt.publish;
+    p.qosLevel = ((byte0 >> 1) & 0x03);
+    p.isDup = (byte0 & 0x08);
+    p.hasRetain = (byte0 & 0x01);
+
+    p.topicName = dec.read<std::string>();
+    dec.take(remainingLen, p.topicName.size() + 2);
+    if (p.qosLevel > 0) {
+      pkt.packetID = dec.read<uint16_t>();
+      dec.take(remainingLen, 2);
+    }
+    uint32_t propertySize = dec.readLength();
+    dec.take(remainingLen, EncodedVarUint32::size(propertySize) + propertySize);
+    const uint8_t* block = dec.readView(propertySize);
+    if (!dec.ok()) {
+      return dec.done(ControlPacket::Type::PUBLISH);
+    }
+    pkt.properties = PublishProperties(block, propertySize);
+
+    p.payload = dec.readBinaryDataNoLen(remainingLen);
+    return dec.done(ControlPacket::Type::PUBLISH);
+  }
+
+  [[noreturn]] static void throwMalformedFrame() {
+    throw std::runtime_error("PUBLISH: malformed frame");
+  }
+
+  RawPublish::RawPublish(std::vector<uint8_t> frameA)
+      : frame(std::move(frameA)), topicOffset(0), propertiesOffset(0),
+        propertySize(0), payloadOffset(0) {
+    this->parse();
+  }
+
+  void RawPublish::parse() {
+    FixedHeader fhdr;
+    size_t headerLen = 0;
+    if (FixedHeaderReader::parse(this->frame.data(), this->frame.size(), fhdr,
+                                 headerLen) !=
+            FixedHeaderReader::Result::Complete ||
+        static_cast<ControlPacket::Type>(fhdr.first >> 4) !=
+            ControlPacket::Type::PUBLISH ||
+        headerLen + fhdr.second != this->frame.size() ||
+        this->qosLevel() > 2) {
+      throwMalformedFrame();
+    }
+
+    const uint8_t* data = this->frame.data();
+    size_t size = this->frame.size();
+    size_t pos = headerLen;
+    if (pos + 2 > size) {
+      throwMalformedFrame();
+    }
+    this->topicOffset = pos + 2;
+    size_t topicLen = size_t(data[pos]) << 8 | data[pos + 1];
+    pos = this->topicOffset + topicLen;
+    // the topic is forwarded as it is, it is checked once here: well formed
+    // UTF-8 and no wildcards. Empty is allowed, the Topic Alias names it
+    if (pos > size) {
+      throwMalformedFrame();
+    }
+    mqttutils::UTF8::Result topic = mqttutils::UTF8::scan(
+        reinterpret_cast<const char*>(data + this->topicOffset), topicLen);
+    if (!topic.valid || topic.hasWildcard) {
+      throwMalformedFrame();
+    }
+    if (this->qosLevel() > 0) {
+      if (pos + 2 > size || (data[pos] == 0 && data[pos + 1] == 0)) {
+        throwMalformedFrame();
+      }
+      pos += 2;
+    }
+    uint32_t n = pos < size ? EncodedVarUint32::decode(data + pos, size - pos,
+                                                       this->propertySize)
+                            : 0;
+    pos += n;
+    if (n == 0 || pos + this->propertySize > size) {
+      throwMalformedFrame();
+    }
+    this->propertiesOffset = pos;
+    this->payloadOffset = pos + this->propertySize;
+  }
+
+  uint8_t RawPublish::qosLevel() const {
+    return (this->frame[0] >> 1) & 0x03;
+  }
+
+  bool RawPublish::isDup() const {
+    return (this->frame[0] & 0x08) != 0;
+  }
+
+  bool RawPublish::hasRetain() const {
+    return (this->frame[0] & 0x01) != 0;
+  }
+
+  std::string_view RawPublish::topic() const {
+    const uint8_t* data = this->frame.data();
+    size_t len = size_t(data[this->topicOffset - 2]) << 8 |
+                 data[this->topicOffset - 1];
+    return std::string_view(
+        reinterpret_cast<const char*>(data + this->topicOffset), len);
+  }
+
+  uint16_t RawPublish::packetID() const {
+    if (this->qosLevel() == 0) {
+      return 0;
+    }
+    size_t pos = this->topicOffset + this->topic().size();
+    return static_cast<uint16_t>(this->frame[pos] << 8 | this->frame[pos + 1]);
+  }
+
+  PublishProperties RawPublish::properties() const {
+    return PublishProperties(this->frame.data() + this->propertiesOffset,
+                             this->propertySize);
+  }
+
+  const uint8_t* RawPublish::payload() const {
+    return this->frame.data() + this->payloadOffset;
+  }
+
+  size_t RawPublish::payloadSize() const {
+    return this->frame.size() - this->payloadOffset;
+  }
+
+  void RawPublish::setDup(bool isDup) {
+    this->frame[0] = static_cast<uint8_t>(isDup ? this->frame[0] | 0x08
+                                                : this->frame[0] & ~0x08);
+  }
+
+  void RawPublish::setRetain(bool hasRetain) {
+    this->frame[0] = static_cast<uint8_t>(hasRetain ? this->frame[0] | 0x01
+                                                    : this->frame[0] & ~0x01);
+  }
+
+  void RawPublish::setPacketID(uint16_t packetID) {
+    if (this->qosLevel() == 0) {
+      throw std::invalid_argument(__PRETTY_FUNCTION__ +
+                                  std::string(": QoS 0 has no packet id"));
+    }
+    if (packetID == 0) {
+      throw std::invalid_argument(__PRETTY_FUNCTION__ +
+                                  std::string(": packet id 0"));
+    }
+    size_t pos = this->topicOffset + this->topic().size();
+    this->frame[pos] = uint8_t(packetID >> 8);
+    this->frame[pos + 1] = uint8_t(packetID);
+  }
+
+  void RawPublish::setQoS(uint8_t qosLevel, uint16_t packetID) {
+    if (qosLevel > 2) {
+      throw std::invalid_argument(__PRETTY_FUNCTION__ +
+                                  std::string(": invalid QoS"));
+    }
+    if (qosLevel > 0 && packetID == 0) {
+      throw std::invalid_argument(__PRETTY_FUNCTION__ +
+                                  std::string(": packet id 0"));
+    }
+    // DUP must be 0 on a QoS 0 PUBLISH
+    uint8_t flags = qosLevel == 0 ? 0x0E : 0x06;
+    uint8_t byte0 =
+        static_cast<uint8_t>((this->frame[0] & ~flags) | (qosLevel << 1));
+    if ((this->qosLevel() == 0) == (qosLevel == 0)) {
+      this->frame[0] = byte0;
+      if (qosLevel > 0) {
+        this->setPacketID(packetID);
+      }
+      return;
+    }
+
+    // the packet identifier is added or removed, the remaining length and
+    // the bytes after the topic name move
+    size_t idPos = this->topicOffset + this->topic().size();
+    size_t restPos = qosLevel == 0 ? idPos + 2 : idPos;
+    size_t headerLen = this->topicOffset - 2;
+    size_t remainingLength = this->frame.size() - headerLen;
+    remainingLength = qosLevel == 0 ? remainingLength - 2 : remainingLength + 2;
+    Encoder enc(this->frame.size() + 4);
+    enc.write(byte0);
+    enc.writeVarUint32(static_cast<uint32_t>(remainingLength));
+    std::vector<uint8_t> out = enc.takeBuffer();
+    const uint8_t* data = this->frame.data();
+    out.insert(out.end(), data + headerLen, data + idPos);
+    if (qosLevel > 0) {
+      out.push_back(uint8_t(packetID >> 8));
+      out.push_back(uint8_t(packetID));
+    }
+    out.insert(out.end(), data + restPos, data + this->frame.size());
+    mqttutils::BufferPool::local().release(std::move(this->frame));
+    this->frame = std::move(out);
+    this->parse();
+  }
+
+  const std::vector<uint8_t>& RawPublish::bytes() const {
+    return this->frame;
+  }
+
+  std::vector<uint8_t> RawPublish::take() {
+    return std::move(this->frame);
+  }
+
   PublishPacket PublishDecoder::decode(Decoder& dec, uint8_t byte0,
                                        uint32_t remainingLen) {
-    mqtt::Publish p;
+    PublishPacket pkt;
+    throwIfError(PublishDecoder::decode(dec, byte0, remainingLen, pkt));
+    return pkt;
+  }
+
+  std::error_code PublishDecoder::decode(Decoder& dec, uint8_t byte0,
+                                         uint32_t remainingLen,
+                                         PublishPacket& pkt) {
+    mqtt::Publish& p = pkt.second;
     p.qosLevel = ((byte0 >> 1) & 0x03);
     p.isDup = (byte0 & 0x08);
     p.hasRetain = (byte0 & 0x01);
 
     p.topicName = dec.read<std::string>();
-    remainingLen -= uint32_t(p.topicName.size() + 2);
-    uint16_t packetID = 0;
+    dec.take(remainingLen, p.topicName.size() + 2);
+    pkt.first = 0;
     if (p.qosLevel > 0) {
-      packetID = dec.read<uint16_t>();
-      remainingLen -= 2;
+      pkt.first = dec.read<uint16_t>();
+      dec.take(remainingLen, 2);
     }
     auto result = PublishDecoder::decodeProperties(dec);
-    remainingLen -= result.second;
+    dec.take(remainingLen, result.second);
     p.properties = result.first;
 
     p.payload = dec.readBinaryDataNoLen(remainingLen);
-    return {packetID, p};
+    return dec.done(ControlPacket::Type::PUBLISH);
   }
 
   std::pair<std::shared_ptr<mqtt::Publish::Properties>, uint32_t>
   PublishDecoder::decodeProperties(Decoder& dec) {
-    uint32_t propertySize = dec.read<uint32_t, true>();
+    uint32_t propertySize = dec.readLength();
 
     uint32_t consumed = EncodedVarUint32::size(propertySize) + propertySize;
 
     std::shared_ptr<mqtt::Publish::Properties> props;
     if (propertySize > 0) {
-      props = std::make_shared<mqtt::Publish::Properties>();
-    }
-
-    while (propertySize > 0) {
-      uint32_t val = dec.read<uint32_t, true>();
-      propertySize -= EncodedVarUint32::size(val);
-      Property::ID id = static_cast<Property::ID>(val);
-
-      switch (id) {
-      case Property::ID::PayloadFormatIndicatorID:
-        propertySize -=
-            Property::decode(dec, id, props->payloadFormatIndicator);
-        break;
-      case Property::ID::MessageExpiryIntervalID:
-        propertySize -= Property::decode(dec, id, props->messageExpiryInterval);
-        break;
-      case Property::ID::TopicAliasID:
-        propertySize -= Property::decode(dec, id, props->topicAlias);
-        break;
-      case Property::ID::ResponseTopicID:
-        propertySize -= Property::decode(dec, id, props->responseTopic);
-        break;
-      case Property::ID::CorrelationDataID:
-        propertySize -= Property::decode(dec, id, props->correlationData);
-        break;
-      case Property::ID::SubscriptionIdentifierID: {
-        uint32_t value = dec.read<uint32_t, true>();
-        props->subscriptionIdentifiers.push_back(value);
-        propertySize -= Property::valueSize<uint32_t, true>(value);
-      } break;
-      case Property::ID::ContentTypeID:
-        propertySize -= Property::decode(dec, id, props->contentType);
-        break;
-      default:
-        throwInvalidPropertyID(id, "PUBLISH");
-      }
+      props = dec.makeProperties<mqtt::Publish::Properties>();
+      PublishPropertyTable::decode(dec, propertySize, *props);
     }
 
     return {props, consumed};
@@ -1,7 +1,11 @@
 #pragma once
 
+#include "packet.h"
+#include <array>
 #include <mqtt/noncopyable.h>
 #include <mqtt/publish.h>
+#include <string_view>
+#include <system_error>
 
 namespace packet {
   class Encoder;
@@ -9,17 +13,163 @@ namespace packet {
 
   using PublishPacket = std::pair<uint16_t, mqtt::Publish>;
 
+  // PublishEncoder borrows the packet, which must outlive the encoder. The
+  // topic, the properties and the payload are copied once, into the output
   class PublishEncoder : public mqtt::noncopyable {
   public:
-    explicit PublishEncoder(PublishPacket sp);
+    explicit PublishEncoder(const PublishPacket& sp);
     std::vector<uint8_t> encode() const;
+    // encode appends the packet to sink
+    static void encode(const PublishPacket& sp, Sink& sink);
+    static void encode(uint16_t packetID, const mqtt::Publish& p, Sink& sink);
 
   private:
-    uint32_t propertySize() const;
-    void encodeProperties(Encoder& enc, uint32_t propertySize) const;
+    static void write(Encoder& enc, uint16_t packetID, const mqtt::Publish& p);
+    static uint32_t propertySize(const mqtt::Publish& p);
+    static void encodeProperties(Encoder& enc, const mqtt::Publish& p,
+                                 uint32_t propertySize);
 
   private:
-    PublishPacket publishPkt;
+    const uint16_t packetID;
+    const mqtt::Publish& publish;
+  };
+
+  // PublishHeader holds the bytes of a PUBLISH that differ per recipient.
+  // bytes[0, fixedLen) is the fixed header and goes before the topic name,
+  // the variable part follows the topic name: packet identifier, property
+  // length, Message Expiry Interval and Subscription Identifier
+  struct PublishHeader {
+    std::array<uint8_t, 24> bytes;
+    uint8_t fixedLen;
+    uint8_t variableLen;
+  };
+
+  // SharedPublish encodes the parts of a PUBLISH that are the same for all
+  // recipients once: the topic name, the properties other than Message
+  // Expiry Interval and Subscription Identifier, and the payload. A message
+  // sent to many subscribers shares one SharedPublish and only the small
+  // PublishHeader is encoded per recipient, the parts are written with
+  // vectored I/O. Topic Alias is not encoded, it is scoped to a connection.
+  class SharedPublish : public mqtt::noncopyable {
+  public:
+    explicit SharedPublish(const mqtt::Publish& p);
+
+    PublishHeader header(uint8_t qosLevel, bool isDup, uint16_t packetID,
+                         std::optional<uint32_t> messageExpiryInterval,
+                         std::optional<uint32_t> subscriptionID) const;
+
+    // topic is the encoded topic name, rest the shared properties followed
+    // by the payload
+    const std::vector<uint8_t>& topic() const;
+    const std::vector<uint8_t>& rest() const;
+
+    // size of the complete packet
+    size_t size(const PublishHeader& header) const;
+
+    // encode joins the parts into one buffer
+    std::vector<uint8_t> encode(const PublishHeader& header) const;
+
+  private:
+    std::vector<uint8_t> topicBytes;
+    std::vector<uint8_t> restBytes;
+    uint32_t sharedPropertySize;
+    bool hasRetain;
+  };
+
+  // PublishProperties refers to the property block of a decoded PUBLISH
+  // without decoding it. A property is decoded when it is accessed, a path
+  // that only routes by topic and forwards the payload never parses them.
+  // The block is a view into the packet buffer, which must outlive it. A
+  // malformed block shows when it is accessed: the accessors returning an
+  // error code report it, the others throw.
+  class PublishProperties {
+  public:
+    PublishProperties();
+    PublishProperties(const uint8_t* data, uint32_t size);
+
+    bool empty() const;
+    // the property block without the property length
+    const uint8_t* data() const;
+    uint32_t size() const;
+
+    // the lookups scan the block and decode only the requested property
+    std::optional<uint16_t> topicAlias() const;
+    std::optional<uint32_t> messageExpiryInterval() const;
+    std::error_code topicAlias(std::optional<uint16_t>& value) const;
+    std::error_code
+    messageExpiryInterval(std::optional<uint32_t>& value) const;
+
+    // get decodes all properties on the first call, nullptr when the block
+    // is empty
+    const std::shared_ptr<mqtt::Publish::Properties>& get() const;
+    // props is nullptr on error
+    std::error_code
+    get(std::shared_ptr<mqtt::Publish::Properties>& props) const;
+
+  private:
+    std::error_code decode() const;
+
+  private:
+    const uint8_t* block;
+    uint32_t blockSize;
+    mutable bool decoded;
+    mutable std::shared_ptr<mqtt::Publish::Properties> properties;
+  };
+
+  // LazyPublishPacket is a decoded PUBLISH whose properties are not decoded,
+  // publish.properties is not set
+  struct LazyPublishPacket {
+    uint16_t packetID;
+    mqtt::Publish publish;
+    PublishProperties properties;
+  };
+
+  // RawPublish is an inbound PUBLISH frame forwarded without decoding and
+  // encoding it again, e.g. by a bridge. The fixed header, the topic name
+  // (UTF-8, no wildcards), the packet identifier (not 0) and the bounds of
+  // the properties and the payload are validated, the properties and the
+  // payload are not looked at. DUP, RETAIN and the packet identifier are
+  // rewritten in place, changing the QoS between 0 and 1 or 2 adds or
+  // removes the packet identifier and moves the bytes once.
+  //
+  // A Topic Alias is scoped to the inbound connection, a frame that carries
+  // one (properties().topicAlias()) must not be forwarded as it is.
+  class RawPublish {
+  public:
+    // the frame is the complete packet, fixed header included. Throws
+    // std::runtime_error when it is not a well formed PUBLISH
+    explicit RawPublish(std::vector<uint8_t> frame);
+
+    uint8_t qosLevel() const;
+    bool isDup() const;
+    bool hasRetain() const;
+    std::string_view topic() const;
+    // 0 for QoS 0
+    uint16_t packetID() const;
+    PublishProperties properties() const;
+    const uint8_t* payload() const;
+    size_t payloadSize() const;
+
+    void setDup(bool isDup);
+    void setRetain(bool hasRetain);
+    // the QoS must not be 0, the packet identifier must not be 0
+    void setPacketID(uint16_t packetID);
+    // QoS 0 clears DUP, packetID is ignored then. Above QoS 0 packetID must
+    // not be 0
+    void setQoS(uint8_t qosLevel, uint16_t packetID);
+
+    const std::vector<uint8_t>& bytes() const;
+    std::vector<uint8_t> take();
+
+  private:
+    void parse();
+
+  private:
+    std::vector<uint8_t> frame;
+    size_t topicOffset;
+    size_t propertiesOffset;
+    uint32_t propertySize;
+    size_t payloadOffset;
   };
 
   class PublishDecoder {
@@ -27,6 +177,17 @@ namespace packet {
     static PublishPacket decode(std::vector<uint8_t> buffer, uint8_t byte0);
     static PublishPacket decode(Decoder& dec, uint8_t byte0,
                                 uint32_t remainingLen);
+    // decodeLazy leaves the properties undecoded, the decoder must read from
+    // a buffer that outlives the packet
+    static LazyPublishPacket decodeLazy(Decoder& dec, uint8_t byte0,
+                                        uint32_t remainingLen);
+    // decode and decodeLazy without exceptions, pkt is complete when there
+    // is no error
+    static std::error_code decode(Decoder& dec, uint8_t byte0,
+                                  uint32_t remainingLen, PublishPacket& pkt);
+    static std::error_code decodeLazy(Decoder& dec, uint8_t byte0,
+                                      uint32_t remainingLen,
+                                      LazyPublishPacket& pkt);
 
   private:
     static std::pair<std::shared_ptr<mqtt::Publish::Properties>, uint32_t>
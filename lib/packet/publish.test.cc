@@ -1,3 +1,4 @@
+#include "../alloccount.h"
 #include "codec.h"
 #include "doctest/doctest.h"
 #include "packet.h"
@@ -101,3 +102,389 @@ TEST_CASE("testing PUBLISH codec - enc/dec with properties") {
   std::vector<uint8_t> buffer = PublishEncoder(publishPkt).encode();
   REQUIRE(buffer == encoded);
 }
+
+TEST_CASE("testing PUBLISH codec - enc/dec with subscription identifiers") {
+  // clang-format off
+  std::vector<uint8_t> encoded = {
+      0x30, // PUBLISH, NO-DUP, 0, NO-RETAIN
+      0x0D,
+      0x00, 0x03, 'a', '/', 'b',
+      0x05,
+      0x0B, 0x01,       // Subscription Identifier 1
+      0x0B, 0xC8, 0x01, // Subscription Identifier 200
+      'h', 'i',
+  };
+  // clang-format on
+  Decoder dec(encoded);
+
+  FixedHeader fhdr = FixedHeaderReader::read(dec);
+  REQUIRE(uint32_t(0x0D) == fhdr.second);
+
+  const auto publishPkt = PublishDecoder::decode(dec, fhdr.first, fhdr.second);
+  const mqtt::Publish& p = publishPkt.second;
+  REQUIRE(p.properties);
+  REQUIRE(p.properties->subscriptionIdentifiers ==
+          std::vector<uint32_t>{1, 200});
+
+  std::vector<uint8_t> buffer = PublishEncoder(publishPkt).encode();
+  REQUIRE(buffer == encoded);
+}
+
+TEST_CASE("testing PUBLISH lazy properties") {
+  // clang-format off
+  std::vector<uint8_t> encoded = {
+      0x32, // PUBLISH, NO-DUP, 1, NO-RETAIN
+      0x1C,
+      0x00, 0x03, 'a', '/', 'b',
+      0x00, 0x07,             // Packet identifier 7
+      0x12,
+      0x0B, 0xC8, 0x01,       // Subscription Identifier 200
+      0x03, 0x00, 0x04, 't', 'e', 'x', 't', // Content Type
+      0x02, 0x00, 0x00, 0x00, 0x3C, // Message Expiry Interval 60
+      0x23, 0x00, 0x05,       // Topic Alias 5
+      'h', 'i',
+  };
+  // clang-format on
+  Decoder dec(encoded);
+
+  FixedHeader fhdr = FixedHeaderReader::read(dec);
+  REQUIRE(uint32_t(0x1C) == fhdr.second);
+
+  const auto pkt = PublishDecoder::decodeLazy(dec, fhdr.first, fhdr.second);
+  CHECK(pkt.packetID == 7);
+  CHECK(pkt.publish.topicName == "a/b");
+  CHECK(pkt.publish.payload == std::vector<uint8_t>{'h', 'i'});
+  CHECK(!pkt.publish.properties);
+  REQUIRE(!pkt.properties.empty());
+  CHECK(pkt.properties.size() == 0x12);
+  CHECK(pkt.properties.data()[0] == 0x0B);
+
+  // single properties are found without decoding the others
+  CHECK(pkt.properties.topicAlias() == uint16_t(5));
+  CHECK(pkt.properties.messageExpiryInterval() == uint32_t(60));
+
+  const auto& props = pkt.properties.get();
+  REQUIRE(props);
+  CHECK(props == pkt.properties.get());
+  CHECK(props->contentType == "text");
+  CHECK(props->subscriptionIdentifiers == std::vector<uint32_t>{200});
+  CHECK(props->topicAlias == uint16_t(5));
+
+  // no properties
+  const std::vector<uint8_t> bare = {0x30, 0x06, 0x00, 0x01, 'a', 0x00, 'x', 'y'};
+  Decoder bareDec(bare);
+  fhdr = FixedHeaderReader::read(bareDec);
+  const auto barePkt =
+      PublishDecoder::decodeLazy(bareDec, fhdr.first, fhdr.second);
+  CHECK(barePkt.properties.empty());
+  CHECK(!barePkt.properties.topicAlias());
+  CHECK(!barePkt.properties.get());
+  CHECK(barePkt.publish.payload == std::vector<uint8_t>{'x', 'y'});
+
+  // the lookups report a malformed block with an error code, the throwing
+  // ones wrap them
+  std::optional<uint16_t> alias;
+  std::shared_ptr<mqtt::Publish::Properties> decoded;
+  CHECK(!pkt.properties.topicAlias(alias));
+  CHECK(alias == uint16_t(5));
+  CHECK(!pkt.properties.get(decoded));
+  CHECK(decoded == props);
+
+  // an identifier PUBLISH does not have, a Content Type cut short, a Topic
+  // Alias past the end
+  const uint8_t unknown[] = {0x21, 0x00, 0x01};
+  const uint8_t cut[] = {0x03, 0x00};
+  const uint8_t shortAlias[] = {0x23, 0x00};
+  PublishProperties invalid(unknown, sizeof(unknown));
+  CHECK(invalid.topicAlias(alias) == mqtt::Error::InvalidPropertyID);
+  CHECK(!alias);
+  CHECK(invalid.get(decoded) == mqtt::Error::InvalidPropertyID);
+  CHECK(!decoded);
+  CHECK_THROWS_AS(invalid.get(), std::system_error);
+  std::optional<uint32_t> expiry;
+  CHECK(PublishProperties(cut, sizeof(cut)).messageExpiryInterval(expiry) ==
+        mqtt::Error::MalformedPacket);
+  PublishProperties truncated(shortAlias, sizeof(shortAlias));
+  CHECK(truncated.topicAlias(alias) == mqtt::Error::MalformedPacket);
+  CHECK_THROWS_AS(truncated.topicAlias(), std::system_error);
+
+  // a forwarded frame does not look at its properties until asked
+  RawPublish raw({0x30, 0x07, 0x00, 0x01, 'a', 0x03, 0x21, 0x00, 0x01});
+  CHECK(raw.properties().topicAlias(alias) == mqtt::Error::InvalidPropertyID);
+}
+
+TEST_CASE("testing PUBLISH raw forwarding") {
+  mqtt::Publish p;
+  p.topicName = "bridge/in";
+  p.qosLevel = 1;
+  p.isDup = true;
+  p.payload = {'o', 'k'};
+  p.properties = std::make_shared<mqtt::Publish::Properties>();
+  p.properties->contentType = "text";
+  const std::vector<uint8_t> encoded = PublishEncoder({21, p}).encode();
+
+  RawPublish raw(encoded);
+  CHECK(raw.qosLevel() == 1);
+  CHECK(raw.isDup());
+  CHECK(!raw.hasRetain());
+  CHECK(raw.topic() == "bridge/in");
+  CHECK(raw.packetID() == 21);
+  CHECK(!raw.properties().empty());
+  CHECK(!raw.properties().topicAlias());
+  REQUIRE(raw.payloadSize() == 2);
+  CHECK(raw.payload()[0] == 'o');
+
+  // in place
+  const uint8_t* data = raw.bytes().data();
+  raw.setDup(false);
+  raw.setRetain(true);
+  raw.setPacketID(300);
+  raw.setQoS(2, 301);
+  CHECK(raw.bytes().data() == data);
+  auto pkt = PublishDecoder::decode(
+      std::vector<uint8_t>(raw.bytes().begin() + 2, raw.bytes().end()),
+      raw.bytes()[0]);
+  CHECK(pkt.first == 301);
+  CHECK(pkt.second.qosLevel == 2);
+  CHECK(!pkt.second.isDup);
+  CHECK(pkt.second.hasRetain);
+  CHECK(pkt.second.payload == p.payload);
+
+  // the packet identifier is removed and added back
+  raw.setRetain(false);
+  raw.setQoS(0, 0);
+  CHECK(raw.bytes().size() == encoded.size() - 2);
+  CHECK(raw.packetID() == 0);
+  CHECK(raw.topic() == "bridge/in");
+  CHECK(raw.properties().get()->contentType == "text");
+  CHECK_THROWS(raw.setPacketID(1));
+  raw.setQoS(1, 21);
+  raw.setDup(true);
+  CHECK(raw.take() == encoded);
+
+  // a retransmitted QoS 1 frame downgraded to QoS 0 is not a duplicate
+  RawPublish dup(encoded);
+  dup.setQoS(0, 0);
+  CHECK(!dup.isDup());
+  CHECK(dup.bytes()[0] == 0x30);
+  CHECK_THROWS(dup.setQoS(1, 0));
+
+  // a QoS 1 or 2 frame without a packet identifier, or with 0
+  CHECK_THROWS(RawPublish({0x32, 0x04, 0x00, 0x01, 'a', 0x00}));
+  CHECK_THROWS(RawPublish({0x32, 0x06, 0x00, 0x01, 'a', 0x00, 0x00, 0x00}));
+  CHECK(RawPublish({0x32, 0x06, 0x00, 0x01, 'a', 0x00, 0x01, 0x00})
+            .packetID() == 1);
+  CHECK_THROWS(RawPublish({0x32, 0x06, 0x00, 0x01, 'a', 0x00, 0x01, 0x00})
+                   .setPacketID(0));
+
+  // not a PUBLISH, truncated, topic past the end
+  CHECK_THROWS(RawPublish({0x40, 0x02, 0x00, 0x01}));
+  CHECK_THROWS(RawPublish(std::vector<uint8_t>(encoded.begin(),
+                                               encoded.end() - 1)));
+  CHECK_THROWS(RawPublish({0x30, 0x03, 0x00, 0x09, 'a'}));
+  CHECK_THROWS(RawPublish({0x36, 0x04, 0x00, 0x01, 'a', 0x00}));
+  // the topic is validated as PublishDecoder does: UTF-8, no wildcards
+  CHECK_THROWS(RawPublish({0x30, 0x04, 0x00, 0x01, 0xC0, 0x00}));
+  CHECK_THROWS(RawPublish({0x30, 0x04, 0x00, 0x01, 0x00, 0x00}));
+  CHECK_THROWS(RawPublish({0x30, 0x06, 0x00, 0x03, 'a', '/', '#', 0x00}));
+  CHECK_THROWS(RawPublish({0x30, 0x06, 0x00, 0x03, 'a', '/', '+', 0x00}));
+  CHECK(RawPublish({0x30, 0x03, 0x00, 0x00, 0x00}).topic().empty());
+}
+
+TEST_CASE("testing PUBLISH shared encoding") {
+  mqtt::Publish p;
+  p.topicName = "a/b";
+  p.payload = {'h', 'i'};
+
+  // without properties the shared encoding matches PublishEncoder
+  SharedPublish plain(p);
+  PublishHeader h = plain.header(0, false, 0, {}, {});
+  REQUIRE(plain.encode(h) == PublishEncoder({0, p}).encode());
+  REQUIRE(plain.size(h) == plain.encode(h).size());
+  p.qosLevel = 1;
+  h = plain.header(1, true, 0x1234, {}, {});
+  p.isDup = true;
+  REQUIRE(plain.encode(h) == PublishEncoder({0x1234, p}).encode());
+
+  p.hasRetain = true;
+  p.properties = std::make_shared<mqtt::Publish::Properties>();
+  p.properties->payloadFormatIndicator = true;
+  p.properties->messageExpiryInterval = 60;
+  p.properties->topicAlias = 3;
+  p.properties->responseTopic = "reply";
+  p.properties->correlationData = {1, 2};
+  p.properties->subscriptionIdentifiers = {7};
+  p.properties->contentType = "text/plain";
+  SharedPublish shared(p);
+
+  for (uint8_t qos : {uint8_t(0), uint8_t(1)}) {
+    h = shared.header(qos, false, 18, 30, 200);
+    std::vector<uint8_t> encoded = shared.encode(h);
+    REQUIRE(shared.size(h) == encoded.size());
+
+    Decoder dec(encoded);
+    FixedHeader fhdr = FixedHeaderReader::read(dec);
+    REQUIRE(fhdr.second + h.fixedLen == encoded.size());
+    const auto publishPkt =
+        PublishDecoder::decode(dec, fhdr.first, fhdr.second);
+    const mqtt::Publish& q = publishPkt.second;
+    CHECK(publishPkt.first == (qos > 0 ? 18 : 0));
+    CHECK(q.qosLevel == qos);
+    CHECK(!q.isDup);
+    CHECK(q.hasRetain);
+    CHECK(q.topicName == "a/b");
+    CHECK(q.payload == p.payload);
+    REQUIRE(q.properties);
+    CHECK(q.properties->payloadFormatIndicator == true);
+    // per recipient values replace the ones of the message
+    CHECK(q.properties->messageExpiryInterval == 30u);
+    CHECK(q.properties->subscriptionIdentifiers == std::vector<uint32_t>{200});
+    // the topic alias is not forwarded
+    CHECK(!q.properties->topicAlias);
+    CHECK(q.properties->responseTopic == "reply");
+    CHECK(q.properties->correlationData == std::vector<uint8_t>{1, 2});
+    CHECK(q.properties->contentType == "text/plain");
+  }
+
+  // the payload is copied once, into the shared part
+  p.payload.assign(4096, 'x');
+  mqttutils::AllocationCounter counter;
+  SharedPublish large(p);
+  CHECK(counter.allocations() == 2);
+  CHECK(counter.bytes() < 2 * p.payload.size());
+}
+
+TEST_CASE("testing PUBLISH codec - malformed packets") {
+  mqtt::Publish p;
+  p.topicName = "a/b";
+  p.qosLevel = 1;
+  p.properties = std::make_shared<mqtt::Publish::Properties>();
+  p.properties->messageExpiryInterval = 60;
+  p.properties->contentType = "text";
+  p.payload = {'x', 'y'};
+  std::vector<uint8_t> encoded = PublishEncoder({7, p}).encode();
+  FixedHeader fhdr;
+  size_t headerLen = 0;
+  REQUIRE(FixedHeaderReader::parse(encoded.data(), encoded.size(), fhdr,
+                                   headerLen) ==
+          FixedHeaderReader::Result::Complete);
+  const uint8_t* body = encoded.data() + headerLen;
+
+  PublishPacket pkt;
+  Decoder whole(body, fhdr.second);
+  REQUIRE(!PublishDecoder::decode(whole, fhdr.first, fhdr.second, pkt));
+  CHECK(pkt.first == 7);
+  CHECK(pkt.second.payload == p.payload);
+
+  // the body is cut short of the remaining length at every byte
+  for (uint32_t n = 0; n < fhdr.second; ++n) {
+    Decoder dec(body, n);
+    PublishPacket cut;
+    CHECK(PublishDecoder::decode(dec, fhdr.first, fhdr.second, cut) ==
+          mqtt::Error::MalformedPacket);
+    Decoder lazyDec(body, n);
+    LazyPublishPacket lazy{0, {}, {}};
+    CHECK(PublishDecoder::decodeLazy(lazyDec, fhdr.first, fhdr.second,
+                                     lazy) == mqtt::Error::MalformedPacket);
+  }
+
+  // the property length runs past the remaining length
+  std::vector<uint8_t> garbage(body, body + fhdr.second);
+  garbage[7] = 0x7F;
+  Decoder dec(garbage.data(), garbage.size());
+  CHECK(PublishDecoder::decode(dec, fhdr.first, uint32_t(garbage.size()),
+                               pkt) == mqtt::Error::MalformedPacket);
+
+  // a property twice, a property that PUBLISH does not have
+  const std::vector<uint8_t> twice = {0x00, 0x01, 'a', 0x04,
+                                      0x23, 0x00, 0x01, 0x23};
+  Decoder twiceDec(twice.data(), twice.size());
+  CHECK(PublishDecoder::decode(twiceDec, 0x30, uint32_t(twice.size()), pkt) ==
+        mqtt::Error::DuplicateProperty);
+  const std::vector<uint8_t> invalid = {0x00, 0x01, 'a', 0x02, 0x21, 0x00};
+  Decoder invalidDec(invalid.data(), invalid.size());
+  CHECK(PublishDecoder::decode(invalidDec, 0x30, uint32_t(invalid.size()),
+                               pkt) == mqtt::Error::InvalidPropertyID);
+  CHECK_THROWS(PublishDecoder::decode(invalid, 0x30));
+}
+
+TEST_CASE("testing PUBLISH codec - empty string properties") {
+  // an empty Content Type and Correlation Data, then the Message Expiry
+  // Interval, the encoder leaves empty values out
+  const std::vector<uint8_t> body = {0x00, 0x01, 'a',  0x0B, 0x03, 0x00,
+                                     0x00, 0x09, 0x00, 0x00, 0x02, 0x00,
+                                     0x00, 0x00, 0x3C, 'x',  'y'};
+  auto pkt = PublishDecoder::decode(body, 0x30);
+  REQUIRE(pkt.second.properties);
+  CHECK(pkt.second.properties->contentType.empty());
+  CHECK(pkt.second.properties->correlationData.empty());
+  CHECK(pkt.second.properties->messageExpiryInterval == 60u);
+  CHECK(pkt.second.payload == std::vector<uint8_t>{'x', 'y'});
+
+  Decoder dec(body.data(), body.size());
+  LazyPublishPacket lazy{0, {}, {}};
+  REQUIRE(!PublishDecoder::decodeLazy(dec, 0x30, uint32_t(body.size()), lazy));
+  CHECK(lazy.properties.get()->messageExpiryInterval == 60u);
+  CHECK(lazy.publish.payload == pkt.second.payload);
+
+  std::vector<uint8_t> encoded = PublishEncoder(pkt).encode();
+  CHECK(encoded.size() == 2 + body.size() - 6);
+  auto again = PublishDecoder::decode(
+      std::vector<uint8_t>(encoded.begin() + 2, encoded.end()), encoded[0]);
+  CHECK(again.second.properties->messageExpiryInterval == 60u);
+  CHECK(again.second.payload == pkt.second.payload);
+}
+
+TEST_CASE("testing PUBLISH encoder allocations") {
+  mqtt::Publish p;
+  p.topicName = "alloc/topic";
+  p.qosLevel = 1;
+  p.payload.assign(4096, 'x');
+  p.properties = std::make_shared<mqtt::Publish::Properties>();
+  p.properties->contentType = "text";
+  p.properties->correlationData = {1, 2, 3};
+  const PublishPacket pkt{3, p};
+  const std::vector<uint8_t> expected = PublishEncoder(pkt).encode();
+
+  // the encoder borrows the packet
+  mqttutils::AllocationCounter counter;
+  PublishEncoder encoder(pkt);
+  CHECK(counter.allocations() == 0);
+
+  // the packet is copied once, into the sink, which grows once
+  Sink sink;
+  counter.reset();
+  PublishEncoder::encode(pkt, sink);
+  CHECK(counter.allocations() == 1);
+  CHECK(counter.bytes() == expected.size());
+  CHECK(sink == expected);
+
+  // no allocation at all when the sink has room
+  sink.clear();
+  sink.reserve(2 * expected.size());
+  counter.reset();
+  PublishEncoder::encode(pkt, sink);
+  PublishEncoder::encode(pkt.first, pkt.second, sink);
+  CHECK(counter.allocations() == 0);
+  CHECK(sink.size() == 2 * expected.size());
+}
+
+TEST_CASE("testing the sink grows geometrically") {
+  mqtt::Publish p;
+  p.topicName = "a/b";
+  p.payload = {1, 2, 3};
+  const PublishPacket pkt{0, p};
+
+  // appending N packets reallocates about log2(N) times, not N times
+  Sink sink;
+  size_t reallocations = 0;
+  for (size_t i = 0; i < 10000; ++i) {
+    size_t capacity = sink.capacity();
+    PublishEncoder::encode(pkt, sink);
+    if (sink.capacity() != capacity) {
+      reallocations++;
+    }
+  }
+  CHECK(reallocations <= 16);
+  CHECK(sink.size() == 10000 * PublishEncoder(pkt).encode().size());
+}
@@ -1,13 +1,32 @@
 #include "publishresponse.h"
 #include "codec.h"
 #include "properties.h"
+#include "../probes.h"
 #include <cstdint>
 
 namespace packet {
-  PublishResponseEncoder::PublishResponseEncoder(PublishResponsePacket sp)
+  // the PUBACK, PUBREC, PUBREL and PUBCOMP properties in the order they are
+  // encoded
+  using PublishResponseProperties = PropertyTable<
+      mqtt::PublishResponse::Properties,
+      PropertyField<Property::ID::ReasonStringID,
+                    &mqtt::PublishResponse::Properties::reasonString>>;
+
+  PublishResponseEncoder::PublishResponseEncoder(const PublishResponsePacket& sp)
       : publishRespPkt(sp) {}
 
   std::vector<uint8_t> PublishResponseEncoder::encode() const {
+    Encoder enc;
+    this->write(enc);
+    return enc.takeBuffer();
+  }
+
+  void PublishResponseEncoder::encode(const PublishResponsePacket& sp, Sink& sink) {
+    Encoder enc(sink);
+    PublishResponseEncoder(sp).write(enc);
+  }
+
+  void PublishResponseEncoder::write(Encoder& enc) const {
     uint32_t propertySize = this->propertySize();
     const mqtt::PublishResponse& resp = this->publishRespPkt.response;
 
@@ -26,7 +45,7 @@ namespace packet {
       remainingLength += 1;
     }
 
-    Encoder enc(remainingLength + 1 + EncodedVarUint32::size(remainingLength));
+    enc.reserve(remainingLength + 1 + EncodedVarUint32::size(remainingLength));
     uint8_t byte0 = 0;
     ControlPacket::Type t = this->publishRespPkt.type;
     if (t == ControlPacket::Type::PUBREL) {
@@ -36,6 +55,7 @@ namespace packet {
     }
     enc.write(byte0);
     enc.writeVarUint32(remainingLength);
+    MQTT_PROBE2(packet__encode, static_cast<int>(t), remainingLength);
 
     enc.write(this->publishRespPkt.packetID);
     if (remainingLength > 2) {
@@ -45,21 +65,14 @@ namespace packet {
         this->encodeProperties(enc, propertySize);
       }
     }
-
-    return enc.getBuffer();
   }
 
   uint32_t PublishResponseEncoder::propertySize() const {
     if (!this->publishRespPkt.response.properties) {
       return 0;
     }
-
-    const mqtt::PublishResponse::Properties& props =
-        *this->publishRespPkt.response.properties;
-    uint32_t propertySize = 0;
-    propertySize += Property::size(props.reasonString);
-
-    return propertySize;
+    return PublishResponseProperties::size(
+        *this->publishRespPkt.response.properties);
   }
 
   void PublishResponseEncoder::encodeProperties(Encoder& enc,
@@ -67,9 +80,8 @@ namespace packet {
     enc.writeVarUint32(propertySize);
 
     if (this->publishRespPkt.response.properties) {
-      const mqtt::PublishResponse::Properties& props =
-          *this->publishRespPkt.response.properties;
-      Property::encode(enc, Property::ID::ReasonStringID, props.reasonString);
+      PublishResponseProperties::encode(
+          enc, *this->publishRespPkt.response.properties);
     }
   }
 
@@ -85,6 +97,14 @@ namespace packet {
                                                        ControlPacket::Type t,
                                                        uint32_t remainingLen) {
     PublishResponsePacket resp;
+    throwIfError(PublishResponseDecoder::decode(dec, t, remainingLen, resp));
+    return resp;
+  }
+
+  std::error_code PublishResponseDecoder::decode(Decoder& dec,
+                                                 ControlPacket::Type t,
+                                                 uint32_t remainingLen,
+                                                 PublishResponsePacket& resp) {
     resp.type = t;
     resp.packetID = dec.read<uint16_t>();
     if (remainingLen > 2) {
@@ -96,30 +116,19 @@ namespace packet {
       }
     }
 
-    return resp;
+    return dec.done(t);
   }
 
   std::shared_ptr<mqtt::PublishResponse::Properties>
   PublishResponseDecoder::decodeProperties(Decoder& dec) {
-    uint32_t propertySize = dec.read<uint32_t, true>();
+    uint32_t propertySize = dec.readLength();
 
     std::shared_ptr<mqtt::PublishResponse::Properties> props;
     if (propertySize > 0) {
-      props = std::make_shared<mqtt::PublishResponse::Properties>();
+      props = dec.makeProperties<mqtt::PublishResponse::Properties>();
+      PublishResponseProperties::decode(dec, propertySize, *props);
     }
 
-    while (propertySize > 0) {
-      uint32_t val = dec.read<uint32_t, true>();
-      propertySize -= EncodedVarUint32::size(val);
-      Property::ID id = static_cast<Property::ID>(val);
-      switch (id) {
-      case Property::ID::ReasonStringID:
-        propertySize -= Property::decode(dec, id, props->reasonString);
-        break;
-      default:
-        throwInvalidPropertyID(id, "SUBACK");
-      }
-    }
     return props;
   }
 } // namespace packet
@@ -1,6 +1,7 @@
 #include "packet.h"
 #include <mqtt/noncopyable.h>
 #include <mqtt/publishresponse.h>
+#include <system_error>
 
 namespace packet {
   class Encoder;
@@ -14,15 +15,18 @@ namespace packet {
 
   class PublishResponseEncoder : public mqtt::noncopyable {
   public:
-    explicit PublishResponseEncoder(PublishResponsePacket sp);
+    explicit PublishResponseEncoder(const PublishResponsePacket& sp);
     std::vector<uint8_t> encode() const;
+    // encode appends the packet to sink
+    static void encode(const PublishResponsePacket& sp, Sink& sink);
 
   private:
+    void write(Encoder& enc) const;
     uint32_t propertySize() const;
     void encodeProperties(Encoder& enc, uint32_t propertyLen) const;
 
   private:
-    PublishResponsePacket publishRespPkt;
+    const PublishResponsePacket& publishRespPkt;
   };
 
   class PublishResponseDecoder {
@@ -31,6 +35,10 @@ namespace packet {
                                         ControlPacket::Type t);
     static PublishResponsePacket decode(Decoder& dec, ControlPacket::Type t,
                                         uint32_t remainingLen);
+    // decode without exceptions, resp is complete when there is no error
+    static std::error_code decode(Decoder& dec, ControlPacket::Type t,
+                                  uint32_t remainingLen,
+                                  PublishResponsePacket& resp);
 
   private:
     static std::shared_ptr<mqtt::PublishResponse::Properties>
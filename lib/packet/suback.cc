@@ -2,12 +2,30 @@
 #include "codec.h"
 #include "packet.h"
 #include "properties.h"
+#include "../probes.h"
 #include <mqtt/suback.h>
 
 namespace packet {
-  SubAckEncoder::SubAckEncoder(SubAckPacket sp) : subackPkt(sp) {}
+  // the SUBACK properties in the order they are encoded
+  using SubAckProperties = PropertyTable<
+      mqtt::SubAck::Properties,
+      PropertyField<Property::ID::ReasonStringID,
+                    &mqtt::SubAck::Properties::reasonString>>;
+
+  SubAckEncoder::SubAckEncoder(const SubAckPacket& sp) : subackPkt(sp) {}
 
   std::vector<uint8_t> SubAckEncoder::encode() const {
+    Encoder enc;
+    this->write(enc);
+    return enc.takeBuffer();
+  }
+
+  void SubAckEncoder::encode(const SubAckPacket& sp, Sink& sink) {
+    Encoder enc(sink);
+    SubAckEncoder(sp).write(enc);
+  }
+
+  void SubAckEncoder::write(Encoder& enc) const {
     uint32_t propertySize = this->propertySize();
 
     // calculate the remaining length
@@ -16,31 +34,27 @@ namespace packet {
         2 + propertySize + EncodedVarUint32::size(propertySize) +
         uint32_t(this->subackPkt.second.reasonCodes.size());
 
-    Encoder enc(remainingLength + 1 + EncodedVarUint32::size(remainingLength));
+    enc.reserve(remainingLength + 1 + EncodedVarUint32::size(remainingLength));
 
     enc.write(static_cast<uint8_t>(
         static_cast<uint32_t>(ControlPacket::Type::SUBACK) << 4));
     enc.writeVarUint32(remainingLength);
+    MQTT_PROBE2(packet__encode,
+                static_cast<int>(ControlPacket::Type::SUBACK),
+                remainingLength);
 
     enc.write(this->subackPkt.first);
     this->encodeProperties(enc, propertySize);
     for (const auto rc : this->subackPkt.second.reasonCodes) {
       enc.write(static_cast<uint8_t>(rc));
     }
-
-    return enc.getBuffer();
   }
 
   uint32_t SubAckEncoder::propertySize() const {
     if (!this->subackPkt.second.properties) {
       return 0;
     }
-
-    const mqtt::SubAck::Properties& props = *this->subackPkt.second.properties;
-    uint32_t propertySize = 0;
-    propertySize += Property::size(props.reasonString);
-
-    return propertySize;
+    return SubAckProperties::size(*this->subackPkt.second.properties);
   }
 
   void SubAckEncoder::encodeProperties(Encoder& enc,
@@ -48,9 +62,7 @@ namespace packet {
     enc.writeVarUint32(propertySize);
 
     if (this->subackPkt.second.properties) {
-      const mqtt::SubAck::Properties& props =
-          *this->subackPkt.second.properties;
-      Property::encode(enc, Property::ID::ReasonStringID, props.reasonString);
+      SubAckProperties::encode(enc, *this->subackPkt.second.properties);
     }
   }
 
@@ -61,11 +73,18 @@ namespace packet {
   }
 
   SubAckPacket SubAckDecoder::decode(Decoder& dec, uint32_t remainingLen) {
-    uint16_t packetID = dec.read<uint16_t>();
-    mqtt::SubAck sa;
+    SubAckPacket pkt;
+    throwIfError(SubAckDecoder::decode(dec, remainingLen, pkt));
+    return pkt;
+  }
+
+  std::error_code SubAckDecoder::decode(Decoder& dec, uint32_t remainingLen,
+                                        SubAckPacket& pkt) {
+    pkt.first = dec.read<uint16_t>();
+    mqtt::SubAck& sa = pkt.second;
     auto result = SubAckDecoder::decodeProperties(dec);
     sa.properties = result.first;
-    remainingLen -= (2 + result.second);
+    dec.take(remainingLen, 2 + result.second);
 
     const std::vector<uint8_t> reasonCodes =
         dec.readBinaryDataNoLen(remainingLen);
@@ -74,32 +93,21 @@ namespace packet {
       sa.reasonCodes[i] = static_cast<mqtt::SubAck::ReasonCode>(reasonCodes[i]);
     }
 
-    return {packetID, sa};
+    return dec.done(ControlPacket::Type::SUBACK);
   }
 
   std::pair<std::shared_ptr<mqtt::SubAck::Properties>, uint32_t>
   SubAckDecoder::decodeProperties(Decoder& dec) {
-    uint32_t propertySize = dec.read<uint32_t, true>();
+    uint32_t propertySize = dec.readLength();
 
     uint32_t consumed = EncodedVarUint32::size(propertySize) + propertySize;
 
     std::shared_ptr<mqtt::SubAck::Properties> props;
     if (propertySize > 0) {
-      props = std::make_shared<mqtt::SubAck::Properties>();
+      props = dec.makeProperties<mqtt::SubAck::Properties>();
+      SubAckProperties::decode(dec, propertySize, *props);
     }
 
-    while (propertySize > 0) {
-      uint32_t val = dec.read<uint32_t, true>();
-      propertySize -= EncodedVarUint32::size(val);
-      Property::ID id = static_cast<Property::ID>(val);
-      switch (id) {
-      case Property::ID::ReasonStringID:
-        propertySize -= Property::decode(dec, id, props->reasonString);
-        break;
-      default:
-        throwInvalidPropertyID(id, "SUBACK");
-      }
-    }
     return {props, consumed};
   }
 
@@ -1,7 +1,9 @@
 #pragma once
 
+#include "packet.h"
 #include <mqtt/noncopyable.h>
 #include <mqtt/suback.h>
+#include <system_error>
 #include <vector>
 
 namespace packet {
@@ -12,21 +14,27 @@ namespace packet {
 
   class SubAckEncoder : public mqtt::noncopyable {
   public:
-    explicit SubAckEncoder(SubAckPacket sp);
+    explicit SubAckEncoder(const SubAckPacket& sp);
     std::vector<uint8_t> encode() const;
+    // encode appends the packet to sink
+    static void encode(const SubAckPacket& sp, Sink& sink);
 
   private:
+    void write(Encoder& enc) const;
     uint32_t propertySize() const;
     void encodeProperties(Encoder& enc, uint32_t propertyLen) const;
 
   private:
-    SubAckPacket subackPkt;
+    const SubAckPacket& subackPkt;
   };
 
   class SubAckDecoder {
   public:
     static SubAckPacket decode(std::vector<uint8_t> buffer);
     static SubAckPacket decode(Decoder& dec, uint32_t remainingLen);
+    // decode without exceptions, pkt is complete when there is no error
+    static std::error_code decode(Decoder& dec, uint32_t remainingLen,
+                                  SubAckPacket& pkt);
 
   private:
     static std::pair<std::shared_ptr<mqtt::SubAck::Properties>, uint32_t>
@@ -1,13 +1,31 @@
 #include "subscribe.h"
 #include "codec.h"
 #include "properties.h"
+#include "../probes.h"
 #include <mqtt/subscribe.h>
 
 namespace packet {
+  // the SUBSCRIBE properties in the order they are encoded
+  using SubscribeProperties = PropertyTable<
+      mqtt::Subscribe::Properties,
+      PropertyField<Property::ID::SubscriptionIdentifierID,
+                    &mqtt::Subscribe::Properties::subscriptionIdentifier,
+                    true>>;
 
-  SubscribeEncoder::SubscribeEncoder(SubscribePacket sp) : subscribePkt(sp) {}
+  SubscribeEncoder::SubscribeEncoder(const SubscribePacket& sp) : subscribePkt(sp) {}
 
   std::vector<uint8_t> SubscribeEncoder::encode() const {
+    Encoder enc;
+    this->write(enc);
+    return enc.takeBuffer();
+  }
+
+  void SubscribeEncoder::encode(const SubscribePacket& sp, Sink& sink) {
+    Encoder enc(sink);
+    SubscribeEncoder(sp).write(enc);
+  }
+
+  void SubscribeEncoder::write(Encoder& enc) const {
     const uint8_t fhdr = 0x82; // 10000010
     uint32_t propertySize = this->propertySize();
 
@@ -20,9 +38,12 @@ namespace packet {
       remainingLength += uint32_t(s.topicFilter.size() + 2 + 1);
     }
 
-    Encoder enc(remainingLength + 1 + EncodedVarUint32::size(remainingLength));
+    enc.reserve(remainingLength + 1 + EncodedVarUint32::size(remainingLength));
     enc.write(fhdr);
     enc.writeVarUint32(remainingLength);
+    MQTT_PROBE2(packet__encode,
+                static_cast<int>(ControlPacket::Type::SUBSCRIBE),
+                remainingLength);
 
     // write packet ID
     enc.write(this->subscribePkt.first);
@@ -44,22 +65,13 @@ namespace packet {
 
       enc.write(b);
     }
-
-    return enc.getBuffer();
   }
 
   uint32_t SubscribeEncoder::propertySize() const {
     if (!this->subscribePkt.second.properties) {
       return 0;
     }
-
-    const mqtt::Subscribe::Properties& props =
-        *this->subscribePkt.second.properties;
-    uint32_t propertySize = 0;
-    propertySize +=
-        Property::size<decltype(props.subscriptionIdentifier), true>(
-            props.subscriptionIdentifier);
-    return propertySize;
+    return SubscribeProperties::size(*this->subscribePkt.second.properties);
   }
 
   void SubscribeEncoder::encodeProperties(Encoder& enc,
@@ -67,11 +79,7 @@ namespace packet {
     enc.writeVarUint32(propertySize);
 
     if (this->subscribePkt.second.properties) {
-      const mqtt::Subscribe::Properties& props =
-          *this->subscribePkt.second.properties;
-      Property::encode<decltype(props.subscriptionIdentifier), true>(
-          enc, Property::ID::SubscriptionIdentifierID,
-          props.subscriptionIdentifier);
+      SubscribeProperties::encode(enc, *this->subscribePkt.second.properties);
     }
   }
 
@@ -83,52 +91,46 @@ namespace packet {
 
   SubscribePacket SubscribeDecoder::decode(Decoder& dec,
                                            uint32_t remainingLen) {
-    uint16_t packetID = dec.read<uint16_t>();
-    mqtt::Subscribe s;
+    SubscribePacket pkt;
+    throwIfError(SubscribeDecoder::decode(dec, remainingLen, pkt));
+    return pkt;
+  }
+
+  std::error_code SubscribeDecoder::decode(Decoder& dec, uint32_t remainingLen,
+                                           SubscribePacket& pkt) {
+    pkt.first = dec.read<uint16_t>();
+    mqtt::Subscribe& s = pkt.second;
     auto result = SubscribeDecoder::decodeProperties(dec);
     s.properties = result.first;
-    remainingLen -= (2 + result.second);
+    dec.take(remainingLen, 2 + result.second);
 
-    while (remainingLen > 0) {
+    while (remainingLen > 0 && dec.ok()) {
       mqtt::Subscription sub;
       sub.topicFilter = dec.read<std::string>();
       uint8_t b = dec.read<uint8_t>();
       sub.qosLevel = (b & 0x03);
-      sub.noLocal = ((b & 0x04) == 1);
-      sub.retainAsPublished = ((b & 0x08) == 1);
+      sub.noLocal = ((b & 0x04) != 0);
+      sub.retainAsPublished = ((b & 0x08) != 0);
       sub.retainHandling = (b & 0x30);
       s.subscriptions.emplace_back(sub);
-      remainingLen -= uint32_t(sub.topicFilter.size() + 2 + 1);
+      dec.take(remainingLen, sub.topicFilter.size() + 2 + 1);
     };
 
-    return {packetID, s};
+    return dec.done(ControlPacket::Type::SUBSCRIBE);
   }
 
   std::pair<std::shared_ptr<mqtt::Subscribe::Properties>, uint32_t>
   SubscribeDecoder::decodeProperties(Decoder& dec) {
-    uint32_t propertySize = dec.read<uint32_t, true>();
+    uint32_t propertySize = dec.readLength();
 
     uint32_t consumed = EncodedVarUint32::size(propertySize) + propertySize;
 
     std::shared_ptr<mqtt::Subscribe::Properties> props;
     if (propertySize > 0) {
-      props = std::make_shared<mqtt::Subscribe::Properties>();
+      props = dec.makeProperties<mqtt::Subscribe::Properties>();
+      SubscribeProperties::decode(dec, propertySize, *props);
     }
 
-    while (propertySize > 0) {
-      uint32_t val = dec.read<uint32_t, true>();
-      propertySize -= EncodedVarUint32::size(val);
-      Property::ID id = static_cast<Property::ID>(val);
-      switch (id) {
-      case Property::ID::SubscriptionIdentifierID:
-        propertySize -=
-            Property::decode<decltype(props->subscriptionIdentifier), true>(
-                dec, id, props->subscriptionIdentifier);
-        break;
-      default:
-        throwInvalidPropertyID(id, "SUBSCRIBE");
-      }
-    }
     return {props, consumed};
   }
 
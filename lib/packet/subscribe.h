@@ -1,7 +1,9 @@
 #pragma once
 
+#include "packet.h"
 #include <mqtt/noncopyable.h>
 #include <mqtt/subscribe.h>
+#include <system_error>
 #include <vector>
 
 namespace packet {
@@ -12,21 +14,27 @@ namespace packet {
 
   class SubscribeEncoder : public mqtt::noncopyable {
   public:
-    explicit SubscribeEncoder(SubscribePacket sp);
+    explicit SubscribeEncoder(const SubscribePacket& sp);
     std::vector<uint8_t> encode() const;
+    // encode appends the packet to sink
+    static void encode(const SubscribePacket& sp, Sink& sink);
 
   private:
+    void write(Encoder& enc) const;
     uint32_t propertySize() const;
     void encodeProperties(Encoder& enc, uint32_t propertyLen) const;
 
   private:
-    SubscribePacket subscribePkt;
+    const SubscribePacket& subscribePkt;
   };
 
   class SubscribeDecoder {
   public:
     static SubscribePacket decode(std::vector<uint8_t> buffer);
     static SubscribePacket decode(Decoder& dec, uint32_t remainingLen);
+    // decode without exceptions, pkt is complete when there is no error
+    static std::error_code decode(Decoder& dec, uint32_t remainingLen,
+                                  SubscribePacket& pkt);
 
   private:
     static std::pair<std::shared_ptr<mqtt::Subscribe::Properties>, uint32_t>
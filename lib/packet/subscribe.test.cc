@@ -95,3 +95,36 @@ TEST_CASE("testing SUBSCRIBE codec - enc/dec with invalid props") {
   CHECK_THROWS_AS(SubscribeDecoder::decode(dec, fhdr.second),
                   std::runtime_error);
 }
+
+TEST_CASE("testing SUBSCRIBE codec - malformed packets") {
+  mqtt::Subscribe s;
+  s.subscriptions.push_back(mqtt::Subscription{"a/+", 1, false, false, 0});
+  s.subscriptions.push_back(mqtt::Subscription{"b/#", 0, true, false, 0});
+  std::vector<uint8_t> encoded = SubscribeEncoder({9, s}).encode();
+  FixedHeader fhdr;
+  size_t headerLen = 0;
+  REQUIRE(FixedHeaderReader::parse(encoded.data(), encoded.size(), fhdr,
+                                   headerLen) ==
+          FixedHeaderReader::Result::Complete);
+  const uint8_t* body = encoded.data() + headerLen;
+
+  for (uint32_t n = 0; n < fhdr.second; ++n) {
+    Decoder dec(body, n);
+    SubscribePacket pkt;
+    CHECK(SubscribeDecoder::decode(dec, fhdr.second, pkt) ==
+          mqtt::Error::MalformedPacket);
+  }
+
+  // the last topic filter runs past the remaining length
+  Decoder dec(body, fhdr.second);
+  SubscribePacket pkt;
+  CHECK(SubscribeDecoder::decode(dec, fhdr.second - 1, pkt) ==
+        mqtt::Error::MalformedPacket);
+
+  // a malformed UTF-8 topic filter
+  std::vector<uint8_t> garbage(body, body + fhdr.second);
+  garbage[5] = 0xC0;
+  Decoder utf8Dec(garbage.data(), garbage.size());
+  CHECK(SubscribeDecoder::decode(utf8Dec, fhdr.second, pkt) ==
+        mqtt::Error::MalformedUTF8String);
+}
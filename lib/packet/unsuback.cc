@@ -2,11 +2,29 @@
 #include "codec.h"
 #include "packet.h"
 #include "properties.h"
+#include "../probes.h"
 
 namespace packet {
-  UnsubAckEncoder::UnsubAckEncoder(UnsubAckPacket sp) : unsubackPkt(sp) {}
+  // the UNSUBACK properties in the order they are encoded
+  using UnsubAckProperties = PropertyTable<
+      mqtt::UnsubAck::Properties,
+      PropertyField<Property::ID::ReasonStringID,
+                    &mqtt::UnsubAck::Properties::reasonString>>;
+
+  UnsubAckEncoder::UnsubAckEncoder(const UnsubAckPacket& sp) : unsubackPkt(sp) {}
 
   std::vector<uint8_t> UnsubAckEncoder::encode() const {
+    Encoder enc;
+    this->write(enc);
+    return enc.takeBuffer();
+  }
+
+  void UnsubAckEncoder::encode(const UnsubAckPacket& sp, Sink& sink) {
+    Encoder enc(sink);
+    UnsubAckEncoder(sp).write(enc);
+  }
+
+  void UnsubAckEncoder::write(Encoder& enc) const {
     uint32_t propertySize = this->propertySize();
 
     // calculate the remaining length
@@ -15,32 +33,27 @@ namespace packet {
         2 + propertySize + EncodedVarUint32::size(propertySize) +
         uint32_t(this->unsubackPkt.second.reasonCodes.size());
 
-    Encoder enc(remainingLength + 1 + EncodedVarUint32::size(remainingLength));
+    enc.reserve(remainingLength + 1 + EncodedVarUint32::size(remainingLength));
 
     enc.write(static_cast<uint8_t>(
         static_cast<uint32_t>(ControlPacket::Type::UNSUBACK) << 4));
     enc.writeVarUint32(remainingLength);
+    MQTT_PROBE2(packet__encode,
+                static_cast<int>(ControlPacket::Type::UNSUBACK),
+                remainingLength);
 
     enc.write(this->unsubackPkt.first);
     this->encodeProperties(enc, propertySize);
     for (const auto rc : this->unsubackPkt.second.reasonCodes) {
       enc.write(static_cast<uint8_t>(rc));
     }
-
-    return enc.getBuffer();
   }
 
   uint32_t UnsubAckEncoder::propertySize() const {
     if (!this->unsubackPkt.second.properties) {
       return 0;
     }
-
-    const mqtt::UnsubAck::Properties& props =
-        *this->unsubackPkt.second.properties;
-    uint32_t propertySize = 0;
-    propertySize += Property::size(props.reasonString);
-
-    return propertySize;
+    return UnsubAckProperties::size(*this->unsubackPkt.second.properties);
   }
 
   void UnsubAckEncoder::encodeProperties(Encoder& enc,
@@ -48,9 +61,7 @@ namespace packet {
     enc.writeVarUint32(propertySize);
 
     if (this->unsubackPkt.second.properties) {
-      const mqtt::UnsubAck::Properties& props =
-          *this->unsubackPkt.second.properties;
-      Property::encode(enc, Property::ID::ReasonStringID, props.reasonString);
+      UnsubAckProperties::encode(enc, *this->unsubackPkt.second.properties);
     }
   }
 
@@ -61,11 +72,18 @@ namespace packet {
   }
 
   UnsubAckPacket UnsubAckDecoder::decode(Decoder& dec, uint32_t remainingLen) {
-    uint16_t packetID = dec.read<uint16_t>();
-    mqtt::UnsubAck sa;
+    UnsubAckPacket pkt;
+    throwIfError(UnsubAckDecoder::decode(dec, remainingLen, pkt));
+    return pkt;
+  }
+
+  std::error_code UnsubAckDecoder::decode(Decoder& dec, uint32_t remainingLen,
+                                          UnsubAckPacket& pkt) {
+    pkt.first = dec.read<uint16_t>();
+    mqtt::UnsubAck& sa = pkt.second;
     auto result = UnsubAckDecoder::decodeProperties(dec);
     sa.properties = result.first;
-    remainingLen -= (2 + result.second);
+    dec.take(remainingLen, 2 + result.second);
 
     const std::vector<uint8_t> reasonCodes =
         dec.readBinaryDataNoLen(remainingLen);
@@ -75,32 +93,21 @@ namespace packet {
           static_cast<mqtt::UnsubAck::ReasonCode>(reasonCodes[i]);
     }
 
-    return {packetID, sa};
+    return dec.done(ControlPacket::Type::UNSUBACK);
   }
 
   std::pair<std::shared_ptr<mqtt::UnsubAck::Properties>, uint32_t>
   UnsubAckDecoder::decodeProperties(Decoder& dec) {
-    uint32_t propertySize = dec.read<uint32_t, true>();
+    uint32_t propertySize = dec.readLength();
 
     uint32_t consumed = EncodedVarUint32::size(propertySize) + propertySize;
 
     std::shared_ptr<mqtt::UnsubAck::Properties> props;
     if (propertySize > 0) {
-      props = std::make_shared<mqtt::UnsubAck::Properties>();
+      props = dec.makeProperties<mqtt::UnsubAck::Properties>();
+      UnsubAckProperties::decode(dec, propertySize, *props);
     }
 
-    while (propertySize > 0) {
-      uint32_t val = dec.read<uint32_t, true>();
-      propertySize -= EncodedVarUint32::size(val);
-      Property::ID id = static_cast<Property::ID>(val);
-      switch (id) {
-      case Property::ID::ReasonStringID:
-        propertySize -= Property::decode(dec, id, props->reasonString);
-        break;
-      default:
-        throwInvalidPropertyID(id, "UNSUBACK");
-      }
-    }
     return {props, consumed};
   }
 
@@ -1,7 +1,9 @@
 #pragma once
 
+#include "packet.h"
 #include <mqtt/noncopyable.h>
 #include <mqtt/unsuback.h>
+#include <system_error>
 #include <vector>
 
 namespace packet {
@@ -12,21 +14,27 @@ namespace packet {
 
   class UnsubAckEncoder : public mqtt::noncopyable {
   public:
-    explicit UnsubAckEncoder(UnsubAckPacket sp);
+    explicit UnsubAckEncoder(const UnsubAckPacket& sp);
     std::vector<uint8_t> encode() const;
+    // encode appends the packet to sink
+    static void encode(const UnsubAckPacket& sp, Sink& sink);
 
   private:
+    void write(Encoder& enc) const;
     uint32_t propertySize() const;
     void encodeProperties(Encoder& enc, uint32_t propertyLen) const;
 
   private:
-    UnsubAckPacket unsubackPkt;
+    const UnsubAckPacket& unsubackPkt;
   };
 
   class UnsubAckDecoder {
   public:
     static UnsubAckPacket decode(std::vector<uint8_t> buffer);
     static UnsubAckPacket decode(Decoder& dec, uint32_t remainingLen);
+    // decode without exceptions, pkt is complete when there is no error
+    static std::error_code decode(Decoder& dec, uint32_t remainingLen,
+                                  UnsubAckPacket& pkt);
 
   private:
     static std::pair<std::shared_ptr<mqtt::UnsubAck::Properties>, uint32_t>
@@ -1,12 +1,27 @@
 #include "unsubscribe.h"
 #include "codec.h"
 #include "properties.h"
+#include "../probes.h"
 
 namespace packet {
-  UnsubscribeEncoder::UnsubscribeEncoder(UnsubscribePacket sp)
+  // the UNSUBSCRIBE properties in the order they are encoded
+  using UnsubscribeProperties = PropertyTable<mqtt::Unsubscribe::Properties>;
+
+  UnsubscribeEncoder::UnsubscribeEncoder(const UnsubscribePacket& sp)
       : unsubscribePkt(sp) {}
 
   std::vector<uint8_t> UnsubscribeEncoder::encode() const {
+    Encoder enc;
+    this->write(enc);
+    return enc.takeBuffer();
+  }
+
+  void UnsubscribeEncoder::encode(const UnsubscribePacket& sp, Sink& sink) {
+    Encoder enc(sink);
+    UnsubscribeEncoder(sp).write(enc);
+  }
+
+  void UnsubscribeEncoder::write(Encoder& enc) const {
     const uint8_t fhdr = 0xA2;
     uint32_t propertySize = this->propertySize();
 
@@ -18,9 +33,12 @@ namespace packet {
     for (const auto& tf : this->unsubscribePkt.second.topicFilters) {
       remainingLength += uint32_t(tf.size() + 2);
     }
-    Encoder enc(remainingLength + 1 + EncodedVarUint32::size(remainingLength));
+    enc.reserve(remainingLength + 1 + EncodedVarUint32::size(remainingLength));
     enc.write(fhdr);
     enc.writeVarUint32(remainingLength);
+    MQTT_PROBE2(packet__encode,
+                static_cast<int>(ControlPacket::Type::UNSUBSCRIBE),
+                remainingLength);
 
     // write packet ID
     enc.write(this->unsubscribePkt.first);
@@ -29,18 +47,13 @@ namespace packet {
     for (const auto& tf : this->unsubscribePkt.second.topicFilters) {
       enc.write(tf);
     }
-
-    return enc.getBuffer();
   }
 
   uint32_t UnsubscribeEncoder::propertySize() const {
     if (!this->unsubscribePkt.second.properties) {
       return 0;
     }
-
-    uint32_t propertySize = 0;
-    // todo.. implement
-    return propertySize;
+    return UnsubscribeProperties::size(*this->unsubscribePkt.second.properties);
   }
 
   void UnsubscribeEncoder::encodeProperties(Encoder& enc,
@@ -48,7 +61,8 @@ namespace packet {
     enc.writeVarUint32(propertySize);
 
     if (this->unsubscribePkt.second.properties) {
-      // todo.. implement
+      UnsubscribeProperties::encode(enc,
+                                    *this->unsubscribePkt.second.properties);
     }
   }
 
@@ -60,40 +74,40 @@ namespace packet {
 
   UnsubscribePacket UnsubscribeDecoder::decode(Decoder& dec,
                                                uint32_t remainingLen) {
-    uint16_t packetID = dec.read<uint16_t>();
-    mqtt::Unsubscribe us;
+    UnsubscribePacket pkt;
+    throwIfError(UnsubscribeDecoder::decode(dec, remainingLen, pkt));
+    return pkt;
+  }
+
+  std::error_code UnsubscribeDecoder::decode(Decoder& dec,
+                                             uint32_t remainingLen,
+                                             UnsubscribePacket& pkt) {
+    pkt.first = dec.read<uint16_t>();
+    mqtt::Unsubscribe& us = pkt.second;
     auto result = UnsubscribeDecoder::decodeProperties(dec);
     us.properties = result.first;
-    remainingLen -= (2 + result.second);
-    while (remainingLen > 0) {
+    dec.take(remainingLen, 2 + result.second);
+    while (remainingLen > 0 && dec.ok()) {
       std::string tf = dec.read<std::string>();
-      remainingLen -= uint32_t(tf.size() + 2);
+      dec.take(remainingLen, tf.size() + 2);
       us.topicFilters.emplace_back(tf);
     }
 
-    return {packetID, us};
+    return dec.done(ControlPacket::Type::UNSUBSCRIBE);
   }
 
   std::pair<std::shared_ptr<mqtt::Unsubscribe::Properties>, uint32_t>
   UnsubscribeDecoder::decodeProperties(Decoder& dec) {
-    uint32_t propertySize = dec.read<uint32_t, true>();
+    uint32_t propertySize = dec.readLength();
 
     uint32_t consumed = EncodedVarUint32::size(propertySize) + propertySize;
 
     std::shared_ptr<mqtt::Unsubscribe::Properties> props;
     if (propertySize > 0) {
-      props = std::make_shared<mqtt::Unsubscribe::Properties>();
+      props = dec.makeProperties<mqtt::Unsubscribe::Properties>();
+      UnsubscribeProperties::decode(dec, propertySize, *props);
     }
 
-    while (propertySize > 0) {
-      uint32_t val = dec.read<uint32_t, true>();
-      propertySize -= EncodedVarUint32::size(val);
-      Property::ID id = static_cast<Property::ID>(val);
-      switch (id) {
-      default:
-        throwInvalidPropertyID(id, "UNSUBSCRIBE");
-      }
-    }
     return {props, consumed};
   }
 } // namespace packet
@@ -1,6 +1,8 @@
 #pragma once
+#include "packet.h"
 #include <mqtt/noncopyable.h>
 #include <mqtt/unsubscribe.h>
+#include <system_error>
 
 namespace packet {
   class Encoder;
@@ -10,21 +12,27 @@ namespace packet {
 
   class UnsubscribeEncoder : public mqtt::noncopyable {
   public:
-    explicit UnsubscribeEncoder(UnsubscribePacket sp);
+    explicit UnsubscribeEncoder(const UnsubscribePacket& sp);
     std::vector<uint8_t> encode() const;
+    // encode appends the packet to sink
+    static void encode(const UnsubscribePacket& sp, Sink& sink);
 
   private:
+    void write(Encoder& enc) const;
     uint32_t propertySize() const;
     void encodeProperties(Encoder& enc, uint32_t propertyLen) const;
 
   private:
-    UnsubscribePacket unsubscribePkt;
+    const UnsubscribePacket& unsubscribePkt;
   };
 
   class UnsubscribeDecoder {
   public:
     static UnsubscribePacket decode(std::vector<uint8_t> buffer);
     static UnsubscribePacket decode(Decoder& dec, uint32_t remainingLen);
+    // decode without exceptions, pkt is complete when there is no error
+    static std::error_code decode(Decoder& dec, uint32_t remainingLen,
+                                  UnsubscribePacket& pkt);
 
   private:
     static std::pair<std::shared_ptr<mqtt::Unsubscribe::Properties>, uint32_t>
@@ -0,0 +1,38 @@
+#pragma once
+
+// USDT probes of the mqttcpp provider, for perf and bpftrace:
+//
+//   bpftrace -e 'usdt:./mqtt_app:mqttcpp:topic__match { @[arg1] = count(); }'
+//
+// With sys/sdt.h (systemtap-sdt-dev) a probe is a nop in the code and a note
+// in the ELF file that the tracers find and patch when they attach. Without
+// it, or built with MQTT_NO_USDT, the probes are compiled out. Compiled in,
+// the arguments are evaluated on every call, keep them to values at hand.
+//
+//   packet__decode(type, bytes read, error)
+//   packet__encode(type, remaining length)
+//   stream__read(fd, bytes asked, bytes read, errno)
+//   stream__write(fd, bytes asked, bytes written, errno)
+//   topic__match(topic length, subscribers)
+//   queue__push(queue, depth after the push)
+//   queue__pop(queue, depth before the pop)
+
+#if !defined(MQTT_NO_USDT) && defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#include <sys/sdt.h>
+#define MQTT_USDT 1
+#endif
+#endif
+
+#ifdef MQTT_USDT
+#define MQTT_PROBE2(name, a, b) DTRACE_PROBE2(mqttcpp, name, a, b)
+#define MQTT_PROBE3(name, a, b, c) DTRACE_PROBE3(mqttcpp, name, a, b, c)
+#define MQTT_PROBE4(name, a, b, c, d) DTRACE_PROBE4(mqttcpp, name, a, b, c, d)
+#else
+// the arguments stay used, without being evaluated
+#define MQTT_PROBE2(name, a, b) ((void)sizeof(a), (void)sizeof(b))
+#define MQTT_PROBE3(name, a, b, c)                                             \
+  ((void)sizeof(a), (void)sizeof(b), (void)sizeof(c))
+#define MQTT_PROBE4(name, a, b, c, d)                                          \
+  ((void)sizeof(a), (void)sizeof(b), (void)sizeof(c), (void)sizeof(d))
+#endif
@@ -0,0 +1,171 @@
+#include "replay.h"
+#include "packet/codec.h"
+#include "packet/connack.h"
+#include "packet/connect.h"
+#include "packet/packet.h"
+#include "packet/ping.h"
+#include "packet/publish.h"
+#include "packet/publishresponse.h"
+#include "packet/suback.h"
+#include "packet/subscribe.h"
+#include "packet/unsuback.h"
+#include "packet/unsubscribe.h"
+#include <chrono>
+#include <thread>
+
+namespace mqttutils {
+  // the subscriber of the replayed subscriptions, the matches are counted
+  class ReplaySubscriber : public mqtt::Subscriber {
+  public:
+    void onData() override final {}
+  };
+
+  static uint64_t nanos() {
+    return static_cast<uint64_t>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch())
+            .count());
+  }
+
+  CaptureReplay::CaptureReplay(const Capture& captureA)
+      : capture(captureA), subscriber(std::make_shared<ReplaySubscriber>()) {}
+
+  CaptureReplay::Stats CaptureReplay::run(Pace pace) {
+    this->matcher = std::make_unique<TopicMatcher>();
+    Stats stats{};
+    std::array<Direction, 2> directions{};
+
+    uint64_t start = nanos();
+    for (const auto& frame : this->capture.frames) {
+      if (pace == Pace::Recorded) {
+        uint64_t now = nanos();
+        if (start + frame.time > now) {
+          std::this_thread::sleep_for(
+              std::chrono::nanoseconds(start + frame.time - now));
+        }
+      }
+      this->feed(directions[static_cast<size_t>(frame.direction)],
+                 frame.bytes, stats);
+    }
+    stats.nanos = nanos() - start;
+    this->matcher.reset();
+    return stats;
+  }
+
+  void CaptureReplay::feed(Direction& d, const std::vector<uint8_t>& bytes,
+                           Stats& stats) {
+    if (d.failed) {
+      return;
+    }
+    d.in.insert(d.in.end(), bytes.begin(), bytes.end());
+
+    for (;;) {
+      uint64_t start = nanos();
+      packet::FixedHeader fhdr;
+      size_t headerLen = 0;
+      auto result = packet::FixedHeaderReader::parse(
+          d.in.data() + d.offset, d.in.size() - d.offset, fhdr, headerLen);
+      if (result == packet::FixedHeaderReader::Result::Incomplete ||
+          (result == packet::FixedHeaderReader::Result::Complete &&
+           d.in.size() - d.offset - headerLen < fhdr.second)) {
+        break;
+      }
+      if (result == packet::FixedHeaderReader::Result::Malformed) {
+        stats.malformed++;
+        d.failed = true;
+        return;
+      }
+
+      const uint8_t* data = d.in.data() + d.offset + headerLen;
+      size_t size = headerLen + fhdr.second;
+      d.offset += size;
+      bool ok = this->dispatch(fhdr.first, data, fhdr.second, stats);
+      this->arena.reset();
+
+      TypeStats& t = stats.types[fhdr.first >> 4];
+      t.packets++;
+      t.bytes += size;
+      t.nanos += nanos() - start;
+      stats.packets++;
+      stats.bytes += size;
+      if (!ok) {
+        stats.malformed++;
+      }
+    }
+
+    // the bytes of the packets handled are dropped once they are half
+    if (d.offset > 0 && d.offset * 2 >= d.in.size()) {
+      d.in.erase(d.in.begin(),
+                 d.in.begin() + static_cast<std::ptrdiff_t>(d.offset));
+      d.offset = 0;
+    }
+  }
+
+  bool CaptureReplay::dispatch(uint8_t byte0, const uint8_t* data,
+                               uint32_t size, Stats& stats) {
+    using Type = packet::ControlPacket::Type;
+    auto type = static_cast<Type>(byte0 >> 4);
+    packet::Decoder dec(data, size, &this->arena);
+    switch (type) {
+    case Type::CONNECT: {
+      mqtt::Connect c;
+      return !packet::ConnectDecoder::decode(dec, c);
+    }
+    case Type::CONNACK: {
+      mqtt::ConnAck ca;
+      return !packet::ConnAckDecoder::decode(dec, ca);
+    }
+    case Type::PUBLISH: {
+      packet::PublishPacket pkt;
+      if (packet::PublishDecoder::decode(dec, byte0, size, pkt)) {
+        return false;
+      }
+      stats.matched += this->matcher->match(pkt.second.topicName).size();
+      return true;
+    }
+    case Type::PUBACK:
+    case Type::PUBREC:
+    case Type::PUBREL:
+    case Type::PUBCOMP: {
+      packet::PublishResponsePacket resp;
+      return !packet::PublishResponseDecoder::decode(dec, type, size, resp);
+    }
+    case Type::SUBSCRIBE: {
+      packet::SubscribePacket pkt;
+      if (packet::SubscribeDecoder::decode(dec, size, pkt)) {
+        return false;
+      }
+      for (const auto& s : pkt.second.subscriptions) {
+        this->matcher->subscribe(s.topicFilter, this->subscriber);
+      }
+      return true;
+    }
+    case Type::SUBACK: {
+      packet::SubAckPacket pkt;
+      return !packet::SubAckDecoder::decode(dec, size, pkt);
+    }
+    case Type::UNSUBSCRIBE: {
+      packet::UnsubscribePacket pkt;
+      if (packet::UnsubscribeDecoder::decode(dec, size, pkt)) {
+        return false;
+      }
+      for (const auto& filter : pkt.second.topicFilters) {
+        this->matcher->unsubscribe(filter, this->subscriber);
+      }
+      return true;
+    }
+    case Type::UNSUBACK: {
+      packet::UnsubAckPacket pkt;
+      return !packet::UnsubAckDecoder::decode(dec, size, pkt);
+    }
+    case Type::PINGREQ:
+    case Type::PINGRESP: {
+      Type t;
+      return !packet::PingDecoder::decode(byte0, size, t);
+    }
+    default:
+      // DISCONNECT and AUTH have no decoder, they are only framed
+      return true;
+    }
+  }
+} // namespace mqttutils
@@ -0,0 +1,71 @@
+#pragma once
+
+#include "arena.h"
+#include "capture.h"
+#include "mqtt/mqtt.h"
+#include "mqtt/noncopyable.h"
+#include "topic.h"
+#include <array>
+#include <cstdint>
+#include <memory>
+
+namespace mqttutils {
+  // CaptureReplay feeds the frames of a capture through the packet framing,
+  // the decoders and a TopicMatcher, the way the broker handles a
+  // connection: the SUBSCRIBE and UNSUBSCRIBE of the capture change the
+  // subscriptions, the PUBLISH are matched against them. The two directions
+  // are framed apart.
+  class CaptureReplay : private mqtt::noncopyable {
+  public:
+    enum class Pace {
+      // the frames are fed at the times they were captured
+      Recorded,
+      // as fast as possible
+      Fast,
+    };
+
+    struct TypeStats {
+      uint64_t packets;
+      uint64_t bytes;
+      // framing, decoding and matching, the clock reads included
+      uint64_t nanos;
+    };
+
+    struct Stats {
+      // by ControlPacket::Type
+      std::array<TypeStats, 16> types;
+      uint64_t packets;
+      uint64_t bytes;
+      // subscribers matched by the PUBLISH
+      uint64_t matched;
+      // packets the decoders rejected, and malformed fixed headers: one
+      // ends the replay of its direction
+      uint64_t malformed;
+      // wall time of the replay
+      uint64_t nanos;
+    };
+
+    explicit CaptureReplay(const Capture& capture);
+
+    // replays the capture, the subscriptions start empty every run
+    Stats run(Pace pace);
+
+  private:
+    struct Direction {
+      std::vector<uint8_t> in;
+      size_t offset;
+      bool failed;
+    };
+
+    void feed(Direction& d, const std::vector<uint8_t>& bytes, Stats& stats);
+    // returns false when the packet is rejected
+    bool dispatch(uint8_t byte0, const uint8_t* data, uint32_t size,
+                  Stats& stats);
+
+  private:
+    const Capture& capture;
+    std::unique_ptr<TopicMatcher> matcher;
+    std::shared_ptr<mqtt::Subscriber> subscriber;
+    Arena arena;
+  };
+} // namespace mqttutils
@@ -0,0 +1,408 @@
+#include "sessionstore.h"
+#include "mqtt/error.h"
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace mqttutils {
+  // the file starts with a 16 byte header: magic, version and reserved bytes.
+  // Every record has a 12 byte header followed by the packet:
+  //   checksum  uint32  CRC-32 of the rest of the record
+  //   length    uint32  size of the packet
+  //   type      uint8   RecordType
+  //   reserved  uint8
+  //   packetID  uint16
+  // Integers are in host byte order, the file is not meant to be moved
+  // between machines. A zero header marks the end of the log
+  static const char fileMagic[4] = {'M', 'Q', 'S', 'L'};
+  static constexpr uint32_t fileVersion = 1;
+  static constexpr size_t fileHeaderSize = 16;
+  static constexpr size_t recordHeaderSize = 12;
+
+  static constexpr std::array<uint32_t, 256> makeCrc32Table() {
+    std::array<uint32_t, 256> table{};
+    for (uint32_t i = 0; i < 256; ++i) {
+      uint32_t c = i;
+      for (int k = 0; k < 8; ++k) {
+        c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+      }
+      table[i] = c;
+    }
+    return table;
+  }
+
+  static constexpr std::array<uint32_t, 256> crc32Table = makeCrc32Table();
+
+  static uint32_t crc32(const uint8_t* data, size_t size) {
+    uint32_t crc = 0xFFFFFFFFu;
+    for (size_t i = 0; i < size; ++i) {
+      crc = crc32Table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    }
+    return crc ^ 0xFFFFFFFFu;
+  }
+
+  static std::error_code lastError() {
+    return std::error_code(errno, std::generic_category());
+  }
+
+  static uint32_t recordLength(const uint8_t* record) {
+    uint32_t length = 0;
+    std::memcpy(&length, record + 4, sizeof(length));
+    return length;
+  }
+
+  static uint16_t recordPacketID(const uint8_t* record) {
+    uint16_t packetID = 0;
+    std::memcpy(&packetID, record + 10, sizeof(packetID));
+    return packetID;
+  }
+
+  SessionStore::SessionStore(std::string pathA)
+      : SessionStore(std::move(pathA), Options()) {}
+
+  SessionStore::SessionStore(std::string pathA, Options optionsA)
+      : path(std::move(pathA)), options(optionsA), fd(-1), base(nullptr),
+        length(0), end(0), syncedEnd(0), liveBytes(0) {}
+
+  SessionStore::~SessionStore() {
+    this->close();
+  }
+
+  std::error_code SessionStore::open() {
+    if (this->fd != -1) {
+      return {};
+    }
+
+    int f = ::open(this->path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (f == -1) {
+      return lastError();
+    }
+
+    struct stat st;
+    if (fstat(f, &st) != 0) {
+      auto ec = lastError();
+      ::close(f);
+      return ec;
+    }
+
+    size_t size = static_cast<size_t>(st.st_size);
+    const bool created = (size == 0);
+    if (created) {
+      size = std::max(this->options.initialSize,
+                      fileHeaderSize + recordHeaderSize);
+      if (ftruncate(f, static_cast<off_t>(size)) != 0) {
+        auto ec = lastError();
+        ::close(f);
+        return ec;
+      }
+    } else if (size < fileHeaderSize) {
+      ::close(f);
+      return mqtt::Error::SessionStoreCorrupt;
+    }
+
+    this->fd = f;
+    auto ec = this->map(size);
+    if (ec) {
+      ::close(f);
+      this->fd = -1;
+      return ec;
+    }
+
+    if (created) {
+      std::memcpy(this->base, fileMagic, sizeof(fileMagic));
+      std::memcpy(this->base + 4, &fileVersion, sizeof(fileVersion));
+      this->end = fileHeaderSize;
+      this->syncedEnd = 0;
+      return this->sync();
+    }
+
+    uint32_t version = 0;
+    std::memcpy(&version, this->base + 4, sizeof(version));
+    if (std::memcmp(this->base, fileMagic, sizeof(fileMagic)) != 0 ||
+        version != fileVersion) {
+      this->close();
+      return mqtt::Error::SessionStoreCorrupt;
+    }
+    this->recover();
+    return {};
+  }
+
+  void SessionStore::close() {
+    if (this->fd == -1) {
+      return;
+    }
+    this->sync();
+    munmap(this->base, this->length);
+    ::close(this->fd);
+    this->fd = -1;
+    this->base = nullptr;
+    this->length = 0;
+    this->end = 0;
+    this->syncedEnd = 0;
+    this->liveBytes = 0;
+    this->index.clear();
+  }
+
+  std::error_code SessionStore::map(size_t size) {
+    void* m = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, this->fd,
+                   0);
+    if (m == MAP_FAILED) {
+      return lastError();
+    }
+    this->base = static_cast<uint8_t*>(m);
+    this->length = size;
+    return {};
+  }
+
+  void SessionStore::recover() {
+    this->index.clear();
+    this->liveBytes = 0;
+
+    size_t pos = fileHeaderSize;
+    while (pos + recordHeaderSize <= this->length) {
+      const uint8_t* record = this->base + pos;
+      uint32_t checksum = 0;
+      std::memcpy(&checksum, record, sizeof(checksum));
+      uint32_t size = recordLength(record);
+      auto type = static_cast<RecordType>(record[8]);
+      if (checksum == 0 && size == 0 && record[8] == 0) {
+        break;
+      }
+
+      bool valid = (type == RecordType::Put || type == RecordType::Remove) &&
+                   size <= this->length - pos - recordHeaderSize &&
+                   checksum == crc32(record + 4, recordHeaderSize - 4 + size);
+      if (!valid) {
+        // a record torn by a crash ends the log. The rest of the file is
+        // cleared, stale bytes must not be read as a record later
+        std::memset(this->base + pos, 0, this->length - pos);
+        break;
+      }
+
+      uint16_t packetID = recordPacketID(record);
+      auto it = this->index.find(packetID);
+      if (it != this->index.end()) {
+        this->liveBytes -= recordHeaderSize + recordLength(this->base + it->second);
+        this->index.erase(it);
+      }
+      if (type == RecordType::Put) {
+        this->index[packetID] = pos;
+        this->liveBytes += recordHeaderSize + size;
+      }
+      pos += recordHeaderSize + size;
+    }
+
+    this->end = pos;
+    this->syncedEnd = pos;
+  }
+
+  std::error_code SessionStore::put(uint16_t packetID, const uint8_t* data,
+                                    size_t size) {
+    return this->append(RecordType::Put, packetID, data, size);
+  }
+
+  std::error_code SessionStore::put(uint16_t packetID,
+                                    const std::vector<uint8_t>& data) {
+    return this->append(RecordType::Put, packetID, data.data(), data.size());
+  }
+
+  std::error_code SessionStore::remove(uint16_t packetID) {
+    if (this->index.find(packetID) == this->index.end()) {
+      return {};
+    }
+    return this->append(RecordType::Remove, packetID, nullptr, 0);
+  }
+
+  std::error_code SessionStore::append(RecordType type, uint16_t packetID,
+                                       const uint8_t* data, size_t size) {
+    if (this->fd == -1) {
+      return std::make_error_code(std::errc::bad_file_descriptor);
+    }
+    if (size > UINT32_MAX) {
+      return std::make_error_code(std::errc::message_size);
+    }
+
+    const size_t recordSize = recordHeaderSize + size;
+    auto ec = this->reserve(recordSize);
+    if (ec) {
+      return ec;
+    }
+
+    uint8_t* record = this->base + this->end;
+    uint32_t len = static_cast<uint32_t>(size);
+    std::memcpy(record + 4, &len, sizeof(len));
+    record[8] = static_cast<uint8_t>(type);
+    record[9] = 0;
+    std::memcpy(record + 10, &packetID, sizeof(packetID));
+    if (size > 0) {
+      std::memcpy(record + recordHeaderSize, data, size);
+    }
+    uint32_t checksum = crc32(record + 4, recordHeaderSize - 4 + size);
+    std::memcpy(record, &checksum, sizeof(checksum));
+
+    auto it = this->index.find(packetID);
+    if (it != this->index.end()) {
+      this->liveBytes -= recordHeaderSize + recordLength(this->base + it->second);
+      this->index.erase(it);
+    }
+    if (type == RecordType::Put) {
+      this->index[packetID] = this->end;
+      this->liveBytes += recordSize;
+    }
+    this->end += recordSize;
+
+    if (this->options.syncBytes > 0 &&
+        this->end - this->syncedEnd >= this->options.syncBytes) {
+      return this->sync();
+    }
+    return {};
+  }
+
+  // reserve makes room for size bytes at the end of the log, compacting the
+  // log when at most half of the file is live and growing it otherwise
+  std::error_code SessionStore::reserve(size_t size) {
+    if (this->end + size <= this->length) {
+      return {};
+    }
+    if (fileHeaderSize + this->liveBytes + size <= this->length / 2) {
+      return this->compact();
+    }
+
+    size_t newLength = this->length * 2;
+    while (this->end + size > newLength) {
+      newLength *= 2;
+    }
+    if (ftruncate(this->fd, static_cast<off_t>(newLength)) != 0) {
+      return lastError();
+    }
+    // the old mapping stays in use when the new one fails, the file only
+    // grew
+    uint8_t* oldBase = this->base;
+    size_t oldLength = this->length;
+    auto ec = this->map(newLength);
+    if (!ec) {
+      munmap(oldBase, oldLength);
+    }
+    return ec;
+  }
+
+  std::error_code SessionStore::sync() {
+    if (this->fd == -1 || this->end == this->syncedEnd) {
+      return {};
+    }
+    // msync wants a page aligned address
+    size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    size_t start = this->syncedEnd / page * page;
+    if (msync(this->base + start, this->end - start, MS_SYNC) != 0) {
+      return lastError();
+    }
+    this->syncedEnd = this->end;
+    return {};
+  }
+
+  // compact writes the live records to a new file which replaces the log.
+  // The old log stays valid until the rename, a crash in between loses
+  // nothing
+  std::error_code SessionStore::compact() {
+    if (this->fd == -1) {
+      return std::make_error_code(std::errc::bad_file_descriptor);
+    }
+
+    std::vector<size_t> offsets;
+    offsets.reserve(this->index.size());
+    for (const auto& entry : this->index) {
+      offsets.push_back(entry.second);
+    }
+    std::sort(offsets.begin(), offsets.end());
+
+    const std::string tmpPath = this->path + ".compact";
+    int f = ::open(tmpPath.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC,
+                   0644);
+    if (f == -1) {
+      return lastError();
+    }
+    void* m = MAP_FAILED;
+    if (ftruncate(f, static_cast<off_t>(this->length)) == 0) {
+      m = mmap(nullptr, this->length, PROT_READ | PROT_WRITE, MAP_SHARED, f, 0);
+    }
+    if (m == MAP_FAILED) {
+      auto ec = lastError();
+      ::close(f);
+      unlink(tmpPath.c_str());
+      return ec;
+    }
+
+    auto* newBase = static_cast<uint8_t*>(m);
+    std::memcpy(newBase, this->base, fileHeaderSize);
+    std::unordered_map<uint16_t, size_t> newIndex;
+    size_t pos = fileHeaderSize;
+    for (size_t offset : offsets) {
+      const uint8_t* record = this->base + offset;
+      size_t recordSize = recordHeaderSize + recordLength(record);
+      std::memcpy(newBase + pos, record, recordSize);
+      newIndex[recordPacketID(record)] = pos;
+      pos += recordSize;
+    }
+
+    if (msync(newBase, pos, MS_SYNC) != 0 ||
+        rename(tmpPath.c_str(), this->path.c_str()) != 0) {
+      auto ec = lastError();
+      munmap(newBase, this->length);
+      ::close(f);
+      unlink(tmpPath.c_str());
+      return ec;
+    }
+
+    // make the rename durable
+    auto slash = this->path.find_last_of('/');
+    std::string dir =
+        slash == std::string::npos ? "." : this->path.substr(0, slash + 1);
+    int dirFd = ::open(dir.c_str(), O_RDONLY | O_CLOEXEC);
+    if (dirFd != -1) {
+      fsync(dirFd);
+      ::close(dirFd);
+    }
+
+    munmap(this->base, this->length);
+    ::close(this->fd);
+    this->fd = f;
+    this->base = newBase;
+    this->end = pos;
+    this->syncedEnd = pos;
+    this->index.swap(newIndex);
+    return {};
+  }
+
+  std::vector<std::pair<uint16_t, std::vector<uint8_t>>>
+  SessionStore::pending() const {
+    std::vector<size_t> offsets;
+    offsets.reserve(this->index.size());
+    for (const auto& entry : this->index) {
+      offsets.push_back(entry.second);
+    }
+    std::sort(offsets.begin(), offsets.end());
+
+    std::vector<std::pair<uint16_t, std::vector<uint8_t>>> packets;
+    packets.reserve(offsets.size());
+    for (size_t offset : offsets) {
+      const uint8_t* record = this->base + offset;
+      const uint8_t* data = record + recordHeaderSize;
+      packets.emplace_back(recordPacketID(record),
+                           std::vector<uint8_t>(data, data + recordLength(record)));
+    }
+    return packets;
+  }
+
+  size_t SessionStore::size() const {
+    return this->index.size();
+  }
+
+  size_t SessionStore::capacity() const {
+    return this->length;
+  }
+} // namespace mqttutils
@@ -0,0 +1,84 @@
+#pragma once
+
+#include "mqtt/noncopyable.h"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <system_error>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace mqttutils {
+  // SessionStore persists the in-flight QoS 1 and QoS 2 state of a session
+  // (cleanStart=false with a Session Expiry Interval) across a restart.
+  //
+  // The store is an append-only log in a memory mapped file. put appends the
+  // packet exactly as it goes on the wire, the PUBLISH and later the PUBREL
+  // that replaces it for QoS 2. remove appends a tombstone once the flow is
+  // complete. An append is a copy into the mapping, sync makes everything
+  // appended so far durable with one msync, so many packets share the cost
+  // of a flush (group commit). open recovers the log: a record torn by a
+  // crash ends the log, and pending returns the packets that were not
+  // removed, in the order they were stored.
+  //
+  // When the file is full the live records are compacted into a new file,
+  // or the file doubles when most records are still live.
+  class SessionStore : private mqtt::noncopyable {
+  public:
+    struct Options {
+      // initial size of the log file
+      size_t initialSize{1 << 20};
+      // put and remove call sync once this many bytes are not synced, 0
+      // leaves syncing to the caller
+      size_t syncBytes{0};
+    };
+
+    explicit SessionStore(std::string path);
+    SessionStore(std::string path, Options options);
+    ~SessionStore();
+
+    // open maps the log file, creates it when it does not exist and
+    // recovers the pending packets
+    std::error_code open();
+    void close();
+
+    // put stores the encoded packet for packetID, replacing the packet
+    // stored before for the same packet identifier
+    std::error_code put(uint16_t packetID, const uint8_t* data, size_t size);
+    std::error_code put(uint16_t packetID, const std::vector<uint8_t>& data);
+    // remove drops the packet once it is acknowledged
+    std::error_code remove(uint16_t packetID);
+
+    std::error_code sync();
+    std::error_code compact();
+
+    // pending returns the stored packets in the order they were put
+    std::vector<std::pair<uint16_t, std::vector<uint8_t>>> pending() const;
+    size_t size() const;
+    size_t capacity() const;
+
+  private:
+    enum class RecordType : uint8_t { Put = 1, Remove = 2 };
+
+    std::error_code map(size_t size);
+    void recover();
+    std::error_code append(RecordType type, uint16_t packetID,
+                           const uint8_t* data, size_t size);
+    std::error_code reserve(size_t size);
+
+  private:
+    const std::string path;
+    const Options options;
+    int fd;
+    uint8_t* base;
+    size_t length;
+    // offset of the next record and of the first byte not synced
+    size_t end;
+    size_t syncedEnd;
+    // bytes of the records in index
+    size_t liveBytes;
+    // packet identifier -> offset of its record
+    std::unordered_map<uint16_t, size_t> index;
+  };
+} // namespace mqttutils
@@ -0,0 +1,125 @@
+#include "doctest/doctest.h"
+#include "mqtt/error.h"
+#include "sessionstore.h"
+#include "temppath.h"
+
+#include <fstream>
+#include <unistd.h>
+
+namespace test {
+  static std::vector<uint8_t> packet(uint8_t fill, size_t size) {
+    return std::vector<uint8_t>(size, fill);
+  }
+} // namespace test
+
+TEST_CASE("testing session store put remove and recovery") {
+  test::TempPath tmp("mqtt-session-basic");
+  {
+    mqttutils::SessionStore store(tmp.path);
+    REQUIRE(!store.open());
+    CHECK(store.size() == 0);
+    REQUIRE(!store.put(1, test::packet(0x31, 20)));
+    REQUIRE(!store.put(2, test::packet(0x32, 30)));
+    REQUIRE(!store.put(3, test::packet(0x33, 40)));
+    REQUIRE(!store.remove(2));
+    // PUBREL replaces the PUBLISH of a QoS 2 flow
+    REQUIRE(!store.put(1, test::packet(0x62, 4)));
+    REQUIRE(!store.remove(42));
+    CHECK(store.size() == 2);
+    REQUIRE(!store.sync());
+  }
+
+  mqttutils::SessionStore store(tmp.path);
+  REQUIRE(!store.open());
+  auto pending = store.pending();
+  REQUIRE(pending.size() == 2);
+  CHECK(pending[0].first == 3);
+  CHECK(pending[0].second == test::packet(0x33, 40));
+  CHECK(pending[1].first == 1);
+  CHECK(pending[1].second == test::packet(0x62, 4));
+
+  // the recovered log is appended to
+  REQUIRE(!store.put(4, test::packet(0x34, 8)));
+  store.close();
+  REQUIRE(!store.open());
+  CHECK(store.size() == 3);
+}
+
+TEST_CASE("testing session store discards a torn record") {
+  test::TempPath tmp("mqtt-session-torn");
+  {
+    mqttutils::SessionStore store(tmp.path);
+    REQUIRE(!store.open());
+    REQUIRE(!store.put(1, test::packet(0x31, 100)));
+    REQUIRE(!store.put(2, test::packet(0x32, 100)));
+  }
+
+  // corrupt the payload of the second record, as if the crash happened
+  // while it was written
+  {
+    std::fstream f(tmp.path, std::ios::in | std::ios::out | std::ios::binary);
+    f.seekp(16 + 112 + 12 + 50);
+    f.put(0x00);
+  }
+
+  mqttutils::SessionStore store(tmp.path);
+  REQUIRE(!store.open());
+  auto pending = store.pending();
+  REQUIRE(pending.size() == 1);
+  CHECK(pending[0].first == 1);
+
+  REQUIRE(!store.put(3, test::packet(0x33, 10)));
+  store.close();
+  REQUIRE(!store.open());
+  pending = store.pending();
+  REQUIRE(pending.size() == 2);
+  CHECK(pending[1].first == 3);
+}
+
+TEST_CASE("testing session store grows and compacts") {
+  test::TempPath tmp("mqtt-session-compact");
+  mqttutils::SessionStore::Options options;
+  options.initialSize = 4096;
+  options.syncBytes = 1024;
+  mqttutils::SessionStore store(tmp.path, options);
+  REQUIRE(!store.open());
+
+  // in flight messages beyond the initial size grow the file
+  for (uint16_t id = 1; id <= 100; ++id) {
+    REQUIRE(!store.put(id, test::packet(uint8_t(id), 100)));
+  }
+  CHECK(store.capacity() > 4096);
+
+  // acknowledged messages are compacted away, the file stops growing once
+  // the live records take at most half of it
+  size_t capacity = 0;
+  for (uint16_t id = 101; id <= 5000; ++id) {
+    REQUIRE(!store.put(id, test::packet(uint8_t(id), 100)));
+    REQUIRE(!store.remove(uint16_t(id - 100)));
+    if (id == 1000) {
+      capacity = store.capacity();
+    }
+  }
+  CHECK(store.capacity() == capacity);
+  CHECK(store.size() == 100);
+  store.close();
+
+  REQUIRE(!store.open());
+  auto pending = store.pending();
+  REQUIRE(pending.size() == 100);
+  for (size_t i = 0; i < pending.size(); ++i) {
+    CHECK(pending[i].first == 4901 + i);
+    CHECK(pending[i].second == test::packet(uint8_t(4901 + i), 100));
+  }
+}
+
+TEST_CASE("testing session store rejects other files") {
+  test::TempPath tmp("mqtt-session-invalid");
+  {
+    std::ofstream f(tmp.path, std::ios::binary);
+    f << "this is not a session log";
+  }
+  mqttutils::SessionStore store(tmp.path);
+  CHECK(store.open() == mqtt::Error::SessionStoreCorrupt);
+  CHECK(store.put(1, test::packet(0x31, 1)));
+}
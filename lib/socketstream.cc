@@ -0,0 +1,81 @@
+#include "socketstream.h"
+#include "metrics.h"
+#include "probes.h"
+#include <cerrno>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace mqttutils {
+  static int sendFlags() {
+#ifdef MSG_NOSIGNAL
+    return MSG_NOSIGNAL;
+#else
+    return 0;
+#endif
+  }
+
+  SocketStream::SocketStream(const char* transport, int fd)
+      : sockfd(fd), readCounter(MetricsRegistry::global().counter(
+                        "mqtt_stream_bytes_read_total",
+                        "Bytes read by the streams", {{"transport", transport}})),
+        writeCounter(MetricsRegistry::global().counter(
+            "mqtt_stream_bytes_written_total", "Bytes written by the streams",
+            {{"transport", transport}})) {}
+
+  SocketStream::~SocketStream() {
+    this->close();
+  }
+
+  void SocketStream::close() {
+    if (this->sockfd != -1) {
+      ::close(this->sockfd);
+      this->sockfd = -1;
+    }
+  }
+
+  std::pair<std::vector<uint8_t>, int> SocketStream::readBytes(size_t len) {
+    std::vector<uint8_t> buffer(len);
+    size_t totalBytesRead = 0;
+    while (totalBytesRead < len) {
+      ssize_t bytesRead = recv(this->sockfd, buffer.data() + totalBytesRead,
+                               len - totalBytesRead, 0);
+      if (bytesRead > 0) {
+        totalBytesRead += static_cast<size_t>(bytesRead);
+      } else if (bytesRead == 0 || errno != EINTR) {
+        int err = bytesRead == 0 ? ECONNRESET : errno;
+        this->readCounter.add(totalBytesRead);
+        MQTT_PROBE4(stream__read, this->sockfd, len, totalBytesRead, err);
+        buffer.resize(totalBytesRead);
+        return {std::move(buffer), err};
+      }
+    }
+    this->readCounter.add(totalBytesRead);
+    MQTT_PROBE4(stream__read, this->sockfd, len, totalBytesRead, 0);
+    return {std::move(buffer), 0};
+  }
+
+  std::pair<size_t, int>
+  SocketStream::writeBytes(const std::vector<uint8_t>& data) {
+    size_t size = data.size();
+    size_t totalBytesWritten = 0;
+    while (totalBytesWritten < size) {
+      ssize_t bytesWritten = send(this->sockfd, data.data() + totalBytesWritten,
+                                  size - totalBytesWritten, sendFlags());
+      if (bytesWritten >= 0) {
+        totalBytesWritten += static_cast<size_t>(bytesWritten);
+      } else if (errno != EINTR) {
+        int err = errno;
+        this->writeCounter.add(totalBytesWritten);
+        MQTT_PROBE4(stream__write, this->sockfd, size, totalBytesWritten, err);
+        return {totalBytesWritten, err};
+      }
+    }
+    this->writeCounter.add(totalBytesWritten);
+    MQTT_PROBE4(stream__write, this->sockfd, size, totalBytesWritten, 0);
+    return {totalBytesWritten, 0};
+  }
+
+  bool SocketStream::isValid() const {
+    return this->sockfd != -1;
+  }
+} // namespace mqttutils
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <mqtt/stream.h>
+
+namespace mqttutils {
+  class Counter;
+
+  // SocketStream is the I/O of the streams over a connected stream socket,
+  // TCPStream and UnixStream: the reads and writes loop until all the bytes
+  // are transferred, count them in the stream metrics of the transport and
+  // fire the stream probes. The subclasses open the socket.
+  class SocketStream : public mqtt::Stream {
+  public:
+    ~SocketStream() override;
+
+  protected:
+    // transport is the label of the stream metrics, e.g. "tcp". fd is a
+    // connected socket or -1
+    explicit SocketStream(const char* transport, int fd = -1);
+
+    void close() override final;
+    // reads until it has read len bytes, returns the bytes read and an
+    // error if fewer bytes are read: ECONNRESET when the peer closed
+    std::pair<std::vector<uint8_t>, int> readBytes(size_t len) override final;
+    // writes all of data, returns the bytes written and the errno of the
+    // failing send. A peer gone is EPIPE, not a SIGPIPE
+    std::pair<size_t, int>
+    writeBytes(const std::vector<uint8_t>& data) override final;
+    bool isValid() const override final;
+
+  protected:
+    int sockfd;
+
+  private:
+    Counter& readCounter;
+    Counter& writeCounter;
+  };
+} // namespace mqttutils
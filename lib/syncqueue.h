@@ -1,14 +1,18 @@
 #pragma once
 
+#include "metrics.h"
+#include "probes.h"
 #include <condition_variable>
 #include <mqtt/noncopyable.h>
 #include <mutex>
 #include <queue>
 
 namespace mqttutils {
+  // SyncQueue is a blocking FIFO between threads. The depth gauge, when
+  // given, follows the number of queued items
   template <typename T> class SyncQueue : public mqtt::noncopyable {
   public:
-    SyncQueue();
+    explicit SyncQueue(Gauge* depth = nullptr);
 
     void close();
 
@@ -25,9 +29,11 @@ namespace mqttutils {
     mutable std::mutex mux;
     std::condition_variable cond;
     bool closed;
+    Gauge* depth;
   };
 
-  template <typename T> SyncQueue<T>::SyncQueue() : closed(false) {}
+  template <typename T>
+  SyncQueue<T>::SyncQueue(Gauge* depthA) : closed(false), depth(depthA) {}
 
   template <typename T> void SyncQueue<T>::close() {
     {
@@ -46,7 +52,8 @@ namespace mqttutils {
 
   template <typename T> bool SyncQueue<T>::pop(T& item) {
     std::unique_lock<std::mutex> lock(this->mux);
-    if (!this->closed && this->queue.empty()) {
+    // wait can wake up spuriously
+    while (!this->closed && this->queue.empty()) {
       this->cond.wait(lock);
     }
 
@@ -54,10 +61,14 @@ namespace mqttutils {
       return true;
     }
 
+    MQTT_PROBE2(queue__pop, this, this->queue.size());
     // copy the item first
     item = std::move(this->queue.front());
     // now pop
     this->queue.pop();
+    if (this->depth) {
+      this->depth->add(-1);
+    }
     return false;
   }
 
@@ -70,6 +81,10 @@ namespace mqttutils {
       }
       wasEmpty = this->queue.empty();
       this->queue.push(item);
+      MQTT_PROBE2(queue__push, this, this->queue.size());
+      if (this->depth) {
+        this->depth->add(1);
+      }
     }
 
     // notify that we have an item available when the queue was empty
@@ -85,6 +100,10 @@ namespace mqttutils {
         return;
       }
       this->queue.push(item);
+      MQTT_PROBE2(queue__push, this, this->queue.size());
+      if (this->depth) {
+        this->depth->add(1);
+      }
     }
 
     // notify that we have an item available
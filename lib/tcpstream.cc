@@ -1,5 +1,6 @@
 #include "tcpstream.h"
 #include <arpa/inet.h>
+#include <cstring>
 #include <errno.h>
 #include <netdb.h>
 #include <sys/socket.h>
@@ -7,7 +8,7 @@
 
 namespace mqttutils {
   TCPStream::TCPStream(std::string hostNameA, int portA)
-      : sockfd(-1), hostName(hostNameA), port(portA) {}
+      : SocketStream("tcp"), hostName(hostNameA), port(portA) {}
 
   int TCPStream::open() {
     if (this->isValid()) {
@@ -27,64 +28,15 @@ namespace mqttutils {
 
     if (::connect(fd, reinterpret_cast<const sockaddr*>(&hostSockAddr),
                   sizeof(sockaddr)) != 0) {
-      return errno;
+      int err = errno;
+      ::close(fd);
+      return err;
     }
 
     this->sockfd = fd;
     return 0;
   }
 
-  void TCPStream::close() {
-    if (this->sockfd != 0) {
-      ::close(this->sockfd);
-      this->sockfd = -1;
-    }
-  }
-
-  // reads from socket untill it has read len bytes
-  // Returns the  bytes read and an error if fewer bytes
-  // are read
-  std::pair<std::vector<uint8_t>, int> TCPStream::readBytes(size_t len) {
-    std::vector<uint8_t> buffer(len);
-    size_t totalBytesRead = 0;
-    while (totalBytesRead < len) {
-      ssize_t bytesRead = recv(this->sockfd, buffer.data() + totalBytesRead,
-                               len - totalBytesRead, 0);
-      if (bytesRead > 0) {
-        totalBytesRead += static_cast<size_t>(bytesRead);
-      } else if (bytesRead == 0 || (bytesRead == -1 && errno != EINTR)) {
-        buffer.resize(totalBytesRead);
-        return {buffer, errno};
-      }
-    }
-    return {buffer, 0};
-  }
-
-  // Writes all data from buffer to socket. Returns the total number
-  // of bytes written and the error code. In there an error while writing
-  // then the errno and the total the total number of bytes written till
-  // that point will be returned
-  std::pair<size_t, int>
-  TCPStream::writeBytes(const std::vector<uint8_t>& buffer) {
-    size_t size = buffer.size();
-    size_t totalBytesWritten = 0;
-    while (totalBytesWritten < size) {
-      ssize_t bytesWritten =
-          send(this->sockfd, buffer.data() + totalBytesWritten,
-               size - totalBytesWritten, 0);
-      if (bytesWritten >= 0) {
-        totalBytesWritten += static_cast<size_t>(bytesWritten);
-      } else if (bytesWritten == -1 && errno != EINTR) {
-        return {totalBytesWritten, errno};
-      }
-    }
-    return {totalBytesWritten, 0};
-  }
-
-  bool TCPStream::isValid() const {
-    return this->sockfd != -1;
-  }
-
   int TCPStream::getAddrInfo(sockaddr_in* addrIn) {
     addrinfo hints = {};
     hints.ai_family = AF_INET;
@@ -98,7 +50,7 @@ namespace mqttutils {
       return result;
     }
     memcpy(addrIn, resultList->ai_addr, sizeof(sockaddr_in));
-    addrIn->sin_port = htons(this->port);
+    addrIn->sin_port = htons(static_cast<uint16_t>(this->port));
 
     freeaddrinfo(resultList);
 
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <cstdio>
+#include <filesystem>
+#include <string>
+#include <unistd.h>
+
+namespace test {
+  // TempPath is a file in the temporary directory for a test, the name gets
+  // the pid so that concurrent runs do not collide. A file left by an
+  // earlier run is removed, and the file is removed when the test is done
+  struct TempPath {
+    explicit TempPath(const std::string& name)
+        : path((std::filesystem::temp_directory_path() /
+                (name + "-" + std::to_string(::getpid())))
+                   .string()) {
+      std::remove(this->path.c_str());
+    }
+    ~TempPath() {
+      std::remove(this->path.c_str());
+    }
+    const std::string path;
+  };
+} // namespace test
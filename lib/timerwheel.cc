@@ -0,0 +1,246 @@
+#include "timerwheel.h"
+#include <utility>
+
+namespace mqttutils {
+  TimerWheel::TimerWheel(uint64_t now) : current(now), count(0) {
+    this->heads.fill(npos);
+    this->tails.fill(npos);
+    this->occupied.fill(0);
+  }
+
+  TimerWheel::TimerID TimerWheel::schedule(uint64_t deadline,
+                                           Callback callback) {
+    if (deadline <= this->current) {
+      deadline = this->current + 1;
+    }
+
+    uint32_t index = this->allocNode();
+    Node& node = this->nodes[index];
+    node.deadline = deadline;
+    node.callback = std::move(callback);
+    this->place(index);
+    ++this->count;
+
+    return (static_cast<uint64_t>(node.generation) << 32) | (index + 1);
+  }
+
+  TimerWheel::TimerID TimerWheel::scheduleAfter(uint64_t delay,
+                                                Callback callback) {
+    return this->schedule(this->current + delay, std::move(callback));
+  }
+
+  bool TimerWheel::cancel(TimerID id) {
+    uint64_t slot = id & UINT32_MAX;
+    if (slot == 0 || slot > this->nodes.size()) {
+      return false;
+    }
+
+    uint32_t index = static_cast<uint32_t>(slot - 1);
+    const Node& node = this->nodes[index];
+    if (node.list == npos || node.generation != (id >> 32)) {
+      // already fired or cancelled
+      return false;
+    }
+
+    this->unlink(index);
+    this->freeNode(index);
+    --this->count;
+    return true;
+  }
+
+  size_t TimerWheel::advance(uint64_t now) {
+    size_t fired = 0;
+    while (this->current < now) {
+      if (this->count == 0) {
+        this->current = now;
+        break;
+      }
+
+      // jump to the next tick that fires timers or cascades a level, the
+      // ticks in between have nothing to do
+      uint64_t next = this->nextTick();
+      if (next > now) {
+        this->current = now;
+        break;
+      }
+
+      this->current = next;
+      if ((this->current & slotMask) == 0) {
+        this->cascade(1);
+      }
+      fired += this->expire(static_cast<uint32_t>(this->current & slotMask));
+    }
+    return fired;
+  }
+
+  std::optional<uint64_t> TimerWheel::ticksUntilNext() const {
+    if (this->count == 0) {
+      return std::nullopt;
+    }
+    return this->nextTick() - this->current;
+  }
+
+  // nextTick returns the first tick after the current time at which a slot
+  // that is not empty is reached, on the lowest level the timers of the slot
+  // fire, on the upper levels the slot cascades
+  uint64_t TimerWheel::nextTick() const {
+    uint64_t next = UINT64_MAX;
+    if (this->heads[overflowList] != npos) {
+      // the overflow list is looked at when the top level wraps around
+      const uint32_t topShift = bitsPerLevel * levels;
+      next = ((this->current >> topShift) + 1) << topShift;
+    }
+
+    for (uint32_t level = 0; level < levels; ++level) {
+      uint64_t bits = this->occupied[level];
+      if (bits == 0) {
+        continue;
+      }
+      const uint32_t shift = bitsPerLevel * level;
+      uint64_t index = (this->current >> shift) & slotMask;
+      uint64_t after =
+          (index == slotMask) ? 0 : bits & (~uint64_t(0) << (index + 1));
+      // slots at or before the current index are reached on the next
+      // rotation
+      uint64_t slot = after ? uint64_t(__builtin_ctzll(after))
+                            : uint64_t(__builtin_ctzll(bits)) + slotsPerLevel;
+      uint64_t tick = ((this->current >> shift) - index + slot) << shift;
+      if (tick < next) {
+        next = tick;
+      }
+    }
+    return next;
+  }
+
+  uint64_t TimerWheel::now() const {
+    return this->current;
+  }
+
+  size_t TimerWheel::size() const {
+    return this->count;
+  }
+
+  uint32_t TimerWheel::allocNode() {
+    if (!this->freeNodes.empty()) {
+      uint32_t index = this->freeNodes.back();
+      this->freeNodes.pop_back();
+      return index;
+    }
+
+    this->nodes.push_back(Node{0, nullptr, npos, npos, npos, 1});
+    return static_cast<uint32_t>(this->nodes.size() - 1);
+  }
+
+  void TimerWheel::freeNode(uint32_t index) {
+    Node& node = this->nodes[index];
+    node.callback = nullptr;
+    node.list = npos;
+    ++node.generation;
+    this->freeNodes.push_back(index);
+  }
+
+  // place links the node in the slot matching its deadline, the deadline must
+  // not be before the current time
+  void TimerWheel::place(uint32_t index) {
+    const uint64_t deadline = this->nodes[index].deadline;
+    const uint64_t delta = deadline - this->current;
+    for (uint32_t level = 0; level < levels; ++level) {
+      const uint32_t shift = bitsPerLevel * level;
+      if (delta < (uint64_t(1) << (shift + bitsPerLevel))) {
+        uint32_t slot = static_cast<uint32_t>((deadline >> shift) & slotMask);
+        this->link(level * slotsPerLevel + slot, index);
+        return;
+      }
+    }
+    this->link(overflowList, index);
+  }
+
+  // link appends the node to the list, timers with the same deadline fire in
+  // the order they were scheduled
+  void TimerWheel::link(uint32_t list, uint32_t index) {
+    Node& node = this->nodes[index];
+    node.list = list;
+    node.next = npos;
+    node.prev = this->tails[list];
+    if (node.prev != npos) {
+      this->nodes[node.prev].next = index;
+    } else {
+      this->heads[list] = index;
+    }
+    this->tails[list] = index;
+    if (list < overflowList) {
+      this->occupied[list / slotsPerLevel] |= uint64_t(1)
+                                              << (list % slotsPerLevel);
+    }
+  }
+
+  void TimerWheel::unlink(uint32_t index) {
+    Node& node = this->nodes[index];
+    if (node.prev != npos) {
+      this->nodes[node.prev].next = node.next;
+    } else {
+      this->heads[node.list] = node.next;
+    }
+    if (node.next != npos) {
+      this->nodes[node.next].prev = node.prev;
+    } else {
+      this->tails[node.list] = node.prev;
+    }
+
+    if (node.list < overflowList && this->heads[node.list] == npos) {
+      this->occupied[node.list / slotsPerLevel] &=
+          ~(uint64_t(1) << (node.list % slotsPerLevel));
+    }
+    node.prev = npos;
+    node.next = npos;
+  }
+
+  // cascade moves the timers of the current slot of the level one level
+  // down, the level above cascades first when this level wraps around
+  void TimerWheel::cascade(uint32_t level) {
+    if (level == levels) {
+      // the overflow list may link the nodes back in the overflow list,
+      // detach them first
+      std::vector<uint32_t> overflow;
+      while (this->heads[overflowList] != npos) {
+        uint32_t index = this->heads[overflowList];
+        this->unlink(index);
+        overflow.push_back(index);
+      }
+      for (uint32_t index : overflow) {
+        this->place(index);
+      }
+      return;
+    }
+
+    const uint32_t slot = static_cast<uint32_t>(
+        (this->current >> (bitsPerLevel * level)) & slotMask);
+    if (slot == 0) {
+      this->cascade(level + 1);
+    }
+
+    const uint32_t list = level * slotsPerLevel + slot;
+    while (this->heads[list] != npos) {
+      uint32_t index = this->heads[list];
+      this->unlink(index);
+      this->place(index);
+    }
+  }
+
+  size_t TimerWheel::expire(uint32_t slot) {
+    size_t fired = 0;
+    // the callbacks may schedule or cancel timers, take the nodes one by one
+    while (this->heads[slot] != npos) {
+      uint32_t index = this->heads[slot];
+      this->unlink(index);
+      Callback callback = std::move(this->nodes[index].callback);
+      this->freeNode(index);
+      --this->count;
+      ++fired;
+      if (callback) {
+        callback();
+      }
+    }
+    return fired;
+  }
+} // namespace mqttutils
@@ -0,0 +1,94 @@
+#pragma once
+
+#include "mqtt/noncopyable.h"
+#include <array>
+#include <cstdint>
+#include <functional>
+#include <optional>
+#include <vector>
+
+namespace mqttutils {
+  // TimerWheel is a hierarchical timing wheel. Time is measured in ticks, the
+  // unit of a tick is chosen by the owner (the broker uses milliseconds).
+  // Insert and cancel are O(1), advance does work proportional to the number
+  // of timers that fire or cascade and skips over empty slots.
+  //
+  // The wheel is not thread safe, it is meant to be driven from the event
+  // loop that owns it: compute the poll timeout with ticksUntilNext(), then
+  // call advance() with the current time.
+  //
+  // The broker workers keep the session deadlines on it: the CONNECT
+  // timeout and keep alive, message expiry reads its clock. There is no
+  // will delay timer, the CONNECT codec has no will message to publish
+  // when it runs out.
+  class TimerWheel : private mqtt::noncopyable {
+  public:
+    using TimerID = uint64_t;
+    using Callback = std::function<void()>;
+
+    static constexpr TimerID invalidTimerID = 0;
+
+    explicit TimerWheel(uint64_t now = 0);
+
+    // schedule the callback to run when the time reaches deadline, deadlines
+    // in the past fire on the next tick
+    TimerID schedule(uint64_t deadline, Callback callback);
+    TimerID scheduleAfter(uint64_t delay, Callback callback);
+
+    // returns false if the timer has already fired or was cancelled
+    bool cancel(TimerID id);
+
+    // moves the time forward and runs the callbacks of the expired timers.
+    // Returns the number of timers that fired
+    size_t advance(uint64_t now);
+
+    // number of ticks after which advance() can have work to do, nullopt when
+    // there are no timers. Deadlines far in the future are reported as the
+    // time of the next cascade, not the exact deadline. Timers with the same
+    // deadline fire in the order they were scheduled
+    std::optional<uint64_t> ticksUntilNext() const;
+
+    uint64_t now() const;
+    size_t size() const;
+
+  private:
+    static constexpr uint32_t bitsPerLevel = 6;
+    static constexpr uint32_t slotsPerLevel = 1 << bitsPerLevel;
+    static constexpr uint32_t slotMask = slotsPerLevel - 1;
+    static constexpr uint32_t levels = 5;
+    static constexpr uint32_t npos = UINT32_MAX;
+
+    struct Node {
+      uint64_t deadline;
+      Callback callback;
+      uint32_t prev;
+      uint32_t next;
+      // list the node is linked in, npos when the node is free
+      uint32_t list;
+      uint32_t generation;
+    };
+
+    // lists are the wheel slots, level by level, followed by the overflow
+    // list for deadlines beyond the range of the top level
+    static constexpr uint32_t overflowList = levels * slotsPerLevel;
+
+    uint32_t allocNode();
+    void freeNode(uint32_t index);
+    void place(uint32_t index);
+    void link(uint32_t list, uint32_t index);
+    void unlink(uint32_t index);
+    void cascade(uint32_t level);
+    size_t expire(uint32_t slot);
+    uint64_t nextTick() const;
+
+  private:
+    std::vector<Node> nodes;
+    std::vector<uint32_t> freeNodes;
+    std::array<uint32_t, levels * slotsPerLevel + 1> heads;
+    std::array<uint32_t, levels * slotsPerLevel + 1> tails;
+    // bit n is set when slot n of the level is not empty
+    std::array<uint64_t, levels> occupied;
+    uint64_t current;
+    size_t count;
+  };
+} // namespace mqttutils
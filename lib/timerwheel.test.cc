@@ -0,0 +1,159 @@
+#include "doctest/doctest.h"
+#include "timerwheel.h"
+
+#include <map>
+#include <random>
+#include <vector>
+
+TEST_CASE("testing timer wheel fires timers at the deadline") {
+  mqttutils::TimerWheel wheel;
+  std::vector<int> fired;
+  wheel.schedule(10, [&fired] { fired.push_back(10); });
+  wheel.schedule(5, [&fired] { fired.push_back(5); });
+  wheel.schedule(100, [&fired] { fired.push_back(100); });
+  CHECK(wheel.size() == 3);
+
+  CHECK(wheel.advance(4) == 0);
+  CHECK(wheel.advance(5) == 1);
+  CHECK(wheel.advance(99) == 1);
+  CHECK(fired == std::vector<int>{5, 10});
+  CHECK(wheel.advance(100) == 1);
+  CHECK(fired == std::vector<int>{5, 10, 100});
+  CHECK(wheel.size() == 0);
+  CHECK(wheel.now() == 100);
+}
+
+TEST_CASE("testing timer wheel cancel") {
+  mqttutils::TimerWheel wheel;
+  int fired = 0;
+  auto id = wheel.schedule(10, [&fired] { ++fired; });
+  wheel.schedule(10, [&fired] { ++fired; });
+  CHECK(wheel.cancel(id));
+  CHECK_FALSE(wheel.cancel(id));
+  CHECK_FALSE(wheel.cancel(mqttutils::TimerWheel::invalidTimerID));
+  wheel.advance(10);
+  CHECK(fired == 1);
+
+  // the ID of a fired timer is not valid anymore, even if its node is reused
+  auto fid = wheel.schedule(20, [] {});
+  wheel.advance(20);
+  wheel.schedule(30, [] {});
+  CHECK_FALSE(wheel.cancel(fid));
+  CHECK(wheel.size() == 1);
+}
+
+TEST_CASE("testing timer wheel deadlines in the past fire on the next tick") {
+  mqttutils::TimerWheel wheel(1000);
+  int fired = 0;
+  wheel.schedule(10, [&fired] { ++fired; });
+  CHECK(wheel.advance(1000) == 0);
+  CHECK(wheel.advance(1001) == 1);
+  CHECK(fired == 1);
+}
+
+TEST_CASE("testing timer wheel callbacks schedule and cancel timers") {
+  mqttutils::TimerWheel wheel;
+  std::vector<uint64_t> fired;
+  mqttutils::TimerWheel::TimerID other = 0;
+  wheel.schedule(10, [&] {
+    fired.push_back(wheel.now());
+    CHECK(wheel.cancel(other));
+    wheel.scheduleAfter(5, [&] { fired.push_back(wheel.now()); });
+  });
+  other = wheel.schedule(10, [&] { fired.push_back(0); });
+  wheel.advance(100);
+  CHECK(fired == std::vector<uint64_t>{10, 15});
+}
+
+TEST_CASE("testing timer wheel long deadlines") {
+  mqttutils::TimerWheel wheel;
+  std::vector<uint64_t> deadlines = {63,
+                                     64,
+                                     4095,
+                                     4096,
+                                     262143,
+                                     262144,
+                                     uint64_t(1) << 30,
+                                     (uint64_t(1) << 30) + 5,
+                                     uint64_t(1) << 33};
+  std::vector<uint64_t> fired;
+  for (auto deadline : deadlines) {
+    wheel.schedule(deadline, [&] { fired.push_back(wheel.now()); });
+  }
+
+  // advance in uneven steps
+  uint64_t now = 0;
+  while (wheel.size() > 0) {
+    auto next = wheel.ticksUntilNext();
+    REQUIRE(next);
+    now += *next;
+    wheel.advance(now);
+  }
+  CHECK(fired == deadlines);
+}
+
+TEST_CASE("testing timer wheel against a reference") {
+  std::mt19937_64 rng(42);
+  mqttutils::TimerWheel wheel;
+  std::multimap<uint64_t, mqttutils::TimerWheel::TimerID> expected;
+  std::vector<std::pair<uint64_t, uint64_t>> fired;
+
+  uint64_t now = 0;
+  for (int round = 0; round < 200; ++round) {
+    for (int i = 0; i < 20; ++i) {
+      // mix of short and long timeouts
+      uint64_t delay = (rng() % 4 == 0) ? rng() % 1000000 : rng() % 200;
+      uint64_t deadline = now + delay + 1;
+      auto id = wheel.schedule(
+          deadline, [&fired, &wheel, deadline] {
+            fired.emplace_back(deadline, wheel.now());
+          });
+      expected.emplace(deadline, id);
+    }
+
+    // cancel a few
+    for (auto it = expected.begin(); it != expected.end();) {
+      if (rng() % 10 == 0) {
+        CHECK(wheel.cancel(it->second));
+        it = expected.erase(it);
+      } else {
+        ++it;
+      }
+    }
+
+    now += rng() % 5000;
+    fired.clear();
+    wheel.advance(now);
+    size_t due = 0;
+    for (auto it = expected.begin(); it != expected.end() && it->first <= now;
+         it = expected.erase(it)) {
+      ++due;
+    }
+    CHECK(fired.size() == due);
+    for (const auto& f : fired) {
+      // fires exactly at its deadline
+      CHECK(f.first == f.second);
+    }
+    CHECK(wheel.size() == expected.size());
+  }
+}
+
+TEST_CASE("testing timer wheel session deadlines") {
+  // a will message is published when the will delay elapses, unless the
+  // client reconnects before
+  mqttutils::TimerWheel wheel;
+  bool willPublished = false;
+  auto willTimer =
+      wheel.scheduleAfter(5000, [&willPublished] { willPublished = true; });
+  wheel.advance(3000);
+  // client reconnected
+  CHECK(wheel.cancel(willTimer));
+  wheel.advance(10000);
+  CHECK_FALSE(willPublished);
+
+  willTimer =
+      wheel.scheduleAfter(5000, [&willPublished] { willPublished = true; });
+  wheel.advance(15000);
+  CHECK(willPublished);
+  CHECK_FALSE(wheel.ticksUntilNext());
+}
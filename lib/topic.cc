@@ -1,5 +1,8 @@
 #include "topic.h"
+#include "metrics.h"
 #include "mqtt/error.h"
+#include "probes.h"
+#include "utf8.h"
 #include <regex>
 
 namespace mqttutils {
@@ -8,9 +11,11 @@ namespace mqttutils {
       return mqtt::Error::TopicLenTooLong;
     }
 
-    return (std::string::npos == topic.find_first_of("+#"))
-               ? mqtt::Error::Success
-               : mqtt::Error::InvalidTopic;
+    UTF8::Result r = UTF8::scan(topic.data(), topic.size());
+    if (!r.valid) {
+      return mqtt::Error::MalformedUTF8String;
+    }
+    return r.hasWildcard ? mqtt::Error::InvalidTopic : mqtt::Error::Success;
   }
 
   std::error_code TopicUtils::validateSubscribeTopic(const std::string& topic) {
@@ -23,6 +28,14 @@ namespace mqttutils {
       return mqtt::Error::TopicLenTooLong;
     }
 
+    UTF8::Result r = UTF8::scan(topic.data(), topic.size());
+    if (!r.valid) {
+      return mqtt::Error::MalformedUTF8String;
+    }
+    if (!r.hasWildcard) {
+      return mqtt::Error::Success;
+    }
+
     char   previousChar = 0;
     size_t topicLen     = topic.size();
 
@@ -133,8 +146,8 @@ namespace mqttutils {
     }
   }
 
-  void Trie::remove(const std::string&                topic,
-                    std::shared_ptr<mqtt::Subscriber> subscriber) {
+  size_t Trie::remove(const std::string&                topic,
+                      std::shared_ptr<mqtt::Subscriber> subscriber) {
     std::vector<std::string>    parts = mqttutils::TopicUtils::split(topic);
     Node*                       cur   = &root;
     std::lock_guard<std::mutex> guard(this->mux);
@@ -143,19 +156,23 @@ namespace mqttutils {
           cur->children.find(part);
       if (it == cur->children.end()) {
         // no subscribers registered
-        return;
+        return 0;
       } else {
         cur = it->second.get();
       }
     }
     // remove the subscriber
+    size_t before = cur->subscribers.size();
     cur->subscribers.erase(std::remove_if(
         cur->subscribers.begin(),
         cur->subscribers.end(),
         [subscriber](const std::shared_ptr<mqtt::Subscriber>& item) {
           return item == subscriber;
-        }));
+        }),
+        cur->subscribers.end());
+    size_t removed = before - cur->subscribers.size();
     detachChild(*cur);
+    return removed;
   }
 
   mqtt::Subscribers Trie::match(const std::string& topic) const {
@@ -219,7 +236,31 @@ namespace mqttutils {
   }
 
   // // -----------------------------------------------------------------------
-  TopicMatcher::TopicMatcher() : trie(std::make_unique<Trie>()) {}
+  // the metrics of all the matchers of the process
+  struct MatcherMetrics {
+    Gauge& subscriptions;
+    Counter& matches;
+    Counter& matched;
+  };
+
+  static MatcherMetrics& matcherMetrics() {
+    static MatcherMetrics m{
+        MetricsRegistry::global().gauge("mqtt_topic_subscriptions",
+                                        "Subscriptions in the topic matchers"),
+        MetricsRegistry::global().counter("mqtt_topic_matches_total",
+                                          "Topics matched"),
+        MetricsRegistry::global().counter(
+            "mqtt_topic_matched_subscribers_total",
+            "Subscribers found by the topic matches")};
+    return m;
+  }
+
+  TopicMatcher::TopicMatcher()
+      : trie(std::make_unique<Trie>()), subscriptions(0) {}
+
+  TopicMatcher::~TopicMatcher() {
+    matcherMetrics().subscriptions.add(-this->subscriptions.load());
+  }
 
   std::error_code
   TopicMatcher::subscribe(const std::string&                topic,
@@ -230,6 +271,8 @@ namespace mqttutils {
     }
 
     this->trie->insert(topic, subscriber);
+    this->subscriptions++;
+    matcherMetrics().subscriptions.add(1);
 
     return mqtt::Error::Success;
   }
@@ -242,7 +285,10 @@ namespace mqttutils {
       return err;
     }
 
-    this->trie->remove(topic, subscriber);
+    int64_t removed =
+        static_cast<int64_t>(this->trie->remove(topic, subscriber));
+    this->subscriptions -= removed;
+    matcherMetrics().subscriptions.add(-removed);
 
     return mqtt::Error::Success;
   }
@@ -252,7 +298,11 @@ namespace mqttutils {
   }
 
   mqtt::Subscribers TopicMatcher::match(const std::string& topic) const {
-    return this->trie->match(topic);
+    mqtt::Subscribers subscribers = this->trie->match(topic);
+    MQTT_PROBE2(topic__match, topic.size(), subscribers.size());
+    matcherMetrics().matches.add();
+    matcherMetrics().matched.add(subscribers.size());
+    return subscribers;
   }
 
 } // namespace mqttutils
@@ -2,6 +2,7 @@
 
 #include "mqtt/mqtt.h"
 #include "mqtt/noncopyable.h"
+#include <atomic>
 #include <mutex>
 #include <string>
 #include <system_error>
@@ -22,7 +23,8 @@ namespace mqttutils {
   public:
     void              insert(const std::string&                topic,
                              std::shared_ptr<mqtt::Subscriber> subscriber);
-    void              remove(const std::string&                topic,
+    // returns the number of subscriptions removed
+    size_t            remove(const std::string&                topic,
                              std::shared_ptr<mqtt::Subscriber> subscriber);
     mqtt::Subscribers match(const std::string& topic) const;
 
@@ -51,9 +53,12 @@ namespace mqttutils {
     Node               root;
   };
 
+  // TopicMatcher counts its subscriptions and matches in the global metrics
+  // registry, mqtt_topic_*
   class TopicMatcher : private mqtt::noncopyable {
   public:
     TopicMatcher();
+    ~TopicMatcher();
 
     std::error_code   subscribe(const std::string&                topic,
                                 std::shared_ptr<mqtt::Subscriber> subscriber);
@@ -65,5 +70,7 @@ namespace mqttutils {
 
   private:
     std::unique_ptr<Trie> trie;
+    // subscriptions in the trie, taken off the gauge on destruction
+    std::atomic<int64_t> subscriptions;
   };
 } // namespace mqttutils
@@ -33,6 +33,22 @@ TEST_CASE("testing publish topic validation") {
   }
 }
 
+TEST_CASE("testing topic UTF-8 validation") {
+  const std::vector<std::string> malformed{
+      std::string("pub/\0/topic", 11), "pub/\xC0\xAF", "pub/\xED\xA0\x80",
+      "pub/\xE2\x82"};
+  for (const auto& topic : malformed) {
+    CHECK(mqttutils::TopicUtils::validatePublishTopic(topic) ==
+          mqtt::Error::MalformedUTF8String);
+    CHECK(mqttutils::TopicUtils::validateSubscribeTopic(topic) ==
+          mqtt::Error::MalformedUTF8String);
+  }
+  CHECK(mqttutils::TopicUtils::validatePublishTopic("caf\xC3\xA9/\xF0\x9F\x98\x80") ==
+        mqtt::Error::Success);
+  CHECK(mqttutils::TopicUtils::validateSubscribeTopic("caf\xC3\xA9/+/#") ==
+        mqtt::Error::Success);
+}
+
 TEST_CASE("testing subscribe topic validation") {
   std::vector<std::string> validSubscribeTopics{"sub/topic",
                                                 "sub//topic",
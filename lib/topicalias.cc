@@ -0,0 +1,105 @@
+#include "topicalias.h"
+#include "mqtt/error.h"
+#include <iterator>
+
+namespace mqttutils {
+  // properties may be shared by several PUBLISH packets, only modify them
+  // when this packet is the sole owner
+  static mqtt::Publish::Properties& ownProperties(mqtt::Publish& p) {
+    if (!p.properties) {
+      p.properties = std::make_shared<mqtt::Publish::Properties>();
+    } else if (p.properties.use_count() > 1) {
+      p.properties = std::make_shared<mqtt::Publish::Properties>(*p.properties);
+    }
+    return *p.properties;
+  }
+
+  TopicAliasManager::TopicAliasManager(uint16_t aliasMaximumA)
+      : aliasMaximum(aliasMaximumA) {}
+
+  void TopicAliasManager::setAliasMaximum(uint16_t aliasMaximumA) {
+    this->aliasMaximum = aliasMaximumA;
+    this->reset();
+  }
+
+  uint16_t TopicAliasManager::getAliasMaximum() const {
+    return this->aliasMaximum;
+  }
+
+  void TopicAliasManager::reset() {
+    this->lru.clear();
+    this->aliases.clear();
+  }
+
+  void TopicAliasManager::apply(mqtt::Publish& p) {
+    if (this->aliasMaximum == 0 || p.topicName.empty()) {
+      return;
+    }
+
+    auto it = this->aliases.find(p.topicName);
+    if (it != this->aliases.end()) {
+      // known topic, send the alias only
+      this->lru.splice(this->lru.begin(), this->lru, it->second);
+      ownProperties(p).topicAlias = it->second->alias;
+      p.topicName.clear();
+      return;
+    }
+
+    uint16_t alias = 0;
+    if (this->lru.size() < this->aliasMaximum) {
+      alias = static_cast<uint16_t>(this->lru.size() + 1);
+      this->lru.push_front(Entry{p.topicName, alias});
+    } else {
+      // reuse the alias of the least recently used topic, the broker replaces
+      // the mapping as the PUBLISH carries both topic name and alias
+      auto last = std::prev(this->lru.end());
+      alias = last->alias;
+      this->aliases.erase(last->topic);
+      last->topic = p.topicName;
+      this->lru.splice(this->lru.begin(), this->lru, last);
+    }
+    this->aliases[p.topicName] = this->lru.begin();
+    ownProperties(p).topicAlias = alias;
+  }
+
+  size_t TopicAliasManager::size() const {
+    return this->lru.size();
+  }
+
+  // -----------------------------------------------------------------------
+  TopicAliasResolver::TopicAliasResolver(uint16_t aliasMaximum)
+      : topics(aliasMaximum) {}
+
+  void TopicAliasResolver::setAliasMaximum(uint16_t aliasMaximum) {
+    this->topics.assign(aliasMaximum, std::string());
+  }
+
+  void TopicAliasResolver::reset() {
+    for (auto& topic : this->topics) {
+      topic.clear();
+    }
+  }
+
+  std::error_code TopicAliasResolver::resolve(mqtt::Publish& p) {
+    if (!p.properties || !p.properties->topicAlias) {
+      return mqtt::Error::Success;
+    }
+
+    uint16_t alias = *p.properties->topicAlias;
+    if (alias == 0 || alias > this->topics.size()) {
+      return mqtt::Error::TopicAliasInvalid;
+    }
+
+    std::string& topic = this->topics[size_t(alias - 1)];
+    if (!p.topicName.empty()) {
+      topic = p.topicName;
+      return mqtt::Error::Success;
+    }
+
+    if (topic.empty()) {
+      return mqtt::Error::TopicAliasNotFound;
+    }
+    p.topicName = topic;
+    return mqtt::Error::Success;
+  }
+} // namespace mqttutils
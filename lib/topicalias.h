@@ -0,0 +1,68 @@
+#pragma once
+
+#include "mqtt/noncopyable.h"
+#include "mqtt/publish.h"
+#include <list>
+#include <string>
+#include <system_error>
+#include <unordered_map>
+#include <vector>
+
+namespace mqttutils {
+  // TopicAliasManager assigns topic aliases to outbound PUBLISH packets.
+  // The first PUBLISH on a topic carries the topic name and the alias, the
+  // following ones carry an empty topic name and the alias only. When all
+  // aliases (1..aliasMaximum) are in use the least recently used topic gives
+  // up its alias. The manager owns the alias space of a network connection,
+  // aliases set by the caller are overwritten.
+  class TopicAliasManager : private mqtt::noncopyable {
+  public:
+    explicit TopicAliasManager(uint16_t aliasMaximum = 0);
+
+    // aliasMaximum is the Topic Alias Maximum sent by the broker in CONNACK.
+    // Changing the maximum drops all the assigned aliases
+    void setAliasMaximum(uint16_t aliasMaximum);
+    uint16_t getAliasMaximum() const;
+
+    // aliases are scoped to a network connection, reset must be called when
+    // a new connection is established
+    void reset();
+
+    // apply sets the topic alias property and clears the topic name when the
+    // topic has already been sent with an alias
+    void apply(mqtt::Publish& p);
+
+    size_t size() const;
+
+  private:
+    struct Entry {
+      std::string topic;
+      uint16_t alias;
+    };
+
+    // most recently used entry at the front
+    std::list<Entry> lru;
+    std::unordered_map<std::string, std::list<Entry>::iterator> aliases;
+    uint16_t aliasMaximum;
+  };
+
+  // TopicAliasResolver maps the topic aliases of inbound PUBLISH packets back
+  // to the topic name
+  class TopicAliasResolver : private mqtt::noncopyable {
+  public:
+    explicit TopicAliasResolver(uint16_t aliasMaximum = 0);
+
+    // aliasMaximum is the Topic Alias Maximum this side sent in CONNECT (or
+    // CONNACK for the broker)
+    void setAliasMaximum(uint16_t aliasMaximum);
+    void reset();
+
+    // resolve records the mapping when the PUBLISH has a topic name and an
+    // alias, and fills in the topic name when the topic name is empty
+    std::error_code resolve(mqtt::Publish& p);
+
+  private:
+    // indexed by alias - 1
+    std::vector<std::string> topics;
+  };
+} // namespace mqttutils
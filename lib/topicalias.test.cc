@@ -0,0 +1,117 @@
+#include "doctest/doctest.h"
+#include "packet/codec.h"
+#include "packet/packet.h"
+#include "packet/publish.h"
+#include "topicalias.h"
+#include <mqtt/error.h>
+
+#include <string>
+#include <vector>
+
+static mqtt::Publish makePublish(const std::string& topic) {
+  mqtt::Publish p;
+  p.topicName = topic;
+  p.payload = {'h', 'e', 'l', 'l', 'o'};
+  return p;
+}
+
+TEST_CASE("testing topic alias manager assigns aliases") {
+  mqttutils::TopicAliasManager manager(2);
+
+  mqtt::Publish p = makePublish("a/b");
+  manager.apply(p);
+  REQUIRE(p.properties);
+  CHECK(*p.properties->topicAlias == 1);
+  CHECK(p.topicName == "a/b");
+
+  p = makePublish("a/b");
+  manager.apply(p);
+  CHECK(*p.properties->topicAlias == 1);
+  CHECK(p.topicName.empty());
+
+  p = makePublish("c/d");
+  manager.apply(p);
+  CHECK(*p.properties->topicAlias == 2);
+  CHECK(p.topicName == "c/d");
+  CHECK(manager.size() == 2);
+}
+
+TEST_CASE("testing topic alias manager evicts least recently used") {
+  mqttutils::TopicAliasManager manager(2);
+  for (const auto& topic : {"a", "b", "a"}) {
+    mqtt::Publish p = makePublish(topic);
+    manager.apply(p);
+  }
+
+  // "b" is the least recently used, "c" takes over its alias
+  mqtt::Publish p = makePublish("c");
+  manager.apply(p);
+  CHECK(*p.properties->topicAlias == 2);
+  CHECK(p.topicName == "c");
+
+  p = makePublish("a");
+  manager.apply(p);
+  CHECK(*p.properties->topicAlias == 1);
+  CHECK(p.topicName.empty());
+
+  p = makePublish("b");
+  manager.apply(p);
+  CHECK(*p.properties->topicAlias == 2);
+  CHECK(p.topicName == "b");
+  CHECK(manager.size() == 2);
+}
+
+TEST_CASE("testing topic alias manager without alias maximum") {
+  mqttutils::TopicAliasManager manager;
+  mqtt::Publish p = makePublish("a/b");
+  manager.apply(p);
+  CHECK_FALSE(p.properties);
+  CHECK(p.topicName == "a/b");
+}
+
+TEST_CASE("testing topic alias manager does not modify shared properties") {
+  mqttutils::TopicAliasManager manager(1);
+  auto props = std::make_shared<mqtt::Publish::Properties>();
+  props->contentType = "text/plain";
+
+  mqtt::Publish p = makePublish("a/b");
+  p.properties = props;
+  manager.apply(p);
+  CHECK_FALSE(props->topicAlias);
+  CHECK(*p.properties->topicAlias == 1);
+  CHECK(p.properties->contentType == "text/plain");
+}
+
+TEST_CASE("testing topic alias resolver") {
+  mqttutils::TopicAliasManager manager(2);
+  mqttutils::TopicAliasResolver resolver(2);
+
+  for (const auto& topic : {"a", "b", "a", "c", "b", "a"}) {
+    mqtt::Publish p = makePublish(topic);
+    manager.apply(p);
+
+    // roundtrip through the codec
+    std::vector<uint8_t> encoded =
+        packet::PublishEncoder(packet::PublishPacket{0, p}).encode();
+    packet::Decoder dec(encoded);
+    packet::FixedHeader fhdr = packet::FixedHeaderReader::read(dec);
+    auto decoded = packet::PublishDecoder::decode(dec, fhdr.first, fhdr.second);
+    CHECK(resolver.resolve(decoded.second) == mqtt::Error::Success);
+    CHECK(decoded.second.topicName == topic);
+  }
+}
+
+TEST_CASE("testing topic alias resolver errors") {
+  mqttutils::TopicAliasResolver resolver(2);
+
+  mqtt::Publish p = makePublish("");
+  p.properties = std::make_shared<mqtt::Publish::Properties>();
+  p.properties->topicAlias = 1;
+  CHECK(resolver.resolve(p) == mqtt::Error::TopicAliasNotFound);
+
+  p.properties->topicAlias = 0;
+  CHECK(resolver.resolve(p) == mqtt::Error::TopicAliasInvalid);
+
+  p.properties->topicAlias = 3;
+  CHECK(resolver.resolve(p) == mqtt::Error::TopicAliasInvalid);
+}
@@ -0,0 +1,317 @@
+#include "tracering.h"
+#include "packet/packet.h"
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <fcntl.h>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
+
+namespace mqttutils {
+  // a dump starts with the magic and the version, then the thread count and
+  // for each thread its ID, the record count and the records. Little endian
+  static const char magic[8] = {'M', 'Q', 'T', 'T', 'R', 'I', 'N', 'G'};
+  static constexpr uint32_t version = 1;
+  static constexpr size_t recordSize = 16;
+
+  // the exited threads are dropped from the dump past this many rings
+  static constexpr size_t maxRings = 256;
+
+  struct Rings {
+    std::mutex mux;
+    std::vector<std::shared_ptr<TraceRing>> all;
+  };
+
+  static Rings& rings() {
+    // never destroyed, threads may trace during exit
+    static Rings& r = *new Rings();
+    return r;
+  }
+
+  static uint32_t threadID() {
+#ifdef __linux__
+    // the ID perf and top show
+    return static_cast<uint32_t>(syscall(SYS_gettid));
+#else
+    static std::atomic<uint32_t> next{1};
+    return next.fetch_add(1, std::memory_order_relaxed);
+#endif
+  }
+
+  TraceRing::TraceRing(uint32_t thread) : id(thread), head(0) {
+    for (auto& s : this->slots) {
+      s.timestamp.store(0, std::memory_order_relaxed);
+      s.data.store(0, std::memory_order_relaxed);
+    }
+  }
+
+  TraceRing& TraceRing::local() {
+    static thread_local std::shared_ptr<TraceRing> ring = [] {
+      auto r = std::make_shared<TraceRing>(threadID());
+      Rings& all = rings();
+      std::lock_guard<std::mutex> guard(all.mux);
+      if (all.all.size() >= maxRings) {
+        // the registry holds the only reference of the rings of the
+        // exited threads
+        all.all.erase(std::remove_if(all.all.begin(), all.all.end(),
+                                     [](const std::shared_ptr<TraceRing>& p) {
+                                       return p.use_count() == 1;
+                                     }),
+                      all.all.end());
+      }
+      all.all.push_back(r);
+      return r;
+    }();
+    return *ring;
+  }
+
+  uint64_t TraceRing::now() {
+    return static_cast<uint64_t>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch())
+            .count());
+  }
+
+  std::vector<TraceRecord> TraceRing::records() const {
+    uint64_t end = this->head.load(std::memory_order_acquire);
+    uint64_t begin = end > capacity ? end - capacity : 0;
+    std::vector<TraceRecord> out;
+    out.reserve(static_cast<size_t>(end - begin));
+    for (uint64_t i = begin; i < end; ++i) {
+      const Slot& s = this->slots[i & (capacity - 1)];
+      uint64_t data = s.data.load(std::memory_order_relaxed);
+      out.push_back(TraceRecord{s.timestamp.load(std::memory_order_relaxed),
+                                static_cast<uint32_t>(data),
+                                static_cast<uint16_t>(data >> 32),
+                                static_cast<TraceEvent>(data >> 48),
+                                static_cast<uint8_t>(data >> 56)});
+    }
+
+    // the writer went on while copying, drop what it overwrote and the
+    // slot it may be writing
+    std::atomic_thread_fence(std::memory_order_acquire);
+    uint64_t after = this->head.load(std::memory_order_relaxed) + 1;
+    if (after > begin + capacity) {
+      size_t lost = static_cast<size_t>(
+          std::min<uint64_t>(after - begin - capacity, out.size()));
+      out.erase(out.begin(), out.begin() + static_cast<std::ptrdiff_t>(lost));
+    }
+    return out;
+  }
+
+  uint32_t TraceRing::thread() const {
+    return this->id;
+  }
+
+  static void put(std::vector<uint8_t>& out, uint64_t v, size_t bytes) {
+    for (size_t i = 0; i < bytes; ++i) {
+      out.push_back(static_cast<uint8_t>(v >> (8 * i)));
+    }
+  }
+
+  static uint64_t get(const uint8_t* in, size_t bytes) {
+    uint64_t v = 0;
+    for (size_t i = 0; i < bytes; ++i) {
+      v |= uint64_t(in[i]) << (8 * i);
+    }
+    return v;
+  }
+
+  int TraceRing::dump(const std::string& path) {
+    std::vector<std::shared_ptr<TraceRing>> all;
+    {
+      Rings& r = rings();
+      std::lock_guard<std::mutex> guard(r.mux);
+      all = r.all;
+    }
+
+    std::vector<uint8_t> out(magic, magic + sizeof(magic));
+    put(out, version, 4);
+    put(out, all.size(), 4);
+    for (const auto& ring : all) {
+      std::vector<TraceRecord> records = ring->records();
+      put(out, ring->thread(), 4);
+      put(out, records.size(), 4);
+      for (const auto& r : records) {
+        put(out, r.timestamp, 8);
+        put(out, r.size, 4);
+        put(out, r.packetID, 2);
+        put(out, static_cast<uint8_t>(r.event), 1);
+        put(out, r.packetType, 1);
+      }
+    }
+
+    FILE* f = fopen(path.c_str(), "wb");
+    if (f == nullptr) {
+      return errno;
+    }
+    int err = 0;
+    if (fwrite(out.data(), 1, out.size(), f) != out.size()) {
+      err = errno != 0 ? errno : EIO;
+    }
+    if (fclose(f) != 0 && err == 0) {
+      err = errno;
+    }
+    return err;
+  }
+
+  // the write end of the pipe the signal handler wakes the dump thread with
+  static std::atomic<int> signalFd{-1};
+
+  static void onSignal(int) {
+    int saved = errno;
+    int fd = signalFd.load(std::memory_order_relaxed);
+    if (fd != -1) {
+      uint8_t b = 0;
+      ssize_t n = write(fd, &b, 1);
+      (void)n;
+    }
+    errno = saved;
+  }
+
+  int TraceRing::dumpOnSignal(int signo, const std::string& path) {
+    static std::mutex mux;
+    static std::string* dumpPath = new std::string();
+    std::lock_guard<std::mutex> guard(mux);
+    *dumpPath = path;
+
+    if (signalFd.load() == -1) {
+      int fds[2];
+      if (pipe(fds) != 0) {
+        return errno;
+      }
+      fcntl(fds[1], F_SETFL, fcntl(fds[1], F_GETFL, 0) | O_NONBLOCK);
+      signalFd.store(fds[1]);
+      // runs until the process exits
+      std::thread([fd = fds[0]] {
+        uint8_t b;
+        for (;;) {
+          ssize_t n = ::read(fd, &b, 1);
+          if (n < 0 && errno == EINTR) {
+            continue;
+          }
+          if (n <= 0) {
+            return;
+          }
+          std::string p;
+          {
+            std::lock_guard<std::mutex> lock(mux);
+            p = *dumpPath;
+          }
+          TraceRing::dump(p);
+        }
+      }).detach();
+    }
+
+    struct sigaction sa = {};
+    sa.sa_handler = onSignal;
+    sigemptyset(&sa.sa_mask);
+    sa.sa_flags = SA_RESTART;
+    if (sigaction(signo, &sa, nullptr) != 0) {
+      return errno;
+    }
+    return 0;
+  }
+
+  int TraceDump::read(const std::string& path) {
+    FILE* f = fopen(path.c_str(), "rb");
+    if (f == nullptr) {
+      return errno;
+    }
+    std::vector<uint8_t> in;
+    uint8_t buffer[65536];
+    size_t n = 0;
+    while ((n = fread(buffer, 1, sizeof(buffer), f)) > 0) {
+      in.insert(in.end(), buffer, buffer + n);
+    }
+    fclose(f);
+
+    this->threads.clear();
+    size_t offset = sizeof(magic) + 8;
+    if (in.size() < offset ||
+        !std::equal(magic, magic + sizeof(magic), in.begin()) ||
+        get(in.data() + sizeof(magic), 4) != version) {
+      return EINVAL;
+    }
+    uint64_t threadCount = get(in.data() + sizeof(magic) + 4, 4);
+    for (uint64_t t = 0; t < threadCount; ++t) {
+      if (in.size() - offset < 8) {
+        return EINVAL;
+      }
+      Thread thread{static_cast<uint32_t>(get(in.data() + offset, 4)), {}};
+      uint64_t count = get(in.data() + offset + 4, 4);
+      offset += 8;
+      if ((in.size() - offset) / recordSize < count) {
+        return EINVAL;
+      }
+      thread.records.reserve(static_cast<size_t>(count));
+      for (uint64_t i = 0; i < count; ++i, offset += recordSize) {
+        const uint8_t* r = in.data() + offset;
+        thread.records.push_back(
+            TraceRecord{get(r, 8), static_cast<uint32_t>(get(r + 8, 4)),
+                        static_cast<uint16_t>(get(r + 12, 2)),
+                        static_cast<TraceEvent>(r[14]), r[15]});
+      }
+      this->threads.emplace_back(std::move(thread));
+    }
+    return 0;
+  }
+
+  std::string TraceDump::timeline() const {
+    struct Line {
+      uint32_t thread;
+      const TraceRecord* record;
+    };
+    std::vector<Line> lines;
+    for (const auto& t : this->threads) {
+      for (const auto& r : t.records) {
+        lines.push_back(Line{t.thread, &r});
+      }
+    }
+    std::stable_sort(lines.begin(), lines.end(),
+                     [](const Line& a, const Line& b) {
+                       return a.record->timestamp < b.record->timestamp;
+                     });
+
+    std::string out;
+    uint64_t start = lines.empty() ? 0 : lines.front().record->timestamp;
+    char buffer[160];
+    for (const auto& l : lines) {
+      const TraceRecord& r = *l.record;
+      snprintf(buffer, sizeof(buffer),
+               "%14.3f us  thread %-7u %-15s %-11s id %-5u size %u\n",
+               double(r.timestamp - start) / 1e3, l.thread,
+               eventName(r.event),
+               packet::ControlPacket::name(
+                   static_cast<packet::ControlPacket::Type>(r.packetType)),
+               unsigned(r.packetID), r.size);
+      out += buffer;
+    }
+    return out;
+  }
+
+  const char* TraceDump::eventName(TraceEvent event) {
+    switch (event) {
+    case TraceEvent::FrameReceived:
+      return "frame-received";
+    case TraceEvent::Decoded:
+      return "decoded";
+    case TraceEvent::Matched:
+      return "matched";
+    case TraceEvent::Enqueued:
+      return "enqueued";
+    case TraceEvent::Encoded:
+      return "encoded";
+    case TraceEvent::Written:
+      return "written";
+    }
+    return "unknown";
+  }
+} // namespace mqttutils
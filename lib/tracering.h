@@ -0,0 +1,110 @@
+#pragma once
+
+#include "mqtt/noncopyable.h"
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace mqttutils {
+  enum class TraceEvent : uint8_t {
+    // a packet was framed out of the bytes read, size is the packet size
+    FrameReceived = 1,
+    Decoded,
+    // size is the number of subscribers matched
+    Matched,
+    // deliveries handed to another thread, size is the number of deliveries
+    Enqueued,
+    Encoded,
+    // size is the number of bytes written
+    Written,
+  };
+
+  struct TraceRecord {
+    // nanoseconds, steady clock
+    uint64_t timestamp;
+    uint32_t size;
+    uint16_t packetID;
+    TraceEvent event;
+    // ControlPacket::Type
+    uint8_t packetType;
+  };
+
+  // TraceRing is a flight recorder: it keeps the last capacity events of a
+  // thread, in fixed size records, so that a latency spike can be looked at
+  // after the fact. Recording stores two words and bumps the head, it does
+  // not lock, allocate or format.
+  //
+  // A ring has one writer, local() is the ring of the calling thread. The
+  // rings of all the threads are written to a file by dump, on demand or on
+  // a signal, and read back by TraceDump. A record overwritten while the
+  // ring is read is dropped from the copy.
+  class TraceRing : private mqtt::noncopyable {
+  public:
+    static constexpr size_t capacity = 4096;
+
+    explicit TraceRing(uint32_t thread);
+
+    // the ring of the calling thread, registered for dump on first use. The
+    // ring outlives its thread
+    static TraceRing& local();
+    // the clock of the records
+    static uint64_t now();
+
+    // called by the writer only
+    inline void record(TraceEvent event, uint8_t packetType,
+                       uint16_t packetID, uint32_t size, uint64_t timestamp) {
+      uint64_t h = this->head.load(std::memory_order_relaxed);
+      Slot& s = this->slots[h & (capacity - 1)];
+      s.timestamp.store(timestamp, std::memory_order_relaxed);
+      s.data.store(uint64_t(size) | uint64_t(packetID) << 32 |
+                       uint64_t(event) << 48 | uint64_t(packetType) << 56,
+                   std::memory_order_relaxed);
+      this->head.store(h + 1, std::memory_order_release);
+    }
+
+    // the records kept, oldest first. Up to capacity - 1: the oldest slot
+    // of a full ring may be being overwritten
+    std::vector<TraceRecord> records() const;
+    uint32_t thread() const;
+
+    // dump writes the rings of all the threads to path. Returns 0 or the
+    // errno of the failing call
+    static int dump(const std::string& path);
+    // dumpOnSignal dumps to path when signo is received. The handler only
+    // wakes a thread that writes the file
+    static int dumpOnSignal(int signo, const std::string& path);
+
+  private:
+    struct Slot {
+      std::atomic<uint64_t> timestamp;
+      // size, packet ID, event, packet type
+      std::atomic<uint64_t> data;
+    };
+
+    const uint32_t id;
+    std::atomic<uint64_t> head;
+    std::array<Slot, capacity> slots;
+  };
+
+  // TraceDump is a file written by TraceRing::dump
+  struct TraceDump {
+    struct Thread {
+      uint32_t thread;
+      std::vector<TraceRecord> records;
+    };
+
+    std::vector<Thread> threads;
+
+    // returns 0, the errno of the failing call or EINVAL when the file is
+    // not a dump
+    int read(const std::string& path);
+    // timeline renders the records of all the threads ordered by time, one
+    // per line, in microseconds since the first record
+    std::string timeline() const;
+
+    static const char* eventName(TraceEvent event);
+  };
+} // namespace mqttutils
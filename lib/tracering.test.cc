@@ -0,0 +1,120 @@
+#include "doctest/doctest.h"
+#include "temppath.h"
+#include "tracering.h"
+
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <filesystem>
+#include <thread>
+#include <unistd.h>
+
+namespace test {
+  // the records of a thread in a dump
+  static const mqttutils::TraceDump::Thread*
+  find(const mqttutils::TraceDump& dump, uint32_t thread) {
+    for (const auto& t : dump.threads) {
+      if (t.thread == thread) {
+        return &t;
+      }
+    }
+    return nullptr;
+  }
+} // namespace test
+
+TEST_CASE("testing trace ring keeps the last records") {
+  mqttutils::TraceRing ring(1);
+  CHECK(ring.records().empty());
+
+  for (uint32_t i = 0; i < mqttutils::TraceRing::capacity + 10; ++i) {
+    ring.record(mqttutils::TraceEvent::Written, 3, uint16_t(i), i, 1000 + i);
+  }
+  std::vector<mqttutils::TraceRecord> records = ring.records();
+  // the oldest slot may be being overwritten, it is left out of a full ring
+  REQUIRE(records.size() == mqttutils::TraceRing::capacity - 1);
+  CHECK(records.front().size == 11);
+  CHECK(records.front().timestamp == 1011);
+  CHECK(records.back().size == mqttutils::TraceRing::capacity + 9);
+  CHECK(records.back().packetID == uint16_t(mqttutils::TraceRing::capacity + 9));
+  CHECK(records.back().event == mqttutils::TraceEvent::Written);
+  CHECK(records.back().packetType == 3);
+}
+
+TEST_CASE("testing trace ring dump and timeline") {
+  test::TempPath tmp("mqtt-trace-dump");
+
+  // a thread that exited is still in the dump
+  uint32_t other = 0;
+  std::thread([&other] {
+    mqttutils::TraceRing& ring = mqttutils::TraceRing::local();
+    other = ring.thread();
+    ring.record(mqttutils::TraceEvent::Enqueued, 3, 0, 2,
+                mqttutils::TraceRing::now());
+  }).join();
+
+  mqttutils::TraceRing& ring = mqttutils::TraceRing::local();
+  CHECK(&ring == &mqttutils::TraceRing::local());
+  CHECK(ring.thread() != other);
+  uint64_t now = mqttutils::TraceRing::now();
+  ring.record(mqttutils::TraceEvent::FrameReceived, 3, 0, 42, now);
+  ring.record(mqttutils::TraceEvent::Decoded, 3, 7, 40, now + 1500);
+  REQUIRE(mqttutils::TraceRing::dump(tmp.path) == 0);
+
+  mqttutils::TraceDump dump;
+  REQUIRE(dump.read(tmp.path) == 0);
+  const mqttutils::TraceDump::Thread* self = test::find(dump, ring.thread());
+  REQUIRE(self != nullptr);
+  REQUIRE(self->records.size() >= 2);
+  const mqttutils::TraceRecord& decoded = self->records.back();
+  CHECK(decoded.event == mqttutils::TraceEvent::Decoded);
+  CHECK(decoded.packetID == 7);
+  CHECK(decoded.size == 40);
+  CHECK(decoded.timestamp == now + 1500);
+  const mqttutils::TraceDump::Thread* exited = test::find(dump, other);
+  REQUIRE(exited != nullptr);
+  REQUIRE(exited->records.size() == 1);
+  CHECK(exited->records[0].event == mqttutils::TraceEvent::Enqueued);
+
+  // relative to the first record, the threads interleaved
+  mqttutils::TraceDump manual;
+  manual.threads = {
+      {1, {{now, 42, 0, mqttutils::TraceEvent::FrameReceived, 3},
+           {now + 1500, 40, 7, mqttutils::TraceEvent::Decoded, 3}}},
+      {2, {{now + 500, 1, 0, mqttutils::TraceEvent::Matched, 3}}}};
+  std::string timeline = manual.timeline();
+  size_t frame = timeline.find("0.000 us  thread 1       frame-received  PUBLISH");
+  size_t matched = timeline.find("0.500 us  thread 2       matched");
+  size_t decodedAt =
+      timeline.find("1.500 us  thread 1       decoded         PUBLISH     id 7");
+  CHECK(frame != std::string::npos);
+  CHECK(matched != std::string::npos);
+  CHECK(decodedAt != std::string::npos);
+  CHECK(frame < matched);
+  CHECK(matched < decodedAt);
+
+  // not a dump
+  FILE* f = fopen(tmp.path.c_str(), "wb");
+  REQUIRE(f != nullptr);
+  fputs("garbage", f);
+  fclose(f);
+  CHECK(dump.read(tmp.path) == EINVAL);
+}
+
+TEST_CASE("testing trace ring dump on signal") {
+  test::TempPath tmp("mqtt-trace-signal");
+  REQUIRE(mqttutils::TraceRing::dumpOnSignal(SIGUSR2, tmp.path) == 0);
+  raise(SIGUSR2);
+
+  // the dump is written by another thread
+  mqttutils::TraceDump dump;
+  for (int i = 0; i < 200 && !std::filesystem::exists(tmp.path); ++i) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  int err = EINVAL;
+  for (int i = 0; i < 200 && err != 0; ++i) {
+    err = dump.read(tmp.path);
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  CHECK(err == 0);
+  signal(SIGUSR2, SIG_DFL);
+}
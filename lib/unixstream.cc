@@ -0,0 +1,73 @@
+#include "unixstream.h"
+#include <cerrno>
+#include <cstddef>
+#include <cstring>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace mqttutils {
+  int unixAddress(const std::string& path, sockaddr_un& addr, socklen_t& len) {
+    addr = {};
+    addr.sun_family = AF_UNIX;
+    if (path.empty()) {
+      return EINVAL;
+    }
+    // a path has a terminating nul, an abstract name does not: its length
+    // is in len
+    bool abstract = path[0] == '@';
+    if (path.size() + (abstract ? 0 : 1) > sizeof(addr.sun_path)) {
+      return ENAMETOOLONG;
+    }
+    memcpy(addr.sun_path, path.data(), path.size());
+    if (abstract) {
+      addr.sun_path[0] = '\0';
+    }
+    len = static_cast<socklen_t>(offsetof(sockaddr_un, sun_path) +
+                                 path.size() + (abstract ? 0 : 1));
+    return 0;
+  }
+
+  UnixStream::UnixStream(std::string pathA)
+      : SocketStream("unix"), path(std::move(pathA)) {}
+
+  UnixStream::UnixStream(int fd) : SocketStream("unix", fd) {}
+
+  std::pair<UnixStream::Pair, int> UnixStream::pair() {
+    int fds[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0) {
+      return {Pair(), errno};
+    }
+    // the constructor is private, no make_unique
+    return {Pair(std::unique_ptr<mqtt::Stream>(new UnixStream(fds[0])),
+                 std::unique_ptr<mqtt::Stream>(new UnixStream(fds[1]))),
+            0};
+  }
+
+  int UnixStream::open() {
+    if (this->isValid()) {
+      return 0;
+    }
+
+    sockaddr_un addr;
+    socklen_t addrLen = 0;
+    int result = unixAddress(this->path, addr, addrLen);
+    if (result != 0) {
+      return result;
+    }
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd == -1) {
+      return errno;
+    }
+
+    if (::connect(fd, reinterpret_cast<const sockaddr*>(&addr), addrLen) !=
+        0) {
+      int err = errno;
+      ::close(fd);
+      return err;
+    }
+
+    this->sockfd = fd;
+    return 0;
+  }
+} // namespace mqttutils
@@ -0,0 +1,42 @@
+#pragma once
+
+#include "socketstream.h"
+#include <memory>
+#include <string>
+#include <sys/socket.h>
+#include <utility>
+
+struct sockaddr_un;
+
+namespace mqttutils {
+  // UnixStream is a Stream over an AF_UNIX stream socket, for clients on the
+  // same host as the broker: the bytes are copied between the sockets
+  // without the TCP stack. A path starting with '@' is in the abstract
+  // namespace (Linux), there is no file and the name goes away with the
+  // listener.
+  class UnixStream : public SocketStream {
+  public:
+    explicit UnixStream(std::string path);
+
+    using Pair =
+        std::pair<std::unique_ptr<mqtt::Stream>, std::unique_ptr<mqtt::Stream>>;
+
+    // the two ends of a connected socketpair, e.g. a process and the child
+    // it forks. Returns the errno of socketpair on failure, the ends are
+    // opened already
+    static std::pair<Pair, int> pair();
+
+  private:
+    explicit UnixStream(int fd);
+
+    int open() override final;
+
+  private:
+    std::string path;
+  };
+
+  // unixAddress fills addr with path, '@' for the abstract namespace, and
+  // len with the length to pass to bind or connect. Returns ENAMETOOLONG or
+  // EINVAL for an empty path
+  int unixAddress(const std::string& path, sockaddr_un& addr, socklen_t& len);
+} // namespace mqttutils
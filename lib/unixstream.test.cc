@@ -0,0 +1,128 @@
+#include "doctest/doctest.h"
+
+#include "temppath.h"
+#include "unixstream.h"
+#include <cerrno>
+#include <sys/un.h>
+#include <thread>
+#include <unistd.h>
+
+namespace test {
+  // echoes what one connection on path writes, until it closes
+  class UnixEchoServer {
+  public:
+    explicit UnixEchoServer(const std::string& path) : fd(-1) {
+      sockaddr_un addr;
+      socklen_t addrLen = 0;
+      REQUIRE(mqttutils::unixAddress(path, addr, addrLen) == 0);
+      this->fd = socket(AF_UNIX, SOCK_STREAM, 0);
+      REQUIRE(bind(this->fd, reinterpret_cast<sockaddr*>(&addr), addrLen) ==
+              0);
+      REQUIRE(listen(this->fd, 1) == 0);
+      this->t = std::thread(&UnixEchoServer::run, this);
+    }
+
+    ~UnixEchoServer() {
+      this->t.join();
+      close(this->fd);
+    }
+
+  private:
+    void run() {
+      int conn = accept(this->fd, nullptr, nullptr);
+      if (conn < 0) {
+        return;
+      }
+      uint8_t buffer[128];
+      ssize_t n = 0;
+      while ((n = recv(conn, buffer, sizeof(buffer), 0)) > 0) {
+        if (send(conn, buffer, static_cast<size_t>(n), 0) != n) {
+          break;
+        }
+      }
+      close(conn);
+    }
+
+  private:
+    int fd;
+    std::thread t;
+  };
+
+  static void echo(mqtt::Stream& stream) {
+    REQUIRE(stream.open() == 0);
+    CHECK(stream.isValid());
+    std::vector<uint8_t> buffer = {'A', 'B', 'C', 'D', 'E'};
+    auto writeResult = stream.writeBytes(buffer);
+    CHECK(writeResult.second == 0);
+    CHECK(writeResult.first == buffer.size());
+    auto readResult = stream.readBytes(buffer.size());
+    CHECK(readResult.second == 0);
+    CHECK(readResult.first == buffer);
+    stream.close();
+    CHECK(!stream.isValid());
+  }
+} // namespace test
+
+TEST_CASE("Unix Stream connect/send/recv/close on a path") {
+  test::TempPath tmp("mqtt-echo.sock");
+  const std::string& path = tmp.path;
+  {
+    test::UnixEchoServer svr(path);
+    mqttutils::UnixStream stream(path);
+    test::echo(stream);
+  }
+  unlink(path.c_str());
+
+  // nobody listens any more
+  mqttutils::UnixStream stream(path);
+  mqtt::Stream& s = stream;
+  CHECK(s.open() == ENOENT);
+  CHECK(!s.isValid());
+}
+
+TEST_CASE("Unix Stream in the abstract namespace") {
+  std::string name = "@mqtt-echo-" + std::to_string(getpid());
+  {
+    test::UnixEchoServer svr(name);
+    mqttutils::UnixStream stream(name);
+    test::echo(stream);
+  }
+
+  sockaddr_un addr;
+  socklen_t addrLen = 0;
+  CHECK(mqttutils::unixAddress("", addr, addrLen) == EINVAL);
+  CHECK(mqttutils::unixAddress(std::string(sizeof(addr.sun_path), 'x'), addr,
+                               addrLen) == ENAMETOOLONG);
+  // no terminating nul in the abstract namespace
+  CHECK(mqttutils::unixAddress("@" + std::string(sizeof(addr.sun_path) - 1,
+                                                 'x'),
+                               addr, addrLen) == 0);
+}
+
+TEST_CASE("Unix Stream socketpair") {
+  auto result = mqttutils::UnixStream::pair();
+  REQUIRE(result.second == 0);
+  mqtt::Stream& a = *result.first.first;
+  mqtt::Stream& b = *result.first.second;
+  CHECK(a.open() == 0);
+  CHECK(b.isValid());
+
+  // more than the socket buffer, the reader drains it meanwhile
+  std::vector<uint8_t> data(1 << 20);
+  for (size_t i = 0; i < data.size(); ++i) {
+    data[i] = static_cast<uint8_t>(i * 7);
+  }
+  std::thread writer([&] { CHECK(a.writeBytes(data).first == data.size()); });
+  auto read = b.readBytes(data.size());
+  writer.join();
+  CHECK(read.second == 0);
+  CHECK(read.first == data);
+
+  // the peer closed: the bytes left, then ECONNRESET, and EPIPE to write
+  CHECK(b.writeBytes({1, 2, 3}).second == 0);
+  b.close();
+  auto rest = a.readBytes(4);
+  CHECK(rest.first == std::vector<uint8_t>{1, 2, 3});
+  CHECK(rest.second == ECONNRESET);
+  CHECK(a.writeBytes({1}).second == EPIPE);
+}
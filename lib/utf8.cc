@@ -0,0 +1,344 @@
+#include "utf8.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define MQTT_UTF8_X86 1
+#include <immintrin.h>
+#else
+#define MQTT_UTF8_X86 0
+#endif
+
+#include <cstring>
+
+namespace mqttutils {
+  static UTF8::Result scanScalar(const char* str, size_t size) {
+    const uint8_t* data = reinterpret_cast<const uint8_t*>(str);
+    UTF8::Result result{true, false};
+    size_t i = 0;
+    while (i < size) {
+      uint8_t b = data[i];
+      if (b < 0x80) {
+        if (b == 0) {
+          return {false, result.hasWildcard};
+        }
+        if (b == '+' || b == '#') {
+          result.hasWildcard = true;
+        }
+        i++;
+        continue;
+      }
+
+      // length of the sequence and the range of the second byte, the
+      // narrower ranges exclude overlong forms, surrogates and values above
+      // U+10FFFF
+      size_t len = 0;
+      uint8_t lo = 0x80;
+      uint8_t hi = 0xBF;
+      if (b >= 0xC2 && b <= 0xDF) {
+        len = 2;
+      } else if (b >= 0xE0 && b <= 0xEF) {
+        len = 3;
+        if (b == 0xE0) {
+          lo = 0xA0;
+        } else if (b == 0xED) {
+          hi = 0x9F;
+        }
+      } else if (b >= 0xF0 && b <= 0xF4) {
+        len = 4;
+        if (b == 0xF0) {
+          lo = 0x90;
+        } else if (b == 0xF4) {
+          hi = 0x8F;
+        }
+      } else {
+        return {false, result.hasWildcard};
+      }
+
+      if (i + len > size || data[i + 1] < lo || data[i + 1] > hi) {
+        return {false, result.hasWildcard};
+      }
+      for (size_t j = 2; j < len; ++j) {
+        if ((data[i + j] & 0xC0) != 0x80) {
+          return {false, result.hasWildcard};
+        }
+      }
+      i += len;
+    }
+    return result;
+  }
+
+#if MQTT_UTF8_X86
+  // error classes of a pair of bytes, see the paper. A pair is invalid when
+  // the classes of the high nibble of the first byte, the low nibble of the
+  // first byte and the high nibble of the second byte share a bit
+  static constexpr uint8_t tooShort = 1 << 0;
+  static constexpr uint8_t tooLong = 1 << 1;
+  static constexpr uint8_t overlong3 = 1 << 2;
+  static constexpr uint8_t tooLarge = 1 << 3;
+  static constexpr uint8_t surrogate = 1 << 4;
+  static constexpr uint8_t overlong2 = 1 << 5;
+  static constexpr uint8_t tooLarge1000 = 1 << 6;
+  static constexpr uint8_t overlong4 = 1 << 6;
+  static constexpr uint8_t twoConts = 1 << 7;
+  static constexpr uint8_t carry = tooShort | tooLong | twoConts;
+
+  alignas(16) static const uint8_t byte1HighTable[16] = {
+      // 0_______ ascii
+      tooLong, tooLong, tooLong, tooLong, tooLong, tooLong, tooLong, tooLong,
+      // 10______ continuation
+      twoConts, twoConts, twoConts, twoConts,
+      // 1100____ 1101____ two byte lead
+      tooShort | overlong2, tooShort,
+      // 1110____ three byte lead
+      tooShort | overlong3 | surrogate,
+      // 1111____ four byte lead
+      tooShort | tooLarge | tooLarge1000 | overlong4};
+
+  alignas(16) static const uint8_t byte1LowTable[16] = {
+      carry | overlong3 | overlong2 | overlong4,
+      carry | overlong2,
+      carry,
+      carry,
+      carry | tooLarge,
+      carry | tooLarge | tooLarge1000,
+      carry | tooLarge | tooLarge1000,
+      carry | tooLarge | tooLarge1000,
+      carry | tooLarge | tooLarge1000,
+      carry | tooLarge | tooLarge1000,
+      carry | tooLarge | tooLarge1000,
+      carry | tooLarge | tooLarge1000,
+      carry | tooLarge | tooLarge1000,
+      carry | tooLarge | tooLarge1000 | surrogate,
+      carry | tooLarge | tooLarge1000,
+      carry | tooLarge | tooLarge1000};
+
+  alignas(16) static const uint8_t byte2HighTable[16] = {
+      // ________ 0_______ ascii
+      tooShort, tooShort, tooShort, tooShort, tooShort, tooShort, tooShort,
+      tooShort,
+      // ________ 1000____
+      tooLong | overlong2 | twoConts | overlong3 | tooLarge1000 | overlong4,
+      // ________ 1001____
+      tooLong | overlong2 | twoConts | overlong3 | tooLarge,
+      // ________ 101_____
+      tooLong | overlong2 | twoConts | surrogate | tooLarge,
+      tooLong | overlong2 | twoConts | surrogate | tooLarge,
+      // ________ 11______
+      tooShort, tooShort, tooShort, tooShort};
+
+  // the last bytes of a block that start a sequence not finished in it
+  alignas(32) static const uint8_t incompleteTable[32] = {
+      255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
+      255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
+      255, 255, 255, 255, 255, 255, 255, 0xF0 - 1, 0xE0 - 1, 0xC0 - 1};
+
+  // SSEState and AVX2State are the accumulated checks of the blocks seen
+  // so far and the previous block
+  struct SSEState {
+    __m128i error;
+    __m128i forbidden;
+    __m128i wildcard;
+    __m128i prevInput;
+    __m128i prevIncomplete;
+  };
+
+  __attribute__((target("sse4.1"))) static inline __m128i
+  lookup(const uint8_t* table, __m128i index) {
+    return _mm_shuffle_epi8(
+        _mm_load_si128(reinterpret_cast<const __m128i*>(table)), index);
+  }
+
+  __attribute__((target("sse4.1"))) static inline void blockSSE4(SSEState& s,
+                                                                 __m128i input) {
+    const __m128i nibble = _mm_set1_epi8(0x0F);
+    s.forbidden =
+        _mm_or_si128(s.forbidden, _mm_cmpeq_epi8(input, _mm_setzero_si128()));
+    s.wildcard = _mm_or_si128(
+        s.wildcard, _mm_or_si128(_mm_cmpeq_epi8(input, _mm_set1_epi8('+')),
+                                 _mm_cmpeq_epi8(input, _mm_set1_epi8('#'))));
+    if (_mm_movemask_epi8(input) == 0) {
+      // ascii, a sequence of the previous block must have ended there
+      s.error = _mm_or_si128(s.error, s.prevIncomplete);
+    } else {
+      __m128i prev1 = _mm_alignr_epi8(input, s.prevInput, 15);
+      __m128i sc = _mm_and_si128(
+          _mm_and_si128(
+              lookup(byte1HighTable,
+                     _mm_and_si128(_mm_srli_epi16(prev1, 4), nibble)),
+              lookup(byte1LowTable, _mm_and_si128(prev1, nibble))),
+          lookup(byte2HighTable,
+                 _mm_and_si128(_mm_srli_epi16(input, 4), nibble)));
+      __m128i prev2 = _mm_alignr_epi8(input, s.prevInput, 14);
+      __m128i prev3 = _mm_alignr_epi8(input, s.prevInput, 13);
+      // only 111_____ and 1111____ leave the high bit set, the third and
+      // fourth bytes must be continuations
+      __m128i must23 =
+          _mm_or_si128(_mm_subs_epu8(prev2, _mm_set1_epi8(0xE0 - 0x80)),
+                       _mm_subs_epu8(prev3, _mm_set1_epi8(0xF0 - 0x80)));
+      __m128i must23x80 = _mm_and_si128(must23, _mm_set1_epi8(char(0x80)));
+      s.error = _mm_or_si128(s.error, _mm_xor_si128(must23x80, sc));
+      s.prevIncomplete = _mm_subs_epu8(
+          input,
+          _mm_load_si128(reinterpret_cast<const __m128i*>(incompleteTable + 16)));
+    }
+    s.prevInput = input;
+  }
+
+  __attribute__((target("sse4.1"))) static UTF8::Result
+  scanSSE4(const char* str, size_t size) {
+    const __m128i zero = _mm_setzero_si128();
+    SSEState s{zero, zero, zero, zero, zero};
+    size_t i = 0;
+    for (; i + 16 <= size; i += 16) {
+      blockSSE4(s, _mm_loadu_si128(reinterpret_cast<const __m128i*>(str + i)));
+    }
+    if (i < size) {
+      // padded with spaces, ascii that is neither forbidden nor a wildcard
+      alignas(16) char tail[16];
+      std::memset(tail, ' ', sizeof(tail));
+      std::memcpy(tail, str + i, size - i);
+      blockSSE4(s, _mm_load_si128(reinterpret_cast<const __m128i*>(tail)));
+    }
+    s.error = _mm_or_si128(s.error, s.prevIncomplete);
+
+    return {_mm_testz_si128(s.error, s.error) != 0 &&
+                _mm_testz_si128(s.forbidden, s.forbidden) != 0,
+            _mm_testz_si128(s.wildcard, s.wildcard) == 0};
+  }
+
+  struct AVX2State {
+    __m256i error;
+    __m256i forbidden;
+    __m256i wildcard;
+    __m256i prevInput;
+    __m256i prevIncomplete;
+  };
+
+  __attribute__((target("avx2"))) static inline __m256i
+  lookup(const uint8_t* table, __m256i index) {
+    return _mm256_shuffle_epi8(
+        _mm256_broadcastsi128_si256(
+            _mm_load_si128(reinterpret_cast<const __m128i*>(table))),
+        index);
+  }
+
+  // prev shifts input by n bytes across the lanes, prevInput fills in
+  template <int n>
+  __attribute__((target("avx2"))) static inline __m256i prev(__m256i input,
+                                                             __m256i prevInput) {
+    return _mm256_alignr_epi8(
+        input, _mm256_permute2x128_si256(prevInput, input, 0x21), 16 - n);
+  }
+
+  __attribute__((target("avx2"))) static inline void blockAVX2(AVX2State& s,
+                                                               __m256i input) {
+    const __m256i nibble = _mm256_set1_epi8(0x0F);
+    s.forbidden = _mm256_or_si256(
+        s.forbidden, _mm256_cmpeq_epi8(input, _mm256_setzero_si256()));
+    s.wildcard = _mm256_or_si256(
+        s.wildcard,
+        _mm256_or_si256(_mm256_cmpeq_epi8(input, _mm256_set1_epi8('+')),
+                        _mm256_cmpeq_epi8(input, _mm256_set1_epi8('#'))));
+    if (_mm256_movemask_epi8(input) == 0) {
+      s.error = _mm256_or_si256(s.error, s.prevIncomplete);
+    } else {
+      __m256i prev1 = prev<1>(input, s.prevInput);
+      __m256i sc = _mm256_and_si256(
+          _mm256_and_si256(
+              lookup(byte1HighTable,
+                     _mm256_and_si256(_mm256_srli_epi16(prev1, 4), nibble)),
+              lookup(byte1LowTable, _mm256_and_si256(prev1, nibble))),
+          lookup(byte2HighTable,
+                 _mm256_and_si256(_mm256_srli_epi16(input, 4), nibble)));
+      __m256i must23 =
+          _mm256_or_si256(_mm256_subs_epu8(prev<2>(input, s.prevInput),
+                                           _mm256_set1_epi8(0xE0 - 0x80)),
+                          _mm256_subs_epu8(prev<3>(input, s.prevInput),
+                                           _mm256_set1_epi8(0xF0 - 0x80)));
+      __m256i must23x80 =
+          _mm256_and_si256(must23, _mm256_set1_epi8(char(0x80)));
+      s.error = _mm256_or_si256(s.error, _mm256_xor_si256(must23x80, sc));
+      s.prevIncomplete = _mm256_subs_epu8(
+          input,
+          _mm256_load_si256(reinterpret_cast<const __m256i*>(incompleteTable)));
+    }
+    s.prevInput = input;
+  }
+
+  __attribute__((target("avx2"))) static UTF8::Result
+  scanAVX2(const char* str, size_t size) {
+    const __m256i zero = _mm256_setzero_si256();
+    AVX2State s{zero, zero, zero, zero, zero};
+    size_t i = 0;
+    for (; i + 32 <= size; i += 32) {
+      blockAVX2(s,
+                _mm256_loadu_si256(reinterpret_cast<const __m256i*>(str + i)));
+    }
+    if (i < size) {
+      alignas(32) char tail[32];
+      std::memset(tail, ' ', sizeof(tail));
+      std::memcpy(tail, str + i, size - i);
+      blockAVX2(s, _mm256_load_si256(reinterpret_cast<const __m256i*>(tail)));
+    }
+    s.error = _mm256_or_si256(s.error, s.prevIncomplete);
+
+    return {_mm256_testz_si256(s.error, s.error) != 0 &&
+                _mm256_testz_si256(s.forbidden, s.forbidden) != 0,
+            _mm256_testz_si256(s.wildcard, s.wildcard) == 0};
+  }
+#endif
+
+  using ScanFunc = UTF8::Result (*)(const char*, size_t);
+
+  static UTF8::Implementation detect() {
+#if MQTT_UTF8_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+      return UTF8::Implementation::AVX2;
+    }
+    if (__builtin_cpu_supports("sse4.1")) {
+      return UTF8::Implementation::SSE4;
+    }
+#endif
+    return UTF8::Implementation::Scalar;
+  }
+
+  static ScanFunc scanFunc(UTF8::Implementation impl) {
+    switch (impl) {
+#if MQTT_UTF8_X86
+    case UTF8::Implementation::AVX2:
+      return scanAVX2;
+    case UTF8::Implementation::SSE4:
+      return scanSSE4;
+#endif
+    default:
+      return scanScalar;
+    }
+  }
+
+  UTF8::Result UTF8::scan(const char* data, size_t size) {
+    static const ScanFunc best = scanFunc(implementation());
+    // the vector setup does not pay off for the short strings
+    if (size < 16) {
+      return scanScalar(data, size);
+    }
+    return best(data, size);
+  }
+
+  bool UTF8::validate(const char* data, size_t size) {
+    return scan(data, size).valid;
+  }
+
+  UTF8::Result UTF8::scan(Implementation impl, const char* data,
+                          size_t size) {
+    return scanFunc(impl)(data, size);
+  }
+
+  bool UTF8::supported(Implementation impl) {
+    return impl <= implementation();
+  }
+
+  UTF8::Implementation UTF8::implementation() {
+    static const Implementation best = detect();
+    return best;
+  }
+} // namespace mqttutils
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace mqttutils {
+  // UTF8 validates MQTT UTF-8 encoded strings: well formed UTF-8 (no
+  // overlong forms, no surrogates, nothing above U+10FFFF) without U+0000.
+  // The same pass reports the topic wildcards '+' and '#'.
+  //
+  // The vector implementations check 16 (SSE4) or 32 (AVX2) bytes at a
+  // time with the lookup algorithm of Keiser and Lemire, "Validating UTF-8
+  // In Less Than One Instruction Per Byte". The best one the CPU supports is
+  // picked at startup, the scalar one is the fallback.
+  class UTF8 {
+  public:
+    enum class Implementation { Scalar, SSE4, AVX2 };
+
+    struct Result {
+      bool valid;
+      bool hasWildcard;
+    };
+
+    static Result scan(const char* data, size_t size);
+    static bool validate(const char* data, size_t size);
+
+    // scan with a given implementation, for tests and benchmarks. The
+    // implementation must be supported
+    static Result scan(Implementation impl, const char* data, size_t size);
+    static bool supported(Implementation impl);
+    static Implementation implementation();
+
+  private:
+    UTF8() {}
+  };
+} // namespace mqttutils
@@ -0,0 +1,90 @@
+#include "doctest/doctest.h"
+#include "utf8.h"
+
+#include <random>
+#include <string>
+#include <vector>
+
+static std::vector<mqttutils::UTF8::Implementation> implementations() {
+  std::vector<mqttutils::UTF8::Implementation> impls;
+  for (auto impl : {mqttutils::UTF8::Implementation::Scalar,
+                    mqttutils::UTF8::Implementation::SSE4,
+                    mqttutils::UTF8::Implementation::AVX2}) {
+    if (mqttutils::UTF8::supported(impl)) {
+      impls.push_back(impl);
+    }
+  }
+  return impls;
+}
+
+TEST_CASE("testing UTF-8 validation") {
+  const std::vector<std::string> valid{
+      "", "a/b", "caf\xC3\xA9", "\xE2\x82\xAC", "\xEF\xBF\xBF",
+      "\xF0\x90\x80\x80", "\xF4\x8F\xBF\xBF", "\xED\x9F\xBF"};
+  const std::vector<std::string> invalid{
+      std::string("\0", 1),    // U+0000
+      "\x80",                  // lone continuation
+      "\xC3",                  // truncated
+      "\xC3\x28",              // missing continuation
+      "\xC0\xAF",              // overlong
+      "\xE0\x80\xAF",          // overlong
+      "\xF0\x80\x80\xAF",      // overlong
+      "\xED\xA0\x80",          // surrogate
+      "\xF4\x90\x80\x80",      // above U+10FFFF
+      "\xF8\x88\x80\x80\x80",  // five bytes
+      "\xE2\x82\xAC\xAC",      // extra continuation
+      "\xFF"};
+
+  for (auto impl : implementations()) {
+    // the bad sequence at every position of the vector blocks
+    for (size_t prefix : {size_t(0), size_t(13), size_t(15), size_t(29),
+                          size_t(31), size_t(62), size_t(100)}) {
+      const std::string pad(prefix, 'x');
+      for (const auto& s : valid) {
+        std::string str = pad + s + pad;
+        auto r = mqttutils::UTF8::scan(impl, str.data(), str.size());
+        CHECK_MESSAGE(r.valid, "impl ", int(impl), " prefix ", prefix);
+        CHECK(!r.hasWildcard);
+      }
+      for (const auto& s : invalid) {
+        std::string str = pad + s + "tail";
+        CHECK_MESSAGE(!mqttutils::UTF8::scan(impl, str.data(), str.size()).valid,
+                      "impl ", int(impl), " prefix ", prefix);
+        // at the end of the input
+        str = pad + s;
+        CHECK_MESSAGE(!mqttutils::UTF8::scan(impl, str.data(), str.size()).valid,
+                      "impl ", int(impl), " prefix ", prefix);
+      }
+      std::string topic = pad + "/+/" + pad;
+      CHECK(mqttutils::UTF8::scan(impl, topic.data(), topic.size()).hasWildcard);
+      topic = pad + "#";
+      CHECK(mqttutils::UTF8::scan(impl, topic.data(), topic.size()).hasWildcard);
+    }
+  }
+}
+
+TEST_CASE("testing UTF-8 vector and scalar agree") {
+  std::mt19937 rng(7);
+  // mostly valid text with random bytes mixed in
+  const std::vector<std::string> pieces{
+      "a", "/", "+", "#", "\xC3\xA9", "\xE2\x82\xAC", "\xF0\x9F\x98\x80",
+      "\x80", "\xC3", "\xED\xA0\x80", std::string("\0", 1)};
+  for (int n = 0; n < 2000; ++n) {
+    std::string str;
+    size_t count = rng() % 40;
+    for (size_t i = 0; i < count; ++i) {
+      // the invalid pieces are rare
+      size_t k = rng() % 64;
+      str += k < 7 ? pieces[k] : (k < 60 ? pieces[0] : pieces[k % pieces.size()]);
+    }
+    auto expected = mqttutils::UTF8::scan(
+        mqttutils::UTF8::Implementation::Scalar, str.data(), str.size());
+    for (auto impl : implementations()) {
+      auto r = mqttutils::UTF8::scan(impl, str.data(), str.size());
+      CHECK(r.valid == expected.valid);
+      if (expected.valid) {
+        CHECK(r.hasWildcard == expected.hasWildcard);
+      }
+    }
+  }
+}
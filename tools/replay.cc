@@ -0,0 +1,86 @@
+// mqtt_replay feeds a capture written by RecordingStream through the packet
+// framing, the decoders and a TopicMatcher and reports the throughput and
+// the cost per packet type:
+//
+//   mqtt_replay capture.bin [--paced] [--repetitions=N]
+//
+// --paced feeds the frames at the times they were captured, the default is
+// as fast as possible. With repetitions the fastest run is reported.
+#include "lib/capture.h"
+#include "lib/packet/packet.h"
+#include "lib/replay.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+int main(int argc, char** argv) {
+  std::string path;
+  auto pace = mqttutils::CaptureReplay::Pace::Fast;
+  int repetitions = 1;
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    if (arg == "--paced") {
+      pace = mqttutils::CaptureReplay::Pace::Recorded;
+    } else if (arg.rfind("--repetitions=", 0) == 0) {
+      repetitions = std::max(1, atoi(arg.c_str() + strlen("--repetitions=")));
+    } else if (path.empty() && arg[0] != '-') {
+      path = arg;
+    } else {
+      path.clear();
+      break;
+    }
+  }
+  if (path.empty()) {
+    fprintf(stderr, "usage: %s <capture> [--paced] [--repetitions=N]\n",
+            argv[0]);
+    return 2;
+  }
+
+  mqttutils::Capture capture;
+  int err = capture.read(path);
+  if (err != 0) {
+    fprintf(stderr, "%s: %s\n", path.c_str(), strerror(err));
+    return 1;
+  }
+  size_t bytes = 0;
+  for (const auto& f : capture.frames) {
+    bytes += f.bytes.size();
+  }
+  printf("%zu frames, %zu bytes, captured over %.3f s\n",
+         capture.frames.size(), bytes,
+         capture.frames.empty() ? 0.0
+                                : double(capture.frames.back().time) / 1e9);
+
+  mqttutils::CaptureReplay replay(capture);
+  mqttutils::CaptureReplay::Stats best{};
+  for (int i = 0; i < repetitions; ++i) {
+    mqttutils::CaptureReplay::Stats stats = replay.run(pace);
+    if (i == 0 || stats.nanos < best.nanos) {
+      best = stats;
+    }
+  }
+
+  double seconds = double(best.nanos) / 1e9;
+  printf("%llu packets in %.3f ms: %.0f packets/s, %.1f MB/s, %llu matched, "
+         "%llu malformed\n",
+         static_cast<unsigned long long>(best.packets), seconds * 1e3,
+         seconds > 0 ? double(best.packets) / seconds : 0.0,
+         seconds > 0 ? double(best.bytes) / seconds / 1e6 : 0.0,
+         static_cast<unsigned long long>(best.matched),
+         static_cast<unsigned long long>(best.malformed));
+  printf("%-12s %10s %12s %12s\n", "type", "packets", "bytes", "ns/packet");
+  for (size_t i = 0; i < best.types.size(); ++i) {
+    const auto& t = best.types[i];
+    if (t.packets == 0) {
+      continue;
+    }
+    printf("%-12s %10llu %12llu %12.1f\n",
+           packet::ControlPacket::name(packet::ControlPacket::Type(i)),
+           static_cast<unsigned long long>(t.packets),
+           static_cast<unsigned long long>(t.bytes),
+           double(t.nanos) / double(t.packets));
+  }
+  return 0;
+}
@@ -0,0 +1,38 @@
+// mqtt_tracedump renders a dump of the trace rings as a timeline:
+//
+//   mqtt_tracedump trace.bin [thread]
+//
+// one line per event, ordered by time across the threads, optionally only
+// the events of one thread.
+#include "lib/tracering.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+int main(int argc, char** argv) {
+  if (argc < 2 || argc > 3) {
+    fprintf(stderr, "usage: %s <dump> [thread]\n", argv[0]);
+    return 2;
+  }
+
+  mqttutils::TraceDump dump;
+  int err = dump.read(argv[1]);
+  if (err != 0) {
+    fprintf(stderr, "%s: %s\n", argv[1], strerror(err));
+    return 1;
+  }
+  if (argc == 3) {
+    auto thread = static_cast<uint32_t>(strtoul(argv[2], nullptr, 10));
+    for (auto it = dump.threads.begin(); it != dump.threads.end();) {
+      it = it->thread == thread ? it + 1 : dump.threads.erase(it);
+    }
+  }
+
+  size_t events = 0;
+  for (const auto& t : dump.threads) {
+    events += t.records.size();
+  }
+  printf("%zu threads, %zu events\n", dump.threads.size(), events);
+  fputs(dump.timeline().c_str(), stdout);
+  return 0;
+}